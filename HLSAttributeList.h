@@ -0,0 +1,105 @@
+#pragma once
+#include <charconv>
+#include <string_view>
+#include "HLSStructuralIndex.h"
+
+using namespace std;
+
+// Parses the numeric portion of an attribute value. Like atol/atof, parsing stops at
+// the first character that is not part of the number and 0 is returned if there is none
+template <typename T>
+T ParseNumber(string_view val)
+{
+    T result = 0;
+    from_chars(val.data(), val.data() + val.length(), result);
+    return result;
+}
+
+// A single NAME=VALUE pair from an HLS attribute list. Both views point
+// directly into the tag text that was tokenized, so they are only valid
+// for as long as that text is alive. Quoted values have their quotes stripped
+struct HLSAttribute
+{
+    string_view name;
+    string_view value;
+    bool isQuoted = false;
+};
+
+// Walks an HLS attribute list (e.g. BANDWIDTH=1280000,CODECS="avc1.4d401f,mp4a.40.2")
+// one attribute at a time without allocating. Quoted values may contain commas,
+// so the end of a value is located by its closing quote rather than the next comma
+class HLSAttributeList
+{
+public:
+    explicit HLSAttributeList(string_view attributes) : m_attributes(attributes) {}
+
+    // Tokenizes using the structural positions of the list instead of searching it.
+    // The cursor's window must cover exactly the attribute list, or not be indexed
+    HLSAttributeList(string_view attributes, const HLSStructureCursor& structure) :
+        m_attributes(attributes), m_structure(structure) {}
+
+    // Reads the next attribute of the list. Returns false once the list is exhausted
+    bool Next(HLSAttribute& attribute)
+    {
+        if (m_pos >= m_attributes.length())
+        {
+            return false;
+        }
+
+        size_t nameEnd = Find('=', m_pos);
+
+        if (nameEnd == string_view::npos)
+        {
+            // A trailing attribute with no value. Hand back the name so that
+            // the caller can report it, and finish the list
+            attribute.name = m_attributes.substr(m_pos);
+            attribute.value = string_view();
+            attribute.isQuoted = false;
+            m_pos = m_attributes.length();
+            return true;
+        }
+
+        attribute.name = m_attributes.substr(m_pos, nameEnd - m_pos);
+
+        size_t valueStart = nameEnd + 1;
+        size_t valueEnd;
+
+        if (valueStart < m_attributes.length() && m_attributes[valueStart] == '\"')
+        {
+            // We are handling a string value, which runs until its closing quote
+            valueStart++;
+            valueEnd = Find('\"', valueStart);
+            attribute.isQuoted = true;
+
+            if (valueEnd == string_view::npos)
+            {
+                valueEnd = m_attributes.length();
+            }
+
+            attribute.value = m_attributes.substr(valueStart, valueEnd - valueStart);
+
+            // Skip over the closing quote before looking for the next separator
+            valueEnd = Find(',', valueEnd);
+        }
+        else
+        {
+            valueEnd = Find(',', valueStart);
+            attribute.isQuoted = false;
+            attribute.value = m_attributes.substr(valueStart, valueEnd == string_view::npos ?
+                string_view::npos : valueEnd - valueStart);
+        }
+
+        m_pos = valueEnd == string_view::npos ? m_attributes.length() : valueEnd + 1;
+        return true;
+    }
+
+private:
+    size_t Find(char c, size_t from)
+    {
+        return m_structure.IsIndexed() ? m_structure.Find(c, from) : m_attributes.find(c, from);
+    }
+
+    string_view m_attributes;
+    HLSStructureCursor m_structure;
+    size_t m_pos = 0;
+};
@@ -0,0 +1,120 @@
+#include "HLSBatchProcessor.h"
+#include "HLSPlaylistSource.h"
+#include <string>
+
+HLSBatchProcessor::HLSBatchProcessor(HLSThreadPool& pool, size_t maxInFlight) :
+    m_pool(pool),
+    m_maxInFlight(maxInFlight > 0 ? maxInFlight : pool.ThreadCount() * 4),
+    m_loader(&HLSBatchProcessor::LoadLocalFile)
+{
+}
+
+void HLSBatchProcessor::LoadLocalFile(const string& path, HLSMasterPlaylist& playlist)
+{
+    HLSPlaylistSource source = HLSPlaylistSource::MapFile(path);
+    playlist.ParseMasterPlaylist(source.View());
+}
+
+void HLSBatchProcessor::Process(Slot& slot, SortParameter sortParam, bool isAscending)
+{
+    string output;
+    bool isSuccess = false;
+
+    try
+    {
+        if (m_sharedLoader)
+        {
+            // Shared playlists are never sorted in place; the order is picked by the writer
+            HLSPlaylistCache::PlaylistPtr playlist = m_sharedLoader(slot.input);
+            HLSSerializer(output, m_format).Write(*playlist, sortParam, isAscending);
+        }
+        else
+        {
+            HLSMasterPlaylist playlist;
+            m_loader(slot.input, playlist);
+            playlist.Sort(sortParam, isAscending);
+
+            HLSSerializer(output, m_format).Write(playlist);
+        }
+
+        isSuccess = true;
+    }
+    catch (const exception& e)
+    {
+        output = e.what();
+    }
+
+    // Notify while still holding the lock. Once it is released, Run may return and
+    // destroy both the slot and this processor
+    lock_guard<mutex> lock(m_slotLock);
+    slot.output = move(output);
+    slot.isSuccess = isSuccess;
+    slot.isDone = true;
+    m_slotDone.notify_all();
+}
+
+size_t HLSBatchProcessor::Run(istream& inputList, SortParameter sortParam, bool isAscending, const ResultHandler& onResult)
+{
+    // Inputs are assigned to slots round robin. The input with index i always lives
+    // in slot i % m_maxInFlight, which is free again once input i - m_maxInFlight
+    // has been reported
+    vector<Slot> slots(m_maxInFlight);
+    size_t submitted = 0;
+    size_t reported = 0;
+    size_t failures = 0;
+    bool hasMoreInputs = true;
+    string input;
+
+    while (true)
+    {
+        // Top up the window of in-flight inputs
+        while (hasMoreInputs && submitted - reported < m_maxInFlight)
+        {
+            if (!getline(inputList, input))
+            {
+                hasMoreInputs = false;
+                break;
+            }
+
+            if (!input.empty() && input.back() == '\r')
+            {
+                input.pop_back();
+            }
+
+            if (input.empty())
+            {
+                continue;
+            }
+
+            Slot& slot = slots[submitted % m_maxInFlight];
+            slot.input = move(input);
+            slot.output.clear();
+            slot.isDone = false;
+
+            m_pool.Submit([this, &slot, sortParam, isAscending]{ Process(slot, sortParam, isAscending); });
+            submitted++;
+        }
+
+        if (reported == submitted)
+        {
+            break;
+        }
+
+        // Results are streamed out strictly in input order
+        Slot& slot = slots[reported % m_maxInFlight];
+        {
+            unique_lock<mutex> lock(m_slotLock);
+            m_slotDone.wait(lock, [&slot]{ return slot.isDone; });
+        }
+
+        if (!slot.isSuccess)
+        {
+            failures++;
+        }
+
+        onResult(reported, slot.input, slot.isSuccess, slot.output);
+        reported++;
+    }
+
+    return failures;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "HLSMasterPlaylist.h"
+#include "HLSPlaylistCache.h"
+#include "HLSSerializer.h"
+#include "HLSThreadPool.h"
+#include <istream>
+
+using namespace std;
+
+// Parses and sorts many playlists in parallel on a thread pool. Inputs are read
+// one per line from a list, and a result is produced for every input in the
+// order the inputs were listed. At most maxInFlight inputs are loaded, parsed
+// or waiting to be reported at any time, so memory stays bounded no matter how
+// long the list is
+class HLSBatchProcessor
+{
+public:
+    // Loads and parses a single input into a playlist. The default loader treats
+    // every input as a local file path. Loaders are called concurrently from the
+    // pool's workers and report failures by throwing
+    typedef function<void(const string& input, HLSMasterPlaylist& playlist)> PlaylistLoader;
+
+    // Receives each input's result, always on the thread that called Run and always
+    // in input order. On success output holds the sorted playlist, otherwise it holds
+    // the error message
+    typedef function<void(size_t index, const string& input, bool isSuccess, const string& output)> ResultHandler;
+
+    // A maxInFlight of 0 allows four inputs per worker thread
+    HLSBatchProcessor(HLSThreadPool& pool, size_t maxInFlight = 0);
+
+    // Returns an input's playlist already parsed, typically from an HLSPlaylistCache,
+    // so that inputs with the same content share one parse. Also called concurrently
+    typedef function<HLSPlaylistCache::PlaylistPtr(const string& input)> SharedPlaylistLoader;
+
+    void SetLoader(PlaylistLoader loader) { m_loader = move(loader); }
+
+    // Takes precedence over the loader when set
+    void SetSharedLoader(SharedPlaylistLoader loader) { m_sharedLoader = move(loader); }
+
+    // Format of the successful outputs, M3U8 by default
+    void SetOutputFormat(SerializeFormat format) { m_format = format; }
+
+    // Processes every non-empty line of inputList and returns the number of inputs
+    // that failed
+    size_t Run(istream& inputList, SortParameter sortParam, bool isAscending, const ResultHandler& onResult);
+
+    static void LoadLocalFile(const string& path, HLSMasterPlaylist& playlist);
+
+private:
+    struct Slot
+    {
+        string input;
+        string output;
+        bool isSuccess = false;
+        bool isDone = false;
+    };
+
+    void Process(Slot& slot, SortParameter sortParam, bool isAscending);
+
+    HLSThreadPool& m_pool;
+    size_t m_maxInFlight;
+    PlaylistLoader m_loader;
+    SharedPlaylistLoader m_sharedLoader;
+    SerializeFormat m_format = SerializeFormat::M3U8;
+
+    // Guards the isDone flags of the slots; the main thread waits on m_slotDone
+    // for the oldest outstanding input to finish
+    mutex m_slotLock;
+    condition_variable m_slotDone;
+};
@@ -0,0 +1,382 @@
+#include "HLSCodecs.h"
+#include <charconv>
+
+// Packs a sample entry code into an integer so that codec families can be
+// recognized with a switch instead of string comparisons
+constexpr uint32_t FourCC(const char (&code)[5])
+{
+    return (uint32_t(uint8_t(code[0])) << 24) | (uint32_t(uint8_t(code[1])) << 16) |
+        (uint32_t(uint8_t(code[2])) << 8) | uint32_t(uint8_t(code[3]));
+}
+
+static uint32_t FourCC(string_view code)
+{
+    if (code.length() != 4)
+    {
+        return 0;
+    }
+
+    return (uint32_t(uint8_t(code[0])) << 24) | (uint32_t(uint8_t(code[1])) << 16) |
+        (uint32_t(uint8_t(code[2])) << 8) | uint32_t(uint8_t(code[3]));
+}
+
+// Complexity of each codec family relative to the other families of the same kind,
+// indexed by CodecFamily
+constexpr uint8_t s_familyRank[] =
+{
+    0,  // UNKNOWN
+    1,  // AVC
+    3,  // HEVC
+    5,  // DOLBY_VISION
+    2,  // VP9
+    4,  // AV1
+    2,  // AAC
+    1,  // MP3
+    3,  // AC3
+    4,  // EC3
+    5,  // AC4
+    3,  // FLAC
+    2,  // OPUS
+};
+
+static_assert(sizeof(s_familyRank) == static_cast<size_t>(CodecFamily::OPUS) + 1,
+    "Every codec family needs a rank");
+
+// Splits the dot separated fields of a codec string one at a time
+class CodecFields
+{
+public:
+    explicit CodecFields(string_view codec) : m_rest(codec) {}
+
+    bool Next(string_view& field)
+    {
+        if (m_isDone)
+        {
+            return false;
+        }
+
+        size_t dot = m_rest.find('.');
+        field = m_rest.substr(0, dot);
+
+        if (dot == string_view::npos)
+        {
+            m_isDone = true;
+        }
+        else
+        {
+            m_rest.remove_prefix(dot + 1);
+        }
+
+        return true;
+    }
+
+private:
+    string_view m_rest;
+    bool m_isDone = false;
+};
+
+template <typename T>
+static T ParseField(string_view field, int base = 10)
+{
+    unsigned value = 0;
+    from_chars(field.data(), field.data() + field.length(), value, base);
+    return static_cast<T>(value);
+}
+
+static void ParseAvc(CodecFields& fields, CodecDescriptor& codec)
+{
+    string_view field;
+    if (!fields.Next(field))
+    {
+        return;
+    }
+
+    string_view level;
+    if (fields.Next(level))
+    {
+        // Legacy form with decimal fields, e.g. avc1.66.30
+        codec.profile = ParseField<uint8_t>(field);
+        codec.level = ParseField<uint16_t>(level);
+    }
+    else if (field.length() == 6)
+    {
+        // RFC 6381 form: profile_idc, constraint flags and level_idc as hex, e.g. avc1.640028
+        codec.profile = ParseField<uint8_t>(field.substr(0, 2), 16);
+        codec.level = ParseField<uint16_t>(field.substr(4, 2), 16);
+    }
+
+    // High 10, High 4:2:2 and High 4:4:4 allow more than 8 bits
+    bool isHighBitDepth = codec.profile == 110 || codec.profile == 122 || codec.profile == 244;
+    codec.bitDepth = isHighBitDepth ? 10 : 8;
+}
+
+static void ParseHevc(CodecFields& fields, CodecDescriptor& codec)
+{
+    // e.g. hvc1.2.4.L153.B0: [profile space]profile_idc, compatibility flags, tier and level
+    string_view profile, compatibility, tierLevel;
+
+    if (fields.Next(profile))
+    {
+        if (!profile.empty() && profile[0] >= 'A' && profile[0] <= 'C')
+        {
+            profile.remove_prefix(1);
+        }
+
+        codec.profile = ParseField<uint8_t>(profile);
+    }
+
+    if (fields.Next(compatibility) && fields.Next(tierLevel) && !tierLevel.empty())
+    {
+        codec.tier = tierLevel[0] == 'H' ? 1 : 0;
+        codec.level = ParseField<uint16_t>(tierLevel.substr(1));
+    }
+
+    // Main is 8 bit and Main 10 is 10 bit. Range extension profiles are not distinguished
+    codec.bitDepth = codec.profile == 1 ? 8 : codec.profile == 2 ? 10 : 0;
+}
+
+static void ParseDolbyVision(CodecFields& fields, CodecDescriptor& codec)
+{
+    // e.g. dvh1.05.06: profile and level
+    string_view field;
+
+    if (fields.Next(field))
+    {
+        codec.profile = ParseField<uint8_t>(field);
+    }
+
+    if (fields.Next(field))
+    {
+        codec.level = ParseField<uint16_t>(field);
+    }
+
+    // Profile 9 is carried in 8 bit AVC, everything else is 10 bit
+    codec.bitDepth = codec.profile == 9 ? 8 : 10;
+}
+
+static void ParseAv1(CodecFields& fields, CodecDescriptor& codec)
+{
+    // e.g. av01.0.08M.10: seq_profile, seq_level_idx with tier, bit depth
+    string_view field;
+
+    if (fields.Next(field))
+    {
+        codec.profile = ParseField<uint8_t>(field);
+    }
+
+    if (fields.Next(field) && !field.empty())
+    {
+        codec.tier = field.back() == 'H' ? 1 : 0;
+        codec.level = ParseField<uint16_t>(field.substr(0, field.length() - 1));
+    }
+
+    if (fields.Next(field))
+    {
+        codec.bitDepth = ParseField<uint8_t>(field);
+    }
+}
+
+static void ParseVp9(CodecFields& fields, CodecDescriptor& codec)
+{
+    // e.g. vp09.02.10.10: profile, level, bit depth
+    string_view field;
+
+    if (fields.Next(field))
+    {
+        codec.profile = ParseField<uint8_t>(field);
+    }
+
+    if (fields.Next(field))
+    {
+        codec.level = ParseField<uint16_t>(field);
+    }
+
+    if (fields.Next(field))
+    {
+        codec.bitDepth = ParseField<uint8_t>(field);
+    }
+}
+
+static void ParseMp4Audio(CodecFields& fields, CodecDescriptor& codec)
+{
+    // mp4a.<object type indication in hex>[.<audio object type>]
+    string_view field;
+    if (!fields.Next(field))
+    {
+        return;
+    }
+
+    switch (ParseField<uint8_t>(field, 16))
+    {
+        case 0x40:
+        case 0x66:
+        case 0x67:
+        case 0x68:
+        {
+            codec.family = CodecFamily::AAC;
+
+            string_view objectType;
+            if (fields.Next(objectType))
+            {
+                codec.profile = ParseField<uint8_t>(objectType);
+            }
+
+            // Audio object type 34 is MPEG-1 Layer 3
+            if (codec.profile == 34)
+            {
+                codec.family = CodecFamily::MP3;
+                codec.profile = 0;
+            }
+            break;
+        }
+        case 0x69:
+        case 0x6B:
+            codec.family = CodecFamily::MP3;
+            break;
+        case 0xA5:
+            codec.family = CodecFamily::AC3;
+            break;
+        case 0xA6:
+            codec.family = CodecFamily::EC3;
+            break;
+        default:
+            codec.family = CodecFamily::UNKNOWN;
+            break;
+    }
+}
+
+CodecDescriptor ParseCodec(string_view codecString)
+{
+    CodecDescriptor codec;
+    CodecFields fields(codecString);
+    string_view sampleEntry;
+
+    fields.Next(sampleEntry);
+
+    switch (FourCC(sampleEntry))
+    {
+        case FourCC("avc1"):
+        case FourCC("avc3"):
+            codec.family = CodecFamily::AVC;
+            ParseAvc(fields, codec);
+            break;
+
+        case FourCC("hvc1"):
+        case FourCC("hev1"):
+            codec.family = CodecFamily::HEVC;
+            ParseHevc(fields, codec);
+            break;
+
+        case FourCC("dvh1"):
+        case FourCC("dvhe"):
+        case FourCC("dvav"):
+        case FourCC("dva1"):
+            codec.family = CodecFamily::DOLBY_VISION;
+            ParseDolbyVision(fields, codec);
+            break;
+
+        case FourCC("av01"):
+            codec.family = CodecFamily::AV1;
+            ParseAv1(fields, codec);
+            break;
+
+        case FourCC("vp09"):
+            codec.family = CodecFamily::VP9;
+            ParseVp9(fields, codec);
+            break;
+
+        case FourCC("mp4a"):
+            ParseMp4Audio(fields, codec);
+            break;
+
+        case FourCC("ac-3"):
+            codec.family = CodecFamily::AC3;
+            break;
+
+        case FourCC("ec-3"):
+            codec.family = CodecFamily::EC3;
+            break;
+
+        case FourCC("ac-4"):
+            codec.family = CodecFamily::AC4;
+            break;
+
+        case FourCC("fLaC"):
+            codec.family = CodecFamily::FLAC;
+            break;
+
+        case FourCC("Opus"):
+            codec.family = CodecFamily::OPUS;
+            break;
+
+        default:
+            break;
+    }
+
+    // Family first, then profile, bit depth, tier and level
+    codec.complexity = (uint32_t(s_familyRank[static_cast<size_t>(codec.family)]) << 24) |
+        (uint32_t(codec.profile) << 16) |
+        (uint32_t(codec.bitDepth < 15 ? codec.bitDepth : 15) << 12) |
+        (uint32_t(codec.tier) << 11) |
+        uint32_t(codec.level < 2047 ? codec.level : 2047);
+
+    return codec;
+}
+
+CodecList ParseCodecs(string_view codecs)
+{
+    CodecList list;
+
+    while (!codecs.empty())
+    {
+        size_t comma = codecs.find(',');
+        string_view entry = codecs.substr(0, comma);
+        codecs = comma == string_view::npos ? string_view() : codecs.substr(comma + 1);
+
+        // Tolerate spaces after the separating commas
+        while (!entry.empty() && entry.front() == ' ')
+        {
+            entry.remove_prefix(1);
+        }
+
+        if (entry.empty())
+        {
+            continue;
+        }
+
+        CodecDescriptor codec = ParseCodec(entry);
+        list.codecCount++;
+
+        if (codec.IsVideo() && list.video.family == CodecFamily::UNKNOWN)
+        {
+            list.video = codec;
+        }
+        else if (codec.IsAudio() && list.audio.family == CodecFamily::UNKNOWN)
+        {
+            list.audio = codec;
+        }
+    }
+
+    return list;
+}
+
+const char* CodecFamilyToString(CodecFamily family)
+{
+    switch (family)
+    {
+        case CodecFamily::UNKNOWN: return "UNKNOWN";
+        case CodecFamily::AVC: return "AVC";
+        case CodecFamily::HEVC: return "HEVC";
+        case CodecFamily::DOLBY_VISION: return "DOLBY_VISION";
+        case CodecFamily::VP9: return "VP9";
+        case CodecFamily::AV1: return "AV1";
+        case CodecFamily::AAC: return "AAC";
+        case CodecFamily::MP3: return "MP3";
+        case CodecFamily::AC3: return "AC3";
+        case CodecFamily::EC3: return "EC3";
+        case CodecFamily::AC4: return "AC4";
+        case CodecFamily::FLAC: return "FLAC";
+        case CodecFamily::OPUS: return "OPUS";
+        default: return "UNKNOWN";
+    }
+}
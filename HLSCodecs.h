@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+// Codec families that can appear in a CODECS attribute, grouped by the sample
+// entry (RFC 6381 "fourcc") that introduces them
+enum class CodecFamily : uint8_t
+{
+    UNKNOWN = 0,
+
+    // Video
+    AVC,            // avc1, avc3
+    HEVC,           // hvc1, hev1
+    DOLBY_VISION,   // dvh1, dvhe, dvav, dva1
+    VP9,            // vp09
+    AV1,            // av01
+
+    // Audio
+    AAC,            // mp4a.40.x
+    MP3,            // mp4a.40.34, mp4a.6B
+    AC3,            // ac-3, mp4a.a5
+    EC3,            // ec-3, mp4a.a6
+    AC4,            // ac-4
+    FLAC,           // fLaC
+    OPUS,           // Opus
+};
+
+// One codec out of a CODECS attribute, broken into the parameters that matter
+// for ranking and filtering. Fields that a codec string does not carry are 0
+struct CodecDescriptor
+{
+    CodecFamily family = CodecFamily::UNKNOWN;
+
+    // Profile: profile_idc for AVC/HEVC, the Dolby Vision profile, the AV1 seq_profile,
+    // or the audio object type for AAC
+    uint8_t profile = 0;
+
+    // Level as written in the codec string: level_idc for AVC/HEVC (e.g. 31 for 3.1,
+    // 123 for HEVC 4.1), seq_level_idx for AV1, the Dolby Vision level
+    uint16_t level = 0;
+
+    // 1 for HEVC High tier or AV1 High tier
+    uint8_t tier = 0;
+    uint8_t bitDepth = 0;
+
+    // Relative decoding complexity. Higher ranks need more capable decoders: the
+    // codec family dominates, then profile, bit depth, tier and level
+    uint32_t complexity = 0;
+
+    bool IsVideo() const { return family >= CodecFamily::AVC && family <= CodecFamily::AV1; }
+    bool IsAudio() const { return family >= CodecFamily::AAC; }
+};
+
+// The parsed form of a whole CODECS attribute. Playlists pair at most one video
+// codec with one audio codec per variant, so those are kept directly; any further
+// codecs only count towards codecCount
+struct CodecList
+{
+    CodecDescriptor video;
+    CodecDescriptor audio;
+    uint8_t codecCount = 0;
+
+    bool HasFamily(CodecFamily family) const { return video.family == family || audio.family == family; }
+
+    // Orders variants by the video codec first and the audio codec second
+    uint64_t Complexity() const { return (uint64_t(video.complexity) << 32) | audio.complexity; }
+};
+
+// Parses a single codec string such as "avc1.640028" or "mp4a.40.2"
+CodecDescriptor ParseCodec(string_view codec);
+
+// Parses a full CODECS attribute value such as "hvc1.2.4.L153.B0,ec-3"
+CodecList ParseCodecs(string_view codecs);
+
+const char* CodecFamilyToString(CodecFamily family);
@@ -0,0 +1,165 @@
+#include "HLSDiagnostics.h"
+#include <algorithm>
+#include <cstring>
+
+void HLSDiagnostics::BeginParse()
+{
+    m_parse++;
+
+    for (atomic<uint32_t>& count : m_counts)
+    {
+        count.store(0, memory_order_relaxed);
+    }
+}
+
+void HLSDiagnostics::Report(HLSDiagnosticCode code, uint32_t line, string_view text)
+{
+    // Only the parser writes the counts, so they need no read-modify-write
+    atomic<uint32_t>& count = m_counts[static_cast<size_t>(code)];
+    count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+
+    uint64_t head = m_head.load(memory_order_relaxed);
+    if (head - m_tail.load(memory_order_acquire) >= Capacity)
+    {
+        m_droppedCount.store(m_droppedCount.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+
+    // The reader only looks at the ring after seeing an event published below
+    if (!m_events)
+    {
+        m_events = make_unique<HLSDiagnostic[]>(Capacity);
+    }
+
+    HLSDiagnostic& event = m_events[head % Capacity];
+    event.parse = m_parse;
+    event.line = line;
+    event.code = code;
+    event.textLength = static_cast<uint8_t>(min(text.length(), HLSDiagnostic::MaxTextLength));
+    memcpy(event.text, text.data(), event.textLength);
+
+    m_head.store(head + 1, memory_order_release);
+}
+
+void HLSDiagnostics::Merge(HLSDiagnostics& other, uint32_t lineOffset)
+{
+    uint32_t merged[static_cast<size_t>(HLSDiagnosticCode::COUNT)] = {};
+    HLSDiagnostic diagnostic;
+
+    while (other.Next(diagnostic))
+    {
+        Report(diagnostic.code, diagnostic.line + lineOffset, diagnostic.Text());
+        merged[static_cast<size_t>(diagnostic.code)]++;
+    }
+
+    // Events the other ring had no room for would have been dropped here as well
+    for (size_t i = 0; i < static_cast<size_t>(HLSDiagnosticCode::COUNT); i++)
+    {
+        uint32_t missing = other.m_counts[i].load(memory_order_relaxed) - merged[i];
+        m_counts[i].store(m_counts[i].load(memory_order_relaxed) + missing, memory_order_relaxed);
+        m_droppedCount.store(m_droppedCount.load(memory_order_relaxed) + missing, memory_order_relaxed);
+    }
+}
+
+bool HLSDiagnostics::Next(HLSDiagnostic& diagnostic)
+{
+    uint64_t tail = m_tail.load(memory_order_relaxed);
+    if (tail == m_head.load(memory_order_acquire))
+    {
+        return false;
+    }
+
+    diagnostic = m_events[tail % Capacity];
+
+    // Hands the slot back to the parser
+    m_tail.store(tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t HLSDiagnostics::TotalCount() const
+{
+    uint32_t total = 0;
+    for (const atomic<uint32_t>& count : m_counts)
+    {
+        total += count.load(memory_order_relaxed);
+    }
+
+    return total;
+}
+
+void* HLSCountingResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* memory = m_upstream->allocate(bytes, alignment);
+    m_allocationCount.fetch_add(1, memory_order_relaxed);
+    m_allocatedBytes.fetch_add(bytes, memory_order_relaxed);
+    m_heldBytes.fetch_add(bytes, memory_order_relaxed);
+    return memory;
+}
+
+void HLSCountingResource::do_deallocate(void* memory, size_t bytes, size_t alignment)
+{
+    m_upstream->deallocate(memory, bytes, alignment);
+    m_heldBytes.fetch_sub(bytes, memory_order_relaxed);
+}
+
+HLSParseMetrics::Counts HLSParseMetrics::Read() const
+{
+    Counts counts;
+    counts.parses = m_parses.load(memory_order_relaxed);
+    counts.bytes = m_bytes.load(memory_order_relaxed);
+    counts.lines = m_lines.load(memory_order_relaxed);
+
+    for (size_t i = 0; i < TagNameCount; i++)
+    {
+        counts.tags[i] = m_tags[i].load(memory_order_relaxed);
+    }
+
+    counts.diagnostics = m_diagnostics.load(memory_order_relaxed);
+    counts.allocations = m_allocations.load(memory_order_relaxed);
+    counts.allocatedBytes = m_allocatedBytes.load(memory_order_relaxed);
+    counts.parseNs = m_parseNs.load(memory_order_relaxed);
+    counts.sortNs = m_sortNs.load(memory_order_relaxed);
+    counts.serializeNs = m_serializeNs.load(memory_order_relaxed);
+    return counts;
+}
+
+void HLSParseMetrics::Reset()
+{
+    m_parses = 0;
+    m_bytes = 0;
+    m_lines = 0;
+
+    for (atomic<uint64_t>& tag : m_tags)
+    {
+        tag = 0;
+    }
+
+    m_diagnostics = 0;
+    m_allocations = 0;
+    m_allocatedBytes = 0;
+    m_parseNs = 0;
+    m_sortNs = 0;
+    m_serializeNs = 0;
+}
+
+void HLSParseMetrics::Add(const Counts& counts)
+{
+    m_parses.fetch_add(counts.parses, memory_order_relaxed);
+    m_bytes.fetch_add(counts.bytes, memory_order_relaxed);
+    m_lines.fetch_add(counts.lines, memory_order_relaxed);
+
+    for (size_t i = 0; i < TagNameCount; i++)
+    {
+        if (counts.tags[i])
+        {
+            m_tags[i].fetch_add(counts.tags[i], memory_order_relaxed);
+        }
+    }
+
+    m_diagnostics.fetch_add(counts.diagnostics, memory_order_relaxed);
+    m_allocations.fetch_add(counts.allocations, memory_order_relaxed);
+    m_allocatedBytes.fetch_add(counts.allocatedBytes, memory_order_relaxed);
+    m_parseNs.fetch_add(counts.parseNs, memory_order_relaxed);
+    m_sortNs.fetch_add(counts.sortNs, memory_order_relaxed);
+    m_serializeNs.fetch_add(counts.serializeNs, memory_order_relaxed);
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include "HLSKeywords.h"
+
+using namespace std;
+
+// Things a parser can notice about a playlist that do not stop it from being parsed
+enum class HLSDiagnosticCode : uint8_t
+{
+    UNKNOWN_TAG = 0,
+    UNKNOWN_MEDIA_ATTRIBUTE,
+    UNKNOWN_STREAM_ATTRIBUTE,
+    UNKNOWN_KEY_ATTRIBUTE,
+    UNKNOWN_MAP_ATTRIBUTE,
+    UNKNOWN_SKIP_ATTRIBUTE,
+    INVALID_DATE,
+    COUNT
+};
+
+constexpr const char* DiagnosticCodeToString(HLSDiagnosticCode code)
+{
+    switch (code)
+    {
+        case HLSDiagnosticCode::UNKNOWN_TAG: return "Encountered unknown tag";
+        case HLSDiagnosticCode::UNKNOWN_MEDIA_ATTRIBUTE: return "Encountered unknown media field";
+        case HLSDiagnosticCode::UNKNOWN_STREAM_ATTRIBUTE: return "Encountered unknown stream field";
+        case HLSDiagnosticCode::UNKNOWN_KEY_ATTRIBUTE: return "Encountered unknown key field";
+        case HLSDiagnosticCode::UNKNOWN_MAP_ATTRIBUTE: return "Encountered unknown map field";
+        case HLSDiagnosticCode::UNKNOWN_SKIP_ATTRIBUTE: return "Encountered unknown skip field";
+        case HLSDiagnosticCode::INVALID_DATE: return "Encountered invalid date";
+        default: return "Unknown diagnostic";
+    }
+}
+
+// One event, copied out of the playlist text so that it outlives the parse
+struct HLSDiagnostic
+{
+    static constexpr size_t MaxTextLength = 54;
+
+    // Counting from 1, both within the playlist's parses and within the parse
+    uint32_t parse = 0;
+    uint32_t line = 0;
+
+    HLSDiagnosticCode code = HLSDiagnosticCode::UNKNOWN_TAG;
+
+    // The tag, attribute name or value concerned, cut to MaxTextLength
+    uint8_t textLength = 0;
+    char text[MaxTextLength] = {};
+
+    string_view Text() const { return string_view(text, textLength); }
+};
+
+// Events reported by one playlist's parser, kept in a ring that the parser fills and
+// any one other thread may drain while it does, without either of them locking. When
+// the ring is full newer events are dropped, though they are still counted. The ring
+// is only allocated once there is something to report, so clean playlists pay for
+// nothing more than the counters
+class HLSDiagnostics
+{
+public:
+    static constexpr size_t Capacity = 256;
+
+    // Parser side. BeginParse starts a new parse's counts; events of earlier parses
+    // that have not been read stay in the ring
+    void BeginParse();
+    void Report(HLSDiagnosticCode code, uint32_t line, string_view text);
+
+    // Reports the events of another parser's only parse as though they had been
+    // reported here, lineOffset lines further on. Other is drained, so no one else
+    // may be reading it
+    void Merge(HLSDiagnostics& other, uint32_t lineOffset);
+
+    // Reader side. Takes the oldest unread event, returning false if there is none
+    bool Next(HLSDiagnostic& diagnostic);
+
+    // Counts for the current, or last, parse
+    uint32_t Count(HLSDiagnosticCode code) const { return m_counts[static_cast<size_t>(code)].load(memory_order_relaxed); }
+    uint32_t TotalCount() const;
+
+    // Events never queued because the ring was full, over every parse
+    uint64_t DroppedCount() const { return m_droppedCount.load(memory_order_relaxed); }
+
+private:
+    unique_ptr<HLSDiagnostic[]> m_events;
+    uint32_t m_parse = 0;
+
+    // Positions only ever grow. The parser owns m_head and the reader m_tail, each
+    // on its own cache line
+    alignas(64) atomic<uint64_t> m_head{ 0 };
+    alignas(64) atomic<uint64_t> m_tail{ 0 };
+
+    atomic<uint32_t> m_counts[static_cast<size_t>(HLSDiagnosticCode::COUNT)] = {};
+    atomic<uint64_t> m_droppedCount{ 0 };
+};
+
+// Passes allocations through to another resource, counting them, the bytes they
+// asked for in all, and the bytes still held. Counters are relaxed atomics, so the
+// resource may be shared across threads, but a count read while others allocate is
+// only a snapshot
+class HLSCountingResource : public pmr::memory_resource
+{
+public:
+    explicit HLSCountingResource(pmr::memory_resource* upstream = pmr::new_delete_resource()) : m_upstream(upstream) {}
+
+    uint64_t AllocationCount() const { return m_allocationCount.load(memory_order_relaxed); }
+    uint64_t AllocatedBytes() const { return m_allocatedBytes.load(memory_order_relaxed); }
+    size_t HeldBytes() const { return m_heldBytes.load(memory_order_relaxed); }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* memory, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    pmr::memory_resource* m_upstream;
+    atomic<uint64_t> m_allocationCount{ 0 };
+    atomic<uint64_t> m_allocatedBytes{ 0 };
+    atomic<size_t> m_heldBytes{ 0 };
+};
+
+constexpr size_t TagNameCount = static_cast<size_t>(HLSTagName::SKIP) + 1;
+
+// Counters and phase timings over any number of parses, for scraping. One can be
+// attached to many playlists, on any threads. A parser tallies a parse on its own
+// and adds it here once, when the parse ends; playlists with no metrics attached
+// neither count nor read the clock
+class HLSParseMetrics
+{
+public:
+    struct Counts
+    {
+        uint64_t parses = 0;
+        uint64_t bytes = 0;
+        uint64_t lines = 0;
+
+        // Indexed by HLSTagName. UNKNOWN counts tags that were not recognized
+        uint64_t tags[TagNameCount] = {};
+
+        uint64_t diagnostics = 0;
+
+        // Heap blocks taken by master playlists' own arenas. Playlists given a memory
+        // resource, and media playlists, do not count theirs
+        uint64_t allocations = 0;
+        uint64_t allocatedBytes = 0;
+
+        // Parsing, building sort orders, and serializing, in nanoseconds
+        uint64_t parseNs = 0;
+        uint64_t sortNs = 0;
+        uint64_t serializeNs = 0;
+    };
+
+    // A consistent view of each counter, though not of all of them together
+    Counts Read() const;
+    void Reset();
+
+    void Add(const Counts& counts);
+    void AddSortNs(uint64_t ns) { m_sortNs.fetch_add(ns, memory_order_relaxed); }
+    void AddSerializeNs(uint64_t ns) { m_serializeNs.fetch_add(ns, memory_order_relaxed); }
+
+    static uint64_t Now()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    atomic<uint64_t> m_parses{ 0 };
+    atomic<uint64_t> m_bytes{ 0 };
+    atomic<uint64_t> m_lines{ 0 };
+    atomic<uint64_t> m_tags[TagNameCount] = {};
+    atomic<uint64_t> m_diagnostics{ 0 };
+    atomic<uint64_t> m_allocations{ 0 };
+    atomic<uint64_t> m_allocatedBytes{ 0 };
+    atomic<uint64_t> m_parseNs{ 0 };
+    atomic<uint64_t> m_sortNs{ 0 };
+    atomic<uint64_t> m_serializeNs{ 0 };
+};
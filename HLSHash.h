@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+using namespace std;
+
+// 64-bit non-cryptographic hash of a byte range (the XXH64 algorithm). Inputs of 32
+// bytes or more are consumed in four independent lanes, so large playlists hash at
+// several bytes per cycle
+class HLSHash
+{
+public:
+    static uint64_t Bytes(const void* data, size_t length, uint64_t seed = 0)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + length;
+        uint64_t hash;
+
+        if (length >= 32)
+        {
+            uint64_t lanes[4] = { seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1 };
+
+            for (; p + 32 <= end; p += 32)
+            {
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    lanes[lane] = Round(lanes[lane], Read64(p + lane * 8));
+                }
+            }
+
+            hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+            for (uint64_t lane : lanes)
+            {
+                hash = (hash ^ Round(0, lane)) * Prime1 + Prime4;
+            }
+        }
+        else
+        {
+            hash = seed + Prime5;
+        }
+
+        hash += length;
+
+        for (; p + 8 <= end; p += 8)
+        {
+            hash = RotateLeft(hash ^ Round(0, Read64(p)), 27) * Prime1 + Prime4;
+        }
+
+        if (p + 4 <= end)
+        {
+            uint32_t value;
+            memcpy(&value, p, 4);
+            hash = RotateLeft(hash ^ (uint64_t(value) * Prime1), 23) * Prime2 + Prime3;
+            p += 4;
+        }
+
+        for (; p < end; p++)
+        {
+            hash = RotateLeft(hash ^ (*p * Prime5), 11) * Prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= Prime2;
+        hash ^= hash >> 29;
+        hash *= Prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    static uint64_t Text(string_view text, uint64_t seed = 0) { return Bytes(text.data(), text.length(), seed); }
+
+private:
+    static constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t Prime3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+    static uint64_t RotateLeft(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+    static uint64_t Read64(const unsigned char* p)
+    {
+        // Playlists are hashed as they lie in memory; the byte order only has to be
+        // consistent within one process
+        uint64_t value;
+        memcpy(&value, p, 8);
+        return value;
+    }
+
+    static uint64_t Round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * Prime2;
+        return RotateLeft(accumulator, 31) * Prime1;
+    }
+};
@@ -0,0 +1,1551 @@
+#include "HLSHttpClient.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+#endif
+
+static bool EqualsNoCase(string_view a, string_view b)
+{
+    return a.length() == b.length() && equal(a.begin(), a.end(), b.begin(),
+        [](char x, char y) { return tolower(static_cast<unsigned char>(x)) == tolower(static_cast<unsigned char>(y)); });
+}
+
+static bool StartsWithNoCase(string_view text, string_view prefix)
+{
+    return text.length() >= prefix.length() && EqualsNoCase(text.substr(0, prefix.length()), prefix);
+}
+
+static string_view Trim(string_view text)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+    {
+        text.remove_prefix(1);
+    }
+
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+    {
+        text.remove_suffix(1);
+    }
+
+    return text;
+}
+
+HttpUrl HttpUrl::Parse(string_view url)
+{
+    if (StartsWithNoCase(url, "https://"))
+    {
+        throw invalid_argument("HTTPS is not supported: " + string(url));
+    }
+
+    if (!StartsWithNoCase(url, "http://"))
+    {
+        throw invalid_argument("Not an http:// URL: " + string(url));
+    }
+
+    string_view rest = url.substr(7);
+    rest = rest.substr(0, rest.find('#'));
+
+    size_t authorityEnd = min(rest.find('/'), rest.find('?'));
+    string_view authority = rest.substr(0, authorityEnd);
+
+    // Credentials are not supported, but should not be mistaken for the host
+    size_t at = authority.rfind('@');
+    if (at != string_view::npos)
+    {
+        authority.remove_prefix(at + 1);
+    }
+
+    HttpUrl result;
+    size_t portStart = string_view::npos;
+
+    if (!authority.empty() && authority.front() == '[')
+    {
+        // IPv6 literal
+        size_t close = authority.find(']');
+        if (close == string_view::npos)
+        {
+            throw invalid_argument("Invalid host in URL: " + string(url));
+        }
+
+        result.host = authority.substr(1, close - 1);
+        if (close + 1 < authority.length() && authority[close + 1] == ':')
+        {
+            portStart = close + 2;
+        }
+    }
+    else
+    {
+        size_t colon = authority.find(':');
+        result.host = authority.substr(0, colon);
+        if (colon != string_view::npos)
+        {
+            portStart = colon + 1;
+        }
+    }
+
+    if (portStart != string_view::npos && portStart < authority.length())
+    {
+        string_view port = authority.substr(portStart);
+        unsigned portNumber = 0;
+        auto parsed = from_chars(port.data(), port.data() + port.length(), portNumber);
+        if (parsed.ec != errc() || parsed.ptr != port.data() + port.length() || portNumber == 0 || portNumber > 65535)
+        {
+            throw invalid_argument("Invalid port in URL: " + string(url));
+        }
+
+        result.port = port;
+    }
+
+    if (result.host.empty())
+    {
+        throw invalid_argument("Missing host in URL: " + string(url));
+    }
+
+    if (authorityEnd != string_view::npos)
+    {
+        string_view target = rest.substr(authorityEnd);
+        result.target = target.front() == '?' ? "/" + string(target) : string(target);
+    }
+
+    return result;
+}
+
+HttpUrl HttpUrl::Resolve(string_view location) const
+{
+    location = Trim(location);
+
+    if (StartsWithNoCase(location, "http://") || StartsWithNoCase(location, "https://"))
+    {
+        return Parse(location);
+    }
+
+    if (location.substr(0, 2) == "//")
+    {
+        return Parse("http:" + string(location));
+    }
+
+    HttpUrl result = *this;
+    location = location.substr(0, location.find('#'));
+
+    if (!location.empty() && location.front() == '/')
+    {
+        result.target = location;
+    }
+    else if (!location.empty() && location.front() == '?')
+    {
+        result.target = target.substr(0, target.find('?')) + string(location);
+    }
+    else
+    {
+        // Relative to the directory of the current path
+        string path = target.substr(0, target.find('?'));
+        result.target = path.substr(0, path.rfind('/') + 1) + string(location);
+    }
+
+    return result;
+}
+
+string HttpUrl::ToString() const
+{
+    string url = "http://";
+    url += host.find(':') != string::npos ? "[" + host + "]" : host;
+
+    if (port != "80")
+    {
+        url += ':';
+        url += port;
+    }
+
+    url += target;
+    return url;
+}
+
+string_view HttpResult::Header(string_view name) const
+{
+    for (const auto& header : headers)
+    {
+        if (EqualsNoCase(header.first, name))
+        {
+            return header.second;
+        }
+    }
+
+    return string_view();
+}
+
+#ifndef _WIN32
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Incremental reader for a single HTTP/1.1 response. Body bytes are handed on as
+// soon as they arrive, straight out of the receive buffer, so only the headers and
+// chunk size lines are ever copied. Malformed responses throw runtime_error
+class HttpResponseReader
+{
+public:
+    void Reset()
+    {
+        *this = HttpResponseReader();
+    }
+
+    // Consumes received bytes, passing body bytes to onBody. Returns the number of
+    // bytes used, which is less than length only once the response is complete
+    template <typename BodyHandler>
+    size_t Consume(const char* data, size_t length, BodyHandler& onBody);
+
+    // The server closed the connection. Returns true if that ends the response
+    bool OnClose()
+    {
+        if (m_state == State::UNTIL_CLOSE)
+        {
+            m_state = State::DONE;
+        }
+
+        return m_state == State::DONE;
+    }
+
+    bool IsDone() const { return m_state == State::DONE; }
+    int Status() const { return m_status; }
+    bool IsKeepAlive() const { return m_isKeepAlive; }
+    const string& Location() const { return m_location; }
+    HttpHeaders& Headers() { return m_headers; }
+
+private:
+    enum class State
+    {
+        HEADERS,
+        BODY,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        TRAILERS,
+        UNTIL_CLOSE,
+        DONE
+    };
+
+    void ParseHeaders(string_view headers);
+
+    // Gathers a line that may be split across reads. Returns false until the line
+    // is complete, and then leaves it (without its terminator) in m_line
+    bool ReadLine(const char* data, size_t length, size_t& pos);
+
+    State m_state = State::HEADERS;
+    int m_status = 0;
+    bool m_isKeepAlive = true;
+    string m_location;
+    HttpHeaders m_headers;
+    string m_header;
+    string m_line;
+    bool m_isLineComplete = false;
+    size_t m_remaining = 0;
+};
+
+bool HttpResponseReader::ReadLine(const char* data, size_t length, size_t& pos)
+{
+    if (m_isLineComplete)
+    {
+        m_line.clear();
+        m_isLineComplete = false;
+    }
+
+    const char* end = static_cast<const char*>(memchr(data + pos, '\n', length - pos));
+    if (!end)
+    {
+        m_line.append(data + pos, length - pos);
+        pos = length;
+
+        if (m_line.length() > 4096)
+        {
+            throw runtime_error("Malformed chunked response");
+        }
+
+        return false;
+    }
+
+    m_line.append(data + pos, end - (data + pos));
+    pos = end - data + 1;
+
+    if (!m_line.empty() && m_line.back() == '\r')
+    {
+        m_line.pop_back();
+    }
+
+    m_isLineComplete = true;
+    return true;
+}
+
+void HttpResponseReader::ParseHeaders(string_view headers)
+{
+    size_t lineEnd = headers.find('\n');
+    string_view statusLine = Trim(headers.substr(0, lineEnd));
+
+    // HTTP/1.x SSS Reason
+    if (!StartsWithNoCase(statusLine, "HTTP/1.") || statusLine.length() < 12 || statusLine[8] != ' ')
+    {
+        throw runtime_error("Malformed HTTP response");
+    }
+
+    auto parsed = from_chars(statusLine.data() + 9, statusLine.data() + 12, m_status);
+    if (parsed.ec != errc() || parsed.ptr != statusLine.data() + 12)
+    {
+        throw runtime_error("Malformed HTTP response");
+    }
+
+    // HTTP/1.0 servers close the connection unless they say otherwise
+    m_isKeepAlive = statusLine[7] != '0';
+    bool isChunked = false;
+    bool hasLength = false;
+    m_location.clear();
+    m_headers.clear();
+
+    while (lineEnd != string_view::npos)
+    {
+        size_t lineStart = lineEnd + 1;
+        lineEnd = headers.find('\n', lineStart);
+        string_view line = headers.substr(lineStart, lineEnd == string_view::npos ? string_view::npos : lineEnd - lineStart);
+
+        size_t colon = line.find(':');
+        if (colon == string_view::npos)
+        {
+            continue;
+        }
+
+        string_view name = Trim(line.substr(0, colon));
+        string_view value = Trim(line.substr(colon + 1));
+        m_headers.emplace_back(name, value);
+
+        if (EqualsNoCase(name, "Content-Length"))
+        {
+            auto result = from_chars(value.data(), value.data() + value.length(), m_remaining);
+            if (result.ec != errc())
+            {
+                throw runtime_error("Malformed Content-Length");
+            }
+
+            hasLength = true;
+        }
+        else if (EqualsNoCase(name, "Transfer-Encoding"))
+        {
+            // Chunked is always the last coding applied
+            isChunked = value.length() >= 7 && EqualsNoCase(value.substr(value.length() - 7), "chunked");
+        }
+        else if (EqualsNoCase(name, "Connection"))
+        {
+            if (EqualsNoCase(value, "close"))
+            {
+                m_isKeepAlive = false;
+            }
+            else if (EqualsNoCase(value, "keep-alive"))
+            {
+                m_isKeepAlive = true;
+            }
+        }
+        else if (EqualsNoCase(name, "Location"))
+        {
+            m_location = value;
+        }
+    }
+
+    if (m_status == 204 || m_status == 304)
+    {
+        m_state = State::DONE;
+    }
+    else if (isChunked)
+    {
+        m_state = State::CHUNK_SIZE;
+    }
+    else if (hasLength)
+    {
+        m_state = m_remaining > 0 ? State::BODY : State::DONE;
+    }
+    else
+    {
+        m_state = State::UNTIL_CLOSE;
+        m_isKeepAlive = false;
+    }
+}
+
+template <typename BodyHandler>
+size_t HttpResponseReader::Consume(const char* data, size_t length, BodyHandler& onBody)
+{
+    size_t pos = 0;
+
+    while (pos < length && m_state != State::DONE)
+    {
+        switch (m_state)
+        {
+            case State::HEADERS:
+            {
+                // The end of the headers may be split across reads, so look back a little
+                size_t searchFrom = m_header.length() > 3 ? m_header.length() - 3 : 0;
+                m_header.append(data + pos, length - pos);
+
+                size_t headerEnd = m_header.find("\r\n\r\n", searchFrom);
+                size_t terminatorLength = 4;
+                if (headerEnd == string::npos)
+                {
+                    headerEnd = m_header.find("\n\n", searchFrom);
+                    terminatorLength = 2;
+                }
+
+                if (headerEnd == string::npos)
+                {
+                    if (m_header.length() > 64 * 1024)
+                    {
+                        throw runtime_error("HTTP response headers too large");
+                    }
+
+                    pos = length;
+                    break;
+                }
+
+                // Hand back whatever followed the headers in this read
+                size_t used = headerEnd + terminatorLength - (m_header.length() - (length - pos));
+                pos += used;
+
+                ParseHeaders(string_view(m_header).substr(0, headerEnd));
+                m_header.clear();
+
+                // Interim responses are followed by the real one
+                if (m_status >= 100 && m_status < 200)
+                {
+                    m_state = State::HEADERS;
+                }
+
+                break;
+            }
+            case State::BODY:
+            {
+                size_t count = min(m_remaining, length - pos);
+                onBody(data + pos, count);
+                pos += count;
+                m_remaining -= count;
+
+                if (m_remaining == 0)
+                {
+                    m_state = State::DONE;
+                }
+
+                break;
+            }
+            case State::UNTIL_CLOSE:
+            {
+                onBody(data + pos, length - pos);
+                pos = length;
+                break;
+            }
+            case State::CHUNK_SIZE:
+            {
+                if (!ReadLine(data, length, pos))
+                {
+                    break;
+                }
+
+                // Chunk extensions after ';' are ignored
+                string_view line = Trim(string_view(m_line).substr(0, m_line.find(';')));
+                auto result = from_chars(line.data(), line.data() + line.length(), m_remaining, 16);
+                if (line.empty() || result.ec != errc() || result.ptr != line.data() + line.length())
+                {
+                    throw runtime_error("Malformed chunked response");
+                }
+
+                m_state = m_remaining > 0 ? State::CHUNK_DATA : State::TRAILERS;
+                break;
+            }
+            case State::CHUNK_DATA:
+            {
+                size_t count = min(m_remaining, length - pos);
+                onBody(data + pos, count);
+                pos += count;
+                m_remaining -= count;
+
+                if (m_remaining == 0)
+                {
+                    m_state = State::CHUNK_END;
+                }
+
+                break;
+            }
+            case State::CHUNK_END:
+            {
+                if (!ReadLine(data, length, pos))
+                {
+                    break;
+                }
+
+                if (!m_line.empty())
+                {
+                    throw runtime_error("Malformed chunked response");
+                }
+
+                m_state = State::CHUNK_SIZE;
+                break;
+            }
+            case State::TRAILERS:
+            {
+                // Trailer fields are skipped up to the empty line that ends the response
+                if (ReadLine(data, length, pos) && m_line.empty())
+                {
+                    m_state = State::DONE;
+                }
+
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    return pos;
+}
+
+struct HLSHttpClient::HostAddresses
+{
+    struct Address
+    {
+        sockaddr_storage address;
+        socklen_t length;
+    };
+
+    vector<Address> addresses;
+};
+
+struct HLSHttpClient::Request
+{
+    HttpUrl url;
+    HttpHeaders headers;
+    string hostKey;
+    shared_ptr<const HostAddresses> addresses;
+    BodyHandler onBody;
+    CompletionHandler onComplete;
+    chrono::steady_clock::time_point deadline;
+    size_t redirects = 0;
+    HttpResult result;
+};
+
+struct HLSHttpClient::HostPool
+{
+    vector<Connection*> idle;
+    size_t openCount = 0;
+};
+
+struct HLSHttpClient::Connection
+{
+    enum class State
+    {
+        CONNECTING,
+        SENDING,
+        RECEIVING,
+        IDLE,
+        CLOSED
+    };
+
+    int fd = -1;
+    State state = State::CONNECTING;
+    HostPool* pool = nullptr;
+    shared_ptr<const HostAddresses> addresses;
+    size_t addressIndex = 0;
+
+    unique_ptr<Request> request;
+    string sendBuffer;
+    size_t sent = 0;
+    size_t received = 0;
+    bool isReused = false;
+    HttpResponseReader response;
+
+    chrono::steady_clock::time_point connectDeadline;
+    chrono::steady_clock::time_point idleSince;
+};
+
+// Readiness notification over a handful of sockets: epoll where it exists, poll
+// everywhere else. Each descriptor carries a tag that is handed back with its events
+class HLSHttpClient::Poller
+{
+public:
+    struct Event
+    {
+        void* tag;
+        bool isReadable;
+        bool isWritable;
+    };
+
+#ifdef __linux__
+    Poller()
+    {
+        m_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_fd < 0)
+        {
+            throw system_error(errno, generic_category(), "Unable to create epoll instance");
+        }
+    }
+
+    ~Poller() { close(m_fd); }
+
+    void Add(int fd, void* tag, bool isWrite) { Control(EPOLL_CTL_ADD, fd, tag, isWrite); }
+    void Modify(int fd, void* tag, bool isWrite) { Control(EPOLL_CTL_MOD, fd, tag, isWrite); }
+    void Remove(int fd) { epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, nullptr); }
+
+    void Wait(int timeoutMs, vector<Event>& events)
+    {
+        epoll_event ready[64];
+        int count = epoll_wait(m_fd, ready, 64, timeoutMs);
+
+        events.clear();
+        for (int i = 0; i < count; i++)
+        {
+            // Errors and hang-ups are reported as readiness; the next read or write sees them
+            bool isFailed = (ready[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+            events.push_back({ ready[i].data.ptr, isFailed || (ready[i].events & EPOLLIN) != 0,
+                isFailed || (ready[i].events & EPOLLOUT) != 0 });
+        }
+    }
+
+private:
+    void Control(int operation, int fd, void* tag, bool isWrite)
+    {
+        epoll_event event = {};
+        event.events = isWrite ? EPOLLOUT : EPOLLIN;
+        event.data.ptr = tag;
+
+        if (epoll_ctl(m_fd, operation, fd, &event) != 0)
+        {
+            throw system_error(errno, generic_category(), "Unable to watch socket");
+        }
+    }
+
+    int m_fd;
+#else
+    void Add(int fd, void* tag, bool isWrite)
+    {
+        m_fds.push_back({ fd, static_cast<short>(isWrite ? POLLOUT : POLLIN), 0 });
+        m_tags.push_back(tag);
+    }
+
+    void Modify(int fd, void* tag, bool isWrite)
+    {
+        for (size_t i = 0; i < m_fds.size(); i++)
+        {
+            if (m_fds[i].fd == fd)
+            {
+                m_fds[i].events = isWrite ? POLLOUT : POLLIN;
+                m_tags[i] = tag;
+            }
+        }
+    }
+
+    void Remove(int fd)
+    {
+        for (size_t i = 0; i < m_fds.size(); i++)
+        {
+            if (m_fds[i].fd == fd)
+            {
+                m_fds.erase(m_fds.begin() + i);
+                m_tags.erase(m_tags.begin() + i);
+                return;
+            }
+        }
+    }
+
+    void Wait(int timeoutMs, vector<Event>& events)
+    {
+        int count = poll(m_fds.data(), m_fds.size(), timeoutMs);
+
+        events.clear();
+        for (size_t i = 0; count > 0 && i < m_fds.size(); i++)
+        {
+            short ready = m_fds[i].revents;
+            if (ready != 0)
+            {
+                bool isFailed = (ready & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+                events.push_back({ m_tags[i], isFailed || (ready & POLLIN) != 0, isFailed || (ready & POLLOUT) != 0 });
+            }
+        }
+    }
+
+private:
+    vector<pollfd> m_fds;
+    vector<void*> m_tags;
+#endif
+};
+
+static void SetNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) != 0)
+    {
+        throw system_error(errno, generic_category(), "Unable to configure socket");
+    }
+}
+
+HLSHttpClient::HLSHttpClient(const Options& options) :
+    m_options(options),
+    m_poller(make_unique<Poller>()),
+    m_readBuffer(64 * 1024)
+{
+    if (m_options.maxInFlight == 0)
+    {
+        m_options.maxInFlight = 1;
+    }
+
+    if (m_options.maxConnectionsPerHost == 0)
+    {
+        m_options.maxConnectionsPerHost = 1;
+    }
+
+    // Fetch wakes the event loop through a pipe
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        throw system_error(errno, generic_category(), "Unable to create pipe");
+    }
+
+    m_wakeRead = fds[0];
+    m_wakeWrite = fds[1];
+    SetNonBlocking(m_wakeRead);
+    SetNonBlocking(m_wakeWrite);
+    m_poller->Add(m_wakeRead, nullptr, false);
+
+    m_thread = thread(&HLSHttpClient::Run, this);
+    m_resolver = thread(&HLSHttpClient::ResolveLoop, this);
+}
+
+HLSHttpClient::~HLSHttpClient()
+{
+    // Stop the resolver first. Requests still waiting for a lookup go back to the event
+    // loop, which fails them along with everything else
+    {
+        lock_guard<mutex> lock(m_resolveLock);
+        m_isResolverStopping = true;
+    }
+
+    m_resolveWake.notify_all();
+    m_resolver.join();
+
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_isStopping = true;
+
+        while (!m_toResolve.empty())
+        {
+            m_toResolve.front()->result.error = "HTTP client shut down";
+            m_newRequests.push_back(move(m_toResolve.front()));
+            m_toResolve.pop_front();
+        }
+    }
+
+    Wake();
+    m_thread.join();
+
+    close(m_wakeRead);
+    close(m_wakeWrite);
+}
+
+void HLSHttpClient::Wake()
+{
+    // A full pipe already has a wake-up pending
+    char signal = 1;
+    ssize_t result = write(m_wakeWrite, &signal, 1);
+    (void)result;
+}
+
+shared_ptr<const HLSHttpClient::HostAddresses> HLSHttpClient::FindResolvedHost(const HttpUrl& url)
+{
+    lock_guard<mutex> lock(m_lock);
+    auto found = m_resolved.find(url.host + ":" + url.port);
+    return found != m_resolved.end() ? found->second : nullptr;
+}
+
+shared_ptr<const HLSHttpClient::HostAddresses> HLSHttpClient::ResolveHost(const HttpUrl& url)
+{
+    if (shared_ptr<const HostAddresses> found = FindResolvedHost(url))
+    {
+        return found;
+    }
+
+    string key = url.host + ":" + url.port;
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* results = nullptr;
+    int error = getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &results);
+    if (error != 0)
+    {
+        throw runtime_error("Unable to resolve " + url.host + ": " + gai_strerror(error));
+    }
+
+    auto addresses = make_shared<HostAddresses>();
+    for (addrinfo* result = results; result; result = result->ai_next)
+    {
+        HostAddresses::Address address = {};
+        memcpy(&address.address, result->ai_addr, result->ai_addrlen);
+        address.length = result->ai_addrlen;
+        addresses->addresses.push_back(address);
+    }
+
+    freeaddrinfo(results);
+
+    lock_guard<mutex> lock(m_lock);
+    return m_resolved.emplace(key, move(addresses)).first->second;
+}
+
+void HLSHttpClient::ResolveLoop()
+{
+    while (true)
+    {
+        unique_ptr<Request> request;
+        {
+            unique_lock<mutex> lock(m_resolveLock);
+            m_resolveWake.wait(lock, [this]() { return m_isResolverStopping || !m_toResolve.empty(); });
+
+            if (m_isResolverStopping)
+            {
+                return;
+            }
+
+            request = move(m_toResolve.front());
+            m_toResolve.pop_front();
+        }
+
+        // A request that comes back without addresses is finished with the error
+        try
+        {
+            request->addresses = ResolveHost(request->url);
+        }
+        catch (const exception& e)
+        {
+            request->result.error = e.what();
+        }
+
+        {
+            lock_guard<mutex> lock(m_lock);
+            m_newRequests.push_back(move(request));
+        }
+
+        Wake();
+    }
+}
+
+void HLSHttpClient::Fetch(const string& url, BodyHandler onBody, CompletionHandler onComplete)
+{
+    Fetch(url, HttpHeaders(), move(onBody), move(onComplete));
+}
+
+void HLSHttpClient::Fetch(const string& url, const HttpHeaders& headers, BodyHandler onBody, CompletionHandler onComplete)
+{
+    for (const auto& header : headers)
+    {
+        if (header.first.find_first_of("\r\n:") != string::npos || header.second.find_first_of("\r\n") != string::npos)
+        {
+            throw invalid_argument("Invalid HTTP header: " + header.first);
+        }
+    }
+
+    auto request = make_unique<Request>();
+    request->url = HttpUrl::Parse(url);
+    request->headers = headers;
+    request->hostKey = request->url.host + ":" + request->url.port;
+    request->addresses = ResolveHost(request->url);
+    request->onBody = move(onBody);
+    request->onComplete = move(onComplete);
+    request->deadline = chrono::steady_clock::now() + m_options.requestTimeout;
+
+    {
+        lock_guard<mutex> lock(m_lock);
+        if (m_isStopping)
+        {
+            throw runtime_error("HTTP client is shutting down");
+        }
+
+        m_newRequests.push_back(move(request));
+        m_stats.requests++;
+    }
+
+    Wake();
+}
+
+void HLSHttpClient::FetchPlaylist(const string& url, HLSMasterPlaylist& playlist)
+{
+    // The body is parsed on the client's thread while this one waits, so the
+    // playlist is never touched by both at once
+    promise<HttpResult> done;
+    Fetch(url,
+        [&playlist](const char* data, size_t length) { playlist.Feed(data, length); },
+        [&done](const HttpResult& result) { done.set_value(result); });
+
+    HttpResult result = done.get_future().get();
+    if (!result.isSuccess)
+    {
+        throw runtime_error("Unable to fetch " + url + ": " + result.error);
+    }
+
+    playlist.Finish();
+}
+
+HttpClientStats HLSHttpClient::GetStats() const
+{
+    lock_guard<mutex> lock(m_lock);
+    return m_stats;
+}
+
+void HLSHttpClient::Run()
+{
+    vector<Poller::Event> events;
+
+    while (true)
+    {
+        {
+            lock_guard<mutex> lock(m_lock);
+            if (m_isStopping)
+            {
+                break;
+            }
+        }
+
+        TakeNewRequests();
+        Dispatch();
+        m_poller->Wait(NextTimeoutMs(), events);
+
+        for (const Poller::Event& event : events)
+        {
+            if (!event.tag)
+            {
+                char drain[64];
+                while (read(m_wakeRead, drain, sizeof(drain)) > 0)
+                {
+                }
+
+                continue;
+            }
+
+            // A connection closed by an earlier event in this batch stays allocated,
+            // and marked closed, until the sweep below
+            Connection& connection = *static_cast<Connection*>(event.tag);
+
+            if (event.isWritable && (connection.state == Connection::State::CONNECTING ||
+                connection.state == Connection::State::SENDING))
+            {
+                OnWritable(connection);
+            }
+
+            if (event.isReadable && (connection.state == Connection::State::RECEIVING ||
+                connection.state == Connection::State::IDLE))
+            {
+                OnReadable(connection);
+            }
+        }
+
+        ExpireTimeouts();
+
+        m_connections.erase(remove_if(m_connections.begin(), m_connections.end(),
+            [](const unique_ptr<Connection>& connection) { return connection->state == Connection::State::CLOSED; }),
+            m_connections.end());
+    }
+
+    // Fail whatever is left, in the order it was started
+    TakeNewRequests();
+
+    for (auto& connection : m_connections)
+    {
+        if (connection->request)
+        {
+            FailRequest(*connection, "HTTP client shut down", false);
+        }
+        else
+        {
+            CloseConnection(*connection);
+        }
+    }
+
+    while (!m_queue.empty())
+    {
+        unique_ptr<Request> request = move(m_queue.front());
+        m_queue.pop_front();
+        request->result.error = "HTTP client shut down";
+        Finish(move(request));
+    }
+
+    m_connections.clear();
+}
+
+void HLSHttpClient::TakeNewRequests()
+{
+    deque<unique_ptr<Request>> unresolved;
+
+    {
+        lock_guard<mutex> lock(m_lock);
+        while (!m_newRequests.empty())
+        {
+            unique_ptr<Request>& request = m_newRequests.front();
+            (request->addresses ? m_queue : unresolved).push_back(move(request));
+            m_newRequests.pop_front();
+        }
+    }
+
+    // Redirects whose new host could not be resolved. Finished outside the lock, as
+    // completion handlers may start new requests
+    for (unique_ptr<Request>& request : unresolved)
+    {
+        Finish(move(request));
+    }
+}
+
+void HLSHttpClient::Dispatch()
+{
+    // Requests start in order, except that one waiting for a busy host does not hold
+    // up requests to other hosts. Starting a request can put one back on the queue,
+    // when a pooled connection turns out to be stale, so go round until nothing starts
+    bool isStarted = true;
+    while (isStarted && !m_queue.empty())
+    {
+        isStarted = false;
+        deque<unique_ptr<Request>> waiting;
+        waiting.swap(m_queue);
+
+        while (!waiting.empty())
+        {
+            unique_ptr<Request> request = move(waiting.front());
+            waiting.pop_front();
+
+            if (m_inFlight < m_options.maxInFlight && StartRequest(request))
+            {
+                isStarted = true;
+            }
+            else
+            {
+                m_queue.push_back(move(request));
+            }
+        }
+    }
+}
+
+bool HLSHttpClient::StartRequest(unique_ptr<Request>& request)
+{
+    unique_ptr<HostPool>& pool = m_pools[request->hostKey];
+    if (!pool)
+    {
+        pool = make_unique<HostPool>();
+    }
+
+    Connection* connection = nullptr;
+
+    if (!pool->idle.empty())
+    {
+        connection = pool->idle.back();
+        pool->idle.pop_back();
+        connection->isReused = true;
+
+        lock_guard<mutex> lock(m_lock);
+        m_stats.connectionsReused++;
+    }
+    else if (pool->openCount < m_options.maxConnectionsPerHost)
+    {
+        m_connections.push_back(make_unique<Connection>());
+        connection = m_connections.back().get();
+        connection->pool = pool.get();
+        connection->addresses = request->addresses;
+        pool->openCount++;
+
+        lock_guard<mutex> lock(m_lock);
+        m_stats.connectionsOpened++;
+    }
+    else
+    {
+        return false;
+    }
+
+    const HttpUrl& url = request->url;
+    string& message = connection->sendBuffer;
+    message.clear();
+    message += "GET ";
+    message += url.target;
+    message += " HTTP/1.1\r\nHost: ";
+    message += url.host.find(':') != string::npos ? "[" + url.host + "]" : url.host;
+    if (url.port != "80")
+    {
+        message += ':';
+        message += url.port;
+    }
+
+    message += "\r\nUser-Agent: hlsparser\r\nAccept: */*\r\nConnection: keep-alive\r\n";
+    for (const auto& header : request->headers)
+    {
+        message += header.first;
+        message += ": ";
+        message += header.second;
+        message += "\r\n";
+    }
+
+    message += "\r\n";
+    connection->sent = 0;
+    connection->received = 0;
+    connection->response.Reset();
+
+    request->result.isReusedConnection = connection->isReused;
+    connection->request = move(request);
+    m_inFlight++;
+
+    if (connection->isReused)
+    {
+        SendRequest(*connection);
+    }
+    else
+    {
+        OpenConnection(*connection);
+    }
+
+    return true;
+}
+
+void HLSHttpClient::OpenConnection(Connection& connection)
+{
+    int error = 0;
+
+    for (; connection.addressIndex < connection.addresses->addresses.size(); connection.addressIndex++)
+    {
+        const HostAddresses::Address& address = connection.addresses->addresses[connection.addressIndex];
+
+        int fd = socket(address.address.ss_family, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            error = errno;
+            continue;
+        }
+
+        try
+        {
+            SetNonBlocking(fd);
+        }
+        catch (const system_error& e)
+        {
+            error = e.code().value();
+            close(fd);
+            continue;
+        }
+
+        // Requests are small and sent in one piece, so there is nothing to gain from Nagle
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address.address), address.length) != 0 && errno != EINPROGRESS)
+        {
+            error = errno;
+            close(fd);
+            continue;
+        }
+
+        connection.fd = fd;
+        connection.state = Connection::State::CONNECTING;
+        connection.connectDeadline = chrono::steady_clock::now() + m_options.connectTimeout;
+        m_poller->Add(fd, &connection, true);
+        return;
+    }
+
+    FailRequest(connection, "Unable to connect to " + connection.request->url.host + ": " +
+        generic_category().message(error), false);
+}
+
+void HLSHttpClient::SendRequest(Connection& connection)
+{
+    bool wasWaiting = connection.state == Connection::State::SENDING;
+    connection.state = Connection::State::SENDING;
+
+    while (connection.sent < connection.sendBuffer.length())
+    {
+        ssize_t sent = send(connection.fd, connection.sendBuffer.data() + connection.sent,
+            connection.sendBuffer.length() - connection.sent, MSG_NOSIGNAL);
+
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (!wasWaiting)
+                {
+                    m_poller->Modify(connection.fd, &connection, true);
+                }
+
+                return;
+            }
+
+            FailRequest(connection, "Unable to send request: " + generic_category().message(errno));
+            return;
+        }
+
+        connection.sent += sent;
+    }
+
+    connection.state = Connection::State::RECEIVING;
+    m_poller->Modify(connection.fd, &connection, false);
+}
+
+void HLSHttpClient::OnWritable(Connection& connection)
+{
+    if (connection.state == Connection::State::CONNECTING)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+        if (error != 0)
+        {
+            // Try the host's next address, if it has one
+            m_poller->Remove(connection.fd);
+            close(connection.fd);
+            connection.fd = -1;
+            connection.addressIndex++;
+
+            if (connection.addressIndex < connection.addresses->addresses.size())
+            {
+                OpenConnection(connection);
+            }
+            else
+            {
+                FailRequest(connection, "Unable to connect to " + connection.request->url.host + ": " +
+                    generic_category().message(error), false);
+            }
+
+            return;
+        }
+
+        // Connected. The socket is still watched for writing, which is what sending needs
+        connection.state = Connection::State::SENDING;
+    }
+
+    SendRequest(connection);
+}
+
+void HLSHttpClient::OnReadable(Connection& connection)
+{
+    ssize_t received = recv(connection.fd, m_readBuffer.data(), m_readBuffer.size(), 0);
+
+    if (connection.state == Connection::State::IDLE)
+    {
+        // An idle connection has nothing to say unless the server is closing it
+        CloseConnection(connection);
+        return;
+    }
+
+    if (received < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            FailRequest(connection, "Unable to read response: " + generic_category().message(errno));
+        }
+
+        return;
+    }
+
+    if (received == 0)
+    {
+        if (connection.response.OnClose())
+        {
+            CompleteRequest(connection, false);
+        }
+        else
+        {
+            FailRequest(connection, "Connection closed before the response was complete");
+        }
+
+        return;
+    }
+
+    connection.received += received;
+    Request& request = *connection.request;
+    HttpResponseReader& response = connection.response;
+
+    // Only the body of a successful response is handed on. Redirects and errors are
+    // read to the end so that the connection can be reused, and then dropped
+    auto onBody = [&request, &response](const char* data, size_t length)
+    {
+        if (response.Status() >= 200 && response.Status() < 300)
+        {
+            request.result.bodyBytes += length;
+            request.onBody(data, length);
+        }
+    };
+
+    size_t consumed;
+    try
+    {
+        consumed = response.Consume(m_readBuffer.data(), received, onBody);
+    }
+    catch (const exception& e)
+    {
+        FailRequest(connection, e.what(), false);
+        return;
+    }
+
+    if (response.IsDone())
+    {
+        // Nothing should follow a response that was not asked for, so a connection
+        // that has more to say is not trusted with another request
+        CompleteRequest(connection, response.IsKeepAlive() && consumed == size_t(received));
+    }
+}
+
+void HLSHttpClient::CompleteRequest(Connection& connection, bool isReusable)
+{
+    unique_ptr<Request> request = move(connection.request);
+    HttpResponseReader& response = connection.response;
+    int status = response.Status();
+    HttpHeaders headers = move(response.Headers());
+
+    ReleaseConnection(connection, isReusable);
+    m_inFlight--;
+
+    bool isRedirect = status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+    if (isRedirect && !response.Location().empty())
+    {
+        if (request->redirects >= m_options.maxRedirects)
+        {
+            request->result.status = status;
+            request->result.error = "Too many redirects";
+            Finish(move(request));
+            return;
+        }
+
+        try
+        {
+            request->url = request->url.Resolve(response.Location());
+        }
+        catch (const exception& e)
+        {
+            request->result.status = status;
+            request->result.error = e.what();
+            Finish(move(request));
+            return;
+        }
+
+        request->hostKey = request->url.host + ":" + request->url.port;
+        request->addresses = FindResolvedHost(request->url);
+        request->redirects++;
+
+        {
+            lock_guard<mutex> lock(m_lock);
+            m_stats.redirects++;
+        }
+
+        // A host not looked up before is resolved on the resolver thread, which
+        // queues the request again once it has an answer
+        if (!request->addresses)
+        {
+            {
+                lock_guard<mutex> lock(m_resolveLock);
+                m_toResolve.push_back(move(request));
+            }
+
+            m_resolveWake.notify_one();
+            return;
+        }
+
+        // Carry on ahead of anything still queued
+        m_queue.push_front(move(request));
+        return;
+    }
+
+    request->result.status = status;
+    request->result.url = request->url.ToString();
+    request->result.headers = move(headers);
+    request->result.isSuccess = (status >= 200 && status < 300) || status == 304;
+    if (!request->result.isSuccess)
+    {
+        request->result.error = "HTTP status " + to_string(status);
+    }
+
+    Finish(move(request));
+}
+
+void HLSHttpClient::FailRequest(Connection& connection, const string& error, bool canRetry)
+{
+    unique_ptr<Request> request = move(connection.request);
+    bool isStale = canRetry && connection.isReused && connection.received == 0;
+
+    CloseConnection(connection);
+    m_inFlight--;
+
+    if (isStale)
+    {
+        m_queue.push_front(move(request));
+        return;
+    }
+
+    request->result.error = error;
+    Finish(move(request));
+}
+
+void HLSHttpClient::Finish(unique_ptr<Request> request)
+{
+    if (!request->result.isSuccess)
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_stats.failures++;
+    }
+
+    try
+    {
+        request->onComplete(request->result);
+    }
+    catch (...)
+    {
+        // Completion handlers must not throw, and the event loop cannot report it
+    }
+}
+
+void HLSHttpClient::ReleaseConnection(Connection& connection, bool isReusable)
+{
+    if (!isReusable)
+    {
+        CloseConnection(connection);
+        return;
+    }
+
+    connection.state = Connection::State::IDLE;
+    connection.idleSince = chrono::steady_clock::now();
+    connection.pool->idle.push_back(&connection);
+}
+
+void HLSHttpClient::CloseConnection(Connection& connection)
+{
+    if (connection.state == Connection::State::CLOSED)
+    {
+        return;
+    }
+
+    if (connection.state == Connection::State::IDLE)
+    {
+        auto& idle = connection.pool->idle;
+        idle.erase(remove(idle.begin(), idle.end(), &connection), idle.end());
+    }
+
+    if (connection.fd >= 0)
+    {
+        m_poller->Remove(connection.fd);
+        close(connection.fd);
+        connection.fd = -1;
+    }
+
+    connection.pool->openCount--;
+    connection.state = Connection::State::CLOSED;
+}
+
+void HLSHttpClient::ExpireTimeouts()
+{
+    auto now = chrono::steady_clock::now();
+
+    // Counted before the request finishes, so that its callback already sees it in the stats
+    auto countTimeout = [this]()
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_stats.timeouts++;
+    };
+
+    for (auto it = m_queue.begin(); it != m_queue.end(); )
+    {
+        if ((*it)->deadline <= now)
+        {
+            unique_ptr<Request> request = move(*it);
+            it = m_queue.erase(it);
+            request->result.error = "Timed out waiting for a connection";
+            countTimeout();
+            Finish(move(request));
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (auto& connection : m_connections)
+    {
+        switch (connection->state)
+        {
+            case Connection::State::CONNECTING:
+                if (connection->connectDeadline <= now || connection->request->deadline <= now)
+                {
+                    countTimeout();
+                    FailRequest(*connection, "Timed out connecting to " + connection->request->url.host, false);
+                }
+                break;
+            case Connection::State::SENDING:
+            case Connection::State::RECEIVING:
+                if (connection->request->deadline <= now)
+                {
+                    countTimeout();
+                    FailRequest(*connection, "Timed out", false);
+                }
+                break;
+            case Connection::State::IDLE:
+                if (connection->idleSince + m_options.keepAliveTimeout <= now)
+                {
+                    CloseConnection(*connection);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+int HLSHttpClient::NextTimeoutMs() const
+{
+    auto next = chrono::steady_clock::time_point::max();
+
+    for (const auto& request : m_queue)
+    {
+        next = min(next, request->deadline);
+    }
+
+    for (const auto& connection : m_connections)
+    {
+        switch (connection->state)
+        {
+            case Connection::State::CONNECTING:
+                next = min(next, min(connection->connectDeadline, connection->request->deadline));
+                break;
+            case Connection::State::SENDING:
+            case Connection::State::RECEIVING:
+                next = min(next, connection->request->deadline);
+                break;
+            case Connection::State::IDLE:
+                next = min(next, connection->idleSince + m_options.keepAliveTimeout);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (next == chrono::steady_clock::time_point::max())
+    {
+        return -1;
+    }
+
+    // Rounded up, so that the loop does not wake just before a deadline and spin
+    auto wait = chrono::ceil<chrono::milliseconds>(next - chrono::steady_clock::now()).count();
+    return static_cast<int>(max<long long>(0, min<long long>(wait, INT32_MAX)));
+}
+
+#endif
@@ -0,0 +1,197 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "HLSMasterPlaylist.h"
+
+using namespace std;
+
+// The parts of an http:// URL needed to send a request
+struct HttpUrl
+{
+    string host;
+    string port = "80";
+
+    // Path and query, always starting with '/'
+    string target = "/";
+
+    // Throws invalid_argument for anything other than a plain http:// URL
+    static HttpUrl Parse(string_view url);
+
+    // Resolves a Location header against this URL
+    HttpUrl Resolve(string_view location) const;
+
+    string ToString() const;
+};
+
+// Header fields as name and value pairs, in the order they were written
+typedef vector<pair<string, string>> HttpHeaders;
+
+struct HttpResult
+{
+    // A 2xx response, or a 304 answering a conditional request
+    bool isSuccess = false;
+
+    // 0 if no response was received
+    int status = 0;
+
+    // Why the fetch failed, when it did
+    string error;
+
+    // The URL the body came from, after redirects
+    string url;
+
+    // Headers of the final response, after redirects
+    HttpHeaders headers;
+
+    size_t bodyBytes = 0;
+    bool isReusedConnection = false;
+
+    // The value of a response header, matched without regard to case, or an empty
+    // view if it is not present
+    string_view Header(string_view name) const;
+};
+
+struct HttpClientStats
+{
+    size_t requests = 0;
+    size_t connectionsOpened = 0;
+    size_t connectionsReused = 0;
+    size_t redirects = 0;
+    size_t timeouts = 0;
+    size_t failures = 0;
+};
+
+// A non-blocking HTTP/1.1 client with its own event loop thread, built on epoll on
+// Linux and poll elsewhere. Requests can be started from any thread. Connections
+// are kept alive and pooled per host, a limited number of requests are in flight at
+// once and the rest wait their turn, and bodies (including chunked ones) are handed
+// to the caller as they arrive rather than being buffered. Only plain http:// is
+// supported. The client is not available on Windows, where the tool fetches through
+// urlmon instead
+class HLSHttpClient
+{
+public:
+    struct Options
+    {
+        // Requests on the wire at once, across all hosts
+        size_t maxInFlight = 16;
+        size_t maxConnectionsPerHost = 4;
+
+        chrono::milliseconds connectTimeout = chrono::milliseconds(5000);
+
+        // Total time allowed for a request, from Fetch to the end of the body,
+        // including time spent waiting for a free connection
+        chrono::milliseconds requestTimeout = chrono::milliseconds(15000);
+
+        // How long an unused connection is kept in its pool
+        chrono::milliseconds keepAliveTimeout = chrono::milliseconds(30000);
+
+        size_t maxRedirects = 5;
+    };
+
+    // Receives the body of a successful response, piece by piece, on the client's
+    // thread. Throwing fails the request with the exception's message
+    typedef function<void(const char* data, size_t length)> BodyHandler;
+
+    // Called exactly once per request, on the client's thread. Must not throw
+    typedef function<void(const HttpResult& result)> CompletionHandler;
+
+    HLSHttpClient() : HLSHttpClient(Options()) {}
+    explicit HLSHttpClient(const Options& options);
+
+    // Fails every request that has not completed yet
+    ~HLSHttpClient();
+
+    HLSHttpClient(const HLSHttpClient&) = delete;
+    HLSHttpClient& operator = (const HLSHttpClient&) = delete;
+
+    // Starts a GET request and returns immediately. Host names are resolved on the
+    // calling thread and cached, and the new host of a redirect is resolved on a
+    // helper thread of the client. Throws if the URL is invalid or its host cannot
+    // be resolved; anything that goes wrong later is reported to onComplete
+    void Fetch(const string& url, BodyHandler onBody, CompletionHandler onComplete);
+
+    // As above, adding headers to the request, such as the validators of a conditional
+    // request. Throws invalid_argument if a name or value contains a line break
+    void Fetch(const string& url, const HttpHeaders& headers, BodyHandler onBody, CompletionHandler onComplete);
+
+    // Fetches a playlist, feeding the body to the parser as it arrives, and waits for
+    // it to complete. Throws if the fetch fails
+    void FetchPlaylist(const string& url, HLSMasterPlaylist& playlist);
+
+    HttpClientStats GetStats() const;
+
+private:
+    struct HostAddresses;
+    struct Request;
+    struct Connection;
+    struct HostPool;
+    class Poller;
+
+    void Run();
+    void TakeNewRequests();
+    void Dispatch();
+    bool StartRequest(unique_ptr<Request>& request);
+    void OpenConnection(Connection& connection);
+    void SendRequest(Connection& connection);
+    void OnReadable(Connection& connection);
+    void OnWritable(Connection& connection);
+    void CompleteRequest(Connection& connection, bool isReusable);
+
+    // A request that fails on a reused connection before any of the response has
+    // arrived is retried, as the server may simply have closed the idle connection
+    void FailRequest(Connection& connection, const string& error, bool canRetry = true);
+    void Finish(unique_ptr<Request> request);
+    void ReleaseConnection(Connection& connection, bool isReusable);
+    void CloseConnection(Connection& connection);
+    void ExpireTimeouts();
+    int NextTimeoutMs() const;
+    void Wake();
+
+    // Resolved addresses for host:port, looked up once and shared by every request
+    // for the life of the client. FindResolvedHost only consults what has been looked
+    // up already, and returns nullptr for a host that has not
+    shared_ptr<const HostAddresses> ResolveHost(const HttpUrl& url);
+    shared_ptr<const HostAddresses> FindResolvedHost(const HttpUrl& url);
+
+    // Looks up the hosts of redirected requests, so that the event loop never blocks
+    // on a lookup, and hands each request back through m_newRequests
+    void ResolveLoop();
+
+    Options m_options;
+
+    // Shared with the callers of Fetch
+    mutable mutex m_lock;
+    deque<unique_ptr<Request>> m_newRequests;
+    unordered_map<string, shared_ptr<const HostAddresses>> m_resolved;
+    HttpClientStats m_stats;
+    bool m_isStopping = false;
+
+    // Owned by the event loop thread
+    unique_ptr<Poller> m_poller;
+    deque<unique_ptr<Request>> m_queue;
+    vector<unique_ptr<Connection>> m_connections;
+    unordered_map<string, unique_ptr<HostPool>> m_pools;
+    size_t m_inFlight = 0;
+    vector<char> m_readBuffer;
+
+    int m_wakeRead = -1;
+    int m_wakeWrite = -1;
+    thread m_thread;
+
+    // Redirected requests waiting for their new host to be resolved
+    mutex m_resolveLock;
+    condition_variable m_resolveWake;
+    deque<unique_ptr<Request>> m_toResolve;
+    bool m_isResolverStopping = false;
+    thread m_resolver;
+};
@@ -0,0 +1,352 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+using namespace std;
+
+// Tags that may appear in a playlist (RFC 8216 section 4.3, plus the later
+// EXT-X-DEFINE, EXT-X-CONTENT-STEERING and low-latency additions). Master and media
+// playlists share one table, and each parser handles the tags that belong to it
+enum class HLSTagName : uint8_t
+{
+    UNKNOWN = 0,
+    EXTM3U,
+    VERSION,
+    INDEPENDENT_SEGMENTS,
+    START,
+    DEFINE,
+
+    // Master playlist
+    MEDIA,
+    STREAM_INF,
+    I_FRAME_STREAM_INF,
+    SESSION_DATA,
+    SESSION_KEY,
+    CONTENT_STEERING,
+
+    // Media playlist
+    TARGETDURATION,
+    MEDIA_SEQUENCE,
+    DISCONTINUITY_SEQUENCE,
+    ENDLIST,
+    PLAYLIST_TYPE,
+    I_FRAMES_ONLY,
+    PART_INF,
+    SERVER_CONTROL,
+
+    // Media segment
+    EXTINF,
+    BYTERANGE,
+    DISCONTINUITY,
+    KEY,
+    MAP,
+    PROGRAM_DATE_TIME,
+    GAP,
+    BITRATE,
+    PART,
+    DATERANGE,
+    PRELOAD_HINT,
+    RENDITION_REPORT,
+    SKIP,
+};
+
+// Attribute names used by the master playlist tags above
+enum class HLSAttributeName : uint8_t
+{
+    UNKNOWN = 0,
+
+    // EXT-X-MEDIA
+    TYPE,
+    URI,
+    GROUP_ID,
+    LANGUAGE,
+    ASSOC_LANGUAGE,
+    NAME,
+    STABLE_RENDITION_ID,
+    DEFAULT,
+    AUTOSELECT,
+    FORCED,
+    INSTREAM_ID,
+    BIT_DEPTH,
+    SAMPLE_RATE,
+    CHARACTERISTICS,
+    CHANNELS,
+
+    // EXT-X-STREAM-INF and EXT-X-I-FRAME-STREAM-INF
+    BANDWIDTH,
+    AVERAGE_BANDWIDTH,
+    SCORE,
+    CODECS,
+    SUPPLEMENTAL_CODECS,
+    RESOLUTION,
+    FRAME_RATE,
+    HDCP_LEVEL,
+    ALLOWED_CPC,
+    VIDEO_RANGE,
+    REQ_VIDEO_LAYOUT,
+    STABLE_VARIANT_ID,
+    AUDIO,
+    VIDEO,
+    SUBTITLES,
+    CLOSED_CAPTIONS,
+    PATHWAY_ID,
+
+    // EXT-X-SESSION-DATA
+    DATA_ID,
+    VALUE,
+    FORMAT,
+
+    // EXT-X-SESSION-KEY
+    METHOD,
+    IV,
+    KEYFORMAT,
+    KEYFORMATVERSIONS,
+
+    // EXT-X-START
+    TIME_OFFSET,
+    PRECISE,
+
+    // EXT-X-DEFINE
+    IMPORT,
+    QUERYPARAM,
+
+    // EXT-X-CONTENT-STEERING
+    SERVER_URI,
+
+    // EXT-X-MAP
+    BYTERANGE,
+
+    // EXT-X-SKIP
+    SKIPPED_SEGMENTS,
+    RECENTLY_REMOVED_DATERANGES,
+};
+
+template <typename Key>
+struct HLSKeyword
+{
+    string_view name;
+    Key key = Key();
+};
+
+// A perfect hash table over a fixed set of keywords, built entirely at compile time.
+// Every keyword is reduced to a 32-bit signature made of its length and three of its
+// characters, and a multiplier (the seed) sends every signature to its own slot. A
+// lookup is then one multiply, one shift and a single comparison against the keyword
+// in that slot. Searching for a seed takes far more constant evaluation steps than
+// compilers allow by default, so each table is given its seed, found with FindSeed
+// at run time, and a static_assert on IsPerfect checks it whenever the keywords change
+template <typename Key, size_t Count>
+class HLSKeywordTable
+{
+public:
+    constexpr HLSKeywordTable(const HLSKeyword<Key> (&keywords)[Count], uint32_t seed) : m_slots(), m_seed(seed)
+    {
+        m_isPerfect = TryBuild(keywords, seed);
+    }
+
+    // False when two keywords land in the same slot, in which case lookups of either
+    // may fail. Keywords sharing a signature collide under every seed
+    constexpr bool IsPerfect() const { return m_isPerfect; }
+
+    // Returns the first seed that makes a perfect table of keywords, or 0 if none below
+    // 2^16 does. Meant to be run once, outside compilation, when a keyword set changes
+    static uint32_t FindSeed(const HLSKeyword<Key> (&keywords)[Count])
+    {
+        for (uint32_t seed = 1; seed < MaxSeed; seed += 2)
+        {
+            if (HLSKeywordTable(keywords, seed).IsPerfect())
+            {
+                return seed;
+            }
+        }
+
+        return 0;
+    }
+
+    // Looks up name, returning false if it is not one of the keywords
+    constexpr bool Find(string_view name, Key& key) const
+    {
+        if (name.empty())
+        {
+            return false;
+        }
+
+        const HLSKeyword<Key>& slot = m_slots[SlotOf(Signature(name), m_seed)];
+
+        if (slot.name != name)
+        {
+            return false;
+        }
+
+        key = slot.key;
+        return true;
+    }
+
+private:
+    static constexpr size_t SlotBits()
+    {
+        size_t bits = 1;
+        while ((size_t(1) << bits) < Count * 2)
+        {
+            bits++;
+        }
+        return bits;
+    }
+
+    static constexpr size_t SlotCount = size_t(1) << SlotBits();
+    static constexpr uint32_t MaxSeed = 1 << 16;
+
+    static constexpr uint32_t Signature(string_view name)
+    {
+        size_t length = name.length();
+        return uint32_t(length) ^
+            (uint32_t(uint8_t(name[length - 1])) << 8) ^
+            (uint32_t(uint8_t(name[length / 2])) << 16) ^
+            (uint32_t(uint8_t(name[(length * 3) / 4])) << 24);
+    }
+
+    static constexpr size_t SlotOf(uint32_t signature, uint32_t seed)
+    {
+        return (signature * seed) >> (32 - SlotBits());
+    }
+
+    constexpr bool TryBuild(const HLSKeyword<Key> (&keywords)[Count], uint32_t seed)
+    {
+        bool isUsed[SlotCount] = {};
+
+        for (size_t i = 0; i < Count; i++)
+        {
+            size_t slot = SlotOf(Signature(keywords[i].name), seed);
+
+            if (isUsed[slot])
+            {
+                return false;
+            }
+
+            isUsed[slot] = true;
+            m_slots[slot] = keywords[i];
+        }
+
+        return true;
+    }
+
+    array<HLSKeyword<Key>, SlotCount> m_slots;
+    uint32_t m_seed;
+    bool m_isPerfect = false;
+};
+
+template <typename Key, size_t Count>
+constexpr HLSKeywordTable<Key, Count> MakeKeywordTable(const HLSKeyword<Key> (&keywords)[Count], uint32_t seed)
+{
+    return HLSKeywordTable<Key, Count>(keywords, seed);
+}
+
+inline constexpr auto s_tagNames = MakeKeywordTable<HLSTagName>(
+{
+    { "#EXTM3U", HLSTagName::EXTM3U },
+    { "#EXT-X-VERSION", HLSTagName::VERSION },
+    { "#EXT-X-INDEPENDENT-SEGMENTS", HLSTagName::INDEPENDENT_SEGMENTS },
+    { "#EXT-X-START", HLSTagName::START },
+    { "#EXT-X-DEFINE", HLSTagName::DEFINE },
+    { "#EXT-X-MEDIA", HLSTagName::MEDIA },
+    { "#EXT-X-STREAM-INF", HLSTagName::STREAM_INF },
+    { "#EXT-X-I-FRAME-STREAM-INF", HLSTagName::I_FRAME_STREAM_INF },
+    { "#EXT-X-SESSION-DATA", HLSTagName::SESSION_DATA },
+    { "#EXT-X-SESSION-KEY", HLSTagName::SESSION_KEY },
+    { "#EXT-X-CONTENT-STEERING", HLSTagName::CONTENT_STEERING },
+    { "#EXT-X-TARGETDURATION", HLSTagName::TARGETDURATION },
+    { "#EXT-X-MEDIA-SEQUENCE", HLSTagName::MEDIA_SEQUENCE },
+    { "#EXT-X-DISCONTINUITY-SEQUENCE", HLSTagName::DISCONTINUITY_SEQUENCE },
+    { "#EXT-X-ENDLIST", HLSTagName::ENDLIST },
+    { "#EXT-X-PLAYLIST-TYPE", HLSTagName::PLAYLIST_TYPE },
+    { "#EXT-X-I-FRAMES-ONLY", HLSTagName::I_FRAMES_ONLY },
+    { "#EXT-X-PART-INF", HLSTagName::PART_INF },
+    { "#EXT-X-SERVER-CONTROL", HLSTagName::SERVER_CONTROL },
+    { "#EXTINF", HLSTagName::EXTINF },
+    { "#EXT-X-BYTERANGE", HLSTagName::BYTERANGE },
+    { "#EXT-X-DISCONTINUITY", HLSTagName::DISCONTINUITY },
+    { "#EXT-X-KEY", HLSTagName::KEY },
+    { "#EXT-X-MAP", HLSTagName::MAP },
+    { "#EXT-X-PROGRAM-DATE-TIME", HLSTagName::PROGRAM_DATE_TIME },
+    { "#EXT-X-GAP", HLSTagName::GAP },
+    { "#EXT-X-BITRATE", HLSTagName::BITRATE },
+    { "#EXT-X-PART", HLSTagName::PART },
+    { "#EXT-X-DATERANGE", HLSTagName::DATERANGE },
+    { "#EXT-X-PRELOAD-HINT", HLSTagName::PRELOAD_HINT },
+    { "#EXT-X-RENDITION-REPORT", HLSTagName::RENDITION_REPORT },
+    { "#EXT-X-SKIP", HLSTagName::SKIP },
+}, 45153);
+
+static_assert(s_tagNames.IsPerfect(), "Tag names collide; pick a new seed with HLSKeywordTable::FindSeed");
+
+inline constexpr auto s_attributeNames = MakeKeywordTable<HLSAttributeName>(
+{
+    { "TYPE", HLSAttributeName::TYPE },
+    { "URI", HLSAttributeName::URI },
+    { "GROUP-ID", HLSAttributeName::GROUP_ID },
+    { "LANGUAGE", HLSAttributeName::LANGUAGE },
+    { "ASSOC-LANGUAGE", HLSAttributeName::ASSOC_LANGUAGE },
+    { "NAME", HLSAttributeName::NAME },
+    { "STABLE-RENDITION-ID", HLSAttributeName::STABLE_RENDITION_ID },
+    { "DEFAULT", HLSAttributeName::DEFAULT },
+    { "AUTOSELECT", HLSAttributeName::AUTOSELECT },
+    { "FORCED", HLSAttributeName::FORCED },
+    { "INSTREAM-ID", HLSAttributeName::INSTREAM_ID },
+    { "BIT-DEPTH", HLSAttributeName::BIT_DEPTH },
+    { "SAMPLE-RATE", HLSAttributeName::SAMPLE_RATE },
+    { "CHARACTERISTICS", HLSAttributeName::CHARACTERISTICS },
+    { "CHANNELS", HLSAttributeName::CHANNELS },
+    { "BANDWIDTH", HLSAttributeName::BANDWIDTH },
+    { "AVERAGE-BANDWIDTH", HLSAttributeName::AVERAGE_BANDWIDTH },
+    { "SCORE", HLSAttributeName::SCORE },
+    { "CODECS", HLSAttributeName::CODECS },
+    { "SUPPLEMENTAL-CODECS", HLSAttributeName::SUPPLEMENTAL_CODECS },
+    { "RESOLUTION", HLSAttributeName::RESOLUTION },
+    { "FRAME-RATE", HLSAttributeName::FRAME_RATE },
+    { "HDCP-LEVEL", HLSAttributeName::HDCP_LEVEL },
+    { "ALLOWED-CPC", HLSAttributeName::ALLOWED_CPC },
+    { "VIDEO-RANGE", HLSAttributeName::VIDEO_RANGE },
+    { "REQ-VIDEO-LAYOUT", HLSAttributeName::REQ_VIDEO_LAYOUT },
+    { "STABLE-VARIANT-ID", HLSAttributeName::STABLE_VARIANT_ID },
+    { "AUDIO", HLSAttributeName::AUDIO },
+    { "VIDEO", HLSAttributeName::VIDEO },
+    { "SUBTITLES", HLSAttributeName::SUBTITLES },
+    { "CLOSED-CAPTIONS", HLSAttributeName::CLOSED_CAPTIONS },
+    { "PATHWAY-ID", HLSAttributeName::PATHWAY_ID },
+    { "DATA-ID", HLSAttributeName::DATA_ID },
+    { "VALUE", HLSAttributeName::VALUE },
+    { "FORMAT", HLSAttributeName::FORMAT },
+    { "METHOD", HLSAttributeName::METHOD },
+    { "IV", HLSAttributeName::IV },
+    { "KEYFORMAT", HLSAttributeName::KEYFORMAT },
+    { "KEYFORMATVERSIONS", HLSAttributeName::KEYFORMATVERSIONS },
+    { "TIME-OFFSET", HLSAttributeName::TIME_OFFSET },
+    { "PRECISE", HLSAttributeName::PRECISE },
+    { "IMPORT", HLSAttributeName::IMPORT },
+    { "QUERYPARAM", HLSAttributeName::QUERYPARAM },
+    { "SERVER-URI", HLSAttributeName::SERVER_URI },
+    { "BYTERANGE", HLSAttributeName::BYTERANGE },
+    { "SKIPPED-SEGMENTS", HLSAttributeName::SKIPPED_SEGMENTS },
+    { "RECENTLY-REMOVED-DATERANGES", HLSAttributeName::RECENTLY_REMOVED_DATERANGES },
+}, 23281);
+
+static_assert(s_attributeNames.IsPerfect(), "Attribute names collide; pick a new seed with HLSKeywordTable::FindSeed");
+
+// Returns the tag named by name (e.g. "#EXT-X-MEDIA"), or UNKNOWN
+constexpr HLSTagName LookupTagName(string_view name)
+{
+    HLSTagName tag = HLSTagName::UNKNOWN;
+    s_tagNames.Find(name, tag);
+    return tag;
+}
+
+// Returns the attribute named by name (e.g. "BANDWIDTH"), or UNKNOWN
+constexpr HLSAttributeName LookupAttributeName(string_view name)
+{
+    HLSAttributeName attribute = HLSAttributeName::UNKNOWN;
+    s_attributeNames.Find(name, attribute);
+    return attribute;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string_view>
+#include "HLSStructuralIndex.h"
+
+using namespace std;
+
+// Splits a playlist held in one contiguous buffer into lines without copying.
+// Lines are returned without their terminator, and a trailing carriage return
+// is dropped so that playlists saved with CRLF line endings parse the same way
+class HLSLineReader
+{
+public:
+    explicit HLSLineReader(string_view text) : m_text(text) {}
+
+    // Splits the indexed text by walking its structural positions. Each line's share
+    // of the index is then available from LineStructure
+    explicit HLSLineReader(const HLSStructuralIndex& index) : m_text(index.Text()), m_structure(index) {}
+
+    // Reads the next line. Returns false once the end of the buffer is reached
+    bool Next(string_view& line)
+    {
+        if (m_pos >= m_text.length())
+        {
+            return false;
+        }
+
+        size_t lineEnd = m_structure.IsIndexed() ? m_structure.FindLineEnd(m_pos, m_lineStructure) :
+            m_text.find('\n', m_pos);
+
+        if (lineEnd == string_view::npos)
+        {
+            lineEnd = m_text.length();
+        }
+
+        line = m_text.substr(m_pos, lineEnd - m_pos);
+
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+
+        m_pos = lineEnd + 1;
+        return true;
+    }
+
+    // Structural positions of the line last read, for tokenizing it further. Not
+    // indexed when the reader was not given an index
+    const HLSStructureCursor& LineStructure() const { return m_lineStructure; }
+
+private:
+    string_view m_text;
+    HLSStructureCursor m_structure;
+    HLSStructureCursor m_lineStructure;
+    size_t m_pos = 0;
+};
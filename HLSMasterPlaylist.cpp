@@ -1,447 +1,1390 @@
 #include "HLSMasterPlaylist.h"
+#include "HLSAttributeList.h"
+#include "HLSKeywords.h"
+#include "HLSRadixSort.h"
+#include "HLSSerializer.h"
 #include <iostream>
+#include <charconv>
+#include <cmath>
 #include <algorithm>
+#include <condition_variable>
 #include <iterator>
 
-const unordered_map<string, HLSMasterPlaylist::ParseHandler> HLSMasterPlaylist::s_tagProcessor =
+static constexpr auto s_mediaTypes = MakeKeywordTable<MediaType>(
 {
-    {"#EXT-X-MEDIA", &HLSMasterPlaylist::ParseMediaTag },
-    {"#EXT-X-STREAM-INF", &HLSMasterPlaylist::ParseStreamInfo },
-    {"#EXT-X-I-FRAME-STREAM-INF", &HLSMasterPlaylist::ParseIStream },
-};
+    { "AUDIO", MediaType::AUDIO },
+    { "VIDEO", MediaType::VIDEO },
+    { "CLOSED-CAPTIONS", MediaType::CLOSED_CAPTIONS },
+    { "SUBTITLES", MediaType::SUBTITLES },
+}, 297);
 
-const unordered_map<string, MediaType> HLSMasterPlaylist::s_mediaTypes =
-{
-    {"AUDIO", MediaType::AUDIO },
-    {"VIDEO", MediaType::VIDEO },
-    {"CLOSED_CAPTIONS", MediaType::CLOSED_CAPTIONS },
-    {"SUBTITLES", MediaType::SUBTITLES},
-};
+static_assert(s_mediaTypes.IsPerfect(), "Media types collide; pick a new seed with HLSKeywordTable::FindSeed");
 
-constexpr const char* MediaTypeToString(MediaType t)
+void HLSMasterPlaylist::ParseMediaTag(string_view tag, const HLSStructureCursor& structure)
 {
-    switch (t)
+    MediaTag mediaTag(m_allocator);
+
+    // Parse through the full media tag
+    HLSAttributeList attributes(tag, structure);
+    HLSAttribute attribute;
+
+    while (attributes.Next(attribute))
     {
-        case MediaType::AUDIO: return "AUDIO";
-        case MediaType::VIDEO: return "VIDEO";
-        case MediaType::SUBTITLES: return "SUBTITLES";
-        case MediaType::CLOSED_CAPTIONS: return "CLOSED-CAPTIONS";
-        default: throw invalid_argument("Unimplemented item");
+        const string_view& field = attribute.name;
+        const string_view& val = attribute.value;
+
+        // Find out what kind of val this is and populate the
+        // corresponding field
+        switch (LookupAttributeName(field))
+        {
+            case HLSAttributeName::TYPE:
+                if (!s_mediaTypes.Find(val, mediaTag.type))
+                {
+                    throw invalid_argument("Unknown media type");
+                }
+                break;
+            case HLSAttributeName::GROUP_ID:
+                mediaTag.id = m_symbols->Intern(val);
+                break;
+            case HLSAttributeName::NAME:
+                mediaTag.name = val;
+                break;
+            case HLSAttributeName::LANGUAGE:
+                mediaTag.language = m_symbols->Intern(val);
+                break;
+            case HLSAttributeName::DEFAULT:
+                mediaTag.isDefault = val == "YES";
+                break;
+            case HLSAttributeName::AUTOSELECT:
+                mediaTag.autoSelect = val == "YES";
+                break;
+            case HLSAttributeName::CHANNELS:
+                mediaTag.channels = m_symbols->Intern(val);
+                break;
+            case HLSAttributeName::URI:
+                mediaTag.uri = val;
+                break;
+            case HLSAttributeName::ASSOC_LANGUAGE:
+            case HLSAttributeName::STABLE_RENDITION_ID:
+            case HLSAttributeName::FORCED:
+            case HLSAttributeName::INSTREAM_ID:
+            case HLSAttributeName::BIT_DEPTH:
+            case HLSAttributeName::SAMPLE_RATE:
+            case HLSAttributeName::CHARACTERISTICS:
+                // Valid for this tag, but not used yet
+                break;
+            default:
+                m_diagnostics.Report(HLSDiagnosticCode::UNKNOWN_MEDIA_ATTRIBUTE, m_lineNumber, field);
+                break;
+        }
     }
+
+    AddMediaTag(move(mediaTag));
 }
 
-constexpr const char* SortTypeToString(SortParameter t)
+void HLSMasterPlaylist::AddMediaTag(MediaTag&& mediaTag)
 {
-    switch (t)
+    // The group keeps the place of its first tag, and the last tag's fields
+    uint64_t key = GroupKey(mediaTag.type, mediaTag.id.empty() ? NoGroup : mediaTag.id.Id());
+    auto inserted = m_groupIndexes.emplace(key, static_cast<uint32_t>(m_mediaTags.size()));
+
+    if (inserted.second)
+    {
+        m_mediaTags.push_back(move(mediaTag));
+    }
+    else
     {
-        case SortParameter::DEFAULT: return "DEFAULT"; 
-        case SortParameter::BANDWIDTH: return "BANDWIDTH";
-        case SortParameter::VIDEORANGE: return "VIDEORANGE";
-        case SortParameter::AVG_BANDWIDTH: return "AVG_BANDWIDTH";
-        case SortParameter::RESOLUTION: return "RESOLUTION";
-        case SortParameter::CODECS: return "CODECS";
-        case SortParameter::FRAMERATE: return "FRAMERATE";
-        case SortParameter::CHANNELS: return "CHANNELS";
-        case SortParameter::AUDIO_LANGUAGE: return "AUDIO_LANGUAGE";
-        default: throw invalid_argument("Unimplemented item");
+        m_mediaTags[inserted.first->second] = move(mediaTag);
     }
 }
 
-SortParameter HLSMasterPlaylist::s_sortParam = SortParameter::DEFAULT;
-
-void HLSMasterPlaylist::ParseMediaTag(stringstream& playlist, string& tag)
+void HLSMasterPlaylist::BaseParseStreamInfo(string_view tag, const HLSStructureCursor& structure, StreamType type)
 {
-    MediaTag mediaTag;
+    StreamRow streamInfo;
 
-    // Parse through the full media tag
-    int curPos = 0;
+    streamInfo.type = type;
 
-    while (curPos < tag.length())
+    // Groups are named now and resolved once the playlist has been read, as they
+    // may come after the streams that use them
+    auto groupName = [this](string_view val)
     {
-        int nextDelim = tag.find('=', curPos);
+        HLSSymbol name = m_symbols->Intern(val);
+        return name.empty() ? NoGroup : name.Id();
+    };
 
-        string field = tag.substr(curPos, nextDelim-curPos);
+    // Parse through the full stream tag
+    HLSAttributeList attributes(tag, structure);
+    HLSAttribute attribute;
 
-        curPos = nextDelim+1;
+    while (attributes.Next(attribute))
+    {
+        const string_view& field = attribute.name;
+        const string_view& val = attribute.value;
 
-        // Find out if this is a quoted or unquoted field
-        nextDelim = tag.find_first_of("\",", nextDelim);
+        if (val == "NONE")
+        {
+            // NONE means the stream has no rendition of that kind
+            continue;
+        }
 
-        if (tag[nextDelim] == '\"')
+        switch (LookupAttributeName(field))
         {
-            // We are handling a string value
-            nextDelim++;
-            curPos = nextDelim;
-            nextDelim = tag.find('\"', nextDelim);
+            case HLSAttributeName::BANDWIDTH:
+                streamInfo.bandwidth = ParseNumber<long>(val);
+                break;
+            case HLSAttributeName::AVERAGE_BANDWIDTH:
+                streamInfo.avgBandwidth = ParseNumber<long>(val);
+                break;
+            case HLSAttributeName::CODECS:
+                streamInfo.codecs = m_symbols->Intern(val);
+                streamInfo.codecInfo = ParseCodecs(val);
+                break;
+            case HLSAttributeName::RESOLUTION:
+            {
+                size_t resPos = val.find('x');
+                Resolution res;
+                res.width = ParseNumber<int>(val.substr(0, resPos));
+                res.height = resPos == string_view::npos ? 0 : ParseNumber<int>(val.substr(resPos+1));
+                streamInfo.resolution = res;
+                break;
+            }
+            case HLSAttributeName::VIDEO_RANGE:
+                streamInfo.videoRange = m_symbols->Intern(val);
+                break;
+            case HLSAttributeName::FRAME_RATE:
+                streamInfo.frameRate = ParseNumber<float>(val);
+
+                // The sort key and the serializers both need a finite rate
+                if (!isfinite(streamInfo.frameRate))
+                {
+                    throw invalid_argument("Invalid frame rate");
+                }
+                break;
+            case HLSAttributeName::AUDIO:
+                streamInfo.audioGroup = groupName(val);
+                break;
+            case HLSAttributeName::VIDEO:
+                streamInfo.videoGroup = groupName(val);
+                break;
+            case HLSAttributeName::SUBTITLES:
+                streamInfo.subtitleGroup = groupName(val);
+                break;
+            case HLSAttributeName::CLOSED_CAPTIONS:
+                streamInfo.closedCaptionGroup = groupName(val);
+                break;
+            case HLSAttributeName::URI:
+                streamInfo.uri = val;
+                break;
+            case HLSAttributeName::SCORE:
+            case HLSAttributeName::SUPPLEMENTAL_CODECS:
+            case HLSAttributeName::HDCP_LEVEL:
+            case HLSAttributeName::ALLOWED_CPC:
+            case HLSAttributeName::REQ_VIDEO_LAYOUT:
+            case HLSAttributeName::STABLE_VARIANT_ID:
+            case HLSAttributeName::PATHWAY_ID:
+                // Valid for this tag, but not used yet
+                break;
+            default:
+                m_diagnostics.Report(HLSDiagnosticCode::UNKNOWN_STREAM_ATTRIBUTE, m_lineNumber, field);
+                break;
         }
+    }
+
+    if (type == StreamType::MEDIA)
+    {
+        // The next line will contain the URI, which may not have arrived yet.
+        // Hold on to the stream until it does
+        m_pendingStream = streamInfo;
+        m_pendingStream.uri = string_view();
+        m_hasPendingStream = true;
+        return;
+    }
 
-        string val = tag.substr(curPos, nextDelim-curPos);
+    AddStream(streamInfo, streamInfo.uri);
+}
 
-        nextDelim = tag[nextDelim] == '\"' ? nextDelim+1 : nextDelim;
+void HLSMasterPlaylist::AddStream(const StreamRow& row, string_view uri)
+{
+    StreamColumns* columns;
 
-        // Find out what kind of val this is and populate the
-        // corresponding field
-        if (field == "TYPE")
+    // Add this stream to our streams list
+    switch (row.type)
+    {
+        case StreamType::MEDIA:
+            columns = &m_streams;
+            break;
+        case StreamType::IFRAME:
+            columns = &m_iStreams;
+            break;
+        default:
+            throw invalid_argument("Unknown stream type encountered");
+    }
+
+    if (columns->uris.length() + uri.length() > UINT32_MAX)
+    {
+        throw length_error("Playlist URIs too long");
+    }
+
+    columns->bandwidths.push_back(row.bandwidth);
+    columns->avgBandwidths.push_back(row.avgBandwidth);
+    columns->widths.push_back(row.resolution.width);
+    columns->heights.push_back(row.resolution.height);
+    columns->frameRates.push_back(row.frameRate);
+    columns->audioGroups.push_back(row.audioGroup);
+    columns->videoGroups.push_back(row.videoGroup);
+    columns->subtitleGroups.push_back(row.subtitleGroup);
+    columns->closedCaptionGroups.push_back(row.closedCaptionGroup);
+    columns->codecs.push_back(row.codecs);
+    columns->codecInfos.push_back(row.codecInfo);
+    columns->videoRanges.push_back(row.videoRange);
+    columns->uris.append(uri.data(), uri.length());
+    columns->uriEnds.push_back(static_cast<uint32_t>(columns->uris.length()));
+}
+
+void HLSMasterPlaylist::ResolveGroups(StreamColumns& columns) const
+{
+    auto resolve = [this](pmr::vector<uint32_t>& groups, MediaType type)
+    {
+        for (uint32_t& group : groups)
         {
-            mediaTag.type = s_mediaTypes.at(val);
+            if (group != NoGroup)
+            {
+                auto found = m_groupIndexes.find(GroupKey(type, group));
+                group = found == m_groupIndexes.end() ? NoGroup : found->second;
+            }
         }
-        else if (field == "GROUP-ID")
+    };
+
+    resolve(columns.audioGroups, MediaType::AUDIO);
+    resolve(columns.videoGroups, MediaType::VIDEO);
+    resolve(columns.subtitleGroups, MediaType::SUBTITLES);
+    resolve(columns.closedCaptionGroups, MediaType::CLOSED_CAPTIONS);
+}
+
+HLSMasterPlaylist::StreamInfo HLSMasterPlaylist::AssembleStream(StreamType type, size_t index) const
+{
+    const StreamColumns& columns = GetStreamColumns(type);
+
+    StreamInfo stream;
+    stream.type = type;
+    stream.bandwidth = columns.bandwidths[index];
+    stream.avgBandwidth = columns.avgBandwidths[index];
+    stream.codecs = columns.codecs[index];
+    stream.codecInfo = columns.codecInfos[index];
+    stream.audio = GetGroup(columns.audioGroups[index]);
+    stream.video = GetGroup(columns.videoGroups[index]);
+    stream.subtitles = GetGroup(columns.subtitleGroups[index]);
+    stream.closedCaptions = GetGroup(columns.closedCaptionGroups[index]);
+    stream.resolution.width = columns.widths[index];
+    stream.resolution.height = columns.heights[index];
+    stream.frameRate = columns.frameRates[index];
+    stream.videoRange = columns.videoRanges[index];
+
+    uint32_t uriStart = index == 0 ? 0 : columns.uriEnds[index - 1];
+    stream.uri = string_view(columns.uris).substr(uriStart, columns.uriEnds[index] - uriStart);
+    return stream;
+}
+
+HLSMasterPlaylist::StreamInfo HLSMasterPlaylist::GetStream(size_t index) const
+{
+    if (index >= m_streams.size())
+    {
+        throw out_of_range("Stream index out of range");
+    }
+
+    return AssembleStream(StreamType::MEDIA, index);
+}
+
+HLSMasterPlaylist::StreamInfo HLSMasterPlaylist::GetIStream(size_t index) const
+{
+    if (index >= m_iStreams.size())
+    {
+        throw out_of_range("I-frame stream index out of range");
+    }
+
+    return AssembleStream(StreamType::IFRAME, index);
+}
+
+void HLSMasterPlaylist::ParseStreamInfo(string_view tag, const HLSStructureCursor& structure)
+{
+    BaseParseStreamInfo(tag, structure, StreamType::MEDIA);
+}
+
+
+void HLSMasterPlaylist::ParseIStream(string_view tag, const HLSStructureCursor& structure)
+{
+    BaseParseStreamInfo(tag, structure, StreamType::IFRAME);
+}
+
+
+void HLSMasterPlaylist::ParseMasterPlaylist(stringstream& playlist)
+{
+    // str() copies the stream's buffer once, which is cheaper than copying it
+    // out line by line, and the copy is then parsed in place
+    const string body = playlist.str();
+    ParseMasterPlaylist(string_view(body));
+    playlist.setstate(ios::eofbit);
+}
+
+void HLSMasterPlaylist::ParseMasterPlaylist(string_view playlistText)
+{
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+    BeginParse();
+
+    // Index the whole playlist in one pass, then walk the index rather than the text
+    m_structure.Build(playlistText);
+
+    HLSLineReader playlist(m_structure);
+    string_view line;
+
+    while (playlist.Next(line))
+    {
+        ParseLine(line, playlist.LineStructure());
+    }
+
+    if (m_metrics)
+    {
+        m_parseCounts.bytes += playlistText.length();
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
+    }
+
+    EndParse();
+}
+
+void HLSMasterPlaylist::ParseMasterPlaylist(string_view playlistText, HLSThreadPool& pool)
+{
+    size_t chunkCount = min(pool.ThreadCount(), playlistText.length() / MinParallelChunkSize);
+
+    // Every chunk after the first is parsed as though #EXTM3U had been read. That
+    // only holds when the first tag is #EXTM3U; otherwise the serial parse decides
+    // what to make of the playlist
+    HLSLineReader lines(playlistText);
+    string_view line;
+
+    while (lines.Next(line) && (line.length() < 4 || line.substr(0, 4) != "#EXT"))
+    {
+    }
+
+    if (chunkCount < 2 || LookupTagName(line.substr(0, line.find(':'))) != HLSTagName::EXTM3U)
+    {
+        ParseMasterPlaylist(playlistText);
+        return;
+    }
+
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+    BeginParse();
+
+    vector<size_t> chunkStarts;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        size_t pos = playlistText.length() / chunkCount * i;
+        pos = i == 0 ? 0 : FindChunkStart(playlistText, max(pos, chunkStarts.back()));
+
+        if (pos == playlistText.length())
         {
-            mediaTag.id = val;
+            break;
         }
-        else if (field == "NAME")
+
+        chunkStarts.push_back(pos);
+    }
+
+    chunkStarts.push_back(playlistText.length());
+    chunkCount = chunkStarts.size() - 1;
+
+    vector<unique_ptr<HLSMasterPlaylist>> chunks(chunkCount);
+    vector<exception_ptr> errors(chunkCount);
+
+    auto parseChunk = [&](size_t i)
+    {
+        try
         {
-            mediaTag.name = val;
+            // Chunks count their tags when this playlist is counting, but only this
+            // playlist adds anything to the metrics
+            chunks[i] = make_unique<HLSMasterPlaylist>(nullptr, m_symbols);
+            chunks[i]->m_metrics = m_metrics;
+            chunks[i]->ParseChunk(playlistText.substr(chunkStarts[i], chunkStarts[i + 1] - chunkStarts[i]));
         }
-        else if (field == "LANGUAGE")
+        catch (...)
         {
-            mediaTag.language = val;
+            errors[i] = current_exception();
         }
-        else if (field == "DEFAULT")
+    };
+
+    mutex lock;
+    condition_variable done;
+    size_t remaining = chunkCount - 1;
+
+    for (size_t i = 1; i < chunkCount; i++)
+    {
+        pool.Submit([&, i]()
         {
-            mediaTag.isDefault = val == "YES" ? true : false;
+            parseChunk(i);
+
+            // Notify while still holding the lock, as the waiting thread returns
+            // and destroys both as soon as it sees the last task finish
+            lock_guard<mutex> guard(lock);
+            if (--remaining == 0)
+            {
+                done.notify_one();
+            }
+        });
+    }
+
+    // The calling thread takes the first chunk rather than waiting idle
+    parseChunk(0);
+
+    // Help with pending tasks, this parse's chunks included, until they are done. If
+    // this thread is itself a worker, waiting idle could leave every worker waiting
+    // on chunks none of them is free to parse. Once nothing is pending, every chunk
+    // left has been taken by a thread that is parsing it
+    while (true)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            if (remaining == 0)
+            {
+                break;
+            }
         }
-        else if (field == "AUTOSELECT")
+
+        if (!pool.TryRunOne())
         {
-            mediaTag.autoSelect = val == "YES" ? true : false;
+            unique_lock<mutex> guard(lock);
+            done.wait(guard, [&remaining]() { return remaining == 0; });
+            break;
         }
-        else if (field == "CHANNELS")
+    }
+
+    // The first error in the text is the one the serial parse would have thrown
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        if (errors[i])
         {
-            mediaTag.channels = val;
+            m_isParsing = false;
+            rethrow_exception(errors[i]);
         }
-        else if (field == "URI")
+    }
+
+    // Size every column once, rather than growing it chunk by chunk
+    size_t streamCount = 0;
+    size_t iStreamCount = 0;
+    size_t uriLength = 0;
+    size_t iUriLength = 0;
+
+    for (const auto& chunk : chunks)
+    {
+        streamCount += chunk->m_streams.size();
+        iStreamCount += chunk->m_iStreams.size();
+        uriLength += chunk->m_streams.uris.length();
+        iUriLength += chunk->m_iStreams.uris.length();
+    }
+
+    m_streams.reserve(streamCount, uriLength);
+    m_iStreams.reserve(iStreamCount, iUriLength);
+
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        MergeChunk(*chunks[i], m_lineNumber);
+    }
+
+    if (m_metrics)
+    {
+        m_parseCounts.bytes += playlistText.length();
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
+    }
+
+    EndParse();
+}
+
+// Returns the start of the first line after pos that does not follow a stream tag,
+// as the line after a stream tag is always taken as its URI
+size_t HLSMasterPlaylist::FindChunkStart(string_view text, size_t pos)
+{
+    size_t lineStart = pos > 0 ? text.rfind('\n', pos - 1) : string_view::npos;
+    lineStart = lineStart == string_view::npos ? 0 : lineStart + 1;
+
+    for (size_t lineEnd = text.find('\n', pos); lineEnd != string_view::npos; lineEnd = text.find('\n', lineStart))
+    {
+        string_view line = text.substr(lineStart, lineEnd - lineStart);
+        if (!line.empty() && line.back() == '\r')
         {
-            mediaTag.uri = val;
+            line.remove_suffix(1);
         }
-        else
+
+        if (LookupTagName(line.substr(0, line.find(':'))) != HLSTagName::STREAM_INF)
         {
-            cout << "WARNING: Encountered unknown media field: " << field << "\n";
+            return lineEnd + 1;
         }
 
-        if (nextDelim < 0) break;
-        
-        // Update the current position
-        curPos = nextDelim + 1;
+        lineStart = lineEnd + 1;
     }
 
-    // Add the media type to our media tags map
-    m_mediaTags[mediaTag.id] = mediaTag;
+    return text.length();
 }
 
-void HLSMasterPlaylist::BaseParseStreamInfo(stringstream& playlist, string& tag, StreamType type)
+void HLSMasterPlaylist::ParseChunk(string_view text)
 {
-    StreamInfo streamInfo;
+    BeginParse();
 
-    streamInfo.type = type;
+    // The caller has checked that the playlist's first tag is #EXTM3U
+    m_isValid = true;
+    m_structure.Build(text);
 
-    // Parse through the full stream tag
-    int curPos = 0;
+    HLSLineReader lines(m_structure);
+    string_view line;
 
-    while (curPos < tag.length())
+    while (lines.Next(line))
     {
-        int nextDelim = tag.find('=', curPos);
+        ParseLine(line, lines.LineStructure());
+    }
+}
 
-        string field = tag.substr(curPos, nextDelim-curPos);
+void HLSMasterPlaylist::StreamColumns::reserve(size_t count, size_t uriLength)
+{
+    bandwidths.reserve(count);
+    avgBandwidths.reserve(count);
+    widths.reserve(count);
+    heights.reserve(count);
+    frameRates.reserve(count);
+    audioGroups.reserve(count);
+    videoGroups.reserve(count);
+    subtitleGroups.reserve(count);
+    closedCaptionGroups.reserve(count);
+    codecs.reserve(count);
+    codecInfos.reserve(count);
+    videoRanges.reserve(count);
+    uriEnds.reserve(count);
+    uris.reserve(uriLength);
+}
 
-        curPos = nextDelim+1;
+// Appends the columns of a chunk's streams. Group handles are still symbol IDs, which
+// every chunk shares, and are resolved once all chunks are in
+static void AppendColumns(HLSMasterPlaylist::StreamColumns& columns, const HLSMasterPlaylist::StreamColumns& chunk)
+{
+    if (columns.uris.length() + chunk.uris.length() > UINT32_MAX)
+    {
+        throw length_error("Playlist URIs too long");
+    }
 
-        // Find out if this is a quoted or unquoted field
-        nextDelim = tag.find_first_of("\",", nextDelim);
+    auto append = [](auto& column, const auto& chunkColumn) { column.insert(column.end(), chunkColumn.begin(), chunkColumn.end()); };
+
+    append(columns.bandwidths, chunk.bandwidths);
+    append(columns.avgBandwidths, chunk.avgBandwidths);
+    append(columns.widths, chunk.widths);
+    append(columns.heights, chunk.heights);
+    append(columns.frameRates, chunk.frameRates);
+    append(columns.audioGroups, chunk.audioGroups);
+    append(columns.videoGroups, chunk.videoGroups);
+    append(columns.subtitleGroups, chunk.subtitleGroups);
+    append(columns.closedCaptionGroups, chunk.closedCaptionGroups);
+    append(columns.codecs, chunk.codecs);
+    append(columns.codecInfos, chunk.codecInfos);
+    append(columns.videoRanges, chunk.videoRanges);
+
+    uint32_t uriOffset = static_cast<uint32_t>(columns.uris.length());
+    for (uint32_t uriEnd : chunk.uriEnds)
+    {
+        columns.uriEnds.push_back(uriOffset + uriEnd);
+    }
 
-        if (tag[nextDelim] == '\"')
-        {
-            // We are handling a string value
-            nextDelim++;
-            curPos = nextDelim;
-            nextDelim = tag.find('\"', nextDelim);
-        }
+    columns.uris.append(chunk.uris);
+}
 
-        string val = tag.substr(curPos, nextDelim-curPos);
+void HLSMasterPlaylist::MergeChunk(HLSMasterPlaylist& chunk, uint32_t lineOffset)
+{
+    // Tags of a group in several chunks end up as if they had been parsed in order
+    for (MediaTag& mediaTag : chunk.m_mediaTags)
+    {
+        AddMediaTag(move(mediaTag));
+    }
 
-        nextDelim = tag[nextDelim] == '\"' ? nextDelim+1 : nextDelim;
+    AppendColumns(m_streams, chunk.m_streams);
+    AppendColumns(m_iStreams, chunk.m_iStreams);
 
-        if (field == "BANDWIDTH")
-        {
-            streamInfo.bandwidth = atol(val.c_str());
-        }
-        else if (field == "AVERAGE-BANDWIDTH")
-        {
-            streamInfo.avgBandwidth = atol(val.c_str());
-        }
-        else if (field == "CODECS")
-        {
-            streamInfo.codecs = val;
-        }
-        else if (field == "RESOLUTION")
-        {
-            int resPos = val.find('x');
-            Resolution res;
-            res.width = atoi(val.substr(0, resPos).c_str());
-            res.height = atoi(val.substr(resPos+1).c_str());
-            streamInfo.resolution = res;
-        }
-        else if (field == "VIDEO-RANGE")
+    // Only the last chunk can end on a stream tag
+    if (chunk.m_hasPendingStream)
+    {
+        m_pendingStream = chunk.m_pendingStream;
+        m_hasPendingStream = true;
+    }
+
+    m_independentSegments = m_independentSegments || chunk.m_independentSegments;
+    m_lineNumber += chunk.m_lineNumber;
+    m_diagnostics.Merge(chunk.m_diagnostics, lineOffset);
+
+    for (size_t i = 0; i < TagNameCount; i++)
+    {
+        m_parseCounts.tags[i] += chunk.m_parseCounts.tags[i];
+    }
+}
+
+void HLSMasterPlaylist::Feed(const char* data, size_t length)
+{
+    // Only the time spent in the parser counts, not the time between chunks
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+
+    if (!m_isParsing)
+    {
+        BeginParse();
+    }
+
+    m_structure.Build(string_view(data, length));
+    HLSStructureCursor chunk(m_structure);
+    size_t pos = 0;
+
+    while (pos < length)
+    {
+        HLSStructureCursor structure;
+        size_t lineEnd = chunk.FindLineEnd(pos, structure);
+
+        if (lineEnd == string_view::npos)
         {
-            streamInfo.videoRange = val;
+            // Keep the unterminated tail of the chunk until the rest of the line arrives
+            m_partialLine.append(data + pos, length - pos);
+            break;
         }
-        else if (field == "FRAME-RATE")
+
+        string_view line(data + pos, lineEnd - pos);
+
+        // Lines that were split across chunks are parsed from the carried buffer,
+        // which is not indexed. Everything else is parsed in place
+        if (!m_partialLine.empty())
         {
-            streamInfo.frameRate = atof(val.c_str());
+            m_partialLine.append(line.data(), line.length());
+            line = m_partialLine;
+            structure = HLSStructureCursor();
         }
-        else if (field == "AUDIO" && val != "NONE")
+
+        pos = lineEnd + 1;
+
+        if (!line.empty() && line.back() == '\r')
         {
-            if (m_mediaTags.find(val) != m_mediaTags.end())
-            {
-                streamInfo.audio = &m_mediaTags[val];
-            }
-            else
-            {
-                // Create the tag and it will be populated later
-                m_mediaTags[val] = MediaTag();
-            }
+            line.remove_suffix(1);
         }
-        else if (field == "CLOSED-CAPTIONS" && val != "NONE")
-        {
-            if (m_mediaTags.find(val) != m_mediaTags.end())
-            {
-                streamInfo.closedCaptions = &m_mediaTags[val];
-            }
-            else
-            {
-                // Create the tag and it will be populated later
-                m_mediaTags[val] = MediaTag();
-            }
-        }
-        else if (field == "VIDEO" && val != "NONE")
+
+        try
         {
-            if (m_mediaTags.find(val) != m_mediaTags.end())
-            {
-                streamInfo.audio = &m_mediaTags[val];
-            }
-            else
-            {
-                // Create the tag and it will be populated later
-                m_mediaTags[val] = MediaTag();
-            }
+            ParseLine(line, structure);
         }
-        else if (field == "URI")
+        catch (...)
         {
-            streamInfo.uri = val;
+            // Leave the parser ready to start on a new playlist
+            m_isParsing = false;
+            throw;
         }
-        else if (val != "NONE")
+
+        m_partialLine.clear();
+    }
+
+    if (m_metrics)
+    {
+        m_parseCounts.bytes += length;
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
+    }
+}
+
+void HLSMasterPlaylist::Finish()
+{
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+
+    if (!m_isParsing)
+    {
+        BeginParse();
+    }
+
+    // The final line of a playlist does not need a terminator
+    if (!m_partialLine.empty())
+    {
+        string_view line = m_partialLine;
+
+        if (line.back() == '\r')
         {
-            cout << "WARNING: Encountered unknown stream field: " << field << "\n";
+            line.remove_suffix(1);
         }
 
-        if (nextDelim < 0) break;
+        // Whatever happens, the next call to Feed starts on a new playlist
+        m_isParsing = false;
+        ParseLine(line);
+        m_partialLine.clear();
+    }
 
-        curPos = nextDelim + 1;
+    if (m_metrics)
+    {
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
     }
 
-    if (type == StreamType::MEDIA)
+    EndParse();
+}
+
+HLSMasterPlaylist::HLSMasterPlaylist(pmr::memory_resource* resource, shared_ptr<HLSSymbolTable> symbols) :
+    m_symbols(symbols ? move(symbols) : HLSSymbolTable::Global()),
+    m_arena(resource ? nullptr : make_unique<pmr::monotonic_buffer_resource>(ArenaInitialSize, &m_arenaUpstream)),
+    m_allocator(resource ? resource : m_arena.get()),
+    m_mediaTags(m_allocator),
+    m_groupIndexes(m_allocator),
+    m_streams(m_allocator),
+    m_iStreams(m_allocator),
+    m_partialLine(m_allocator)
+{
+    m_sortIndexes.reserve(SortIndexCount);
+    for (size_t i = 0; i < SortIndexCount; i++)
     {
-        // The next line will contain the URI
-        getline(playlist, streamInfo.uri);
+        m_sortIndexes.emplace_back(m_allocator);
     }
+}
 
-    // Add this stream to our streams list
-    switch (type)
+void HLSMasterPlaylist::BeginParse()
+{
+    // Clear the current data if it exists, along with every order built for it
+    ResetStorage();
+
+    m_independentSegments = false;
+    m_isParsing = true;
+    m_isValid = false;
+    m_hasPendingStream = false;
+    m_lineNumber = 0;
+    m_diagnostics.BeginParse();
+
+    // Allocations are counted from here, once the arena has been released
+    m_parseCounts = HLSParseMetrics::Counts();
+    m_parseCounts.allocations = m_arenaUpstream.AllocationCount();
+    m_parseCounts.allocatedBytes = m_arenaUpstream.AllocatedBytes();
+}
+
+void HLSMasterPlaylist::ResetStorage()
+{
+    // Replace every container rather than clearing it, so that none of them hold on
+    // to memory from the arena when it is released below
+    m_iStreams = StreamColumns(m_allocator);
+    m_streams = StreamColumns(m_allocator);
+    m_mediaTags = decltype(m_mediaTags)(m_allocator);
+    m_groupIndexes = decltype(m_groupIndexes)(m_allocator);
+    m_pendingStream = StreamRow();
+
+    // A string assigned an empty one keeps its buffer, so swap the strings out instead
+    pmr::string(m_allocator).swap(m_iStreams.uris);
+    pmr::string(m_allocator).swap(m_streams.uris);
+    pmr::string(m_allocator).swap(m_partialLine);
+
+    for (atomic<bool>& isBuilt : m_isSortIndexBuilt)
     {
-        case StreamType::MEDIA:
-            m_streams.push_back(streamInfo);
+        isBuilt = false;
+    }
+
+    for (SortIndex& index : m_sortIndexes)
+    {
+        index.streams = pmr::vector<uint32_t>(m_allocator);
+        index.iStreams = pmr::vector<uint32_t>(m_allocator);
+        index.mediaTags = pmr::vector<uint32_t>(m_allocator);
+    }
+
+    if (m_arena)
+    {
+        m_arena->release();
+    }
+}
+
+void HLSMasterPlaylist::EndParse()
+{
+    // A media stream at the very end of the playlist never received its URI
+    if (m_hasPendingStream)
+    {
+        m_hasPendingStream = false;
+        AddStream(m_pendingStream, string_view());
+    }
+
+    m_isParsing = false;
+    m_structure.Release();
+
+    // Every group is known now, wherever its tag was
+    ResolveGroups(m_streams);
+    ResolveGroups(m_iStreams);
+
+    if (m_metrics)
+    {
+        m_parseCounts.parses = 1;
+        m_parseCounts.lines = m_lineNumber;
+        m_parseCounts.diagnostics = m_diagnostics.TotalCount();
+        m_parseCounts.allocations = m_arenaUpstream.AllocationCount() - m_parseCounts.allocations;
+        m_parseCounts.allocatedBytes = m_arenaUpstream.AllocatedBytes() - m_parseCounts.allocatedBytes;
+        m_metrics->Add(m_parseCounts);
+    }
+
+    Sort(m_sortParam, m_isAscendingSort);
+}
+
+void HLSMasterPlaylist::ParseLine(string_view line, const HLSStructureCursor& structure)
+{
+    m_lineNumber++;
+
+    if (m_hasPendingStream)
+    {
+        // The line after a media stream tag is the URI of that stream
+        m_hasPendingStream = false;
+        AddStream(m_pendingStream, line);
+        return;
+    }
+
+    // All valid lines will start with #EXT. Anything else is a comment or a URI
+    if (line.length() < 4 || line.substr(0, 4) != "#EXT")
+    {
+        return;
+    }
+
+    // The tag name runs up to the attribute list, if there is one
+    size_t curIdx = line.find(':');
+    string_view tag = line.substr(0, curIdx);
+    string_view attributeList = curIdx == string_view::npos ? string_view() : line.substr(curIdx+1);
+    HLSStructureCursor attributeStructure;
+
+    if (structure.IsIndexed() && curIdx != string_view::npos)
+    {
+        attributeStructure = structure.Window(curIdx+1, line.length());
+    }
+    HLSTagName tagName = LookupTagName(tag);
+
+    if (m_metrics)
+    {
+        m_parseCounts.tags[static_cast<size_t>(tagName)]++;
+    }
+
+    // The first line of the file should read #EXTM3U. If we have not read it
+    // before any other tag, it is a malformed file
+    if (tagName == HLSTagName::EXTM3U)
+    {
+        m_isValid = true;
+        return;
+    }
+
+    if (!m_isValid)
+    {
+        throw logic_error("Malformed HLS Playlist");
+    }
+
+    switch (tagName)
+    {
+        case HLSTagName::MEDIA:
+            ParseMediaTag(attributeList, attributeStructure);
             break;
-        case StreamType::IFRAME:
-            m_iStreams.push_back(streamInfo);
+        case HLSTagName::STREAM_INF:
+            ParseStreamInfo(attributeList, attributeStructure);
+            break;
+        case HLSTagName::I_FRAME_STREAM_INF:
+            ParseIStream(attributeList, attributeStructure);
+            break;
+        case HLSTagName::INDEPENDENT_SEGMENTS:
+            m_independentSegments = true;
+            break;
+        case HLSTagName::VERSION:
+        case HLSTagName::START:
+        case HLSTagName::DEFINE:
+        case HLSTagName::SESSION_DATA:
+        case HLSTagName::SESSION_KEY:
+        case HLSTagName::CONTENT_STEERING:
+            // Deliberately ignored, as the playlist does not model the version, session
+            // data and keys, content steering, variables or the start offset. They are
+            // recognized so that valid playlists do not produce warnings
             break;
         default:
-            throw invalid_argument("Unknown stream type encountered");
+            m_diagnostics.Report(HLSDiagnosticCode::UNKNOWN_TAG, m_lineNumber, tag);
             break;
     }
-    
 }
 
-void HLSMasterPlaylist::ParseStreamInfo(stringstream& playlist, string& tag)
+// Symbol ranks are only looked up by the orders that compare strings
+static constexpr bool UsesSymbolRanks(SortParameter sortParam)
 {
-    BaseParseStreamInfo(playlist, tag, StreamType::MEDIA);
+    return sortParam == SortParameter::CHANNELS || sortParam == SortParameter::AUDIO_LANGUAGE ||
+        sortParam == SortParameter::VIDEORANGE;
 }
 
-
-void HLSMasterPlaylist::ParseIStream(stringstream& playlist, string& tag)
+// Stands in for the rank table in orders that do not use it
+static const vector<uint32_t>& NoRanks()
 {
-    BaseParseStreamInfo(playlist, tag, StreamType::IFRAME);
+    static const vector<uint32_t> noRanks;
+    return noRanks;
 }
 
-
-void HLSMasterPlaylist::ParseMasterPlaylist(stringstream& playlist)
+// Key of an interned string under alphabetical order. The empty string sorts first
+static uint64_t SymbolKey(HLSSymbol symbol, const vector<uint32_t>& ranks)
 {
-    string curLine;
-    bool isValid = false;
+    return symbol.empty() ? 0 : uint64_t(ranks[symbol.Id()]) + 1;
+}
 
-    // Clear the current data if it exists
-    m_iStreams.clear();
-    m_mediaTags.clear();
-    m_streams.clear();
+// Packs the field a sort compares into an integer key, so that ascending keys put
+// the streams in ascending order of that field. Numeric fields keep their order,
+// and string fields are interned, so their keys are the symbols' alphabetical
+// ranks. Only the one column the sort needs is read
+template <SortParameter Param>
+static uint64_t StreamSortKey(const HLSMasterPlaylist::StreamColumns& streams, size_t i,
+    const pmr::vector<HLSMasterPlaylist::MediaTag>& mediaTags, const vector<uint32_t>& ranks)
+{
+    static_assert(Param != SortParameter::DEFAULT, "Cannot sort with no sorting method");
 
-    while (getline(playlist, curLine))
+    if constexpr (Param == SortParameter::AUDIO_LANGUAGE || Param == SortParameter::CHANNELS)
     {
-        // The first line of the file should read #EXTM3U. If it does not, it is 
-        // a malformed file
-        if (curLine == "#EXTM3U")
+        // Streams without audio come last, and audio groups that are not actually
+        // audio come after all real audio, ordered by type and ID
+        if (streams.audioGroups[i] == HLSMasterPlaylist::NoGroup)
         {
-            isValid = true;
-            continue;
+            return UINT64_MAX;
         }
 
-        // All valid lines will start with #EXT. If we have not read the #EXTM3U tag first,
-        // then this file is incalid
-        if (curLine.length() >= 4 && curLine.substr(0, 4) == "#EXT")
+        const HLSMasterPlaylist::MediaTag* audio = &mediaTags[streams.audioGroups[i]];
+
+        if (audio->type != MediaType::AUDIO)
         {
-            if (!isValid)
-            {
-                throw logic_error("Malformed HLS Playlist");
-            }
+            return (uint64_t(1) << 62) | (uint64_t(audio->type) << 32) | SymbolKey(audio->id, ranks);
+        }
 
-            // Find the index of the end of the tag. The first 
-            // part of the tag will map to our tag processor
-            int curIdx = curLine.find(':');
+        if constexpr (Param == SortParameter::CHANNELS)
+        {
+            // Shorter channel specifiers first, then alphabetically
+            return (uint64_t(audio->channels.View().length()) << 32) | SymbolKey(audio->channels, ranks);
+        }
+        else
+        {
+            return SymbolKey(audio->language, ranks);
+        }
+    }
+    else if constexpr (Param == SortParameter::BANDWIDTH)
+    {
+        return OrderedKey(streams.bandwidths[i]);
+    }
+    else if constexpr (Param == SortParameter::AVG_BANDWIDTH)
+    {
+        return OrderedKey(streams.avgBandwidths[i]);
+    }
+    else if constexpr (Param == SortParameter::RESOLUTION)
+    {
+        // Sorting is done by total height and width
+        return OrderedKey(int64_t(streams.widths[i]) + streams.heights[i]);
+    }
+    else if constexpr (Param == SortParameter::FRAMERATE)
+    {
+        // Frame rates are fixed point with millihertz precision, which is enough to
+        // keep rates such as 29.97 and 30 apart
+        return OrderedKey(llround(double(streams.frameRates[i]) * 1000));
+    }
+    else if constexpr (Param == SortParameter::CODECS)
+    {
+        // Complexity already packs the video rank above the audio rank
+        return streams.codecInfos[i].Complexity();
+    }
+    else
+    {
+        static_assert(Param == SortParameter::VIDEORANGE, "Unknown sort parameter");
+        return SymbolKey(streams.videoRanges[i], ranks);
+    }
+}
 
-            if (curIdx == string::npos)
-            {
-                // This is referencing a global tag. Apply it to our
-                // playlist file
-                // TODO: Add support for other global tags. For now,
-                // only support the independent segments tag
-                if (curLine == "#EXT-X-INDEPENDENT-SEGMENTS")
-                {
-                    m_independentSegments = true;
-                }
-                else
-                {
-                    cout << "WARNING: Encountered unknown global tag: " << curLine << "\n";
-                }
+// Builds the permutation that orders a list of streams under Param. Rather than
+// comparing streams during the sort, radix sort a compact key column
+template <SortParameter Param>
+static void OrderStreams(const HLSMasterPlaylist::StreamColumns& streams, bool isAscending,
+    const pmr::vector<HLSMasterPlaylist::MediaTag>& mediaTags, const vector<uint32_t>& ranks, pmr::vector<uint32_t>& order)
+{
+    vector<uint64_t> keys(streams.size());
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        uint64_t key = StreamSortKey<Param>(streams, i, mediaTags, ranks);
+        keys[i] = isAscending ? key : ~key;
+    }
 
-                continue;
-            }
+    order.resize(streams.size());
+    RadixSortOrder(keys.data(), keys.size(), order.data());
+}
 
-            string tag = curLine.substr(0, curIdx);
-            string attributeList = curLine.substr(curIdx+1);
+template <SortParameter Param>
+void HLSMasterPlaylist::BuildSortIndex(SortIndex& index, bool isAscending) const
+{
+    // Every symbol of this playlist was interned before parsing finished, so any
+    // rank table taken now covers all of them. Numeric orders never read it, and
+    // skip the table-wide lock and rebuild taking one can cost
+    HLSSymbolTable::RankTable ranks;
+    if constexpr (UsesSymbolRanks(Param))
+    {
+        ranks = m_symbols->Ranks();
+    }
 
-            auto const tagProcessor = s_tagProcessor.find(tag);
+    const vector<uint32_t>& rankTable = ranks ? *ranks : NoRanks();
+    OrderStreams<Param>(m_streams, isAscending, m_mediaTags, rankTable, index.streams);
+    OrderStreams<Param>(m_iStreams, isAscending, m_mediaTags, rankTable, index.iStreams);
 
-            if (tagProcessor == s_tagProcessor.end())
-            {
-                cout << "WARNING: Encountered unknown tag: " << tag << "\n";
-                continue;
-            }
+    // Media tags are always listed in ascending order
+    index.mediaTags.resize(m_mediaTags.size());
+    for (size_t i = 0; i < index.mediaTags.size(); i++)
+    {
+        index.mediaTags[i] = static_cast<uint32_t>(i);
+    }
 
-            (this->*(tagProcessor->second))(playlist, attributeList);
-        }
+    MediaTagOrder<Param> less;
+    sort(index.mediaTags.begin(), index.mediaTags.end(),
+        [&](uint32_t a, uint32_t b){ return less(m_mediaTags[a], m_mediaTags[b]); });
+}
+
+size_t HLSMasterPlaylist::SortIndexSlot(SortParameter sortParam, bool isAscending)
+{
+    if (sortParam >= SortParameter::DEFAULT || sortParam < SortParameter::BANDWIDTH)
+    {
+        throw logic_error("Unknown sort parameter");
     }
 
-    Sort(s_sortParam, isAscendingSort);
+    return static_cast<size_t>(sortParam) * 2 + (isAscending ? 0 : 1);
 }
 
-void HLSMasterPlaylist::Sort(SortParameter sortParam, bool isAscending)
+const HLSMasterPlaylist::SortIndex* HLSMasterPlaylist::GetSortIndex(SortParameter sortParam, bool isAscending) const
 {
-    s_sortParam = sortParam;
-    m_sortedMediaTypes.clear();
-    transform(m_mediaTags.begin(), m_mediaTags.end(), back_inserter(m_sortedMediaTypes),
-            [](auto& kv){ return kv.second; });
+    if (sortParam == SortParameter::DEFAULT)
+    {
+        return nullptr;
+    }
 
-    // Only perform sorting if a sort method has been selected
-    if (s_sortParam != SortParameter::DEFAULT)
+    size_t slot = SortIndexSlot(sortParam, isAscending);
+    SortIndex& index = m_sortIndexes[slot];
+
+    if (m_isSortIndexBuilt[slot].load(memory_order_acquire))
     {
-        if (isAscending)
-        {
-            sort(m_streams.begin(), m_streams.end());
-            sort(m_iStreams.begin(), m_iStreams.end());
-            sort(m_sortedMediaTypes.begin(), m_sortedMediaTypes.end());
-        }
-        else
-        {
-            sort(m_streams.rbegin(), m_streams.rend());
-            sort(m_iStreams.rbegin(), m_iStreams.rend());
-            sort(m_sortedMediaTypes.begin(), m_sortedMediaTypes.end());
-        }
+        return &index;
+    }
+
+    lock_guard<mutex> lock(m_sortIndexLock);
+
+    // Another thread may have built the index while we were waiting
+    if (m_isSortIndexBuilt[slot].load(memory_order_relaxed))
+    {
+        return &index;
     }
 
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+
+    // Pick the comparator once for the whole sort
+    switch (sortParam)
+    {
+        case SortParameter::BANDWIDTH: BuildSortIndex<SortParameter::BANDWIDTH>(index, isAscending); break;
+        case SortParameter::AVG_BANDWIDTH: BuildSortIndex<SortParameter::AVG_BANDWIDTH>(index, isAscending); break;
+        case SortParameter::RESOLUTION: BuildSortIndex<SortParameter::RESOLUTION>(index, isAscending); break;
+        case SortParameter::FRAMERATE: BuildSortIndex<SortParameter::FRAMERATE>(index, isAscending); break;
+        case SortParameter::CODECS: BuildSortIndex<SortParameter::CODECS>(index, isAscending); break;
+        case SortParameter::CHANNELS: BuildSortIndex<SortParameter::CHANNELS>(index, isAscending); break;
+        case SortParameter::AUDIO_LANGUAGE: BuildSortIndex<SortParameter::AUDIO_LANGUAGE>(index, isAscending); break;
+        case SortParameter::VIDEORANGE: BuildSortIndex<SortParameter::VIDEORANGE>(index, isAscending); break;
+        default: throw logic_error("Unknown sort parameter");
+    }
+
+    if (m_metrics)
+    {
+        m_metrics->AddSortNs(HLSParseMetrics::Now() - start);
+    }
+
+    m_isSortIndexBuilt[slot].store(true, memory_order_release);
+    return &index;
 }
 
-ostream& operator << (ostream& os, const HLSMasterPlaylist::MediaTag& mediaTag)
+HLSMasterPlaylist::StreamView HLSMasterPlaylist::GetStreams(SortParameter sortParam, bool isAscending) const
+{
+    const SortIndex* index = GetSortIndex(sortParam, isAscending);
+    return StreamView(this, StreamType::MEDIA, index ? index->streams.data() : nullptr);
+}
+
+HLSMasterPlaylist::StreamView HLSMasterPlaylist::GetIStreams(SortParameter sortParam, bool isAscending) const
+{
+    const SortIndex* index = GetSortIndex(sortParam, isAscending);
+    return StreamView(this, StreamType::IFRAME, index ? index->iStreams.data() : nullptr);
+}
+
+HLSMasterPlaylist::MediaTagView HLSMasterPlaylist::GetMediaTags(SortParameter sortParam, bool isAscending) const
+{
+    const SortIndex* index = GetSortIndex(sortParam, isAscending);
+    return MediaTagView(m_mediaTags.data(), m_mediaTags.size(), index ? index->mediaTags.data() : nullptr);
+}
+
+void HLSMasterPlaylist::RankStreams(const StreamColumns& streams, SortParameter sortParam, bool isAscending,
+    vector<RankedStream>& ranked) const
 {
-    os << "#EXT-X-MEDIA:" << "TYPE=" << MediaTypeToString(mediaTag.type) << 
-        ",GROUP-ID=\"" << mediaTag.id << "\",NAME=\"" << mediaTag.name << "\",DEFAULT=" <<
-        (mediaTag.isDefault ? "YES" : "NO") << ",AUTOSELECT=" << 
-        (mediaTag.autoSelect ? "YES" : "NO");
+    ranked.resize(streams.size());
 
-    if (mediaTag.language != "") os << ",LANGUAGE=\"" << mediaTag.language << "\"";
+    HLSSymbolTable::RankTable ranks;
+    if (UsesSymbolRanks(sortParam))
+    {
+        ranks = m_symbols->Ranks();
+    }
 
-    if (mediaTag.type == MediaType::AUDIO) os << ",CHANNELS=\"" << mediaTag.channels << "\"";
+    const vector<uint32_t>& rankTable = ranks ? *ranks : NoRanks();
 
-    if (mediaTag.uri != "") os << ",URI=\"" << mediaTag.uri << "\"";
+    // Pick the key once for the whole column
+    auto rank = [&](auto param)
+    {
+        for (size_t i = 0; i < streams.size(); i++)
+        {
+            uint64_t key = StreamSortKey<decltype(param)::value>(streams, i, m_mediaTags, rankTable);
+            ranked[i] = { isAscending ? key : ~key, static_cast<uint32_t>(i) };
+        }
+    };
 
-    return os;
+    switch (sortParam)
+    {
+        case SortParameter::BANDWIDTH: rank(integral_constant<SortParameter, SortParameter::BANDWIDTH>()); break;
+        case SortParameter::AVG_BANDWIDTH: rank(integral_constant<SortParameter, SortParameter::AVG_BANDWIDTH>()); break;
+        case SortParameter::RESOLUTION: rank(integral_constant<SortParameter, SortParameter::RESOLUTION>()); break;
+        case SortParameter::FRAMERATE: rank(integral_constant<SortParameter, SortParameter::FRAMERATE>()); break;
+        case SortParameter::CODECS: rank(integral_constant<SortParameter, SortParameter::CODECS>()); break;
+        case SortParameter::CHANNELS: rank(integral_constant<SortParameter, SortParameter::CHANNELS>()); break;
+        case SortParameter::AUDIO_LANGUAGE: rank(integral_constant<SortParameter, SortParameter::AUDIO_LANGUAGE>()); break;
+        case SortParameter::VIDEORANGE: rank(integral_constant<SortParameter, SortParameter::VIDEORANGE>()); break;
+        default: throw logic_error("Unknown sort parameter");
+    }
 }
 
-ostream& operator << (ostream& os, const HLSMasterPlaylist::Resolution& resolution)
+// Moves the items that belong at positions [first, last) of the sorted order there,
+// sorted, and leaves the others in no particular order. A partial sort keeps a heap
+// as large as the range, which beats selecting the range and then sorting it only
+// while the range is a small part of the items it is chosen from
+template <typename Item>
+static void SelectRange(Item* items, size_t count, size_t first, size_t last)
 {
-    os << resolution.width << "x" << resolution.height;
-    return os;
+    if (first > 0)
+    {
+        nth_element(items, items + first, items + count);
+    }
+
+    if ((last - first) * 8 <= count - first)
+    {
+        partial_sort(items + first, items + last, items + count);
+        return;
+    }
+
+    if (last < count)
+    {
+        nth_element(items + first, items + last, items + count);
+    }
+
+    sort(items + first, items + last);
 }
 
-ostream& operator << (ostream& os, const HLSMasterPlaylist::StreamInfo& streamInfo)
+vector<uint32_t> HLSMasterPlaylist::GetStreamRange(StreamType type, SortParameter sortParam, bool isAscending,
+    size_t first, size_t last) const
 {
-    os << (streamInfo.type == StreamType::IFRAME ? "#EXT-X-I-FRAME-STREAM-INF:" : "#EXT-X-STREAM-INF:") <<
-        "BANDWIDTH=" << streamInfo.bandwidth;
+    const StreamColumns& streams = GetStreamColumns(type);
+    last = min(last, streams.size());
+
+    vector<uint32_t> result;
+    if (first >= last)
+    {
+        return result;
+    }
 
-    if (streamInfo.avgBandwidth > 0) os << ",AVG-BANDWIDTH=" << streamInfo.avgBandwidth;
+    result.reserve(last - first);
 
-    os << ",CODECS=\"" << streamInfo.codecs << "\"";
+    if (sortParam == SortParameter::DEFAULT)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            result.push_back(static_cast<uint32_t>(i));
+        }
+        return result;
+    }
+
+    // An order that has been fully sorted already holds the answer
+    size_t slot = SortIndexSlot(sortParam, isAscending);
+    if (m_isSortIndexBuilt[slot].load(memory_order_acquire))
+    {
+        const SortIndex& index = m_sortIndexes[slot];
+        const pmr::vector<uint32_t>& order = type == StreamType::IFRAME ? index.iStreams : index.streams;
+        result.assign(order.begin() + first, order.begin() + last);
+        return result;
+    }
 
-    if (streamInfo.resolution.width > 0) os << ",RESOLUTION=" << streamInfo.resolution;
-    if (streamInfo.frameRate > 0) os << ",FRAME-RATE=" << streamInfo.frameRate;
-    if (streamInfo.videoRange != "") os << ",VIDEO-RANGE=" << streamInfo.videoRange;
-    if (streamInfo.audio) os << ",AUDIO=\"" << streamInfo.audio->id << "\"";
-    if (streamInfo.video) os << ",VIDEO=\"" << streamInfo.video->id << "\"";
-    if (streamInfo.closedCaptions) os << ",CLOSED-CAPTIONS=\"" << streamInfo.closedCaptions->id << "\"";
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
 
-    // Put the URI on a new line if the stream type is media to match formatting of a regular
-    // HLS playlist
-    streamInfo.type == StreamType::IFRAME ? (os << ",URI=\"" << streamInfo.uri << "\"") : (os << "\n" << streamInfo.uri);
+    // Parse order breaks ties between equal keys, as the stable full sort does
+    vector<RankedStream> ranked;
+    RankStreams(streams, sortParam, isAscending, ranked);
+    SelectRange(ranked.data(), ranked.size(), first, last);
 
-    return os;
+    for (size_t i = first; i < last; i++)
+    {
+        result.push_back(ranked[i].index);
+    }
+
+    if (m_metrics)
+    {
+        m_metrics->AddSortNs(HLSParseMetrics::Now() - start);
+    }
+
+    return result;
 }
 
-ostream& operator << (ostream& os, const HLSMasterPlaylist& playlist)
+HLSMasterPlaylist::StreamGroups HLSMasterPlaylist::GetTopStreamsByGroup(StreamType type, GroupParameter group,
+    SortParameter sortParam, bool isAscending, size_t countPerGroup) const
 {
-    // Output the info in the following way:
-    //  1: output any global tags present
-    //  2: output all media types in sorted order
-    //  3. output all i-streams in sorted order
-    //  4. Output all regular streams in sorted order
+    if (group != GroupParameter::CODEC_FAMILY && group != GroupParameter::VIDEORANGE)
+    {
+        throw logic_error("Unknown group parameter");
+    }
+
+    const StreamColumns& streams = GetStreamColumns(type);
+    StreamGroups result;
+
+    // Number the groups in the order their first stream appears. Keys are codec
+    // families, or video range symbols offset by one so the empty range is 0
+    vector<uint32_t> groupOf(streams.size());
+    vector<uint32_t> groupSizes;
+    unordered_map<uint32_t, uint32_t> groupIds;
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        CodecFamily family = streams.codecInfos[i].video.family;
+        HLSSymbol videoRange = streams.videoRanges[i];
+        uint32_t key = group == GroupParameter::CODEC_FAMILY ? static_cast<uint32_t>(family) :
+            (videoRange.empty() ? 0 : videoRange.Id() + 1);
+
+        auto found = groupIds.try_emplace(key, static_cast<uint32_t>(result.groups.size()));
+        if (found.second)
+        {
+            StreamGroup streamGroup;
+            if (group == GroupParameter::CODEC_FAMILY)
+            {
+                streamGroup.family = family;
+            }
+            else
+            {
+                streamGroup.videoRange = videoRange;
+            }
+
+            result.groups.push_back(streamGroup);
+            groupSizes.push_back(0);
+        }
+
+        groupOf[i] = found.first->second;
+        groupSizes[groupOf[i]]++;
+    }
+
+    // An order that has been fully sorted already lists each group's streams best
+    // first, so the first ones met are the answer
+    const SortIndex* index = nullptr;
+    if (sortParam != SortParameter::DEFAULT)
+    {
+        size_t slot = SortIndexSlot(sortParam, isAscending);
+        if (m_isSortIndexBuilt[slot].load(memory_order_acquire))
+        {
+            index = &m_sortIndexes[slot];
+        }
+    }
 
-    os << "Sorting order: " << SortTypeToString(HLSMasterPlaylist::s_sortParam) << "\n";
+    // Each group's share of result.streams
+    uint32_t offset = 0;
+    for (size_t g = 0; g < result.groups.size(); g++)
+    {
+        uint32_t count = static_cast<uint32_t>(min<size_t>(countPerGroup, groupSizes[g]));
+        result.groups[g].begin = offset;
+        result.groups[g].end = offset;
+        offset += count;
+    }
+    result.streams.resize(offset);
 
-    // Currently the only supported global tag is INDEPENDENT_SEGMENTS
-    os << (playlist.m_independentSegments ? "#EXT-X-INDEPENDENT-SEGMENTS\n\n" : "\n");
+    if (index)
+    {
+        const pmr::vector<uint32_t>& order = type == StreamType::IFRAME ? index->iStreams : index->streams;
+        for (uint32_t stream : order)
+        {
+            StreamGroup& streamGroup = result.groups[groupOf[stream]];
+            if (streamGroup.end - streamGroup.begin < countPerGroup)
+            {
+                result.streams[streamGroup.end++] = stream;
+            }
+        }
+        return result;
+    }
 
-    os << "Media Types:\n";
-    for (const auto& mediaTag : playlist.m_sortedMediaTypes)
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+
+    // Rank every stream, then lay the ranks out group by group and select within each
+    vector<RankedStream> ranked;
+    if (sortParam == SortParameter::DEFAULT)
     {
-        os << mediaTag << "\n";
+        ranked.resize(streams.size());
+        for (size_t i = 0; i < streams.size(); i++)
+        {
+            ranked[i] = { 0, static_cast<uint32_t>(i) };
+        }
+    }
+    else
+    {
+        RankStreams(streams, sortParam, isAscending, ranked);
     }
 
-    os << "\nI-Frame Streams:\n";
-    for (const auto& stream : playlist.m_iStreams)
+    vector<uint32_t> groupStarts(result.groups.size() + 1, 0);
+    for (size_t g = 0; g < result.groups.size(); g++)
     {
-        os << stream << "\n";
+        groupStarts[g + 1] = groupStarts[g] + groupSizes[g];
     }
 
-    os << "\nMedia Streams:\n";
-    for (const auto& stream : playlist.m_streams)
+    vector<RankedStream> grouped(ranked.size());
+    vector<uint32_t> positions(groupStarts.begin(), groupStarts.end() - 1);
+    for (const RankedStream& stream : ranked)
     {
-        os << stream << "\n";
+        grouped[positions[groupOf[stream.index]]++] = stream;
     }
 
-    return os;
+    for (size_t g = 0; g < result.groups.size(); g++)
+    {
+        StreamGroup& streamGroup = result.groups[g];
+        size_t size = groupSizes[g];
+        size_t count = min(countPerGroup, size);
+        RankedStream* items = grouped.data() + groupStarts[g];
+
+        SelectRange(items, size, 0, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            result.streams[streamGroup.end++] = items[i].index;
+        }
+    }
+
+    if (m_metrics)
+    {
+        m_metrics->AddSortNs(HLSParseMetrics::Now() - start);
+    }
+
+    return result;
+}
+
+void HLSMasterPlaylist::Sort(SortParameter sortParam, bool isAscending)
+{
+    // Make sure the order is available (and valid) up front, so printing never has to sort
+    GetSortIndex(sortParam, isAscending);
+
+    m_sortParam = sortParam;
+    m_isAscendingSort = isAscending;
+}
+
+// The stream operators are thin wrappers over HLSSerializer, which formats the whole
+// item into one buffer so that the stream sees a single write
+
+ostream& operator << (ostream& os, const HLSMasterPlaylist::MediaTag& mediaTag)
+{
+    string buffer;
+    HLSSerializer(buffer).Write(mediaTag);
+    return os.write(buffer.data(), buffer.size());
+}
+
+ostream& operator << (ostream& os, const HLSMasterPlaylist::Resolution& resolution)
+{
+    string buffer;
+    HLSSerializer(buffer).Write(resolution);
+    return os.write(buffer.data(), buffer.size());
+}
+
+ostream& operator << (ostream& os, const HLSMasterPlaylist::StreamInfo& streamInfo)
+{
+    string buffer;
+    HLSSerializer(buffer).Write(streamInfo);
+    return os.write(buffer.data(), buffer.size());
+}
+
+ostream& operator << (ostream& os, const HLSMasterPlaylist& playlist)
+{
+    string buffer;
+    HLSSerializer(buffer).Write(playlist);
+    return os.write(buffer.data(), buffer.size());
 }
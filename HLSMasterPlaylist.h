@@ -1,8 +1,21 @@
 #pragma once
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <functional>
+#include <memory>
+#include <memory_resource>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include "HLSCodecs.h"
+#include "HLSDiagnostics.h"
+#include "HLSLineReader.h"
+#include "HLSSortedView.h"
+#include "HLSStructuralIndex.h"
+#include "HLSSymbolTable.h"
+#include "HLSThreadPool.h"
 
 using namespace std;
 
@@ -33,57 +46,89 @@ enum class SortParameter
     DEFAULT
 };
 
+// What the streams of a grouped top-K query are grouped by
+enum class GroupParameter
+{
+    CODEC_FAMILY = 0,
+    VIDEORANGE
+};
+
+constexpr const char* MediaTypeToString(MediaType t)
+{
+    switch (t)
+    {
+        case MediaType::AUDIO: return "AUDIO";
+        case MediaType::VIDEO: return "VIDEO";
+        case MediaType::SUBTITLES: return "SUBTITLES";
+        case MediaType::CLOSED_CAPTIONS: return "CLOSED-CAPTIONS";
+        default: throw invalid_argument("Unimplemented item");
+    }
+}
+
+constexpr const char* SortTypeToString(SortParameter t)
+{
+    switch (t)
+    {
+        case SortParameter::DEFAULT: return "DEFAULT"; 
+        case SortParameter::BANDWIDTH: return "BANDWIDTH";
+        case SortParameter::VIDEORANGE: return "VIDEORANGE";
+        case SortParameter::AVG_BANDWIDTH: return "AVG_BANDWIDTH";
+        case SortParameter::RESOLUTION: return "RESOLUTION";
+        case SortParameter::CODECS: return "CODECS";
+        case SortParameter::FRAMERATE: return "FRAMERATE";
+        case SortParameter::CHANNELS: return "CHANNELS";
+        case SortParameter::AUDIO_LANGUAGE: return "AUDIO_LANGUAGE";
+        default: throw invalid_argument("Unimplemented item");
+    }
+}
+
 class HLSMasterPlaylist
 {
 public:
+    // Strings and containers owned by a playlist are allocated from its memory resource.
+    // MediaTag and StreamInfo are allocator-aware, so containers constructed with the
+    // playlist's allocator pass it down to every string inside them
+    typedef pmr::polymorphic_allocator<char> allocator_type;
+
     struct MediaTag
     {
-        string id;
-        MediaType type;
-        string uri;
-        string name;
-        string language;
+        typedef HLSMasterPlaylist::allocator_type allocator_type;
+
+        // Group IDs, languages and channel layouts repeat across playlists, so
+        // they are interned in the playlist's symbol table
+        HLSSymbol id;
+        MediaType type = MediaType::AUDIO;
+        pmr::string uri;
+        pmr::string name;
+        HLSSymbol language;
         bool isDefault = false;
         bool autoSelect = false;
 
         // Some compressed audio formats use string specifiers
         // for special channel information
-        string channels;
+        HLSSymbol channels;
 
         // Not including CHARACTERISTICS or 
         // INSTREAM-ID parts due to scope
 
-        bool operator < (const MediaTag& other) const
-        {
-            // Only support sorting on audio media types for now
-            if (type != MediaType::AUDIO || other.type != MediaType::AUDIO)
-            {
-                return true;
-            }
+        MediaTag() = default;
+        MediaTag(const MediaTag&) = default;
+        MediaTag(MediaTag&&) = default;
+        MediaTag& operator = (const MediaTag&) = default;
+        MediaTag& operator = (MediaTag&&) = default;
 
-            switch (HLSMasterPlaylist::s_sortParam)
-            {
-                case SortParameter::DEFAULT:
-                    // If a sorting parameter hasn't been defined, we cannot sort
-                    throw logic_error("Cannot sort with no sorting method");
-
-                case SortParameter::CHANNELS:
-                    // For audio channel formats, we assume compressed formats will
-                    // have longer lengths due to specifiers, and PCM formats will
-                    // have just a channel count
-                    if (channels.length() == other.channels.length())
-                    {
-                        return channels < other.channels;
-                    }
-                    return channels.length() < other.channels.length();
-
-                case SortParameter::AUDIO_LANGUAGE:
-                    return language < other.language;
-                default:
-                    // use default sorting by ID when other sorting methods are used
-                    return id < other.id;
-            }
-        }
+        explicit MediaTag(const allocator_type& alloc) :
+            uri(alloc), name(alloc) {}
+
+        MediaTag(const MediaTag& other, const allocator_type& alloc) :
+            id(other.id), type(other.type), uri(other.uri, alloc), name(other.name, alloc),
+            language(other.language), isDefault(other.isDefault), autoSelect(other.autoSelect),
+            channels(other.channels) {}
+
+        MediaTag(MediaTag&& other, const allocator_type& alloc) :
+            id(other.id), type(other.type), uri(move(other.uri), alloc), name(move(other.name), alloc),
+            language(other.language), isDefault(other.isDefault), autoSelect(other.autoSelect),
+            channels(other.channels) {}
 
         friend ostream& operator << (ostream& os, const HLSMasterPlaylist::MediaTag& mediaTag);
     };
@@ -102,118 +147,444 @@ public:
         friend ostream& operator << (ostream& os, const HLSMasterPlaylist::Resolution& resolution);
     };
 
+    // A variant stream or i-frame stream. Streams are stored column by column rather
+    // than as one object each, and a StreamInfo is assembled from the columns when a
+    // stream is read, as the segments of a media playlist are. Its URI and media tags
+    // belong to the playlist, and are valid until it is parsed again or destroyed
     struct StreamInfo
     {
-        StreamType type;
+        StreamType type = StreamType::MEDIA;
         long bandwidth = 0;
         long avgBandwidth = 0;
 
-        // TODO: quantify codecs into a struct/class or enum
-        string codecs;
+        // The CODECS attribute as written, and its parsed form used for ranking and filtering
+        HLSSymbol codecs;
+        CodecList codecInfo;
+
+        // The rendition group of each kind the stream uses. nullptr when the stream
+        // names none, or names a group the playlist does not have
+        const MediaTag* audio = nullptr;
+        const MediaTag* video = nullptr;
+        const MediaTag* subtitles = nullptr;
+        const MediaTag* closedCaptions = nullptr;
 
-        MediaTag* audio = nullptr;
-        MediaTag* video = nullptr;
-        MediaTag* closedCaptions = nullptr;
         Resolution resolution;
-        string uri;
+        string_view uri;
         float frameRate = 0;
 
-        // TODO: Create better mechanism for handling video ranges
-        string videoRange;
+        HLSSymbol videoRange;
 
-        // Override the < operator so that we can use sort functions
-        // based on our sort parameter
-        bool operator < (const StreamInfo& other) const
+        friend ostream& operator << (ostream& os, const HLSMasterPlaylist::StreamInfo& streamInfo);
+    };
+
+    // Marks a stream that uses no group of some kind
+    static constexpr uint32_t NoGroup = UINT32_MAX;
+
+    // Streams or i-frame streams, one column per field, in parse order. Sorts, filters
+    // and the variant selector scan the dense numeric columns and never touch strings
+    struct StreamColumns
+    {
+        explicit StreamColumns(const allocator_type& alloc) :
+            bandwidths(alloc), avgBandwidths(alloc), widths(alloc), heights(alloc), frameRates(alloc),
+            audioGroups(alloc), videoGroups(alloc), subtitleGroups(alloc), closedCaptionGroups(alloc),
+            codecs(alloc), codecInfos(alloc), videoRanges(alloc), uriEnds(alloc), uris(alloc) {}
+
+        size_t size() const { return bandwidths.size(); }
+
+        // Makes room for count streams with URIs of uriLength characters in all
+        void reserve(size_t count, size_t uriLength);
+
+        pmr::vector<long> bandwidths;
+        pmr::vector<long> avgBandwidths;
+        pmr::vector<int> widths;
+        pmr::vector<int> heights;
+        pmr::vector<float> frameRates;
+
+        // Group handles: indexes of media tags in parse order, or NoGroup. A stream may
+        // name a group before the group's tag appears, so handles are only filled in
+        // once the whole playlist has been read
+        pmr::vector<uint32_t> audioGroups;
+        pmr::vector<uint32_t> videoGroups;
+        pmr::vector<uint32_t> subtitleGroups;
+        pmr::vector<uint32_t> closedCaptionGroups;
+
+        pmr::vector<HLSSymbol> codecs;
+        pmr::vector<CodecList> codecInfos;
+        pmr::vector<HLSSymbol> videoRanges;
+
+        // Every URI end to end in one string heap. uriEnds[i] is where stream i's URI
+        // ends, and the one before it ends where it starts
+        pmr::vector<uint32_t> uriEnds;
+        pmr::string uris;
+    };
+
+    // Streams or i-frame streams in some order. Like SortedView it refers to the
+    // playlist without copying anything, but it yields each stream by value,
+    // assembled from the columns as it is read
+    class StreamView
+    {
+    public:
+        // Streams are assembled as they are read, so there is no reference to return
+        // and the iterator is only an input iterator
+        class Iterator
+        {
+        public:
+            typedef input_iterator_tag iterator_category;
+            typedef StreamInfo value_type;
+            typedef ptrdiff_t difference_type;
+            typedef void pointer;
+            typedef StreamInfo reference;
+
+            Iterator(const StreamView* view, size_t pos) : m_view(view), m_pos(pos) {}
+
+            StreamInfo operator * () const { return (*m_view)[m_pos]; }
+            Iterator& operator ++ () { m_pos++; return *this; }
+            Iterator operator ++ (int) { Iterator old = *this; m_pos++; return old; }
+            bool operator == (const Iterator& other) const { return m_pos == other.m_pos; }
+            bool operator != (const Iterator& other) const { return m_pos != other.m_pos; }
+
+        private:
+            const StreamView* m_view;
+            size_t m_pos;
+        };
+
+        StreamView(const HLSMasterPlaylist* playlist, StreamType type, const uint32_t* order) :
+            m_playlist(playlist), m_type(type), m_order(order) {}
+
+        size_t size() const { return m_playlist->GetStreamColumns(m_type).size(); }
+        bool empty() const { return size() == 0; }
+
+        StreamInfo operator [] (size_t pos) const { return m_playlist->AssembleStream(m_type, Index(pos)); }
+
+        // Parse order position of the stream at pos, which indexes the columns
+        size_t Index(size_t pos) const { return m_order ? m_order[pos] : pos; }
+
+        Iterator begin() const { return Iterator(this, 0); }
+        Iterator end() const { return Iterator(this, size()); }
+
+    private:
+        const HLSMasterPlaylist* m_playlist;
+        StreamType m_type;
+        const uint32_t* m_order;
+    };
+
+    // Comparator for media tags under a given sort parameter. The parameter is a template
+    // argument so that each ordering is compiled on its own, without a switch on every
+    // comparison and without any state shared between playlists
+    template <SortParameter Param>
+    struct MediaTagOrder
+    {
+        bool operator () (const MediaTag& tag, const MediaTag& other) const
         {
-            switch (HLSMasterPlaylist::s_sortParam)
+            static_assert(Param != SortParameter::DEFAULT, "Cannot sort with no sorting method");
+
+            // Only support sorting on audio media types for now. Audio tags come first,
+            // and all other tags follow ordered by type and ID
+            bool isAudio = tag.type == MediaType::AUDIO;
+            bool isOtherAudio = other.type == MediaType::AUDIO;
+
+            if (!isAudio || !isOtherAudio)
             {
-                case SortParameter::DEFAULT:
-                    // If a sorting parameter hasn't been defined, we cannot sort
-                    throw logic_error("Cannot sort with no sorting method");
-
-                case SortParameter::AUDIO_LANGUAGE:
-                case SortParameter::CHANNELS:
-                    // Just return which language is alphabetically.
-                    // If one stream does not have a language, the stream with
-                    // a language will come first
-                    if (!other.audio || (!audio && !other.audio))
-                    {
-                        return true;
-                    }
-                    else if (!audio)
-                    {
-                        return false;
-                    }
-
-                    return *audio < *(other.audio);
-
-                case SortParameter::BANDWIDTH:
-                    return bandwidth < other.bandwidth;
-
-                case SortParameter::AVG_BANDWIDTH:
-                    return avgBandwidth < other.avgBandwidth;
-
-                case SortParameter::RESOLUTION:
-                    return resolution < other.resolution;
-
-                case SortParameter::CODECS:
-                    // TODO: Sort codecs based on their profiles and complexity.
-                    // For simplicity, we will sort them alphabetically for now
-                    return codecs < other.codecs;
-
-                case SortParameter::FRAMERATE:
-                    return frameRate < other.frameRate;
-
-                case SortParameter::VIDEORANGE:
-                    // For now, just return which video range comes first alphabetically
-                    return videoRange < other.videoRange;
-                default:
-                    throw logic_error("Unknown sort parameter");
+                if (isAudio != isOtherAudio)
+                {
+                    return isAudio;
+                }
+
+                if (tag.type != other.type)
+                {
+                    return tag.type < other.type;
+                }
+
+                return tag.id < other.id;
             }
-        }
 
-        friend ostream& operator << (ostream& os, const HLSMasterPlaylist::StreamInfo& streamInfo);
+            if constexpr (Param == SortParameter::CHANNELS)
+            {
+                // For audio channel formats, we assume compressed formats will
+                // have longer lengths due to specifiers, and PCM formats will
+                // have just a channel count
+                if (tag.channels.View().length() == other.channels.View().length())
+                {
+                    return tag.channels < other.channels;
+                }
+                return tag.channels.View().length() < other.channels.View().length();
+            }
+            else if constexpr (Param == SortParameter::AUDIO_LANGUAGE)
+            {
+                return tag.language < other.language;
+            }
+            else
+            {
+                // use default sorting by ID when other sorting methods are used
+                return tag.id < other.id;
+            }
+        }
     };
 
 private:
-    // Function map to process tags
-    typedef void(HLSMasterPlaylist::*ParseHandler)(stringstream& playlist, string& tag);
-    
-    // Function and type maps for call direction
-    static const unordered_map<string, ParseHandler> s_tagProcessor;
-    static const unordered_map<string, MediaType> s_mediaTypes;
-    
-    // Media tags vector must be declared before streams. The default destructor will destroy
-    // all streams first, which have a pointer reference into the corresponding media tags
-    unordered_map<string, MediaTag> m_mediaTags;
+    // One stream's fields while its tag is parsed. Groups are the symbol IDs of the
+    // group names until they are resolved, and the URI of an i-frame stream points
+    // into the tag
+    struct StreamRow
+    {
+        StreamType type = StreamType::MEDIA;
+        long bandwidth = 0;
+        long avgBandwidth = 0;
+        HLSSymbol codecs;
+        CodecList codecInfo;
+        Resolution resolution;
+        float frameRate = 0;
+        HLSSymbol videoRange;
+        uint32_t audioGroup = NoGroup;
+        uint32_t videoGroup = NoGroup;
+        uint32_t subtitleGroup = NoGroup;
+        uint32_t closedCaptionGroup = NoGroup;
+        string_view uri;
+    };
 
-    // Sortable lists of streams and media types
-    vector<StreamInfo> m_streams;
-    vector<StreamInfo> m_iStreams;
-    vector<MediaTag> m_sortedMediaTypes;
+    // Smallest piece of a playlist parsed on a thread of its own
+    static constexpr size_t MinParallelChunkSize = 64 * 1024;
+
+    // Interned attribute values of this playlist live here
+    shared_ptr<HLSSymbolTable> m_symbols;
+
+    // The arena used when the caller does not supply a memory resource. It is declared
+    // ahead of everything allocated from it, so that it is destroyed last
+    static constexpr size_t ArenaInitialSize = 16 * 1024;
+    HLSCountingResource m_arenaUpstream;
+    unique_ptr<pmr::monotonic_buffer_resource> m_arena;
+    allocator_type m_allocator;
+
+    // Media tags, one per rendition group, in the order their groups first appeared.
+    // A later tag for the same group replaces an earlier one. Groups are found by
+    // type and ID, packed by GroupKey
+    pmr::vector<MediaTag> m_mediaTags;
+    pmr::unordered_map<uint64_t, uint32_t> m_groupIndexes;
+
+    // Streams in the order they were parsed. These are never reordered; sorted orders
+    // are presented through the sort indexes below
+    StreamColumns m_streams;
+    StreamColumns m_iStreams;
+
+    // Permutations of the lists above for one sort parameter and direction. Each one
+    // is built the first time that order is asked for, and kept until the next parse
+    struct SortIndex
+    {
+        explicit SortIndex(const allocator_type& alloc) : streams(alloc), iStreams(alloc), mediaTags(alloc) {}
+
+        pmr::vector<uint32_t> streams;
+        pmr::vector<uint32_t> iStreams;
+        pmr::vector<uint32_t> mediaTags;
+    };
+
+    // One index per sort parameter and direction, ascending first. The table itself
+    // lives outside the arena because it outlives every parse; only the permutations
+    // inside it are allocated from the arena
+    static constexpr size_t SortIndexCount = static_cast<size_t>(SortParameter::DEFAULT) * 2;
+    mutable vector<SortIndex> m_sortIndexes;
+    mutable atomic<bool> m_isSortIndexBuilt[SortIndexCount] = {};
+
+    // Serializes building indexes, so that views can be requested from many threads
+    mutable mutex m_sortIndexLock;
 
     bool m_independentSegments = false;
 
-    // Sort parameter must be static so that comparators can compare the correct
-    // field of a stream or media tag
-    static SortParameter s_sortParam;
-    bool isAscendingSort = true;
+    // The order most recently selected by Sort, which operator << prints in. Each
+    // playlist keeps its own, so different playlists never affect each other
+    SortParameter m_sortParam = SortParameter::DEFAULT;
+    bool m_isAscendingSort = true;
+
+    // State carried between lines so that a playlist can be parsed as it arrives.
+    // A media stream tag is held back until the URI line that follows it is seen,
+    // and any incomplete line at the end of a fed chunk waits for the next chunk
+    bool m_isParsing = false;
+    bool m_isValid = false;
+    bool m_hasPendingStream = false;
+    StreamRow m_pendingStream;
+    pmr::string m_partialLine;
+
+    // Structural index of the buffer being parsed. It takes about half a byte per byte
+    // of text and is only read while lines are, so it lives on the heap rather than in
+    // the arena: its storage is reused from one fed chunk to the next and freed when
+    // the parse ends, leaving a parsed playlist holding none of it
+    HLSStructuralIndex m_structure;
+
+    // Lines passed to ParseLine so far, which numbers the line being parsed
+    uint32_t m_lineNumber = 0;
+
+    mutable HLSDiagnostics m_diagnostics;
+
+    // Instrumentation is off while m_metrics is null. The counts of the parse in
+    // progress are added to it when the parse ends
+    HLSParseMetrics* m_metrics = nullptr;
+    HLSParseMetrics::Counts m_parseCounts;
 
 public:
-    // Parses an HLS playlist stored in a string stream into its media types,
+    // Every string and container of the parsed playlist is allocated from resource. When
+    // no resource is given, the playlist uses its own monotonic arena: parsing takes a
+    // handful of block allocations, and a re-parse or destruction frees it all at once.
+    // A supplied resource must outlive the playlist, and must be thread-safe if it is
+    // shared with playlists on other threads. Repeating attribute values are interned
+    // in symbols, or in the global symbol table when none is given
+    explicit HLSMasterPlaylist(pmr::memory_resource* resource = nullptr, shared_ptr<HLSSymbolTable> symbols = nullptr);
+    HLSMasterPlaylist(const HLSMasterPlaylist&) = delete;
+    HLSMasterPlaylist& operator = (const HLSMasterPlaylist&) = delete;
+
+    // Parses an HLS playlist stored in a buffer into its media types,
     // streams, and i-streams. Once the playlist is parsed, it is auto sorted
     // by the currently selected sorting parameter. Calling this function multiple
     // times will clear the current built playlist
+    void ParseMasterPlaylist(string_view playlist);
+    void ParseMasterPlaylist(const char* data, size_t length) { ParseMasterPlaylist(string_view(data, length)); }
+
+    // Convenience wrapper for playlists that have been buffered in a string stream. The
+    // buffer is copied once and the copy is parsed
     void ParseMasterPlaylist(stringstream& playlist);
 
-    // Updates the sorting parameter used and re-sorts the playlist parameters
+    // Parses a large playlist on the pool's threads and the calling thread. The text is
+    // split into one chunk per pool thread, on line boundaries that never part a stream
+    // tag from its URI, and the chunks are parsed at once and merged in order. The
+    // result, diagnostics and exceptions included, is that of the serial parse.
+    // Playlists too small to be worth splitting are parsed serially. The calling
+    // thread runs pending pool tasks while it waits, so this may be called from a
+    // task running on the same pool
+    void ParseMasterPlaylist(string_view playlist, HLSThreadPool& pool);
+
+    // Incremental parsing for playlists that arrive in pieces, such as network reads.
+    // Chunks may split lines anywhere. The first call to Feed after construction or
+    // after Finish clears the current built playlist, and Finish completes the parse
+    // and sorts the result exactly as ParseMasterPlaylist does
+    void Feed(const char* data, size_t length);
+    void Finish();
+
+    // Updates the sorting parameter used for printing the playlist. The order is
+    // looked up in (or added to) the sort index cache, so switching back and
+    // forth between orders does not re-sort anything
     void Sort(SortParameter param, bool isAscending);
+    SortParameter GetSortParameter() const { return m_sortParam; }
+    bool IsAscendingSort() const { return m_isAscendingSort; }
+
+    bool HasIndependentSegments() const { return m_independentSegments; }
+
+    typedef SortedView<MediaTag> MediaTagView;
+
+    // Views of the playlist in any order, independent of the order selected by Sort.
+    // The first request for an order builds its index; later requests just return
+    // a view over it. DEFAULT presents everything in parse order. These may be called
+    // concurrently, but not while the playlist is being parsed
+    StreamView GetStreams(SortParameter param, bool isAscending) const;
+    StreamView GetIStreams(SortParameter param, bool isAscending) const;
+    MediaTagView GetMediaTags(SortParameter param, bool isAscending) const;
+
+    // Streams and i-frame streams by their position in parse order. Throw out_of_range
+    StreamInfo GetStream(size_t index) const;
+    StreamInfo GetIStream(size_t index) const;
+
+    // Partial order queries. GetStreamRange returns the parse order indexes of the
+    // streams (or i-frame streams) at positions [first, last) of the order GetStreams
+    // presents, ties included, and GetTopStreams the first count of them. They select
+    // those streams from a key column instead of sorting everything, and read an
+    // order's index instead when it has already been built. Neither changes the
+    // playlist, so any number may run at once, but not while the playlist is parsed.
+    // Positions past the end are left out
+    vector<uint32_t> GetStreamRange(StreamType type, SortParameter param, bool isAscending, size_t first, size_t last) const;
+    vector<uint32_t> GetTopStreams(StreamType type, SortParameter param, bool isAscending, size_t count) const
+    {
+        return GetStreamRange(type, param, isAscending, 0, count);
+    }
+
+    // Streams sharing the family of their video codec, or their video range. Streams
+    // without a recognized video codec are grouped under CodecFamily::UNKNOWN
+    struct StreamGroup
+    {
+        CodecFamily family = CodecFamily::UNKNOWN;
+        HLSSymbol videoRange;
+
+        // The group's best streams, best first, lie in [begin, end) of StreamGroups::streams
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    struct StreamGroups
+    {
+        // In the order each group's first stream was parsed
+        vector<StreamGroup> groups;
+        vector<uint32_t> streams;
+    };
+
+    // Grouped top-K: the first countPerGroup streams of each group under the order
+    // GetStreams presents, as parse order indexes. Like GetStreamRange it may run
+    // concurrently with other queries
+    StreamGroups GetTopStreamsByGroup(StreamType type, GroupParameter group, SortParameter param, bool isAscending,
+        size_t countPerGroup) const;
+
+    // The columns of the streams (StreamType::MEDIA) or i-frame streams, for scanning
+    // without assembling every stream
+    const StreamColumns& GetStreamColumns(StreamType type) const { return type == StreamType::IFRAME ? m_iStreams : m_streams; }
+
+    // The media tag a group handle refers to, or nullptr for NoGroup
+    const MediaTag* GetGroup(uint32_t handle) const { return handle == NoGroup ? nullptr : &m_mediaTags[handle]; }
     
+    // Unknown tags and attributes met by the parser, with their line numbers. They
+    // may be read while a parse is in progress, by one thread at a time
+    HLSDiagnostics& GetDiagnostics() const { return m_diagnostics; }
+
+    // Adds the counts and timings of this playlist's parses, sorts and serializations
+    // to metrics, which must outlive the playlist. nullptr, the default, turns
+    // instrumentation off. Takes effect from the next parse
+    void SetMetrics(HLSParseMetrics* metrics) { m_metrics = metrics; }
+    HLSParseMetrics* GetMetrics() const { return m_metrics; }
+
     friend ostream& operator << (ostream& os, const HLSMasterPlaylist& playlist);
 
 private:
-    void ParseMediaTag(stringstream& playlist, string& tag);
-    void ParseStreamInfo(stringstream& playlist, string& tag);
-    void ParseIStream(stringstream& playlist, string& tag);
-    void BaseParseStreamInfo(stringstream& playlist, string& tag, StreamType type);
+    void BeginParse();
+    void ResetStorage();
+    // Structure holds the line's structural positions when it was indexed
+    void ParseLine(string_view line, const HLSStructureCursor& structure = HLSStructureCursor());
+    void EndParse();
+
+    void ParseMediaTag(string_view tag, const HLSStructureCursor& structure);
+    void ParseStreamInfo(string_view tag, const HLSStructureCursor& structure);
+    void ParseIStream(string_view tag, const HLSStructureCursor& structure);
+    void BaseParseStreamInfo(string_view tag, const HLSStructureCursor& structure, StreamType type);
+    void AddMediaTag(MediaTag&& mediaTag);
+    void AddStream(const StreamRow& row, string_view uri);
+
+    // Parallel parsing. A chunk is parsed into a playlist of its own, short of
+    // resolving groups and sorting, and then merged into this one. lineOffset is the
+    // number of lines before the chunk
+    static size_t FindChunkStart(string_view text, size_t pos);
+    void ParseChunk(string_view text);
+    void MergeChunk(HLSMasterPlaylist& chunk, uint32_t lineOffset);
+
+    // Turns the group names streams refer to into handles, once every group is known
+    void ResolveGroups(StreamColumns& columns) const;
+
+    StreamInfo AssembleStream(StreamType type, size_t index) const;
+
+    // Position of an order in m_sortIndexes. Throws for DEFAULT and unknown parameters
+    static size_t SortIndexSlot(SortParameter param, bool isAscending);
+
+    // Returns the index for an order, building it first if needed. DEFAULT has no index
+    const SortIndex* GetSortIndex(SortParameter param, bool isAscending) const;
+
+    template <SortParameter Param>
+    void BuildSortIndex(SortIndex& index, bool isAscending) const;
+
+    // A stream's sort key under some order, and its parse order index to break ties
+    struct RankedStream
+    {
+        uint64_t key;
+        uint32_t index;
+
+        bool operator < (const RankedStream& other) const { return key != other.key ? key < other.key : index < other.index; }
+    };
+
+    // Fills ranked with every stream's key under a sort parameter other than DEFAULT,
+    // complemented for descending orders, in parse order
+    void RankStreams(const StreamColumns& streams, SortParameter param, bool isAscending, vector<RankedStream>& ranked) const;
+
+    // Packs a group's type and the symbol ID of its name, or NoGroup when it has none
+    static uint64_t GroupKey(MediaType type, uint32_t id) { return ((uint64_t(id) + 1) << 2) | uint64_t(type); }
 };
\ No newline at end of file
@@ -0,0 +1,948 @@
+#include "HLSMediaPlaylist.h"
+#include "HLSAttributeList.h"
+#include "HLSHash.h"
+#include "HLSKeywords.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Parses "<length>[@<offset>]". Without an offset the range starts where the
+// previous one ended
+static HLSMediaPlaylist::ByteRange ParseByteRange(string_view val, uint64_t nextOffset)
+{
+    HLSMediaPlaylist::ByteRange range;
+    size_t at = val.find('@');
+
+    range.length = ParseNumber<uint64_t>(val.substr(0, at));
+    range.offset = at == string_view::npos ? nextOffset : ParseNumber<uint64_t>(val.substr(at + 1));
+    return range;
+}
+
+// Reads count digits at pos, returning false if any of them is not a digit
+static bool ParseDigits(string_view text, size_t pos, size_t count, int& value)
+{
+    if (pos + count > text.length())
+    {
+        return false;
+    }
+
+    value = 0;
+    for (size_t i = pos; i < pos + count; i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+        {
+            return false;
+        }
+
+        value = value * 10 + (text[i] - '0');
+    }
+
+    return true;
+}
+
+// Days from 1970-01-01 to a date in the proleptic Gregorian calendar
+static int64_t DaysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Parses an ISO 8601 date and time such as 2010-02-19T14:54:23.031+08:00 into
+// milliseconds since the Unix epoch. A missing time zone is taken to be UTC
+static bool ParseDateTime(string_view text, int64_t& milliseconds)
+{
+    int year, month, day, hour, minute, second;
+
+    if (text.length() < 19 || !ParseDigits(text, 0, 4, year) || text[4] != '-' || !ParseDigits(text, 5, 2, month) ||
+        text[7] != '-' || !ParseDigits(text, 8, 2, day) || (text[10] != 'T' && text[10] != 't') ||
+        !ParseDigits(text, 11, 2, hour) || text[13] != ':' || !ParseDigits(text, 14, 2, minute) || text[16] != ':' ||
+        !ParseDigits(text, 17, 2, second))
+    {
+        return false;
+    }
+
+    size_t pos = 19;
+    int64_t fraction = 0;
+
+    if (pos < text.length() && text[pos] == '.')
+    {
+        // Only milliseconds are kept
+        int scale = 100;
+        for (pos++; pos < text.length() && text[pos] >= '0' && text[pos] <= '9'; pos++)
+        {
+            fraction += (text[pos] - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    int64_t offsetMinutes = 0;
+
+    if (pos < text.length() && (text[pos] == '+' || text[pos] == '-'))
+    {
+        int offsetHours = 0, offsetMins = 0;
+        if (!ParseDigits(text, pos + 1, 2, offsetHours))
+        {
+            return false;
+        }
+
+        // The minutes may be written as hh:mm, hhmm or left out
+        size_t minutesPos = pos + 3 < text.length() && text[pos + 3] == ':' ? pos + 4 : pos + 3;
+        if (minutesPos < text.length() && !ParseDigits(text, minutesPos, 2, offsetMins))
+        {
+            return false;
+        }
+
+        offsetMinutes = (offsetHours * 60 + offsetMins) * (text[pos] == '-' ? -1 : 1);
+    }
+    else if (pos < text.length() && text[pos] != 'Z' && text[pos] != 'z')
+    {
+        return false;
+    }
+
+    int64_t seconds = DaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offsetMinutes * 60;
+    milliseconds = seconds * 1000 + fraction;
+    return true;
+}
+
+// Whether a line belongs to the header, which comes before the first segment.
+// Comments count as header lines, anything that starts a segment does not
+static bool IsHeaderLine(string_view line)
+{
+    if (line.empty() || (line.front() == '#' && line.substr(0, 4) != "#EXT"))
+    {
+        return true;
+    }
+
+    if (line.front() != '#')
+    {
+        return false;
+    }
+
+    switch (LookupTagName(line.substr(0, line.find(':'))))
+    {
+        case HLSTagName::EXTM3U:
+        case HLSTagName::VERSION:
+        case HLSTagName::INDEPENDENT_SEGMENTS:
+        case HLSTagName::START:
+        case HLSTagName::DEFINE:
+        case HLSTagName::TARGETDURATION:
+        case HLSTagName::MEDIA_SEQUENCE:
+        case HLSTagName::DISCONTINUITY_SEQUENCE:
+        case HLSTagName::PLAYLIST_TYPE:
+        case HLSTagName::I_FRAMES_ONLY:
+        case HLSTagName::PART_INF:
+        case HLSTagName::SERVER_CONTROL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void HLSMediaPlaylist::ParseMediaPlaylist(string_view playlistText)
+{
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+    BeginParse();
+
+    // Index the whole playlist in one pass, then walk the index rather than the text
+    m_structure.Build(playlistText);
+
+    HLSLineReader playlist(m_structure);
+    string_view line;
+
+    while (playlist.Next(line))
+    {
+        ParseLine(line, playlist.LineStructure());
+    }
+
+    if (m_metrics)
+    {
+        m_parseCounts.bytes += playlistText.length();
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
+    }
+
+    EndParse();
+}
+
+void HLSMediaPlaylist::Feed(const char* data, size_t length)
+{
+    // Only the time spent in the parser counts, not the time between chunks
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+
+    if (!m_isParsing)
+    {
+        BeginParse();
+    }
+
+    m_structure.Build(string_view(data, length));
+    HLSStructureCursor chunk(m_structure);
+    size_t pos = 0;
+
+    while (pos < length)
+    {
+        HLSStructureCursor structure;
+        size_t lineEnd = chunk.FindLineEnd(pos, structure);
+
+        if (lineEnd == string_view::npos)
+        {
+            // Keep the unterminated tail of the chunk until the rest of the line arrives
+            m_partialLine.append(data + pos, length - pos);
+            break;
+        }
+
+        string_view line(data + pos, lineEnd - pos);
+
+        // Lines that were split across chunks are parsed from the carried buffer,
+        // which is not indexed. Everything else is parsed in place
+        if (!m_partialLine.empty())
+        {
+            m_partialLine.append(line.data(), line.length());
+            line = m_partialLine;
+            structure = HLSStructureCursor();
+        }
+
+        pos = lineEnd + 1;
+
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+
+        try
+        {
+            ParseLine(line, structure);
+        }
+        catch (...)
+        {
+            // Leave the parser ready to start on a new playlist
+            m_isParsing = false;
+            throw;
+        }
+
+        m_partialLine.clear();
+    }
+
+    if (m_metrics)
+    {
+        m_parseCounts.bytes += length;
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
+    }
+}
+
+void HLSMediaPlaylist::Finish()
+{
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+
+    if (!m_isParsing)
+    {
+        BeginParse();
+    }
+
+    // The final line of a playlist does not need a terminator
+    if (!m_partialLine.empty())
+    {
+        string_view line = m_partialLine;
+
+        if (line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+
+        // Whatever happens, the next call to Feed starts on a new playlist
+        m_isParsing = false;
+        ParseLine(line);
+        m_partialLine.clear();
+    }
+
+    if (m_metrics)
+    {
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
+    }
+
+    EndParse();
+}
+
+bool HLSMediaPlaylist::Refresh(string_view playlistText)
+{
+    // There has to be a complete earlier parse, made the same way, to build on
+    if (!m_isComplete || m_segmentCount == 0 || m_isStreaming != (m_segmentHandler != nullptr))
+    {
+        ParseMediaPlaylist(playlistText);
+        return false;
+    }
+
+    uint64_t start = m_metrics ? HLSParseMetrics::Now() : 0;
+    int64_t firstKnown = m_mediaSequence;
+    int64_t endKnown = m_mediaSequence + int64_t(m_segmentCount);
+
+    // The header is read afresh. Only the lines up to the last known segment are
+    // split, and none of them are indexed
+    ResetHeader();
+    m_pendingSegment = Segment();
+    m_isComplete = false;
+    m_isParsing = true;
+    m_isValid = false;
+    BeginCounts();
+
+    HLSLineReader lines(playlistText);
+    string_view line;
+    bool hasLine;
+
+    while ((hasLine = lines.Next(line)) && IsHeaderLine(line))
+    {
+        ParseLine(line);
+    }
+
+    size_t knownStart = hasLine ? size_t(line.data() - playlistText.data()) : playlistText.length();
+
+    // In a delta update, EXT-X-SKIP stands in for segments the client already has.
+    // It comes before the first listed segment's URI, though not necessarily before
+    // all of its tags, so those lines are looked through without being consumed
+    int64_t skipped = 0;
+    bool isDelta = false;
+    HLSLineReader ahead = lines;
+
+    for (string_view tag = line; hasLine && m_isValid && (tag.empty() || tag.front() == '#'); )
+    {
+        size_t colon = tag.find(':');
+
+        if (LookupTagName(tag.substr(0, colon)) == HLSTagName::SKIP)
+        {
+            isDelta = true;
+            skipped = ParseSkip(colon == string_view::npos ? string_view() : tag.substr(colon + 1));
+            break;
+        }
+
+        if (!ahead.Next(tag))
+        {
+            break;
+        }
+    }
+
+    int64_t dropped = m_mediaSequence - firstKnown;
+    int64_t known = endKnown - (m_mediaSequence + skipped);
+    bool follows = m_isValid && dropped >= 0 && dropped <= int64_t(m_segmentCount) && known >= 0;
+
+    // Walk past the segments that are listed and already known. The last of them
+    // has to be the last segment of the earlier parse, and only its duration is read
+    string_view duration;
+
+    for (; follows && known > 0 && hasLine; hasLine = lines.Next(line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        if (line.front() != '#')
+        {
+            if (--known == 0)
+            {
+                follows = SegmentHash(line, ParseNumber<float>(duration)) == m_lastSegmentHash;
+            }
+        }
+        else if (line.substr(0, 8) == "#EXTINF:")
+        {
+            duration = line.substr(8);
+        }
+    }
+
+    if (!follows || known > 0)
+    {
+        if (isDelta)
+        {
+            m_isParsing = false;
+            throw logic_error("Delta update does not follow the previous playlist");
+        }
+
+        ParseMediaPlaylist(playlistText);
+        return false;
+    }
+
+    DropSegments(size_t(dropped));
+
+    // Keys, maps and byte range offsets carry on from the earlier parse, as the
+    // tags that set them were the same. Only the new tail is indexed and parsed
+    size_t tailStart = hasLine ? size_t(line.data() - playlistText.data()) : playlistText.length();
+    m_structure.Build(playlistText.substr(tailStart));
+    m_uncountedText = playlistText.substr(knownStart, tailStart - knownStart);
+
+    HLSLineReader tail(m_structure);
+
+    while (tail.Next(line))
+    {
+        // The EXT-X-SKIP tag has been applied already
+        if (isDelta && line.substr(0, 12) == "#EXT-X-SKIP:")
+        {
+            m_lineNumber++;
+            continue;
+        }
+
+        ParseLine(line, tail.LineStructure());
+    }
+
+    if (m_metrics)
+    {
+        m_parseCounts.bytes += playlistText.length();
+        m_parseCounts.parseNs += HLSParseMetrics::Now() - start;
+    }
+
+    EndParse();
+    return true;
+}
+
+void HLSMediaPlaylist::ResetHeader()
+{
+    m_version = 0;
+    m_targetDuration = 0;
+    m_mediaSequence = 0;
+    m_discontinuitySequence = 0;
+    m_playlistType = PlaylistType::NONE;
+    m_hasEndList = false;
+    m_isIFramesOnly = false;
+    m_independentSegments = false;
+}
+
+void HLSMediaPlaylist::BeginParse()
+{
+    // Columns are cleared rather than replaced, so that re-parsing a playlist of
+    // similar size does not allocate
+    ResetHeader();
+
+    m_durations.clear();
+    m_flags.clear();
+    m_uriEnds.clear();
+    m_uris.clear();
+    m_rangeLengths.clear();
+    m_rangeOffsets.clear();
+    m_programDateTimes.clear();
+    m_keyRuns.clear();
+    m_mapRuns.clear();
+    m_keys.clear();
+    m_maps.clear();
+
+    m_segmentCount = 0;
+    m_totalDuration = 0;
+    m_lastSegmentHash = 0;
+    m_hasPendingSegment = false;
+    m_pendingSegment = Segment();
+    m_nextRangeOffset = 0;
+    m_currentKey = NoIndex;
+    m_currentMap = NoIndex;
+    m_partialLine.clear();
+
+    m_isStreaming = m_segmentHandler != nullptr;
+    m_isParsing = true;
+    m_isValid = false;
+    m_isComplete = false;
+    BeginCounts();
+}
+
+void HLSMediaPlaylist::BeginCounts()
+{
+    m_lineNumber = 0;
+    m_lineOffset = 0;
+    m_uncountedText = string_view();
+    m_diagnostics.BeginParse();
+    m_parseCounts = HLSParseMetrics::Counts();
+}
+
+void HLSMediaPlaylist::Report(HLSDiagnosticCode code, string_view text)
+{
+    // The lines a refresh walked past without parsing are only counted once
+    // something needs a line number
+    if (!m_uncountedText.empty())
+    {
+        m_lineOffset += static_cast<uint32_t>(count(m_uncountedText.begin(), m_uncountedText.end(), '\n'));
+        m_uncountedText = string_view();
+    }
+
+    m_diagnostics.Report(code, m_lineNumber + m_lineOffset, text);
+}
+
+void HLSMediaPlaylist::EndParse()
+{
+    // Tags after the last segment, such as the EXTINF of a segment whose URI has not
+    // been published yet, describe nothing and are dropped
+    m_hasPendingSegment = false;
+    m_isParsing = false;
+    m_isComplete = true;
+    m_uncountedText = string_view();
+
+    if (m_metrics)
+    {
+        m_parseCounts.parses = 1;
+        m_parseCounts.lines = m_lineNumber;
+        m_parseCounts.diagnostics = m_diagnostics.TotalCount();
+        m_metrics->Add(m_parseCounts);
+    }
+}
+
+void HLSMediaPlaylist::ParseLine(string_view line, const HLSStructureCursor& structure)
+{
+    m_lineNumber++;
+
+    if (line.empty())
+    {
+        return;
+    }
+
+    // Any line that is not a tag or comment is the URI of a segment
+    if (line.front() != '#')
+    {
+        if (!m_isValid)
+        {
+            throw logic_error("Malformed HLS Playlist");
+        }
+
+        AddSegment(line);
+        return;
+    }
+
+    // All valid lines will start with #EXT. Anything else is a comment
+    if (line.length() < 4 || line.substr(0, 4) != "#EXT")
+    {
+        return;
+    }
+
+    // The tag name runs up to the attribute list, if there is one
+    size_t curIdx = line.find(':');
+    string_view tag = line.substr(0, curIdx);
+    string_view attributeList = curIdx == string_view::npos ? string_view() : line.substr(curIdx+1);
+    HLSStructureCursor attributeStructure;
+
+    if (structure.IsIndexed() && curIdx != string_view::npos)
+    {
+        attributeStructure = structure.Window(curIdx+1, line.length());
+    }
+    HLSTagName tagName = LookupTagName(tag);
+
+    if (m_metrics)
+    {
+        m_parseCounts.tags[static_cast<size_t>(tagName)]++;
+    }
+
+    if (tagName == HLSTagName::EXTM3U)
+    {
+        m_isValid = true;
+        return;
+    }
+
+    if (!m_isValid)
+    {
+        throw logic_error("Malformed HLS Playlist");
+    }
+
+    switch (tagName)
+    {
+        case HLSTagName::EXTINF:
+            // The duration is followed by a comma and an optional title, which is not kept
+            m_pendingSegment.duration = ParseNumber<float>(attributeList);
+            m_hasPendingSegment = true;
+            break;
+        case HLSTagName::BYTERANGE:
+            m_pendingSegment.byteRange = ParseByteRange(attributeList, m_nextRangeOffset);
+            break;
+        case HLSTagName::DISCONTINUITY:
+            m_pendingSegment.isDiscontinuity = true;
+            break;
+        case HLSTagName::GAP:
+            m_pendingSegment.isGap = true;
+            break;
+        case HLSTagName::PROGRAM_DATE_TIME:
+            m_pendingSegment.hasProgramDateTime = ParseDateTime(attributeList, m_pendingSegment.programDateTime);
+            if (!m_pendingSegment.hasProgramDateTime)
+            {
+                Report(HLSDiagnosticCode::INVALID_DATE, attributeList);
+            }
+            break;
+        case HLSTagName::KEY:
+            ParseKey(attributeList, attributeStructure);
+            break;
+        case HLSTagName::MAP:
+            ParseMap(attributeList, attributeStructure);
+            break;
+        case HLSTagName::TARGETDURATION:
+            m_targetDuration = ParseNumber<int64_t>(attributeList);
+            break;
+        case HLSTagName::MEDIA_SEQUENCE:
+            m_mediaSequence = ParseNumber<int64_t>(attributeList);
+            break;
+        case HLSTagName::DISCONTINUITY_SEQUENCE:
+            m_discontinuitySequence = ParseNumber<int64_t>(attributeList);
+            break;
+        case HLSTagName::ENDLIST:
+            m_hasEndList = true;
+            break;
+        case HLSTagName::PLAYLIST_TYPE:
+            m_playlistType = attributeList == "VOD" ? PlaylistType::VOD :
+                attributeList == "EVENT" ? PlaylistType::EVENT : PlaylistType::NONE;
+            break;
+        case HLSTagName::I_FRAMES_ONLY:
+            m_isIFramesOnly = true;
+            break;
+        case HLSTagName::INDEPENDENT_SEGMENTS:
+            m_independentSegments = true;
+            break;
+        case HLSTagName::VERSION:
+            m_version = ParseNumber<int>(attributeList);
+            break;
+        case HLSTagName::SKIP:
+            // Only meaningful against an earlier copy of the playlist
+            throw logic_error("Delta update without a previous playlist");
+        case HLSTagName::START:
+        case HLSTagName::DEFINE:
+        case HLSTagName::PART_INF:
+        case HLSTagName::SERVER_CONTROL:
+        case HLSTagName::BITRATE:
+        case HLSTagName::PART:
+        case HLSTagName::DATERANGE:
+        case HLSTagName::PRELOAD_HINT:
+        case HLSTagName::RENDITION_REPORT:
+            // Deliberately ignored, as the playlist does not model low-latency parts, date
+            // ranges, bitrates, variables or the start offset. They are recognized so that
+            // valid playlists do not produce warnings
+            break;
+        default:
+            Report(HLSDiagnosticCode::UNKNOWN_TAG, tag);
+            break;
+    }
+}
+
+void HLSMediaPlaylist::ParseKey(string_view tag, const HLSStructureCursor& structure)
+{
+    Key key;
+
+    HLSAttributeList attributes(tag, structure);
+    HLSAttribute attribute;
+
+    while (attributes.Next(attribute))
+    {
+        switch (LookupAttributeName(attribute.name))
+        {
+            case HLSAttributeName::METHOD:
+                key.method = attribute.value;
+                break;
+            case HLSAttributeName::URI:
+                key.uri = attribute.value;
+                break;
+            case HLSAttributeName::IV:
+                key.iv = attribute.value;
+                break;
+            case HLSAttributeName::KEYFORMAT:
+                key.keyFormat = attribute.value;
+                break;
+            case HLSAttributeName::KEYFORMATVERSIONS:
+                key.keyFormatVersions = attribute.value;
+                break;
+            default:
+                Report(HLSDiagnosticCode::UNKNOWN_KEY_ATTRIBUTE, attribute.name);
+                break;
+        }
+    }
+
+    // Segments after METHOD=NONE are not encrypted
+    if (key.method == "NONE")
+    {
+        m_currentKey = NoIndex;
+    }
+    else
+    {
+        m_currentKey = static_cast<uint32_t>(m_keys.size());
+        m_keys.push_back(move(key));
+    }
+
+    // A later key for the same segment replaces an earlier one
+    if (!m_keyRuns.empty() && m_keyRuns.back().firstSegment == m_segmentCount)
+    {
+        m_keyRuns.back().index = m_currentKey;
+    }
+    else
+    {
+        m_keyRuns.push_back({ static_cast<uint32_t>(m_segmentCount), m_currentKey });
+    }
+}
+
+void HLSMediaPlaylist::ParseMap(string_view tag, const HLSStructureCursor& structure)
+{
+    Map map;
+
+    HLSAttributeList attributes(tag, structure);
+    HLSAttribute attribute;
+
+    while (attributes.Next(attribute))
+    {
+        switch (LookupAttributeName(attribute.name))
+        {
+            case HLSAttributeName::URI:
+                map.uri = attribute.value;
+                break;
+            case HLSAttributeName::BYTERANGE:
+                map.byteRange = ParseByteRange(attribute.value, 0);
+                break;
+            default:
+                Report(HLSDiagnosticCode::UNKNOWN_MAP_ATTRIBUTE, attribute.name);
+                break;
+        }
+    }
+
+    m_currentMap = static_cast<uint32_t>(m_maps.size());
+    m_maps.push_back(move(map));
+
+    if (!m_mapRuns.empty() && m_mapRuns.back().firstSegment == m_segmentCount)
+    {
+        m_mapRuns.back().index = m_currentMap;
+    }
+    else
+    {
+        m_mapRuns.push_back({ static_cast<uint32_t>(m_segmentCount), m_currentMap });
+    }
+}
+
+int64_t HLSMediaPlaylist::ParseSkip(string_view tag)
+{
+    int64_t skipped = 0;
+
+    HLSAttributeList attributes(tag);
+    HLSAttribute attribute;
+
+    while (attributes.Next(attribute))
+    {
+        switch (LookupAttributeName(attribute.name))
+        {
+            case HLSAttributeName::SKIPPED_SEGMENTS:
+                skipped = ParseNumber<int64_t>(attribute.value);
+                break;
+            case HLSAttributeName::RECENTLY_REMOVED_DATERANGES:
+                // Date ranges are not kept, so there is nothing to remove
+                break;
+            default:
+                Report(HLSDiagnosticCode::UNKNOWN_SKIP_ATTRIBUTE, attribute.name);
+                break;
+        }
+    }
+
+    return skipped;
+}
+
+void HLSMediaPlaylist::AddSegment(string_view uri)
+{
+    if (!m_hasPendingSegment)
+    {
+        throw logic_error("Segment without EXTINF");
+    }
+
+    Segment& segment = m_pendingSegment;
+
+    if (segment.byteRange.IsSet())
+    {
+        m_nextRangeOffset = segment.byteRange.offset + segment.byteRange.length;
+    }
+
+    size_t index = m_segmentCount;
+    m_segmentCount++;
+    m_totalDuration += segment.duration;
+    m_lastSegmentHash = SegmentHash(uri, segment.duration);
+
+    if (m_isStreaming)
+    {
+        segment.sequence = m_mediaSequence + int64_t(index);
+        segment.uri = uri;
+        segment.key = m_currentKey == NoIndex ? nullptr : &m_keys[m_currentKey];
+        segment.map = m_currentMap == NoIndex ? nullptr : &m_maps[m_currentMap];
+        m_segmentHandler(segment);
+    }
+    else
+    {
+        // Segment indexes and URI offsets are 32-bit
+        if (index >= NoIndex || m_uris.length() + uri.length() > UINT32_MAX)
+        {
+            throw length_error("Media playlist too large");
+        }
+
+        m_durations.push_back(segment.duration);
+        m_flags.push_back((segment.isDiscontinuity ? DISCONTINUITY : 0) | (segment.isGap ? GAP : 0));
+        m_uris.append(uri.data(), uri.length());
+        m_uriEnds.push_back(static_cast<uint32_t>(m_uris.length()));
+
+        // The columns start with the first segment that has a byte range, filled in
+        // for the segments before it
+        if (segment.byteRange.IsSet() || !m_rangeLengths.empty())
+        {
+            m_rangeLengths.resize(index);
+            m_rangeOffsets.resize(index);
+            m_rangeLengths.push_back(segment.byteRange.length);
+            m_rangeOffsets.push_back(segment.byteRange.offset);
+        }
+
+        if (segment.hasProgramDateTime)
+        {
+            m_programDateTimes.emplace_back(static_cast<uint32_t>(index), segment.programDateTime);
+        }
+    }
+
+    m_pendingSegment = Segment();
+    m_hasPendingSegment = false;
+}
+
+void HLSMediaPlaylist::DropSegments(size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (!m_isStreaming)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            m_totalDuration -= m_durations[i];
+        }
+
+        m_durations.erase(m_durations.begin(), m_durations.begin() + count);
+        m_flags.erase(m_flags.begin(), m_flags.begin() + count);
+
+        // URI offsets are relative to the start of the buffer
+        uint32_t uriBytes = m_uriEnds[count - 1];
+        m_uris.erase(0, uriBytes);
+        m_uriEnds.erase(m_uriEnds.begin(), m_uriEnds.begin() + count);
+
+        for (uint32_t& uriEnd : m_uriEnds)
+        {
+            uriEnd -= uriBytes;
+        }
+
+        if (!m_rangeLengths.empty())
+        {
+            m_rangeLengths.erase(m_rangeLengths.begin(), m_rangeLengths.begin() + count);
+            m_rangeOffsets.erase(m_rangeOffsets.begin(), m_rangeOffsets.begin() + count);
+        }
+
+        auto kept = lower_bound(m_programDateTimes.begin(), m_programDateTimes.end(),
+            make_pair(static_cast<uint32_t>(count), INT64_MIN));
+        m_programDateTimes.erase(m_programDateTimes.begin(), kept);
+
+        for (auto& programDateTime : m_programDateTimes)
+        {
+            programDateTime.first -= static_cast<uint32_t>(count);
+        }
+    }
+
+    m_segmentCount -= count;
+    DropRuns(m_keyRuns, m_keys, m_currentKey, count);
+    DropRuns(m_mapRuns, m_maps, m_currentMap, count);
+}
+
+template <typename T>
+void HLSMediaPlaylist::DropRuns(vector<Run>& runs, deque<T>& items, uint32_t& current, size_t count)
+{
+    // The run in effect for the new first segment now starts at it
+    auto first = upper_bound(runs.begin(), runs.end(), count,
+        [](size_t index, const Run& run) { return index < run.firstSegment; });
+
+    if (first != runs.begin())
+    {
+        --first;
+    }
+
+    runs.erase(runs.begin(), first);
+
+    for (Run& run : runs)
+    {
+        run.firstSegment = run.firstSegment < count ? 0 : run.firstSegment - static_cast<uint32_t>(count);
+    }
+
+    // Items are numbered in the order they were parsed, so everything before the
+    // first one still referenced can go. Erasing from the front of a deque leaves
+    // the others where they are
+    uint32_t firstUsed = static_cast<uint32_t>(items.size());
+
+    for (const Run& run : runs)
+    {
+        if (run.index != NoIndex)
+        {
+            firstUsed = run.index;
+            break;
+        }
+    }
+
+    if (current != NoIndex)
+    {
+        firstUsed = min(firstUsed, current);
+    }
+
+    items.erase(items.begin(), items.begin() + firstUsed);
+
+    for (Run& run : runs)
+    {
+        if (run.index != NoIndex)
+        {
+            run.index -= firstUsed;
+        }
+    }
+
+    if (current != NoIndex)
+    {
+        current -= firstUsed;
+    }
+}
+
+uint64_t HLSMediaPlaylist::SegmentHash(string_view uri, float duration)
+{
+    uint32_t durationBits;
+    memcpy(&durationBits, &duration, sizeof(durationBits));
+    return HLSHash::Text(uri, durationBits);
+}
+
+uint32_t HLSMediaPlaylist::FindRun(const vector<Run>& runs, size_t segment)
+{
+    // The last run that starts at or before the segment
+    auto run = upper_bound(runs.begin(), runs.end(), segment,
+        [](size_t index, const Run& run) { return index < run.firstSegment; });
+
+    return run == runs.begin() ? NoIndex : prev(run)->index;
+}
+
+string_view HLSMediaPlaylist::GetSegmentUri(size_t index) const
+{
+    if (index >= m_uriEnds.size())
+    {
+        throw out_of_range("Segment index out of range");
+    }
+
+    size_t start = index == 0 ? 0 : m_uriEnds[index - 1];
+    return string_view(m_uris).substr(start, m_uriEnds[index] - start);
+}
+
+HLSMediaPlaylist::Segment HLSMediaPlaylist::GetSegment(size_t index) const
+{
+    Segment segment;
+    segment.uri = GetSegmentUri(index);
+    segment.sequence = m_mediaSequence + int64_t(index);
+    segment.duration = m_durations[index];
+    segment.isDiscontinuity = (m_flags[index] & DISCONTINUITY) != 0;
+    segment.isGap = (m_flags[index] & GAP) != 0;
+
+    if (!m_rangeLengths.empty())
+    {
+        segment.byteRange.length = m_rangeLengths[index];
+        segment.byteRange.offset = m_rangeOffsets[index];
+    }
+
+    auto programDateTime = lower_bound(m_programDateTimes.begin(), m_programDateTimes.end(),
+        make_pair(static_cast<uint32_t>(index), INT64_MIN));
+    if (programDateTime != m_programDateTimes.end() && programDateTime->first == index)
+    {
+        segment.hasProgramDateTime = true;
+        segment.programDateTime = programDateTime->second;
+    }
+
+    uint32_t key = FindRun(m_keyRuns, index);
+    uint32_t map = FindRun(m_mapRuns, index);
+    segment.key = key == NoIndex ? nullptr : &m_keys[key];
+    segment.map = map == NoIndex ? nullptr : &m_maps[map];
+    return segment;
+}
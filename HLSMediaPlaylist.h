@@ -0,0 +1,229 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HLSDiagnostics.h"
+#include "HLSLineReader.h"
+#include "HLSStructuralIndex.h"
+
+using namespace std;
+
+enum class PlaylistType
+{
+    NONE = 0,
+    EVENT,
+    VOD
+};
+
+// A media playlist: the list of segments of one rendition (RFC 8216 section 4.3.3).
+// Segments are stored column by column rather than as one object each, since live
+// DVR windows run to hundreds of thousands of them. Durations, flags and URI offsets
+// take a few bytes per segment, every URI lives in one shared buffer, and rarely
+// changing values (byte ranges, program date times, keys and maps) only take space
+// for the segments that carry them. Sequence numbers follow from the media sequence.
+// Segments can also be streamed to a handler as they are parsed, in which case they
+// are never stored at all
+class HLSMediaPlaylist
+{
+public:
+    struct ByteRange
+    {
+        uint64_t length = 0;
+        uint64_t offset = 0;
+
+        bool IsSet() const { return length > 0; }
+    };
+
+    // EXT-X-KEY
+    struct Key
+    {
+        string method;
+        string uri;
+        string iv;
+        string keyFormat;
+        string keyFormatVersions;
+    };
+
+    // EXT-X-MAP
+    struct Map
+    {
+        string uri;
+        ByteRange byteRange;
+    };
+
+    // One segment, assembled from the columns. The URI points into the playlist's
+    // URI buffer, or into the text being parsed when handed to a segment handler
+    struct Segment
+    {
+        int64_t sequence = 0;
+        float duration = 0;
+        string_view uri;
+        ByteRange byteRange;
+
+        // From an EXT-X-PROGRAM-DATE-TIME tag on this segment, in milliseconds since
+        // the Unix epoch
+        bool hasProgramDateTime = false;
+        int64_t programDateTime = 0;
+
+        // The key and map in effect, or nullptr if the segment is not encrypted or
+        // has no initialization section. They live as long as the playlist's parse
+        const Key* key = nullptr;
+        const Map* map = nullptr;
+
+        bool isDiscontinuity = false;
+        bool isGap = false;
+    };
+
+    // Receives each segment as soon as its URI line has been parsed. The segment is
+    // only valid during the call
+    typedef function<void(const Segment& segment)> SegmentHandler;
+
+    HLSMediaPlaylist() = default;
+    HLSMediaPlaylist(const HLSMediaPlaylist&) = delete;
+    HLSMediaPlaylist& operator = (const HLSMediaPlaylist&) = delete;
+
+    // Streams segments to handler instead of storing them. Headers, keys, maps and
+    // the segment count and total duration are still kept. Pass nullptr to go back
+    // to storing segments. Takes effect from the next parse
+    void SetSegmentHandler(SegmentHandler handler) { m_segmentHandler = move(handler); }
+
+    // Parses a media playlist held in a buffer. Calling this function multiple times
+    // will clear the current parsed playlist, though not the memory it was using
+    void ParseMediaPlaylist(string_view playlist);
+
+    // Incremental parsing, as for HLSMasterPlaylist
+    void Feed(const char* data, size_t length);
+    void Finish();
+
+    // Brings the playlist up to date with a newer copy of the same live playlist.
+    // Segments still listed are matched by media sequence and kept as they are,
+    // segments that have left the window are dropped from the front, and only the
+    // lines after the last known segment are parsed. That segment's URI and duration
+    // must match, otherwise the copy is parsed in full and false is returned. The copy
+    // may be a delta update (EXT-X-SKIP), which throws if it cannot be applied. When
+    // streaming, only the new segments reach the handler and TotalDuration is not
+    // reduced by the dropped ones
+    bool Refresh(string_view playlist);
+
+    int GetVersion() const { return m_version; }
+    int64_t GetTargetDuration() const { return m_targetDuration; }
+    int64_t GetMediaSequence() const { return m_mediaSequence; }
+    int64_t GetDiscontinuitySequence() const { return m_discontinuitySequence; }
+    PlaylistType GetPlaylistType() const { return m_playlistType; }
+    bool HasEndList() const { return m_hasEndList; }
+    bool IsIFramesOnly() const { return m_isIFramesOnly; }
+    bool HasIndependentSegments() const { return m_independentSegments; }
+
+    // Counts streamed segments as well as stored ones
+    size_t SegmentCount() const { return m_segmentCount; }
+    double TotalDuration() const { return m_totalDuration; }
+
+    // Stored segments only
+    Segment GetSegment(size_t index) const;
+    string_view GetSegmentUri(size_t index) const;
+    const vector<float>& GetDurations() const { return m_durations; }
+
+    const deque<Key>& GetKeys() const { return m_keys; }
+    const deque<Map>& GetMaps() const { return m_maps; }
+
+    // Diagnostics and instrumentation, as for HLSMasterPlaylist. A refresh counts as
+    // a parse, of the whole playlist
+    HLSDiagnostics& GetDiagnostics() const { return m_diagnostics; }
+    void SetMetrics(HLSParseMetrics* metrics) { m_metrics = metrics; }
+    HLSParseMetrics* GetMetrics() const { return m_metrics; }
+
+private:
+    // The key or map that applies from a segment onwards
+    struct Run
+    {
+        uint32_t firstSegment;
+        uint32_t index;
+    };
+
+    enum SegmentFlags : uint8_t
+    {
+        DISCONTINUITY = 1,
+        GAP = 2,
+    };
+
+    static constexpr uint32_t NoIndex = UINT32_MAX;
+
+    void BeginParse();
+    void BeginCounts();
+    void ParseLine(string_view line, const HLSStructureCursor& structure = HLSStructureCursor());
+    void EndParse();
+
+    void ResetHeader();
+    void ParseKey(string_view tag, const HLSStructureCursor& structure);
+    void ParseMap(string_view tag, const HLSStructureCursor& structure);
+    int64_t ParseSkip(string_view tag);
+    void AddSegment(string_view uri);
+    void DropSegments(size_t count);
+    void Report(HLSDiagnosticCode code, string_view text);
+
+    static uint32_t FindRun(const vector<Run>& runs, size_t segment);
+    template <typename T>
+    static void DropRuns(vector<Run>& runs, deque<T>& items, uint32_t& current, size_t count);
+    static uint64_t SegmentHash(string_view uri, float duration);
+
+    // Header
+    int m_version = 0;
+    int64_t m_targetDuration = 0;
+    int64_t m_mediaSequence = 0;
+    int64_t m_discontinuitySequence = 0;
+    PlaylistType m_playlistType = PlaylistType::NONE;
+    bool m_hasEndList = false;
+    bool m_isIFramesOnly = false;
+    bool m_independentSegments = false;
+
+    // Segment columns. m_uriEnds[i] is where segment i's URI ends in m_uris, and the
+    // byte range columns stay empty until a segment has a byte range
+    vector<float> m_durations;
+    vector<uint8_t> m_flags;
+    vector<uint32_t> m_uriEnds;
+    string m_uris;
+    vector<uint64_t> m_rangeLengths;
+    vector<uint64_t> m_rangeOffsets;
+    vector<pair<uint32_t, int64_t>> m_programDateTimes;
+    vector<Run> m_keyRuns;
+    vector<Run> m_mapRuns;
+
+    // Deques, so that segments can point at them while more are added
+    deque<Key> m_keys;
+    deque<Map> m_maps;
+
+    size_t m_segmentCount = 0;
+    double m_totalDuration = 0;
+
+    // Identifies the last segment, which a refresh has to find again
+    uint64_t m_lastSegmentHash = 0;
+
+    // Tags that describe the next segment, applied when its URI is reached
+    bool m_hasPendingSegment = false;
+    Segment m_pendingSegment;
+    uint64_t m_nextRangeOffset = 0;
+    uint32_t m_currentKey = NoIndex;
+    uint32_t m_currentMap = NoIndex;
+
+    SegmentHandler m_segmentHandler;
+    bool m_isStreaming = false;
+
+    bool m_isParsing = false;
+    bool m_isValid = false;
+    bool m_isComplete = false;
+    string m_partialLine;
+    HLSStructuralIndex m_structure;
+
+    // Lines passed to ParseLine so far, and those a refresh walked past, which are
+    // only counted out of m_uncountedText when a diagnostic needs them
+    uint32_t m_lineNumber = 0;
+    uint32_t m_lineOffset = 0;
+    string_view m_uncountedText;
+
+    mutable HLSDiagnostics m_diagnostics;
+    HLSParseMetrics* m_metrics = nullptr;
+    HLSParseMetrics::Counts m_parseCounts;
+};
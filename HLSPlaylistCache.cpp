@@ -0,0 +1,318 @@
+#include "HLSPlaylistCache.h"
+#include "HLSHash.h"
+#include <algorithm>
+#include <future>
+#include <memory_resource>
+#include <stdexcept>
+
+// Seeds of the two content hashes, and of the hash that places URLs
+static constexpr uint64_t CheckSeed = 0x51ED270B27D4EB4Full;
+static constexpr uint64_t UrlSeed = 0x2545F4914F6CDD1Dull;
+
+// A playlist parsed into an arena and a symbol table of its own, so that its size is
+// known and nothing it interns outlives it. Cached pointers alias the playlist inside,
+// keeping the arena and symbols alive with it
+struct CachedPlaylist
+{
+    HLSCountingResource upstream;
+    pmr::monotonic_buffer_resource arena;
+    shared_ptr<HLSSymbolTable> symbols;
+    HLSMasterPlaylist playlist;
+
+    CachedPlaylist() : arena(&upstream), symbols(make_shared<HLSSymbolTable>()), playlist(&arena, symbols) {}
+
+    size_t Bytes() const { return sizeof(CachedPlaylist) + upstream.HeldBytes() + sizeof(HLSSymbolTable) + symbols->Bytes(); }
+};
+
+HLSPlaylistCache::ContentKey HLSPlaylistCache::ContentKey::Of(string_view text)
+{
+    ContentKey key;
+    key.hash = HLSHash::Text(text);
+    key.check = HLSHash::Text(text, CheckSeed);
+    key.length = text.length();
+    return key;
+}
+
+HLSPlaylistCache::HLSPlaylistCache(const Options& options) :
+    m_options(options)
+{
+    size_t shardCount = max<size_t>(options.shardCount, 1);
+    m_shardUrls = max<size_t>(options.maxUrls / shardCount, 1);
+
+    for (size_t i = 0; i < shardCount; i++)
+    {
+        m_shards.push_back(make_unique<Shard<Entry>>());
+        m_urlShards.push_back(make_unique<Shard<Validators>>());
+    }
+}
+
+HLSPlaylistCache::PlaylistPtr HLSPlaylistCache::Parse(string_view text)
+{
+    return Lookup(ContentKey::Of(text), text);
+}
+
+HLSPlaylistCache::PlaylistPtr HLSPlaylistCache::Lookup(const ContentKey& key, string_view text)
+{
+    if (PlaylistPtr playlist = Find(key))
+    {
+        m_hits++;
+        return playlist;
+    }
+
+    m_misses++;
+
+    // Parsed outside the shard's lock. Two threads that miss on the same text at
+    // once both parse it, and the first to finish is kept
+    auto cached = make_shared<CachedPlaylist>();
+    cached->playlist.ParseMasterPlaylist(text);
+
+    return Insert(key, PlaylistPtr(cached, &cached->playlist), cached->Bytes());
+}
+
+HLSPlaylistCache::PlaylistPtr HLSPlaylistCache::Find(const ContentKey& key)
+{
+    Shard<Entry>& shard = *m_shards[ShardIndex(key)];
+    lock_guard<mutex> lock(shard.lock);
+
+    auto found = shard.index.find(key.hash);
+    if (found == shard.index.end() || !(found->second->key == key))
+    {
+        return nullptr;
+    }
+
+    // Move the entry to the front of the list
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    return found->second->playlist;
+}
+
+HLSPlaylistCache::PlaylistPtr HLSPlaylistCache::Insert(const ContentKey& key, PlaylistPtr playlist, size_t bytes)
+{
+    // A playlist larger than the whole budget would only evict everything else
+    if (bytes > m_options.byteBudget)
+    {
+        return playlist;
+    }
+
+    size_t shardIndex = ShardIndex(key);
+
+    {
+        Shard<Entry>& shard = *m_shards[shardIndex];
+        lock_guard<mutex> lock(shard.lock);
+
+        auto found = shard.index.find(key.hash);
+        if (found != shard.index.end())
+        {
+            if (found->second->key == key)
+            {
+                shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+                return found->second->playlist;
+            }
+
+            // A hash collision. The newer playlist takes the slot
+            m_bytes -= found->second->bytes;
+            shard.entries.erase(found->second);
+            shard.index.erase(found);
+        }
+
+        shard.entries.push_front({ key, playlist, bytes });
+        shard.index[key.hash] = shard.entries.begin();
+        m_bytes += bytes;
+    }
+
+    Evict(shardIndex, key);
+    return playlist;
+}
+
+void HLSPlaylistCache::Evict(size_t firstShard, const ContentKey& keep)
+{
+    // Only one shard is locked at a time, so this never waits on another eviction
+    for (size_t i = 0; i < m_shards.size() && m_bytes > m_options.byteBudget; i++)
+    {
+        Shard<Entry>& shard = *m_shards[(firstShard + i) % m_shards.size()];
+        lock_guard<mutex> lock(shard.lock);
+
+        while (m_bytes > m_options.byteBudget && !shard.entries.empty() && !(shard.entries.back().key == keep))
+        {
+            const Entry& oldest = shard.entries.back();
+            m_bytes -= oldest.bytes;
+            shard.index.erase(oldest.key.hash);
+            shard.entries.pop_back();
+            m_evictions++;
+        }
+    }
+}
+
+bool HLSPlaylistCache::FindValidators(const string& url, Validators& validators)
+{
+    uint64_t urlHash = HLSHash::Text(url, UrlSeed);
+    Shard<Validators>& shard = UrlShardFor(urlHash);
+    lock_guard<mutex> lock(shard.lock);
+
+    auto found = shard.index.find(urlHash);
+    if (found == shard.index.end() || found->second->url != url)
+    {
+        return false;
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    validators = *found->second;
+    return true;
+}
+
+void HLSPlaylistCache::StoreValidators(Validators&& validators)
+{
+    uint64_t urlHash = HLSHash::Text(validators.url, UrlSeed);
+    Shard<Validators>& shard = UrlShardFor(urlHash);
+    lock_guard<mutex> lock(shard.lock);
+
+    auto found = shard.index.find(urlHash);
+    if (found != shard.index.end())
+    {
+        shard.entries.erase(found->second);
+        shard.index.erase(found);
+    }
+
+    shard.entries.push_front(move(validators));
+    shard.index[urlHash] = shard.entries.begin();
+
+    if (shard.entries.size() > m_shardUrls)
+    {
+        shard.index.erase(HLSHash::Text(shard.entries.back().url, UrlSeed));
+        shard.entries.pop_back();
+    }
+}
+
+void HLSPlaylistCache::EraseValidators(const string& url)
+{
+    uint64_t urlHash = HLSHash::Text(url, UrlSeed);
+    Shard<Validators>& shard = UrlShardFor(urlHash);
+    lock_guard<mutex> lock(shard.lock);
+
+    auto found = shard.index.find(urlHash);
+    if (found != shard.index.end() && found->second->url == url)
+    {
+        shard.entries.erase(found->second);
+        shard.index.erase(found);
+    }
+}
+
+#ifndef _WIN32
+
+HLSPlaylistCache::PlaylistPtr HLSPlaylistCache::Fetch(HLSHttpClient& client, const string& url)
+{
+    Validators known;
+    bool isConditional = FindValidators(url, known);
+
+    while (true)
+    {
+        HttpHeaders headers;
+        if (isConditional && !known.etag.empty())
+        {
+            headers.emplace_back("If-None-Match", known.etag);
+        }
+
+        if (isConditional && !known.lastModified.empty())
+        {
+            headers.emplace_back("If-Modified-Since", known.lastModified);
+        }
+
+        // The whole body is needed to hash it, so it is gathered rather than fed to
+        // a parser as it arrives
+        string body;
+        promise<HttpResult> done;
+        client.Fetch(url, headers,
+            [&body](const char* data, size_t length) { body.append(data, length); },
+            [&done](const HttpResult& result) { done.set_value(result); });
+
+        HttpResult result = done.get_future().get();
+        if (!result.isSuccess)
+        {
+            throw runtime_error("Unable to fetch " + url + ": " + result.error);
+        }
+
+        if (result.status == 304)
+        {
+            PlaylistPtr playlist = isConditional ? Find(known.content) : nullptr;
+            if (playlist)
+            {
+                m_notModified++;
+                m_hits++;
+                return playlist;
+            }
+
+            // The parse has been evicted since the validators were stored, so the
+            // body has to be fetched again
+            EraseValidators(url);
+
+            if (!isConditional)
+            {
+                throw runtime_error("Unable to fetch " + url + ": unexpected 304 response");
+            }
+
+            isConditional = false;
+            continue;
+        }
+
+        ContentKey key = ContentKey::Of(body);
+        PlaylistPtr playlist = Lookup(key, body);
+
+        Validators validators;
+        validators.url = url;
+        validators.etag = result.Header("ETag");
+        validators.lastModified = result.Header("Last-Modified");
+        validators.content = key;
+
+        if (!validators.etag.empty() || !validators.lastModified.empty())
+        {
+            StoreValidators(move(validators));
+        }
+        else if (isConditional)
+        {
+            EraseValidators(url);
+        }
+
+        return playlist;
+    }
+}
+
+#endif
+
+HLSCacheStats HLSPlaylistCache::GetStats() const
+{
+    HLSCacheStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.notModified = m_notModified;
+    stats.bytes = m_bytes;
+
+    for (const auto& shard : m_shards)
+    {
+        lock_guard<mutex> lock(shard->lock);
+        stats.entries += shard->entries.size();
+    }
+
+    return stats;
+}
+
+void HLSPlaylistCache::Clear()
+{
+    for (const auto& shard : m_shards)
+    {
+        lock_guard<mutex> lock(shard->lock);
+        for (const Entry& entry : shard->entries)
+        {
+            m_bytes -= entry.bytes;
+        }
+
+        shard->entries.clear();
+        shard->index.clear();
+    }
+
+    for (const auto& shard : m_urlShards)
+    {
+        lock_guard<mutex> lock(shard->lock);
+        shard->entries.clear();
+        shard->index.clear();
+    }
+}
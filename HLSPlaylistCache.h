@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "HLSHttpClient.h"
+#include "HLSMasterPlaylist.h"
+
+using namespace std;
+
+struct HLSCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+
+    // Conditional fetches answered with 304 Not Modified. These are counted as hits too
+    size_t notModified = 0;
+
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Parsed master playlists keyed by a hash of their text, so that byte-identical
+// playlists are parsed once and shared from then on. Cached playlists are immutable:
+// they are handed out as pointers to const that stay valid for as long as they are
+// held, even once evicted, and are read in any order through their sorted views (or
+// HLSSerializer::Write with an explicit order), which build each order's index once.
+// Entries are spread over shards, each with its own lock and least recently used
+// list, so concurrent lookups rarely contend. The byte budget covers the whole cache
+// and counts everything a parsed playlist holds on to, including the symbol table
+// each cached playlist interns its values in. Going over it evicts the least
+// recently used entries of the shard that was added to, then of the others
+class HLSPlaylistCache
+{
+public:
+    typedef shared_ptr<const HLSMasterPlaylist> PlaylistPtr;
+
+    struct Options
+    {
+        size_t byteBudget = 64 * 1024 * 1024;
+        size_t shardCount = 16;
+
+        // URLs whose validators are kept for conditional fetches
+        size_t maxUrls = 4096;
+    };
+
+    HLSPlaylistCache() : HLSPlaylistCache(Options()) {}
+    explicit HLSPlaylistCache(const Options& options);
+
+    HLSPlaylistCache(const HLSPlaylistCache&) = delete;
+    HLSPlaylistCache& operator = (const HLSPlaylistCache&) = delete;
+
+    // Returns the parsed playlist for text, parsing it only if the same text is not
+    // cached already. May be called from any thread. Parse errors are thrown and
+    // nothing is cached for them
+    PlaylistPtr Parse(string_view text);
+
+    // Fetches and parses a playlist. Once a URL has been fetched, later requests for
+    // it carry the ETag and Last-Modified validators of that response, and a 304
+    // reuses the cached parse without transferring the body. Any other body is looked
+    // up by its content, as by Parse. Throws if the fetch fails. Not available on
+    // Windows, as HLSHttpClient is not
+    PlaylistPtr Fetch(HLSHttpClient& client, const string& url);
+
+    HLSCacheStats GetStats() const;
+
+    // Drops every entry. Playlists still held elsewhere stay valid
+    void Clear();
+
+private:
+    // Identifies a playlist's text. The hash picks the entry, and the length and a
+    // second, differently seeded hash rule out collisions
+    struct ContentKey
+    {
+        uint64_t hash = 0;
+        uint64_t check = 0;
+        size_t length = 0;
+
+        static ContentKey Of(string_view text);
+
+        bool operator == (const ContentKey& other) const
+        {
+            return hash == other.hash && check == other.check && length == other.length;
+        }
+    };
+
+    struct Entry
+    {
+        ContentKey key;
+        PlaylistPtr playlist;
+        size_t bytes = 0;
+    };
+
+    // What the last response for a URL said about itself
+    struct Validators
+    {
+        string url;
+        string etag;
+        string lastModified;
+        ContentKey content;
+    };
+
+    template <typename T>
+    struct Shard
+    {
+        mutex lock;
+
+        // Most recently used first
+        list<T> entries;
+        unordered_map<uint64_t, typename list<T>::iterator> index;
+    };
+
+    // Finds a playlist by content, or parses and adds it, counting the hit or miss
+    PlaylistPtr Lookup(const ContentKey& key, string_view text);
+    PlaylistPtr Find(const ContentKey& key);
+    PlaylistPtr Insert(const ContentKey& key, PlaylistPtr playlist, size_t bytes);
+    void Evict(size_t firstShard, const ContentKey& keep);
+
+    bool FindValidators(const string& url, Validators& validators);
+    void StoreValidators(Validators&& validators);
+    void EraseValidators(const string& url);
+
+    size_t ShardIndex(const ContentKey& key) const { return key.hash % m_shards.size(); }
+    Shard<Validators>& UrlShardFor(uint64_t urlHash) { return *m_urlShards[urlHash % m_urlShards.size()]; }
+
+    Options m_options;
+    size_t m_shardUrls;
+
+    vector<unique_ptr<Shard<Entry>>> m_shards;
+    vector<unique_ptr<Shard<Validators>>> m_urlShards;
+
+    atomic<size_t> m_bytes{ 0 };
+    atomic<size_t> m_hits{ 0 };
+    atomic<size_t> m_misses{ 0 };
+    atomic<size_t> m_evictions{ 0 };
+    atomic<size_t> m_notModified{ 0 };
+};
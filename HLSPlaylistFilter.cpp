@@ -0,0 +1,475 @@
+#include "HLSPlaylistFilter.h"
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include "HLSAttributeList.h"
+
+static_assert(static_cast<unsigned>(HLSAttributeName::RECENTLY_REMOVED_DATERANGES) < 64,
+    "Attribute sets are 64-bit masks");
+
+struct HLSPlaylistFilter::TagAttributes
+{
+    uint64_t present = 0;
+    string_view values[64];
+
+    // Every attribute as written, NAME=VALUE with any quotes, in order
+    vector<pair<HLSAttributeName, string_view>> written;
+
+    bool Has(HLSAttributeName attribute) const { return (present & AttributeBit(attribute)) != 0; }
+    string_view Value(HLSAttributeName attribute) const { return Has(attribute) ? values[static_cast<unsigned>(attribute)] : string_view(); }
+
+    void Read(string_view attributeList)
+    {
+        present = 0;
+        written.clear();
+
+        HLSAttributeList list(attributeList);
+        HLSAttribute attribute;
+        while (list.Next(attribute))
+        {
+            // The attribute runs from its name to the end of its value and closing
+            // quote. A trailing name with no value has no value text at all
+            const char* end = attribute.value.data() ?
+                attribute.value.data() + attribute.value.length() : attribute.name.data() + attribute.name.length();
+            if (attribute.isQuoted && end < attributeList.data() + attributeList.length() && *end == '\"')
+            {
+                end++;
+            }
+
+            HLSAttributeName name = LookupAttributeName(attribute.name);
+            written.emplace_back(name, string_view(attribute.name.data(), end - attribute.name.data()));
+
+            if (name != HLSAttributeName::UNKNOWN)
+            {
+                present |= AttributeBit(name);
+                values[static_cast<unsigned>(name)] = attribute.value;
+            }
+        }
+    }
+};
+
+static bool EqualsIgnoreCase(string_view a, string_view b)
+{
+    if (a.length() != b.length())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.length(); i++)
+    {
+        if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i])))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Parses all of text as a number, unlike ParseNumber
+template <typename T>
+static bool ParseWholeNumber(string_view text, T& result)
+{
+    auto parsed = from_chars(text.data(), text.data() + text.length(), result);
+    return !text.empty() && parsed.ec == errc() && parsed.ptr == text.data() + text.length();
+}
+
+static string_view TrimSpaces(string_view text)
+{
+    while (!text.empty() && text.front() == ' ')
+    {
+        text.remove_prefix(1);
+    }
+
+    while (!text.empty() && text.back() == ' ')
+    {
+        text.remove_suffix(1);
+    }
+
+    return text;
+}
+
+HLSPlaylistFilter::CompiledRule HLSPlaylistFilter::Compile(const Rule& rule)
+{
+    CompiledRule compiled;
+    compiled.reserve(rule.size());
+
+    for (const Condition& condition : rule)
+    {
+        if (condition.attribute == HLSAttributeName::UNKNOWN)
+        {
+            throw invalid_argument("Filter condition on an unknown attribute");
+        }
+
+        Test test;
+        test.attribute = condition.attribute;
+        test.comparison = condition.comparison;
+        test.value = condition.value;
+
+        switch (condition.comparison)
+        {
+            case Comparison::EQUAL:
+            case Comparison::NOT_EQUAL:
+                break;
+            case Comparison::IN:
+            case Comparison::NOT_IN:
+            {
+                string_view list = condition.value;
+                size_t pos = 0;
+                while (pos <= list.length())
+                {
+                    size_t comma = list.find(',', pos);
+                    if (comma == string_view::npos)
+                    {
+                        comma = list.length();
+                    }
+
+                    test.values.emplace_back(TrimSpaces(list.substr(pos, comma - pos)));
+                    pos = comma + 1;
+                }
+                break;
+            }
+            case Comparison::LESS:
+            case Comparison::LESS_EQUAL:
+            case Comparison::GREATER:
+            case Comparison::GREATER_EQUAL:
+            {
+                string_view value = condition.value;
+                bool isValid;
+                if (condition.attribute == HLSAttributeName::RESOLUTION)
+                {
+                    size_t x = value.find('x');
+                    isValid = x != string_view::npos &&
+                        ParseWholeNumber(value.substr(0, x), test.width) &&
+                        ParseWholeNumber(value.substr(x + 1), test.height);
+                }
+                else
+                {
+                    isValid = ParseWholeNumber(value, test.number);
+                }
+
+                if (!isValid)
+                {
+                    throw invalid_argument("Filter condition needs a number: " + condition.value);
+                }
+                break;
+            }
+            case Comparison::HAS_CODEC:
+            {
+                for (uint8_t family = static_cast<uint8_t>(CodecFamily::AVC); family <= static_cast<uint8_t>(CodecFamily::OPUS); family++)
+                {
+                    if (EqualsIgnoreCase(condition.value, CodecFamilyToString(static_cast<CodecFamily>(family))))
+                    {
+                        test.family = static_cast<CodecFamily>(family);
+                    }
+                }
+
+                if (test.family == CodecFamily::UNKNOWN)
+                {
+                    test.family = ParseCodec(condition.value).family;
+                }
+
+                if (test.family == CodecFamily::UNKNOWN)
+                {
+                    throw invalid_argument("Filter condition names an unknown codec: " + condition.value);
+                }
+                break;
+            }
+            default:
+                throw invalid_argument("Unknown filter comparison");
+        }
+
+        compiled.push_back(move(test));
+    }
+
+    return compiled;
+}
+
+bool HLSPlaylistFilter::Matches(const Test& test, const TagAttributes& attributes)
+{
+    string_view value = attributes.Value(test.attribute);
+
+    switch (test.comparison)
+    {
+        case Comparison::EQUAL:
+            return value == test.value;
+        case Comparison::NOT_EQUAL:
+            return value != test.value;
+        case Comparison::IN:
+        case Comparison::NOT_IN:
+        {
+            bool isListed = false;
+            for (const string& listed : test.values)
+            {
+                isListed = isListed || value == listed;
+            }
+            return isListed == (test.comparison == Comparison::IN);
+        }
+        case Comparison::HAS_CODEC:
+        {
+            size_t pos = 0;
+            while (attributes.Has(test.attribute) && pos < value.length())
+            {
+                size_t comma = value.find(',', pos);
+                if (comma == string_view::npos)
+                {
+                    comma = value.length();
+                }
+
+                if (ParseCodec(TrimSpaces(value.substr(pos, comma - pos))).family == test.family)
+                {
+                    return true;
+                }
+                pos = comma + 1;
+            }
+            return false;
+        }
+        default:
+            break;
+    }
+
+    if (!attributes.Has(test.attribute))
+    {
+        return false;
+    }
+
+    if (test.attribute == HLSAttributeName::RESOLUTION)
+    {
+        // Read as the parser does
+        size_t x = value.find('x');
+        int width = ParseNumber<int>(value.substr(0, x));
+        int height = x == string_view::npos ? 0 : ParseNumber<int>(value.substr(x + 1));
+
+        switch (test.comparison)
+        {
+            case Comparison::LESS: return width < test.width && height < test.height;
+            case Comparison::LESS_EQUAL: return width <= test.width && height <= test.height;
+            case Comparison::GREATER: return !(width <= test.width && height <= test.height);
+            case Comparison::GREATER_EQUAL: return !(width < test.width && height < test.height);
+            default: return false;
+        }
+    }
+
+    double number = ParseNumber<double>(value);
+    switch (test.comparison)
+    {
+        case Comparison::LESS: return number < test.number;
+        case Comparison::LESS_EQUAL: return number <= test.number;
+        case Comparison::GREATER: return number > test.number;
+        case Comparison::GREATER_EQUAL: return number >= test.number;
+        default: return false;
+    }
+}
+
+bool HLSPlaylistFilter::Matches(const vector<CompiledRule>& rules, const TagAttributes& attributes)
+{
+    for (const CompiledRule& rule : rules)
+    {
+        bool isMatch = true;
+        for (size_t i = 0; isMatch && i < rule.size(); i++)
+        {
+            isMatch = Matches(rule[i], attributes);
+        }
+
+        if (isMatch)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void HLSPlaylistFilter::DropStreams(const Rule& rule)
+{
+    m_streamRules.push_back(Compile(rule));
+}
+
+void HLSPlaylistFilter::DropMediaTags(const Rule& rule)
+{
+    m_mediaRules.push_back(Compile(rule));
+}
+
+void HLSPlaylistFilter::RemoveStreamAttribute(HLSAttributeName attribute)
+{
+    m_removedStreamAttributes |= AttributeBit(attribute);
+}
+
+void HLSPlaylistFilter::RemoveMediaAttribute(HLSAttributeName attribute)
+{
+    m_removedMediaAttributes |= AttributeBit(attribute);
+}
+
+HLSFilterStats HLSPlaylistFilter::Apply(string_view playlist, string& output) const
+{
+    HLSFilterStats stats;
+    TagAttributes attributes;
+    vector<Group> groups;
+
+    auto findGroup = [&groups](string_view type, string_view id) -> Group*
+    {
+        for (Group& group : groups)
+        {
+            if (group.id == id && group.type == type)
+            {
+                return &group;
+            }
+        }
+        return nullptr;
+    };
+
+    // Whether a stream refers to a group that has had all its renditions dropped
+    auto isEmptied = [&](HLSAttributeName attribute, string_view type)
+    {
+        if (!attributes.Has(attribute))
+        {
+            return false;
+        }
+
+        const Group* group = findGroup(type, attributes.Value(attribute));
+        return group && !group->hasKept;
+    };
+
+    output.reserve(output.length() + playlist.length());
+
+    // Lines are copied in runs, up to the first one that is dropped or rewritten
+    size_t copyStart = 0;
+    size_t pos = 0;
+    bool isValid = false;
+    bool isDroppingUri = false;
+
+    while (pos < playlist.length())
+    {
+        size_t lineStart = pos;
+        size_t newLine = playlist.find('\n', pos);
+        size_t lineEnd = newLine == string_view::npos ? playlist.length() : newLine + 1;
+        pos = lineEnd;
+
+        string_view line = playlist.substr(lineStart, (newLine == string_view::npos ? playlist.length() : newLine) - lineStart);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+
+        if (isDroppingUri && !line.empty() && line[0] != '#')
+        {
+            // The first line after a dropped stream tag that is neither blank nor a
+            // comment or tag is that stream's URI. The lines before it are kept
+            output.append(playlist.data() + copyStart, lineStart - copyStart);
+            copyStart = lineEnd;
+            isDroppingUri = false;
+            continue;
+        }
+
+        if (line.length() < 4 || line.substr(0, 4) != "#EXT")
+        {
+            continue;
+        }
+
+        size_t colon = line.find(':');
+        HLSTagName tagName = LookupTagName(line.substr(0, colon));
+
+        if (tagName == HLSTagName::EXTM3U)
+        {
+            isValid = true;
+            continue;
+        }
+
+        if (!isValid)
+        {
+            throw logic_error("Malformed HLS Playlist");
+        }
+
+        if (tagName != HLSTagName::MEDIA && tagName != HLSTagName::STREAM_INF && tagName != HLSTagName::I_FRAME_STREAM_INF)
+        {
+            continue;
+        }
+
+        attributes.Read(colon == string_view::npos ? string_view() : line.substr(colon + 1));
+
+        bool isDropped;
+        uint64_t removed;
+
+        if (tagName == HLSTagName::MEDIA)
+        {
+            isDropped = Matches(m_mediaRules, attributes);
+            removed = m_removedMediaAttributes;
+
+            string_view type = attributes.Value(HLSAttributeName::TYPE);
+            string_view id = attributes.Value(HLSAttributeName::GROUP_ID);
+            Group* group = findGroup(type, id);
+            if (!group)
+            {
+                groups.push_back(Group{ type, id });
+                group = &groups.back();
+            }
+
+            group->hasKept = group->hasKept || !isDropped;
+            stats.mediaTagsDropped += isDropped;
+        }
+        else
+        {
+            isDropped = Matches(m_streamRules, attributes) ||
+                isEmptied(HLSAttributeName::AUDIO, "AUDIO") ||
+                isEmptied(HLSAttributeName::VIDEO, "VIDEO");
+            removed = m_removedStreamAttributes;
+
+            if (isEmptied(HLSAttributeName::SUBTITLES, "SUBTITLES"))
+            {
+                removed |= AttributeBit(HLSAttributeName::SUBTITLES);
+            }
+
+            if (isEmptied(HLSAttributeName::CLOSED_CAPTIONS, "CLOSED-CAPTIONS"))
+            {
+                removed |= AttributeBit(HLSAttributeName::CLOSED_CAPTIONS);
+            }
+
+            if (tagName == HLSTagName::STREAM_INF)
+            {
+                stats.streamsDropped += isDropped;
+                isDroppingUri = isDropped;
+            }
+            else
+            {
+                stats.iStreamsDropped += isDropped;
+            }
+        }
+
+        if (!isDropped && (attributes.present & removed) == 0)
+        {
+            continue;
+        }
+
+        output.append(playlist.data() + copyStart, lineStart - copyStart);
+        copyStart = lineEnd;
+
+        if (isDropped)
+        {
+            continue;
+        }
+
+        // Write the tag back without the removed attributes, and with its own line ending
+        output.append(line.data(), colon + 1);
+        bool isFirst = true;
+        for (const auto& attribute : attributes.written)
+        {
+            if (attribute.first != HLSAttributeName::UNKNOWN && (removed & AttributeBit(attribute.first)) != 0)
+            {
+                continue;
+            }
+
+            if (!isFirst)
+            {
+                output += ',';
+            }
+            output.append(attribute.second.data(), attribute.second.length());
+            isFirst = false;
+        }
+        output.append(line.data() + line.length(), playlist.data() + lineEnd - (line.data() + line.length()));
+
+        stats.tagsRewritten++;
+    }
+
+    output.append(playlist.data() + copyStart, playlist.length() - copyStart);
+    return stats;
+}
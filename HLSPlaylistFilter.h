@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HLSCodecs.h"
+#include "HLSKeywords.h"
+
+using namespace std;
+
+struct HLSFilterStats
+{
+    size_t streamsDropped = 0;
+    size_t iStreamsDropped = 0;
+    size_t mediaTagsDropped = 0;
+
+    // Kept tags written back with attributes removed
+    size_t tagsRewritten = 0;
+};
+
+// Rewrites a master playlist in a single pass over its text, dropping variants and
+// renditions that match declarative rules, without parsing it into a playlist. Only
+// the EXT-X-STREAM-INF, EXT-X-I-FRAME-STREAM-INF and EXT-X-MEDIA tags are tokenized;
+// every other line, and every tag that is kept as is, is copied through byte for
+// byte, so tags and attributes the parser does not model survive. A dropped stream
+// takes its URI line with it, but not the blank lines and comments before it. Streams whose AUDIO or VIDEO group has had every
+// rendition dropped are dropped too, and references to emptied SUBTITLES and
+// CLOSED-CAPTIONS groups are removed. Groups are expected ahead of the streams that
+// use them, as packagers write them; a group first seen after a stream does not
+// affect that stream. A filter is set up once and may then be applied from many
+// threads at once
+class HLSPlaylistFilter
+{
+public:
+    enum class Comparison
+    {
+        // The attribute's value as written, without quotes. A missing attribute
+        // compares as empty
+        EQUAL = 0,
+        NOT_EQUAL,
+
+        // Comma separated list of values
+        IN,
+        NOT_IN,
+
+        // Numeric. RESOLUTION compares both dimensions: LESS and LESS_EQUAL hold for
+        // a resolution within the value's width and height, GREATER and
+        // GREATER_EQUAL for the resolutions they do not. A missing attribute never
+        // matches
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+
+        // CODECS lists a codec of the value's family, given by name (e.g. "HEVC")
+        // or by a codec string (e.g. "hvc1")
+        HAS_CODEC,
+    };
+
+    struct Condition
+    {
+        HLSAttributeName attribute;
+        Comparison comparison;
+        string value;
+    };
+
+    // A rule matches a tag when all of its conditions hold
+    typedef vector<Condition> Rule;
+
+    // Drops every stream and i-frame stream, or media tag, that matches the rule.
+    // A tag is dropped when any of the rules added matches it. Throws
+    // invalid_argument for numbers or codecs that cannot be compared
+    void DropStreams(const Rule& rule);
+    void DropMediaTags(const Rule& rule);
+
+    // Removes an attribute from every stream, or media tag, that is kept
+    void RemoveStreamAttribute(HLSAttributeName attribute);
+    void RemoveMediaAttribute(HLSAttributeName attribute);
+
+    // Appends the filtered playlist to output. Throws logic_error if a tag comes
+    // before #EXTM3U
+    HLSFilterStats Apply(string_view playlist, string& output) const;
+
+private:
+    // A condition prepared for testing: lists split, numbers parsed, codecs resolved
+    struct Test
+    {
+        HLSAttributeName attribute;
+        Comparison comparison;
+        string value;
+        vector<string> values;
+        double number = 0;
+        int width = 0;
+        int height = 0;
+        CodecFamily family = CodecFamily::UNKNOWN;
+    };
+
+    typedef vector<Test> CompiledRule;
+
+    // Values of one tag's attributes, indexed by attribute name
+    struct TagAttributes;
+
+    // A rendition group, and whether any of its renditions has been kept
+    struct Group
+    {
+        string_view type;
+        string_view id;
+        bool hasKept = false;
+    };
+
+    static CompiledRule Compile(const Rule& rule);
+    static bool Matches(const Test& test, const TagAttributes& attributes);
+    static bool Matches(const vector<CompiledRule>& rules, const TagAttributes& attributes);
+
+    // Bit set of HLSAttributeName values
+    static uint64_t AttributeBit(HLSAttributeName attribute) { return uint64_t(1) << static_cast<unsigned>(attribute); }
+
+    vector<CompiledRule> m_streamRules;
+    vector<CompiledRule> m_mediaRules;
+    uint64_t m_removedStreamAttributes = 0;
+    uint64_t m_removedMediaAttributes = 0;
+};
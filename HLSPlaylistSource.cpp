@@ -0,0 +1,206 @@
+#include "HLSPlaylistSource.h"
+#include <system_error>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+HLSPlaylistSource HLSPlaylistSource::MapFile(const string& path)
+{
+    // Windows builds read the file in one go rather than mapping it
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        throw system_error(ENOENT, generic_category(), "Unable to open " + path);
+    }
+
+    HLSPlaylistSource source;
+    source.m_buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    source.m_data = source.m_buffer.data();
+    source.m_length = source.m_buffer.length();
+    return source;
+}
+
+HLSPlaylistSource HLSPlaylistSource::ReadDescriptor(int fd)
+{
+    HLSPlaylistSource source;
+    char buffer[64 * 1024];
+    int bytesRead;
+
+    while ((bytesRead = _read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        source.m_buffer.append(buffer, bytesRead);
+    }
+
+    if (bytesRead < 0)
+    {
+        throw system_error(errno, generic_category(), "Unable to read playlist");
+    }
+
+    source.m_data = source.m_buffer.data();
+    source.m_length = source.m_buffer.length();
+    return source;
+}
+
+#else
+
+HLSPlaylistSource HLSPlaylistSource::MapFile(const string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw system_error(errno, generic_category(), "Unable to open " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        int error = errno;
+        close(fd);
+        throw system_error(error, generic_category(), "Unable to stat " + path);
+    }
+
+    // Only regular files can be mapped. Anything else (a fifo or a device)
+    // is read through the descriptor instead
+    if (!S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        try
+        {
+            HLSPlaylistSource source = ReadDescriptor(fd);
+            close(fd);
+            return source;
+        }
+        catch (...)
+        {
+            close(fd);
+            throw;
+        }
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        throw system_error(error, generic_category(), "Unable to map " + path);
+    }
+
+    // Playlists are parsed front to back exactly once
+    madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+
+    HLSPlaylistSource source;
+    source.m_data = static_cast<const char*>(mapping);
+    source.m_length = info.st_size;
+    source.m_isMapped = true;
+    return source;
+}
+
+HLSPlaylistSource HLSPlaylistSource::ReadDescriptor(int fd)
+{
+    HLSPlaylistSource source;
+
+    // Size the buffer up front when the descriptor knows its length, otherwise
+    // grow it geometrically as data arrives
+    struct stat info;
+    size_t capacity = 64 * 1024;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        capacity = info.st_size + 1;
+    }
+
+    size_t length = 0;
+    source.m_buffer.resize(capacity);
+
+    while (true)
+    {
+        if (length == source.m_buffer.length())
+        {
+            source.m_buffer.resize(source.m_buffer.length() * 2);
+        }
+
+        ssize_t bytesRead = read(fd, &source.m_buffer[length], source.m_buffer.length() - length);
+
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "Unable to read playlist");
+        }
+
+        if (bytesRead == 0)
+        {
+            break;
+        }
+
+        length += bytesRead;
+    }
+
+    source.m_buffer.resize(length);
+    source.m_data = source.m_buffer.data();
+    source.m_length = length;
+    return source;
+}
+
+#endif
+
+HLSPlaylistSource::HLSPlaylistSource(HLSPlaylistSource&& other) noexcept
+{
+    *this = move(other);
+}
+
+HLSPlaylistSource& HLSPlaylistSource::operator = (HLSPlaylistSource&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+
+        m_isMapped = other.m_isMapped;
+        m_length = other.m_length;
+        m_buffer = move(other.m_buffer);
+
+        // An owned buffer may have moved (small strings live inside the object),
+        // so re-point at wherever it lives now
+        m_data = m_isMapped ? other.m_data : m_buffer.data();
+
+        other.m_data = nullptr;
+        other.m_length = 0;
+        other.m_isMapped = false;
+        other.m_buffer.clear();
+    }
+
+    return *this;
+}
+
+HLSPlaylistSource::~HLSPlaylistSource()
+{
+    Release();
+}
+
+void HLSPlaylistSource::Release()
+{
+#ifndef _WIN32
+    if (m_isMapped && m_data)
+    {
+        munmap(const_cast<char*>(m_data), m_length);
+    }
+#endif
+
+    m_data = nullptr;
+    m_length = 0;
+    m_isMapped = false;
+}
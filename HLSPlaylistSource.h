@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Owns the raw bytes of a playlist so that they can be handed straight to
+// HLSMasterPlaylist::ParseMasterPlaylist without going through a stream.
+// Local files are memory mapped where the platform allows it, and anything
+// else (pipes, sockets, stdin) is read from its file descriptor into a single
+// buffer. Failures are reported by throwing system_error
+class HLSPlaylistSource
+{
+public:
+    // Maps a local file read-only. The mapping is released when the source is destroyed
+    static HLSPlaylistSource MapFile(const string& path);
+
+    // Reads everything from an open file descriptor until end of file. The
+    // descriptor is not closed
+    static HLSPlaylistSource ReadDescriptor(int fd);
+
+    HLSPlaylistSource() = default;
+    HLSPlaylistSource(HLSPlaylistSource&& other) noexcept;
+    HLSPlaylistSource& operator = (HLSPlaylistSource&& other) noexcept;
+    HLSPlaylistSource(const HLSPlaylistSource&) = delete;
+    HLSPlaylistSource& operator = (const HLSPlaylistSource&) = delete;
+    ~HLSPlaylistSource();
+
+    string_view View() const { return string_view(m_data, m_length); }
+
+private:
+    void Release();
+
+    const char* m_data = nullptr;
+    size_t m_length = 0;
+
+    // Set when m_data points into a mapping rather than into m_buffer
+    bool m_isMapped = false;
+    string m_buffer;
+};
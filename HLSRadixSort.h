@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Maps a signed value onto an unsigned key with the same ordering, so that
+// negative values (which should never appear, but can be parsed) still sort first
+inline uint64_t OrderedKey(int64_t value)
+{
+    return static_cast<uint64_t>(value) ^ (uint64_t(1) << 63);
+}
+
+// Produces the permutation that stably sorts keys in ascending order, using an
+// LSD radix sort over the bytes of each key. order[i] is the index of the key
+// that belongs at position i, and order must have room for count entries.
+// Bytes that are identical across every key (such as the high bytes of
+// bandwidths) are detected up front and cost no pass at all
+inline void RadixSortOrder(const uint64_t* keys, size_t count, uint32_t* order)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        order[i] = static_cast<uint32_t>(i);
+    }
+
+    if (count < 2)
+    {
+        return;
+    }
+
+    // Histogram every byte position in a single pass over the keys
+    size_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t key = keys[i];
+        for (int byte = 0; byte < 8; byte++)
+        {
+            histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+        }
+    }
+
+    // Passes alternate between the caller's buffer and a scratch buffer
+    vector<uint32_t> scratch(count);
+    uint32_t* source = order;
+    uint32_t* target = scratch.data();
+
+    for (int byte = 0; byte < 8; byte++)
+    {
+        size_t* histogram = histograms[byte];
+
+        // Every key has the same value in this byte, so this pass would not move anything
+        if (histogram[(keys[0] >> (byte * 8)) & 0xFF] == count)
+        {
+            continue;
+        }
+
+        // Turn the counts into starting offsets for each bucket
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            size_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t index = source[i];
+            target[histogram[(keys[index] >> (byte * 8)) & 0xFF]++] = index;
+        }
+
+        swap(source, target);
+    }
+
+    if (source != order)
+    {
+        memcpy(order, source, count * sizeof(uint32_t));
+    }
+}
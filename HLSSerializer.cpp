@@ -0,0 +1,368 @@
+#include "HLSSerializer.h"
+#include <charconv>
+#include <cmath>
+
+void HLSSerializer::AppendNumber(long value)
+{
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    m_buffer.append(digits, result.ptr - digits);
+}
+
+void HLSSerializer::AppendNumber(float value)
+{
+    // Shortest form that reads back as the same float, so 29.97 stays 29.97
+    char digits[48];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    m_buffer.append(digits, result.ptr - digits);
+}
+
+void HLSSerializer::AppendQuoted(string_view text)
+{
+    Append('\"');
+
+    if (m_format == SerializeFormat::M3U8)
+    {
+        // Quoted strings in a playlist cannot contain quotes or line breaks, and the
+        // parser never produces values that do
+        Append(text);
+    }
+    else
+    {
+        size_t runStart = 0;
+
+        for (size_t pos = 0; pos < text.length(); pos++)
+        {
+            unsigned char c = static_cast<unsigned char>(text[pos]);
+
+            if (c != '\"' && c != '\\' && c >= 0x20)
+            {
+                continue;
+            }
+
+            Append(text.substr(runStart, pos - runStart));
+            runStart = pos + 1;
+
+            if (c == '\"' || c == '\\')
+            {
+                Append('\\');
+                Append(static_cast<char>(c));
+            }
+            else
+            {
+                static const char hex[] = "0123456789abcdef";
+                Append("\\u00");
+                Append(hex[c >> 4]);
+                Append(hex[c & 0xF]);
+            }
+        }
+
+        Append(text.substr(runStart));
+    }
+
+    Append('\"');
+}
+
+void HLSSerializer::AppendMember(string_view name, bool isFirst)
+{
+    if (!isFirst)
+    {
+        Append(',');
+    }
+
+    Append('\"');
+    Append(name);
+    Append("\":");
+}
+
+void HLSSerializer::Write(const HLSMasterPlaylist::Resolution& resolution)
+{
+    if (m_format == SerializeFormat::M3U8)
+    {
+        AppendNumber(long(resolution.width));
+        Append('x');
+        AppendNumber(long(resolution.height));
+        return;
+    }
+
+    Append('{');
+    AppendMember("width", true);
+    AppendNumber(long(resolution.width));
+    AppendMember("height");
+    AppendNumber(long(resolution.height));
+    Append('}');
+}
+
+void HLSSerializer::Write(const HLSMasterPlaylist::MediaTag& mediaTag)
+{
+    if (m_format == SerializeFormat::M3U8)
+    {
+        Append("#EXT-X-MEDIA:TYPE=");
+        Append(MediaTypeToString(mediaTag.type));
+        Append(",GROUP-ID=");
+        AppendQuoted(mediaTag.id.View());
+        Append(",NAME=");
+        AppendQuoted(mediaTag.name);
+        Append(mediaTag.isDefault ? ",DEFAULT=YES" : ",DEFAULT=NO");
+        Append(mediaTag.autoSelect ? ",AUTOSELECT=YES" : ",AUTOSELECT=NO");
+
+        if (!mediaTag.language.empty())
+        {
+            Append(",LANGUAGE=");
+            AppendQuoted(mediaTag.language.View());
+        }
+
+        if (!mediaTag.channels.empty())
+        {
+            Append(",CHANNELS=");
+            AppendQuoted(mediaTag.channels.View());
+        }
+
+        if (!mediaTag.uri.empty())
+        {
+            Append(",URI=");
+            AppendQuoted(mediaTag.uri);
+        }
+
+        return;
+    }
+
+    Append('{');
+    AppendMember("type", true);
+    AppendQuoted(MediaTypeToString(mediaTag.type));
+    AppendMember("groupId");
+    AppendQuoted(mediaTag.id.View());
+    AppendMember("name");
+    AppendQuoted(mediaTag.name);
+    AppendMember("default");
+    Append(mediaTag.isDefault ? "true" : "false");
+    AppendMember("autoSelect");
+    Append(mediaTag.autoSelect ? "true" : "false");
+
+    if (!mediaTag.language.empty())
+    {
+        AppendMember("language");
+        AppendQuoted(mediaTag.language.View());
+    }
+
+    if (!mediaTag.channels.empty())
+    {
+        AppendMember("channels");
+        AppendQuoted(mediaTag.channels.View());
+    }
+
+    if (!mediaTag.uri.empty())
+    {
+        AppendMember("uri");
+        AppendQuoted(mediaTag.uri);
+    }
+
+    Append('}');
+}
+
+void HLSSerializer::Write(const HLSMasterPlaylist::StreamInfo& streamInfo)
+{
+    bool isM3U8 = m_format == SerializeFormat::M3U8;
+
+    if (isM3U8)
+    {
+        Append(streamInfo.type == StreamType::IFRAME ? "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=" : "#EXT-X-STREAM-INF:BANDWIDTH=");
+    }
+    else
+    {
+        Append('{');
+        AppendMember("bandwidth", true);
+    }
+
+    AppendNumber(streamInfo.bandwidth);
+
+    if (streamInfo.avgBandwidth > 0)
+    {
+        isM3U8 ? Append(",AVERAGE-BANDWIDTH=") : AppendMember("averageBandwidth");
+        AppendNumber(streamInfo.avgBandwidth);
+    }
+
+    if (!streamInfo.codecs.empty())
+    {
+        isM3U8 ? Append(",CODECS=") : AppendMember("codecs");
+        AppendQuoted(streamInfo.codecs.View());
+    }
+
+    if (streamInfo.resolution.width > 0)
+    {
+        isM3U8 ? Append(",RESOLUTION=") : AppendMember("resolution");
+        Write(streamInfo.resolution);
+    }
+
+    // Neither format has a spelling for infinity or NaN
+    if (streamInfo.frameRate > 0 && isfinite(streamInfo.frameRate))
+    {
+        isM3U8 ? Append(",FRAME-RATE=") : AppendMember("frameRate");
+        AppendNumber(streamInfo.frameRate);
+    }
+
+    if (!streamInfo.videoRange.empty())
+    {
+        // An enumerated string, so it is not quoted in a playlist
+        if (isM3U8)
+        {
+            Append(",VIDEO-RANGE=");
+            Append(streamInfo.videoRange.View());
+        }
+        else
+        {
+            AppendMember("videoRange");
+            AppendQuoted(streamInfo.videoRange.View());
+        }
+    }
+
+    if (streamInfo.audio)
+    {
+        isM3U8 ? Append(",AUDIO=") : AppendMember("audio");
+        AppendQuoted(streamInfo.audio->id.View());
+    }
+
+    if (streamInfo.video)
+    {
+        isM3U8 ? Append(",VIDEO=") : AppendMember("video");
+        AppendQuoted(streamInfo.video->id.View());
+    }
+
+    if (streamInfo.subtitles)
+    {
+        isM3U8 ? Append(",SUBTITLES=") : AppendMember("subtitles");
+        AppendQuoted(streamInfo.subtitles->id.View());
+    }
+
+    if (streamInfo.closedCaptions)
+    {
+        isM3U8 ? Append(",CLOSED-CAPTIONS=") : AppendMember("closedCaptions");
+        AppendQuoted(streamInfo.closedCaptions->id.View());
+    }
+
+    if (!isM3U8)
+    {
+        AppendMember("uri");
+        AppendQuoted(streamInfo.uri);
+        Append('}');
+    }
+    else if (streamInfo.type == StreamType::IFRAME)
+    {
+        Append(",URI=");
+        AppendQuoted(streamInfo.uri);
+    }
+    else
+    {
+        // The URI of a media stream goes on the line after its tag
+        Append('\n');
+        Append(streamInfo.uri);
+    }
+}
+
+void HLSSerializer::Write(const HLSMasterPlaylist& playlist)
+{
+    Write(playlist, playlist.GetSortParameter(), playlist.IsAscendingSort());
+}
+
+void HLSSerializer::Write(const HLSMasterPlaylist& playlist, SortParameter sortParam, bool isAscending)
+{
+    HLSParseMetrics* metrics = playlist.GetMetrics();
+    uint64_t start = 0;
+
+    if (metrics)
+    {
+        // Build the order first if it is missing, so that it is counted as sorting
+        playlist.GetMediaTags(sortParam, isAscending);
+        start = HLSParseMetrics::Now();
+    }
+
+    if (m_format == SerializeFormat::M3U8)
+    {
+        WriteM3U8(playlist, sortParam, isAscending);
+    }
+    else
+    {
+        WriteJSON(playlist, sortParam, isAscending);
+    }
+
+    if (metrics)
+    {
+        metrics->AddSerializeNs(HLSParseMetrics::Now() - start);
+    }
+}
+
+void HLSSerializer::WriteM3U8(const HLSMasterPlaylist& playlist, SortParameter sortParam, bool isAscending)
+{
+    // Output the info in the following way:
+    //  1: output any global tags present
+    //  2: output all media types in sorted order
+    //  3. output all i-streams in sorted order
+    //  4. Output all regular streams in sorted order
+    Append("#EXTM3U\n# Sorting order: ");
+    Append(SortTypeToString(sortParam));
+    Append('\n');
+
+    // Currently the only supported global tag is INDEPENDENT_SEGMENTS
+    if (playlist.HasIndependentSegments())
+    {
+        Append("#EXT-X-INDEPENDENT-SEGMENTS\n");
+    }
+
+    Append("\n# Media Types\n");
+    for (const auto& mediaTag : playlist.GetMediaTags(sortParam, isAscending))
+    {
+        Write(mediaTag);
+        Append('\n');
+    }
+
+    Append("\n# I-Frame Streams\n");
+    for (const auto& stream : playlist.GetIStreams(sortParam, isAscending))
+    {
+        Write(stream);
+        Append('\n');
+    }
+
+    Append("\n# Media Streams\n");
+    for (const auto& stream : playlist.GetStreams(sortParam, isAscending))
+    {
+        Write(stream);
+        Append('\n');
+    }
+}
+
+void HLSSerializer::WriteJSON(const HLSMasterPlaylist& playlist, SortParameter sortParam, bool isAscending)
+{
+    Append('{');
+    AppendMember("sortOrder", true);
+    AppendQuoted(SortTypeToString(sortParam));
+    AppendMember("ascending");
+    Append(isAscending ? "true" : "false");
+    AppendMember("independentSegments");
+    Append(playlist.HasIndependentSegments() ? "true" : "false");
+
+    WriteJSONArray("mediaTags", playlist.GetMediaTags(sortParam, isAscending));
+    WriteJSONArray("iFrameStreams", playlist.GetIStreams(sortParam, isAscending));
+    WriteJSONArray("streams", playlist.GetStreams(sortParam, isAscending));
+    Append("}\n");
+}
+
+template <typename View>
+void HLSSerializer::WriteJSONArray(string_view name, const View& items)
+{
+    AppendMember(name);
+    Append('[');
+
+    bool isFirst = true;
+    for (const auto& item : items)
+    {
+        if (!isFirst)
+        {
+            Append(',');
+        }
+
+        isFirst = false;
+        Write(item);
+    }
+
+    Append(']');
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include "HLSMasterPlaylist.h"
+
+using namespace std;
+
+enum class SerializeFormat
+{
+    M3U8 = 0,
+    JSON
+};
+
+// Writes playlists, or parts of them, as text appended to a buffer owned by the
+// caller. Numbers are formatted with to_chars and nothing goes through an ostream,
+// so a buffer that is cleared and reused between playlists stops allocating once it
+// has grown to fit. M3U8 output is a valid master playlist, with the sort order and
+// section headings written as comments. JSON output carries the same fields
+class HLSSerializer
+{
+public:
+    explicit HLSSerializer(string& buffer, SerializeFormat format = SerializeFormat::M3U8) :
+        m_buffer(buffer), m_format(format) {}
+
+    // Writes the whole playlist in the order selected by its last Sort
+    void Write(const HLSMasterPlaylist& playlist);
+
+    // Writes the whole playlist in the given order
+    void Write(const HLSMasterPlaylist& playlist, SortParameter sortParam, bool isAscending);
+
+    // Writes a single tag, without a line terminator in M3U8. A media stream is
+    // followed by its URI line
+    void Write(const HLSMasterPlaylist::MediaTag& mediaTag);
+    void Write(const HLSMasterPlaylist::StreamInfo& streamInfo);
+    void Write(const HLSMasterPlaylist::Resolution& resolution);
+
+private:
+    void WriteM3U8(const HLSMasterPlaylist& playlist, SortParameter sortParam, bool isAscending);
+    void WriteJSON(const HLSMasterPlaylist& playlist, SortParameter sortParam, bool isAscending);
+
+    template <typename View>
+    void WriteJSONArray(string_view name, const View& items);
+
+    void Append(string_view text) { m_buffer.append(text.data(), text.length()); }
+    void Append(char c) { m_buffer.push_back(c); }
+    void AppendNumber(long value);
+    void AppendNumber(float value);
+
+    // A quoted-string attribute value in M3U8, or a string in JSON
+    void AppendQuoted(string_view text);
+
+    // JSON only: a "name": prefix, preceded by a separator unless it is the first
+    // member of its object
+    void AppendMember(string_view name, bool isFirst = false);
+
+    string& m_buffer;
+    SerializeFormat m_format;
+};
@@ -0,0 +1,270 @@
+#include "HLSSnapshot.h"
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+static_assert(sizeof(float) == 4, "Snapshots store 32-bit floats");
+
+// Collects the strings of a snapshot, storing each distinct one once
+class SnapshotStrings
+{
+public:
+    // Returns the offset and length of text in the string section
+    pair<uint32_t, uint32_t> Add(string_view text)
+    {
+        if (text.empty())
+        {
+            return { 0, 0 };
+        }
+
+        auto found = m_offsets.find(text);
+        if (found != m_offsets.end())
+        {
+            return { found->second, static_cast<uint32_t>(text.length()) };
+        }
+
+        if (m_data.length() + text.length() > UINT32_MAX)
+        {
+            throw length_error("Playlist too large for a snapshot");
+        }
+
+        uint32_t offset = static_cast<uint32_t>(m_data.length());
+        m_data.append(text.data(), text.length());
+
+        // Keyed by the playlist's own text, which outlives the writer, as m_data
+        // moves when it grows
+        m_offsets.emplace(text, offset);
+        return { offset, static_cast<uint32_t>(text.length()) };
+    }
+
+    const string& Data() const { return m_data; }
+
+private:
+    string m_data;
+    unordered_map<string_view, uint32_t> m_offsets;
+};
+
+// Appends a record to buffer as raw bytes
+template <typename T>
+static void AppendRecord(string& buffer, const T& record)
+{
+    buffer.append(reinterpret_cast<const char*>(&record), sizeof(T));
+}
+
+// Pads buffer so that the next record starts 8-byte aligned relative to start
+static void Align(string& buffer, size_t start)
+{
+    buffer.append((8 - (buffer.length() - start) % 8) % 8, '\0');
+}
+
+void HLSSnapshot::Write(const HLSMasterPlaylist& playlist, string& buffer)
+{
+    // Parse order throughout
+    HLSMasterPlaylist::MediaTagView mediaTags = playlist.GetMediaTags(SortParameter::DEFAULT, true);
+    HLSMasterPlaylist::StreamView streams = playlist.GetStreams(SortParameter::DEFAULT, true);
+    HLSMasterPlaylist::StreamView iStreams = playlist.GetIStreams(SortParameter::DEFAULT, true);
+
+    SnapshotStrings strings;
+    auto stringRef = [&strings](string_view text)
+    {
+        auto added = strings.Add(text);
+        return StringRef{ added.first, added.second };
+    };
+
+    // Streams refer to media tags by index
+    unordered_map<const HLSMasterPlaylist::MediaTag*, uint32_t> tagIndexes;
+    vector<MediaTagRecord> tagRecords;
+    tagRecords.reserve(mediaTags.size());
+
+    for (const HLSMasterPlaylist::MediaTag& mediaTag : mediaTags)
+    {
+        tagIndexes.emplace(&mediaTag, static_cast<uint32_t>(tagRecords.size()));
+
+        MediaTagRecord record = {};
+        record.id = stringRef(mediaTag.id.View());
+        record.uri = stringRef(mediaTag.uri);
+        record.name = stringRef(mediaTag.name);
+        record.language = stringRef(mediaTag.language.View());
+        record.channels = stringRef(mediaTag.channels.View());
+        record.type = static_cast<uint8_t>(mediaTag.type);
+        record.isDefault = mediaTag.isDefault;
+        record.autoSelect = mediaTag.autoSelect;
+        tagRecords.push_back(record);
+    }
+
+    auto tagIndex = [&tagIndexes](const HLSMasterPlaylist::MediaTag* mediaTag)
+    {
+        auto found = mediaTag ? tagIndexes.find(mediaTag) : tagIndexes.end();
+        return found == tagIndexes.end() ? NoIndex : found->second;
+    };
+
+    auto streamRecords = [&](const HLSMasterPlaylist::StreamView& view)
+    {
+        vector<StreamRecord> records;
+        records.reserve(view.size());
+
+        for (const HLSMasterPlaylist::StreamInfo& stream : view)
+        {
+            StreamRecord record = {};
+            record.bandwidth = stream.bandwidth;
+            record.avgBandwidth = stream.avgBandwidth;
+            record.codecs = stringRef(stream.codecs.View());
+            record.uri = stringRef(stream.uri);
+            record.videoRange = stringRef(stream.videoRange.View());
+            record.width = stream.resolution.width;
+            record.height = stream.resolution.height;
+            record.frameRate = stream.frameRate;
+            record.audio = tagIndex(stream.audio);
+            record.video = tagIndex(stream.video);
+            record.subtitles = tagIndex(stream.subtitles);
+            record.closedCaptions = tagIndex(stream.closedCaptions);
+            record.type = static_cast<uint8_t>(stream.type);
+            records.push_back(record);
+        }
+
+        return records;
+    };
+
+    vector<StreamRecord> streamRecordList = streamRecords(streams);
+    vector<StreamRecord> iStreamRecordList = streamRecords(iStreams);
+
+    // Header, media tags, streams, i-frame streams, then strings
+    Header header = {};
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = 0x01020304;
+    header.flags = playlist.HasIndependentSegments() ? uint32_t(INDEPENDENT_SEGMENTS) : 0;
+    header.mediaTagCount = static_cast<uint32_t>(tagRecords.size());
+    header.streamCount = static_cast<uint32_t>(streamRecordList.size());
+    header.iStreamCount = static_cast<uint32_t>(iStreamRecordList.size());
+    header.mediaTagOffset = sizeof(Header);
+    header.streamOffset = header.mediaTagOffset + tagRecords.size() * sizeof(MediaTagRecord);
+    header.iStreamOffset = header.streamOffset + streamRecordList.size() * sizeof(StreamRecord);
+    header.stringOffset = header.iStreamOffset + iStreamRecordList.size() * sizeof(StreamRecord);
+    header.stringLength = strings.Data().length();
+    header.totalLength = header.stringOffset + header.stringLength;
+
+    size_t start = buffer.length();
+    buffer.reserve(start + header.totalLength + 8);
+
+    AppendRecord(buffer, header);
+    for (const MediaTagRecord& record : tagRecords)
+    {
+        AppendRecord(buffer, record);
+    }
+
+    for (const StreamRecord& record : streamRecordList)
+    {
+        AppendRecord(buffer, record);
+    }
+
+    for (const StreamRecord& record : iStreamRecordList)
+    {
+        AppendRecord(buffer, record);
+    }
+
+    buffer += strings.Data();
+
+    // Snapshots written back to back each start aligned
+    Align(buffer, start);
+}
+
+HLSSnapshot::HLSSnapshot(string_view data) :
+    m_data(data)
+{
+    if (reinterpret_cast<uintptr_t>(data.data()) % 8 != 0)
+    {
+        throw invalid_argument("Playlist snapshot is not 8-byte aligned");
+    }
+
+    if (data.length() < sizeof(Header))
+    {
+        throw runtime_error("Not a playlist snapshot");
+    }
+
+    m_header = reinterpret_cast<const Header*>(data.data());
+
+    if (memcmp(m_header->magic, Magic, sizeof(Magic)) != 0 || m_header->byteOrder != 0x01020304)
+    {
+        throw runtime_error("Not a playlist snapshot");
+    }
+
+    if (m_header->version != Version)
+    {
+        throw runtime_error("Unsupported playlist snapshot version " + to_string(m_header->version));
+    }
+
+    // Every section must lie where the counts say, inside the data. Strings are
+    // checked when they are read
+    const Header& header = *m_header;
+    if (header.totalLength > data.length() ||
+        header.mediaTagOffset != sizeof(Header) ||
+        header.streamOffset != header.mediaTagOffset + uint64_t(header.mediaTagCount) * sizeof(MediaTagRecord) ||
+        header.iStreamOffset != header.streamOffset + uint64_t(header.streamCount) * sizeof(StreamRecord) ||
+        header.stringOffset != header.iStreamOffset + uint64_t(header.iStreamCount) * sizeof(StreamRecord) ||
+        header.stringOffset + header.stringLength != header.totalLength)
+    {
+        throw runtime_error("Corrupt playlist snapshot");
+    }
+
+    m_mediaTags = reinterpret_cast<const MediaTagRecord*>(data.data() + header.mediaTagOffset);
+    m_streams = reinterpret_cast<const StreamRecord*>(data.data() + header.streamOffset);
+    m_iStreams = reinterpret_cast<const StreamRecord*>(data.data() + header.iStreamOffset);
+    m_strings = data.substr(header.stringOffset, header.stringLength);
+}
+
+bool HLSSnapshot::HasIndependentSegments() const
+{
+    return (m_header->flags & INDEPENDENT_SEGMENTS) != 0;
+}
+
+HLSSnapshot::MediaTag HLSSnapshot::GetMediaTag(size_t index) const
+{
+    if (index >= m_header->mediaTagCount)
+    {
+        throw out_of_range("Media tag index out of range");
+    }
+
+    return MediaTag(this, m_mediaTags + index);
+}
+
+HLSSnapshot::Stream HLSSnapshot::GetStream(size_t index) const
+{
+    if (index >= m_header->streamCount)
+    {
+        throw out_of_range("Stream index out of range");
+    }
+
+    return Stream(this, m_streams + index);
+}
+
+HLSSnapshot::Stream HLSSnapshot::GetIStream(size_t index) const
+{
+    if (index >= m_header->iStreamCount)
+    {
+        throw out_of_range("I-frame stream index out of range");
+    }
+
+    return Stream(this, m_iStreams + index);
+}
+
+HLSSnapshot::MediaTag HLSSnapshot::GetReferencedTag(uint32_t index) const
+{
+    if (index == NoIndex)
+    {
+        return MediaTag();
+    }
+
+    return GetMediaTag(index);
+}
+
+string_view HLSSnapshot::String(StringRef ref) const
+{
+    if (uint64_t(ref.offset) + ref.length > m_strings.length())
+    {
+        throw runtime_error("Corrupt playlist snapshot");
+    }
+
+    return m_strings.substr(ref.offset, ref.length);
+}
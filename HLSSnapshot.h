@@ -0,0 +1,185 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "HLSMasterPlaylist.h"
+
+using namespace std;
+
+// A parsed master playlist saved as one binary blob, so that it can be loaded again
+// without parsing. The blob is position independent: records refer to each other by
+// index and to their strings by offset, so it can be written to a file, mapped (for
+// example with HLSPlaylistSource::MapFile) and read where it lies. Opening a snapshot
+// only checks its header; fields are bounds checked as they are read. Strings that
+// repeat, such as codecs and group IDs, are stored once. Snapshots hold every media
+// tag, stream and i-frame stream in parse order, and the media tag each stream refers
+// to. Sort orders are not saved. The layout is that of the machine that wrote it, and
+// a snapshot from a machine of the other byte order is rejected
+class HLSSnapshot
+{
+public:
+    // Incremented whenever the layout changes. Older snapshots are rejected rather
+    // than misread
+    static constexpr uint32_t Version = 2;
+
+    // Appends a snapshot of playlist to buffer. The snapshot's records are 8-byte
+    // aligned relative to its start, which readers need to hold too
+    static void Write(const HLSMasterPlaylist& playlist, string& buffer);
+
+    class MediaTag;
+    class Stream;
+
+    // Opens a snapshot held in memory, which must stay alive and unchanged for as long
+    // as the snapshot and anything read from it. Throws runtime_error if the data is not
+    // a snapshot of this version, or invalid_argument if it is not 8-byte aligned
+    explicit HLSSnapshot(string_view data);
+
+    bool HasIndependentSegments() const;
+
+    size_t MediaTagCount() const { return m_header->mediaTagCount; }
+    size_t StreamCount() const { return m_header->streamCount; }
+    size_t IStreamCount() const { return m_header->iStreamCount; }
+
+    // Indexes past the end throw out_of_range
+    MediaTag GetMediaTag(size_t index) const;
+    Stream GetStream(size_t index) const;
+    Stream GetIStream(size_t index) const;
+
+private:
+    // Where a string lies in the string section
+    struct StringRef
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+
+        // Written as 0x01020304, so a snapshot from a machine of the other byte order
+        // reads differently
+        uint32_t byteOrder;
+
+        uint32_t flags;
+        uint32_t mediaTagCount;
+        uint32_t streamCount;
+        uint32_t iStreamCount;
+
+        // Offsets from the start of the snapshot
+        uint64_t mediaTagOffset;
+        uint64_t streamOffset;
+        uint64_t iStreamOffset;
+        uint64_t stringOffset;
+        uint64_t stringLength;
+        uint64_t totalLength;
+    };
+
+    struct MediaTagRecord
+    {
+        StringRef id;
+        StringRef uri;
+        StringRef name;
+        StringRef language;
+        StringRef channels;
+        uint8_t type;
+        uint8_t isDefault;
+        uint8_t autoSelect;
+        uint8_t reserved[5];
+    };
+
+    struct StreamRecord
+    {
+        int64_t bandwidth;
+        int64_t avgBandwidth;
+        StringRef codecs;
+        StringRef uri;
+        StringRef videoRange;
+        int32_t width;
+        int32_t height;
+        float frameRate;
+
+        // Media tag indexes, or NoIndex
+        uint32_t audio;
+        uint32_t video;
+        uint32_t subtitles;
+        uint32_t closedCaptions;
+        uint8_t type;
+        uint8_t reserved[3];
+    };
+
+    enum HeaderFlags : uint32_t
+    {
+        INDEPENDENT_SEGMENTS = 1,
+    };
+
+    static constexpr uint32_t NoIndex = UINT32_MAX;
+    static constexpr char Magic[8] = { 'H', 'L', 'S', 'S', 'N', 'A', 'P', '\0' };
+
+    string_view String(StringRef ref) const;
+
+    string_view m_data;
+    const Header* m_header;
+    const MediaTagRecord* m_mediaTags;
+    const StreamRecord* m_streams;
+    const StreamRecord* m_iStreams;
+    string_view m_strings;
+
+public:
+    // A media tag read in place
+    class MediaTag
+    {
+    public:
+        MediaTag() = default;
+
+        // False for the missing media tag of a stream that refers to none
+        explicit operator bool () const { return m_record != nullptr; }
+
+        string_view Id() const { return m_snapshot->String(m_record->id); }
+        MediaType Type() const { return static_cast<MediaType>(m_record->type); }
+        string_view Uri() const { return m_snapshot->String(m_record->uri); }
+        string_view Name() const { return m_snapshot->String(m_record->name); }
+        string_view Language() const { return m_snapshot->String(m_record->language); }
+        string_view Channels() const { return m_snapshot->String(m_record->channels); }
+        bool IsDefault() const { return m_record->isDefault != 0; }
+        bool AutoSelect() const { return m_record->autoSelect != 0; }
+
+    private:
+        friend class HLSSnapshot;
+        MediaTag(const HLSSnapshot* snapshot, const MediaTagRecord* record) : m_snapshot(snapshot), m_record(record) {}
+
+        const HLSSnapshot* m_snapshot = nullptr;
+        const MediaTagRecord* m_record = nullptr;
+    };
+
+    // A stream or i-frame stream read in place
+    class Stream
+    {
+    public:
+        StreamType Type() const { return static_cast<StreamType>(m_record->type); }
+        long Bandwidth() const { return static_cast<long>(m_record->bandwidth); }
+        long AvgBandwidth() const { return static_cast<long>(m_record->avgBandwidth); }
+        string_view Codecs() const { return m_snapshot->String(m_record->codecs); }
+        string_view Uri() const { return m_snapshot->String(m_record->uri); }
+        string_view VideoRange() const { return m_snapshot->String(m_record->videoRange); }
+        HLSMasterPlaylist::Resolution GetResolution() const { return { m_record->width, m_record->height }; }
+        float FrameRate() const { return m_record->frameRate; }
+
+        // The media tags the stream refers to, which test false when it has none
+        MediaTag Audio() const { return m_snapshot->GetReferencedTag(m_record->audio); }
+        MediaTag Video() const { return m_snapshot->GetReferencedTag(m_record->video); }
+        MediaTag Subtitles() const { return m_snapshot->GetReferencedTag(m_record->subtitles); }
+        MediaTag ClosedCaptions() const { return m_snapshot->GetReferencedTag(m_record->closedCaptions); }
+
+    private:
+        friend class HLSSnapshot;
+        Stream(const HLSSnapshot* snapshot, const StreamRecord* record) : m_snapshot(snapshot), m_record(record) {}
+
+        const HLSSnapshot* m_snapshot;
+        const StreamRecord* m_record;
+    };
+
+private:
+    MediaTag GetReferencedTag(uint32_t index) const;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+using namespace std;
+
+// A read-only view of a list in some order, made of the list itself and a
+// permutation of its indexes. Views do not copy or own anything. They are valid
+// until the playlist that produced them is parsed again or destroyed. A view with
+// no permutation presents the list in its original order. Lists of pointers are
+// dereferenced, so a view always yields references to the underlying items
+template <typename Item>
+class SortedView
+{
+public:
+    typedef remove_cv_t<remove_pointer_t<Item>> value_type;
+
+    class Iterator
+    {
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef typename SortedView::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        Iterator(const SortedView* view, size_t pos) : m_view(view), m_pos(pos) {}
+
+        reference operator * () const { return (*m_view)[m_pos]; }
+        pointer operator -> () const { return &(*m_view)[m_pos]; }
+        Iterator& operator ++ () { m_pos++; return *this; }
+        Iterator operator ++ (int) { Iterator old = *this; m_pos++; return old; }
+        bool operator == (const Iterator& other) const { return m_pos == other.m_pos; }
+        bool operator != (const Iterator& other) const { return m_pos != other.m_pos; }
+
+    private:
+        const SortedView* m_view;
+        size_t m_pos;
+    };
+
+    SortedView(const Item* items, size_t count, const uint32_t* order) :
+        m_items(items), m_count(count), m_order(order) {}
+
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+    const value_type& operator [] (size_t pos) const
+    {
+        return Get(m_items[m_order ? m_order[pos] : pos]);
+    }
+
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, size()); }
+
+private:
+    static const value_type& Get(const value_type& item) { return item; }
+    static const value_type& Get(const value_type* item) { return *item; }
+
+    const Item* m_items;
+    size_t m_count;
+    const uint32_t* m_order;
+};
@@ -0,0 +1,256 @@
+#include "HLSStructuralIndex.h"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HLS_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit vector instructions inside functions marked for them,
+// which lets the AVX2 path live in a binary that must still run without AVX2
+#if defined(__GNUC__) || defined(__clang__)
+#define HLS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HLS_TARGET(isa)
+#endif
+
+const char* ScanLevelToString(ScanLevel level)
+{
+    switch (level)
+    {
+        case ScanLevel::SCALAR: return "SCALAR";
+        case ScanLevel::SSE2: return "SSE2";
+        case ScanLevel::AVX2: return "AVX2";
+        default: throw invalid_argument("Unimplemented item");
+    }
+}
+
+// Appends positions to an index. Storage is grown ahead of each block instead of
+// checked per position, and is never shrunk, so rebuilding an index of similar
+// size writes positions straight into memory that is already there
+class PositionWriter
+{
+public:
+    PositionWriter(vector<uint32_t>& positions) : m_positions(positions) {}
+
+    // Makes room for at least count more positions
+    void Reserve(size_t count)
+    {
+        if (m_count + count > m_positions.size())
+        {
+            m_positions.resize(max(m_positions.size() * 2, m_count + count));
+        }
+    }
+
+    // Adds the offset of every set bit of mask, lowest first. Room for one position
+    // per bit must have been reserved
+    void AppendMask(uint32_t mask, size_t blockStart);
+
+    void Append(size_t pos)
+    {
+        Reserve(1);
+        m_positions[m_count++] = static_cast<uint32_t>(pos);
+    }
+
+    size_t Count() const { return m_count; }
+
+private:
+    vector<uint32_t>& m_positions;
+    size_t m_count = 0;
+};
+
+static void ScanScalar(const char* text, size_t pos, size_t length, PositionWriter& positions)
+{
+    for (; pos < length; pos++)
+    {
+        switch (text[pos])
+        {
+            case '\n':
+            case '=':
+            case ',':
+            case '\"':
+                positions.Append(pos);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+#ifdef HLS_SCAN_X86
+
+static inline unsigned CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+void PositionWriter::AppendMask(uint32_t mask, size_t blockStart)
+{
+    uint32_t* out = m_positions.data() + m_count;
+
+    while (mask != 0)
+    {
+        *out++ = static_cast<uint32_t>(blockStart + CountTrailingZeros(mask));
+        mask &= mask - 1;
+    }
+
+    m_count = out - m_positions.data();
+}
+
+HLS_TARGET("sse2")
+static size_t ScanSse2(const char* text, size_t length, PositionWriter& positions)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i equals = _mm_set1_epi8('=');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('\"');
+
+    size_t pos = 0;
+    for (; pos + 16 <= length; pos += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+        __m128i matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, newline), _mm_cmpeq_epi8(block, equals)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, comma), _mm_cmpeq_epi8(block, quote)));
+
+        positions.Reserve(16);
+        positions.AppendMask(static_cast<uint32_t>(_mm_movemask_epi8(matches)), pos);
+    }
+
+    return pos;
+}
+
+HLS_TARGET("avx2")
+static size_t ScanAvx2(const char* text, size_t length, PositionWriter& positions)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i equals = _mm256_set1_epi8('=');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('\"');
+
+    size_t pos = 0;
+    for (; pos + 32 <= length; pos += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos));
+        __m256i matches = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, newline), _mm256_cmpeq_epi8(block, equals)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, comma), _mm256_cmpeq_epi8(block, quote)));
+
+        positions.Reserve(32);
+        positions.AppendMask(static_cast<uint32_t>(_mm256_movemask_epi8(matches)), pos);
+    }
+
+    return pos;
+}
+
+static bool HasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // The OS must save the YMM registers as well as the CPU supporting the instructions
+    __cpuid(info, 1);
+    bool hasOsSupport = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+
+    __cpuidex(info, 7, 0);
+    return hasOsSupport && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool HasSse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+ScanLevel HLSStructuralIndex::BestLevel()
+{
+    static const ScanLevel s_bestLevel = []()
+    {
+#ifdef HLS_SCAN_X86
+        if (HasAvx2())
+        {
+            return ScanLevel::AVX2;
+        }
+
+        if (HasSse2())
+        {
+            return ScanLevel::SSE2;
+        }
+#endif
+        return ScanLevel::SCALAR;
+    }();
+
+    return s_bestLevel;
+}
+
+void HLSStructuralIndex::Build(string_view text, ScanLevel level)
+{
+    if (text.length() > UINT32_MAX)
+    {
+        throw length_error("Playlist too large to index");
+    }
+
+    if (level > BestLevel())
+    {
+        level = BestLevel();
+    }
+
+    m_text = text;
+
+    // Tags carry a structural character every few bytes, so sizing the index up
+    // front saves most of the regrowth on the first build
+    if (m_positions.size() < text.length() / 8)
+    {
+        m_positions.resize(text.length() / 8);
+    }
+
+    PositionWriter positions(m_positions);
+    size_t scanned = 0;
+
+#ifdef HLS_SCAN_X86
+    switch (level)
+    {
+        case ScanLevel::AVX2:
+            scanned = ScanAvx2(text.data(), text.length(), positions);
+            break;
+        case ScanLevel::SSE2:
+            scanned = ScanSse2(text.data(), text.length(), positions);
+            break;
+        default:
+            break;
+    }
+#endif
+
+    // Whatever the vector loops could not cover in whole blocks
+    ScanScalar(text.data(), scanned, text.length(), positions);
+    m_count = positions.Count();
+}
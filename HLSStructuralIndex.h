@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Instruction sets the structural scanner can use. Every level produces exactly
+// the same index; higher levels only get there faster
+enum class ScanLevel
+{
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+const char* ScanLevelToString(ScanLevel level);
+
+// The offsets of every character that gives a playlist its structure: line feeds,
+// '=', ',' and '"'. The whole buffer is scanned once, several bytes at a time, and
+// the tokenizers then hop from one structural character to the next instead of
+// searching the text byte by byte
+class HLSStructuralIndex
+{
+public:
+    // The best level supported by the CPU we are running on, detected once
+    static ScanLevel BestLevel();
+
+    // Indexes text, replacing the previous index. Levels above BestLevel fall back
+    // to BestLevel. The text must outlive any use of the index
+    void Build(string_view text, ScanLevel level = BestLevel());
+
+    // Frees the storage, leaving an empty index
+    void Release()
+    {
+        m_text = string_view();
+        vector<uint32_t>().swap(m_positions);
+        m_count = 0;
+    }
+
+    string_view Text() const { return m_text; }
+    const uint32_t* begin() const { return m_positions.data(); }
+    const uint32_t* end() const { return m_positions.data() + m_count; }
+    size_t size() const { return m_count; }
+
+private:
+    string_view m_text;
+
+    // Storage for the positions, of which the first m_count are in use. It is kept
+    // between builds so that reindexing does not allocate once it has grown
+    vector<uint32_t> m_positions;
+    size_t m_count = 0;
+};
+
+// Walks the structural positions that fall inside a window of indexed text. Finds
+// and windows must be asked for at offsets that never go backwards, which is how
+// the tokenizers read. A default constructed cursor is not indexed, and tokenizers
+// given one search the text instead
+class HLSStructureCursor
+{
+public:
+    HLSStructureCursor() = default;
+
+    explicit HLSStructureCursor(const HLSStructuralIndex& index) :
+        m_base(index.Text().data()), m_text(index.Text()), m_cur(index.begin()), m_end(index.end()) {}
+
+    bool IsIndexed() const { return m_base != nullptr; }
+
+    // Offset within the window of the first c at or after from, or npos. Works like
+    // string_view::find for the structural characters
+    size_t Find(char c, size_t from)
+    {
+        Skip(from);
+
+        for (const uint32_t* pos = m_cur; pos != m_end; pos++)
+        {
+            if (m_base[*pos] == c)
+            {
+                return *pos - Offset();
+            }
+        }
+
+        return string_view::npos;
+    }
+
+    // Offset of the first line feed at or after from, or npos, like Find('\n', from).
+    // line is set to a cursor over the text from there up to the line feed, which
+    // comes for free while the line feed is being looked for
+    size_t FindLineEnd(size_t from, HLSStructureCursor& line)
+    {
+        Skip(from);
+
+        const uint32_t* lineEnd = m_cur;
+        while (lineEnd != m_end && m_base[*lineEnd] != '\n')
+        {
+            lineEnd++;
+        }
+
+        size_t end = lineEnd == m_end ? string_view::npos : *lineEnd - Offset();
+
+        line.m_base = m_base;
+        line.m_text = m_text.substr(min(from, m_text.length()), end == string_view::npos ? string_view::npos : end - from);
+        line.m_cur = m_cur;
+        line.m_end = lineEnd;
+
+        m_cur = lineEnd;
+        return end;
+    }
+
+    // A cursor over the part of the window between from and to
+    HLSStructureCursor Window(size_t from, size_t to) const
+    {
+        to = min(to, m_text.length());
+        from = min(from, to);
+
+        HLSStructureCursor window;
+        window.m_base = m_base;
+        window.m_text = m_text.substr(from, to - from);
+
+        // Windows are short, usually a line, so walking beats a binary search
+        window.m_cur = m_cur;
+        while (window.m_cur != m_end && *window.m_cur < Offset() + from)
+        {
+            window.m_cur++;
+        }
+
+        window.m_end = m_end;
+        if (to < m_text.length())
+        {
+            window.m_end = window.m_cur;
+            while (window.m_end != m_end && *window.m_end < Offset() + to)
+            {
+                window.m_end++;
+            }
+        }
+
+        return window;
+    }
+
+private:
+    size_t Offset() const { return m_text.data() - m_base; }
+
+    void Skip(size_t from)
+    {
+        size_t target = Offset() + from;
+
+        while (m_cur != m_end && *m_cur < target)
+        {
+            m_cur++;
+        }
+    }
+
+    const char* m_base = nullptr;
+    string_view m_text;
+    const uint32_t* m_cur = nullptr;
+    const uint32_t* m_end = nullptr;
+};
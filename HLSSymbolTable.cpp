@@ -0,0 +1,102 @@
+#include "HLSSymbolTable.h"
+#include <algorithm>
+#include <cstring>
+
+const shared_ptr<HLSSymbolTable>& HLSSymbolTable::Global()
+{
+    static const shared_ptr<HLSSymbolTable> s_global = make_shared<HLSSymbolTable>();
+    return s_global;
+}
+
+HLSSymbol HLSSymbolTable::Intern(string_view text)
+{
+    if (text.empty())
+    {
+        return HLSSymbol();
+    }
+
+    // Almost every value has been seen before, so try a shared lookup first
+    {
+        shared_lock<shared_mutex> lock(m_lock);
+        auto const entry = m_lookup.find(text);
+
+        if (entry != m_lookup.end())
+        {
+            return HLSSymbol(entry->second);
+        }
+    }
+
+    unique_lock<shared_mutex> lock(m_lock);
+
+    // Another thread may have added it while we were waiting for the lock
+    auto const existing = m_lookup.find(text);
+    if (existing != m_lookup.end())
+    {
+        return HLSSymbol(existing->second);
+    }
+
+    char* copy = static_cast<char*>(m_text.allocate(text.length(), 1));
+    memcpy(copy, text.data(), text.length());
+    m_textBytes += text.length();
+
+    HLSSymbol::Entry& entry = m_entries.emplace_back();
+    entry.text = string_view(copy, text.length());
+    entry.id = static_cast<uint32_t>(m_entries.size() - 1);
+
+    m_lookup.emplace(entry.text, &entry);
+    return HLSSymbol(&entry);
+}
+
+HLSSymbolTable::RankTable HLSSymbolTable::Ranks() const
+{
+    lock_guard<mutex> rankLock(m_rankLock);
+
+    vector<string_view> texts;
+    {
+        shared_lock<shared_mutex> lock(m_lock);
+
+        if (m_ranks && m_ranks->size() == m_entries.size())
+        {
+            return m_ranks;
+        }
+
+        texts.reserve(m_entries.size());
+        for (const auto& entry : m_entries)
+        {
+            texts.push_back(entry.text);
+        }
+    }
+
+    vector<uint32_t> order(texts.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = static_cast<uint32_t>(i);
+    }
+
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){ return texts[a] < texts[b]; });
+
+    auto ranks = make_shared<vector<uint32_t>>(texts.size());
+    for (size_t rank = 0; rank < order.size(); rank++)
+    {
+        (*ranks)[order[rank]] = static_cast<uint32_t>(rank);
+    }
+
+    m_ranks = move(ranks);
+    return m_ranks;
+}
+
+size_t HLSSymbolTable::Size() const
+{
+    shared_lock<shared_mutex> lock(m_lock);
+    return m_entries.size();
+}
+
+size_t HLSSymbolTable::Bytes() const
+{
+    shared_lock<shared_mutex> lock(m_lock);
+
+    // A lookup node holds the key, the entry pointer, the next node and the cached hash,
+    // and the node has a bucket pointing at it
+    size_t lookupBytes = sizeof(string_view) + 3 * sizeof(void*) + sizeof(size_t);
+    return m_textBytes + m_entries.size() * (sizeof(HLSSymbol::Entry) + lookupBytes);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class HLSSymbolTable;
+
+// A handle to an interned string. Equal strings interned in the same table always
+// produce the same handle, so comparing handles for equality is a pointer compare.
+// A default constructed symbol is the empty string. Handles stay valid for as long
+// as the table that produced them
+class HLSSymbol
+{
+public:
+    HLSSymbol() = default;
+
+    string_view View() const { return m_entry ? m_entry->text : string_view(); }
+    bool empty() const { return m_entry == nullptr; }
+
+    // Dense id of the symbol within its table, starting at 0. Only valid when not empty
+    uint32_t Id() const { return m_entry->id; }
+
+    bool operator == (const HLSSymbol& other) const { return m_entry == other.m_entry; }
+    bool operator != (const HLSSymbol& other) const { return m_entry != other.m_entry; }
+
+    // Orders symbols alphabetically. Sorting many symbols is cheaper through
+    // HLSSymbolTable::Ranks, which turns every comparison into an integer compare
+    bool operator < (const HLSSymbol& other) const { return View() < other.View(); }
+
+    struct Hash
+    {
+        size_t operator () (const HLSSymbol& symbol) const { return hash<const void*>()(symbol.m_entry); }
+    };
+
+    friend ostream& operator << (ostream& os, const HLSSymbol& symbol) { return os << symbol.View(); }
+
+private:
+    friend class HLSSymbolTable;
+
+    struct Entry
+    {
+        string_view text;
+        uint32_t id;
+    };
+
+    explicit HLSSymbol(const Entry* entry) : m_entry(entry) {}
+
+    const Entry* m_entry = nullptr;
+};
+
+// Thread-safe table of interned strings for attribute values that repeat across
+// playlists: codecs, video ranges, languages, channel layouts and group IDs.
+// Strings are never removed, so the table is meant for low-cardinality values
+// only. Playlists share the global table unless they are given their own
+class HLSSymbolTable
+{
+public:
+    typedef shared_ptr<const vector<uint32_t>> RankTable;
+
+    static const shared_ptr<HLSSymbolTable>& Global();
+
+    HLSSymbolTable() = default;
+    HLSSymbolTable(const HLSSymbolTable&) = delete;
+    HLSSymbolTable& operator = (const HLSSymbolTable&) = delete;
+
+    // Returns the symbol for text, adding it to the table if it is new. Interning
+    // an empty string returns the empty symbol
+    HLSSymbol Intern(string_view text);
+
+    // Alphabetical rank of every symbol interned so far, indexed by symbol id. The
+    // table is rebuilt only when symbols have been added since the last call, and
+    // a returned table is never modified, so it can be used without locking
+    RankTable Ranks() const;
+
+    size_t Size() const;
+
+    // Approximate heap bytes the table holds: the text of every symbol, plus its entry
+    // and its node in the lookup
+    size_t Bytes() const;
+
+private:
+    mutable shared_mutex m_lock;
+    unordered_map<string_view, const HLSSymbol::Entry*> m_lookup;
+
+    // Entries and their text never move once added, so handles can point straight at them
+    deque<HLSSymbol::Entry> m_entries;
+    pmr::monotonic_buffer_resource m_text;
+    size_t m_textBytes = 0;
+
+    mutable mutex m_rankLock;
+    mutable RankTable m_ranks;
+};
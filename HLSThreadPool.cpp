@@ -0,0 +1,149 @@
+#include "HLSThreadPool.h"
+
+// Identifies the pool and queue owned by the current thread, if it is a worker
+static thread_local const HLSThreadPool* t_workerPool = nullptr;
+static thread_local size_t t_workerIndex = 0;
+
+HLSThreadPool::HLSThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = thread::hardware_concurrency();
+    }
+
+    if (threadCount == 0)
+    {
+        threadCount = 1;
+    }
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        m_queues.push_back(make_unique<WorkQueue>());
+    }
+
+    // Queues must all exist before any worker starts stealing from them
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        m_threads.emplace_back(&HLSThreadPool::WorkerLoop, this, i);
+    }
+}
+
+HLSThreadPool::~HLSThreadPool()
+{
+    {
+        lock_guard<mutex> lock(m_wakeLock);
+        m_isStopping = true;
+    }
+
+    m_wake.notify_all();
+
+    for (auto& worker : m_threads)
+    {
+        worker.join();
+    }
+}
+
+void HLSThreadPool::Submit(function<void()> task)
+{
+    size_t index;
+
+    if (t_workerPool == this)
+    {
+        // Work spawned by a task stays local to the worker that spawned it
+        index = t_workerIndex;
+    }
+    else
+    {
+        index = m_nextQueue.fetch_add(1, memory_order_relaxed) % m_queues.size();
+    }
+
+    // Count the task before it becomes visible so that the count can never
+    // drop below zero when a worker steals it straight away
+    {
+        lock_guard<mutex> lock(m_wakeLock);
+        m_pendingTasks++;
+    }
+
+    {
+        lock_guard<mutex> lock(m_queues[index]->lock);
+        m_queues[index]->tasks.push_back(move(task));
+    }
+
+    m_wake.notify_one();
+}
+
+bool HLSThreadPool::TryPop(size_t index, function<void()>& task)
+{
+    // Newest task from our own queue first, since its data is most likely still cached
+    {
+        WorkQueue& own = *m_queues[index];
+        lock_guard<mutex> lock(own.lock);
+
+        if (!own.tasks.empty())
+        {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            m_pendingTasks--;
+            return true;
+        }
+    }
+
+    // Otherwise steal the oldest task from another worker
+    for (size_t offset = 1; offset < m_queues.size(); offset++)
+    {
+        WorkQueue& victim = *m_queues[(index + offset) % m_queues.size()];
+        lock_guard<mutex> lock(victim.lock);
+
+        if (!victim.tasks.empty())
+        {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_pendingTasks--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool HLSThreadPool::TryRunOne()
+{
+    // A worker takes from its own queue first, like its loop does. Other threads
+    // have no queue of their own and start stealing from the first
+    size_t index = t_workerPool == this ? t_workerIndex : 0;
+
+    function<void()> task;
+    if (!TryPop(index, task))
+    {
+        return false;
+    }
+
+    task();
+    return true;
+}
+
+void HLSThreadPool::WorkerLoop(size_t index)
+{
+    t_workerPool = this;
+    t_workerIndex = index;
+
+    function<void()> task;
+
+    while (true)
+    {
+        if (TryPop(index, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        unique_lock<mutex> lock(m_wakeLock);
+        m_wake.wait(lock, [this]{ return m_isStopping || m_pendingTasks > 0; });
+
+        if (m_isStopping && m_pendingTasks == 0)
+        {
+            return;
+        }
+    }
+}
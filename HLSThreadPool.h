@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// A fixed-size work-stealing thread pool. Every worker owns a queue: tasks
+// submitted from a worker go onto that worker's own queue and are run newest
+// first, while idle workers steal the oldest task from the other queues.
+// Tasks submitted from outside the pool are spread round robin over the queues.
+// The destructor runs every task that has already been submitted before joining.
+// Tasks must not throw
+class HLSThreadPool
+{
+public:
+    // A thread count of 0 uses one worker per hardware thread
+    explicit HLSThreadPool(size_t threadCount = 0);
+    ~HLSThreadPool();
+
+    HLSThreadPool(const HLSThreadPool&) = delete;
+    HLSThreadPool& operator = (const HLSThreadPool&) = delete;
+
+    void Submit(function<void()> task);
+
+    // Runs one pending task on the calling thread, if there is one, and returns whether
+    // it did. A thread waiting for tasks it submitted calls this to help, so that
+    // waiting from inside a task cannot leave every worker blocked
+    bool TryRunOne();
+
+    size_t ThreadCount() const { return m_threads.size(); }
+
+private:
+    struct WorkQueue
+    {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    void WorkerLoop(size_t index);
+    bool TryPop(size_t index, function<void()>& task);
+
+    vector<unique_ptr<WorkQueue>> m_queues;
+    vector<thread> m_threads;
+
+    // Idle workers sleep on m_wake until there are pending tasks or the pool is stopping
+    mutex m_wakeLock;
+    condition_variable m_wake;
+    atomic<long long> m_pendingTasks{0};
+    atomic<size_t> m_nextQueue{0};
+    bool m_isStopping = false;
+};
@@ -0,0 +1,441 @@
+#include "HLSVariantSelector.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <tuple>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Queries handed to each pool task
+static constexpr size_t QueriesPerTask = 1024;
+
+static uint32_t CodecBit(CodecFamily family)
+{
+    // Unrecognized codecs never rule a stream out
+    return family == CodecFamily::UNKNOWN ? 0 : 1u << static_cast<uint32_t>(family);
+}
+
+static inline unsigned CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static bool EqualsNoCase(string_view a, string_view b)
+{
+    return a.length() == b.length() && equal(a.begin(), a.end(), b.begin(),
+        [](char x, char y) { return tolower(static_cast<unsigned char>(x)) == tolower(static_cast<unsigned char>(y)); });
+}
+
+static bool IsHdr(HLSSymbol videoRange, const CodecList& codecInfo)
+{
+    string_view range = videoRange.View();
+    return range == "PQ" || range == "HLG" || codecInfo.video.family == CodecFamily::DOLBY_VISION;
+}
+
+uint32_t HLSVariantSelector::CodecMask(initializer_list<CodecFamily> families)
+{
+    uint32_t mask = 0;
+    for (CodecFamily family : families)
+    {
+        mask |= CodecBit(family);
+    }
+
+    return mask;
+}
+
+HLSVariantSelector::HLSVariantSelector(const HLSMasterPlaylist& playlist) :
+    m_playlist(&playlist),
+    m_streams(&playlist.GetStreamColumns(StreamType::MEDIA))
+{
+    const HLSMasterPlaylist::StreamColumns& streams = *m_streams;
+
+    // Every stream goes into the bucket of its language, if it has one, and into
+    // the bucket shared by all languages
+    typedef pair<uint32_t, uint16_t> BucketKey;
+    map<BucketKey, uint32_t> bucketIndexes;
+    vector<pair<uint32_t, uint32_t>> entries;
+    entries.reserve(2 * streams.size());
+
+    auto addEntry = [&](uint32_t requirements, uint16_t language, uint32_t stream)
+    {
+        auto inserted = bucketIndexes.emplace(BucketKey(requirements, language), static_cast<uint32_t>(m_buckets.size()));
+        if (inserted.second)
+        {
+            Bucket bucket = {};
+            bucket.requirements = requirements;
+            bucket.language = language;
+            m_buckets.push_back(bucket);
+        }
+
+        entries.emplace_back(inserted.first->second, stream);
+    };
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        const CodecList& codecInfo = streams.codecInfos[i];
+        const HLSMasterPlaylist::MediaTag* audio = playlist.GetGroup(streams.audioGroups[i]);
+        uint32_t requirements = CodecBit(codecInfo.video.family) | CodecBit(codecInfo.audio.family) |
+            (IsHdr(streams.videoRanges[i], codecInfo) ? HdrBit : 0);
+
+        if (audio && !audio->language.empty())
+        {
+            // Languages past the last index can only be found in the shared buckets
+            auto found = find(m_languages.begin(), m_languages.end(), audio->language);
+            if (found != m_languages.end())
+            {
+                addEntry(requirements, static_cast<uint16_t>(found - m_languages.begin()), static_cast<uint32_t>(i));
+            }
+            else if (m_languages.size() < NoLanguage)
+            {
+                addEntry(requirements, static_cast<uint16_t>(m_languages.size()), static_cast<uint32_t>(i));
+                m_languages.push_back(audio->language);
+            }
+        }
+
+        addEntry(requirements, NoLanguage, static_cast<uint32_t>(i));
+    }
+
+    // Lay the buckets out one after another, each ordered by bandwidth
+    const long* bandwidths = streams.bandwidths.data();
+    sort(entries.begin(), entries.end(), [bandwidths](const pair<uint32_t, uint32_t>& a, const pair<uint32_t, uint32_t>& b)
+    {
+        return make_tuple(a.first, bandwidths[a.second], a.second) < make_tuple(b.first, bandwidths[b.second], b.second);
+    });
+
+    m_bandwidths.reserve(entries.size());
+    m_widths.reserve(entries.size());
+    m_heights.reserve(entries.size());
+    m_streamIndexes.reserve(entries.size());
+
+    for (const auto& entry : entries)
+    {
+        long bandwidth = bandwidths[entry.second];
+        Bucket& bucket = m_buckets[entry.first];
+
+        if (bucket.begin == bucket.end)
+        {
+            bucket.begin = bucket.end = static_cast<uint32_t>(m_streamIndexes.size());
+            bucket.minBandwidth = bandwidth;
+        }
+
+        bucket.maxBandwidth = bandwidth;
+        m_bandwidths.push_back(bandwidth);
+        m_widths.push_back(streams.widths[entry.second]);
+        m_heights.push_back(streams.heights[entry.second]);
+        m_streamIndexes.push_back(entry.second);
+        bucket.end++;
+    }
+
+    // Grouped by language with the shared buckets last, and the highest bandwidths
+    // first within each group so that later buckets are mostly skipped
+    sort(m_buckets.begin(), m_buckets.end(), [](const Bucket& a, const Bucket& b)
+    {
+        return a.language != b.language ? a.language < b.language : a.maxBandwidth > b.maxBandwidth;
+    });
+
+    m_languageBuckets.resize(m_languages.size() + 1);
+    for (size_t i = 0, bucket = 0; i <= m_languages.size(); i++)
+    {
+        while (bucket < m_buckets.size() && m_buckets[bucket].language < i)
+        {
+            bucket++;
+        }
+
+        m_languageBuckets[i] = static_cast<uint32_t>(bucket);
+    }
+
+    for (Bucket& bucket : m_buckets)
+    {
+        m_requirements.push_back(bucket.requirements);
+        BuildTree(bucket);
+    }
+}
+
+void HLSVariantSelector::BuildTree(Bucket& bucket)
+{
+    uint32_t count = bucket.end - bucket.begin;
+    bucket.leafCount = 1;
+    while (bucket.leafCount < count)
+    {
+        bucket.leafCount *= 2;
+    }
+
+    // Node 1 is the root and node k has children 2k and 2k + 1. Node 0 is unused
+    bucket.firstNode = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.resize(m_nodes.size() + 2 * bucket.leafCount);
+    Node* nodes = m_nodes.data() + bucket.firstNode;
+
+    for (uint32_t i = 0; i < bucket.leafCount; i++)
+    {
+        Node& leaf = nodes[bucket.leafCount + i];
+        leaf.begin = leaf.end = static_cast<uint32_t>(m_steps.size());
+
+        if (i < count)
+        {
+            m_steps.push_back({ m_widths[bucket.begin + i], m_heights[bucket.begin + i] });
+            leaf.end++;
+        }
+    }
+
+    vector<Step> merged;
+    for (uint32_t node = bucket.leafCount - 1; node > 0; node--)
+    {
+        const Node& left = nodes[2 * node];
+        const Node& right = nodes[2 * node + 1];
+
+        merged.assign(m_steps.begin() + left.begin, m_steps.begin() + left.end);
+        merged.insert(merged.end(), m_steps.begin() + right.begin, m_steps.begin() + right.end);
+        sort(merged.begin(), merged.end(), [](const Step& a, const Step& b)
+        {
+            return a.width != b.width ? a.width < b.width : a.height < b.height;
+        });
+
+        // Keep only the resolutions no other one is within
+        nodes[node].begin = static_cast<uint32_t>(m_steps.size());
+        for (const Step& step : merged)
+        {
+            if (m_steps.size() == nodes[node].begin || step.height < m_steps.back().height)
+            {
+                m_steps.push_back(step);
+            }
+        }
+
+        nodes[node].end = static_cast<uint32_t>(m_steps.size());
+    }
+}
+
+bool HLSVariantSelector::NodeFits(const Node& node, int maxWidth, int maxHeight) const
+{
+    // Of the steps narrow enough, the last is the shortest
+    const Step* first = m_steps.data() + node.begin;
+    const Step* last = m_steps.data() + node.end;
+    const Step* step = upper_bound(first, last, maxWidth, [](int width, const Step& step) { return width < step.width; });
+
+    return step != first && step[-1].height <= maxHeight;
+}
+
+uint32_t HLSVariantSelector::FindFit(const Bucket& bucket, uint32_t first, uint32_t last, int maxWidth, int maxHeight, bool isLast) const
+{
+    return FindFit(bucket, 1, 0, bucket.leafCount, first, last, maxWidth, maxHeight, isLast);
+}
+
+uint32_t HLSVariantSelector::FindFit(const Bucket& bucket, uint32_t node, uint32_t nodeFirst, uint32_t nodeLast,
+    uint32_t first, uint32_t last, int maxWidth, int maxHeight, bool isLast) const
+{
+    if (nodeLast <= first || nodeFirst >= last || !NodeFits(m_nodes[bucket.firstNode + node], maxWidth, maxHeight))
+    {
+        return NoEntry;
+    }
+
+    if (nodeLast - nodeFirst == 1)
+    {
+        return nodeFirst;
+    }
+
+    // A node that fits as a whole leads straight down to an entry, so only the
+    // nodes on the edges of the range are ever searched on both sides
+    uint32_t middle = nodeFirst + (nodeLast - nodeFirst) / 2;
+    uint32_t found = isLast ?
+        FindFit(bucket, 2 * node + 1, middle, nodeLast, first, last, maxWidth, maxHeight, isLast) :
+        FindFit(bucket, 2 * node, nodeFirst, middle, first, last, maxWidth, maxHeight, isLast);
+
+    if (found != NoEntry)
+    {
+        return found;
+    }
+
+    return isLast ?
+        FindFit(bucket, 2 * node, nodeFirst, middle, first, last, maxWidth, maxHeight, isLast) :
+        FindFit(bucket, 2 * node + 1, middle, nodeLast, first, last, maxWidth, maxHeight, isLast);
+}
+
+bool HLSVariantSelector::Candidate::IsBetterThan(const Candidate& other) const
+{
+    if (isWithinBandwidth != other.isWithinBandwidth)
+    {
+        return isWithinBandwidth;
+    }
+
+    if (bandwidth != other.bandwidth)
+    {
+        // Within the bandwidth the highest stream wins, otherwise the lowest
+        return isWithinBandwidth == (bandwidth > other.bandwidth);
+    }
+
+    return stream < other.stream;
+}
+
+uint16_t HLSVariantSelector::FindLanguage(string_view language) const
+{
+    if (language.empty())
+    {
+        return NoLanguage;
+    }
+
+    for (size_t i = 0; i < m_languages.size(); i++)
+    {
+        if (EqualsNoCase(m_languages[i].View(), language))
+        {
+            return static_cast<uint16_t>(i);
+        }
+    }
+
+    return NoLanguage;
+}
+
+HLSVariantSelector::Selection HLSVariantSelector::Select(const Query& query) const
+{
+    int maxWidth = query.maxResolution.width > 0 ? query.maxResolution.width : INT_MAX;
+    int maxHeight = query.maxResolution.height > 0 ? query.maxResolution.height : INT_MAX;
+    uint32_t allowed = (query.codecs & ~HdrBit) | (query.isHdrCapable ? HdrBit : 0);
+
+    // Any stream in the preferred language beats every other, so the others are
+    // only searched when the client can play none in that language
+    Candidate best;
+    uint16_t language = FindLanguage(query.language);
+
+    if (language != NoLanguage)
+    {
+        Search(m_languageBuckets[language], m_languageBuckets[language + 1], allowed, query.bandwidth, maxWidth, maxHeight, best);
+    }
+
+    if (best.stream == NoEntry)
+    {
+        Search(m_languageBuckets.back(), m_buckets.size(), allowed, query.bandwidth, maxWidth, maxHeight, best);
+    }
+
+    Selection selection;
+    if (best.stream != NoEntry)
+    {
+        selection.stream = best.stream;
+        selection.audio = m_playlist->GetGroup(m_streams->audioGroups[best.stream]);
+        selection.isWithinBandwidth = best.isWithinBandwidth;
+    }
+
+    return selection;
+}
+
+void HLSVariantSelector::Search(size_t first, size_t last, uint32_t allowed, long bandwidth, int maxWidth, int maxHeight, Candidate& best) const
+{
+    auto fits = [&](uint32_t entry) { return m_widths[entry] <= maxWidth && m_heights[entry] <= maxHeight; };
+
+    for (size_t block = first; block < last; block += 32)
+    {
+        // Check a block of buckets without branching, then visit the playable ones
+        size_t blockEnd = min(block + 32, last);
+        uint32_t playable = 0;
+
+        for (size_t i = block; i < blockEnd; i++)
+        {
+            playable |= uint32_t((m_requirements[i] & ~allowed) == 0) << (i - block);
+        }
+
+        for (; playable != 0; playable &= playable - 1)
+        {
+            const Bucket* bucket = &m_buckets[block + CountTrailingZeros(playable)];
+
+            // Skip buckets that cannot beat a stream within the bandwidth
+            if (best.isWithinBandwidth && (bucket->maxBandwidth < best.bandwidth || bucket->minBandwidth > bandwidth))
+            {
+                continue;
+            }
+
+            const long* bandwidths = m_bandwidths.data() + bucket->begin;
+            uint32_t count = bucket->end - bucket->begin;
+            uint32_t affordable = static_cast<uint32_t>(upper_bound(bandwidths, bandwidths + count, bandwidth) - bandwidths);
+
+            // The highest bandwidth that fits, which is most often simply the highest
+            // affordable one, and then the first stream with that bandwidth
+            Candidate candidate;
+            uint32_t entry = NoEntry;
+
+            if (affordable > 0)
+            {
+                entry = fits(bucket->begin + affordable - 1) ? affordable - 1 : FindFit(*bucket, 0, affordable, maxWidth, maxHeight, true);
+            }
+
+            if (entry != NoEntry)
+            {
+                if (entry > 0 && bandwidths[entry - 1] == bandwidths[entry])
+                {
+                    uint32_t sameBandwidth = static_cast<uint32_t>(lower_bound(bandwidths, bandwidths + entry, bandwidths[entry]) - bandwidths);
+                    entry = FindFit(*bucket, sameBandwidth, entry + 1, maxWidth, maxHeight, false);
+                }
+
+                candidate.isWithinBandwidth = true;
+            }
+            else if (!best.isWithinBandwidth)
+            {
+                // Otherwise the lowest stream within the resolution at all
+                entry = affordable < count && fits(bucket->begin + affordable) ? affordable : FindFit(*bucket, affordable, count, maxWidth, maxHeight, false);
+            }
+
+            if (entry == NoEntry)
+            {
+                continue;
+            }
+
+            candidate.bandwidth = bandwidths[entry];
+            candidate.stream = m_streamIndexes[bucket->begin + entry];
+
+            if (best.stream == NoEntry || candidate.IsBetterThan(best))
+            {
+                best = candidate;
+            }
+        }
+    }
+}
+
+void HLSVariantSelector::Select(const Query* queries, size_t count, Selection* results) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        results[i] = Select(queries[i]);
+    }
+}
+
+void HLSVariantSelector::Select(HLSThreadPool& pool, const Query* queries, size_t count, Selection* results) const
+{
+    size_t taskCount = (count + QueriesPerTask - 1) / QueriesPerTask;
+    if (taskCount <= 1)
+    {
+        Select(queries, count, results);
+        return;
+    }
+
+    mutex lock;
+    condition_variable done;
+    size_t remaining = taskCount;
+
+    for (size_t task = 0; task < taskCount; task++)
+    {
+        size_t begin = task * QueriesPerTask;
+        size_t length = min(QueriesPerTask, count - begin);
+
+        pool.Submit([=, &lock, &done, &remaining]()
+        {
+            Select(queries + begin, length, results + begin);
+
+            // Notify while still holding the lock, as the waiting thread returns
+            // and destroys both as soon as it sees the last task finish
+            lock_guard<mutex> guard(lock);
+            if (--remaining == 0)
+            {
+                done.notify_one();
+            }
+        });
+    }
+
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [&remaining]() { return remaining == 0; });
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+#include "HLSCodecs.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSThreadPool.h"
+
+using namespace std;
+
+// Picks the variant stream a client should play, for answering adaptive bitrate
+// decisions at a high rate. The selector is built once per parsed playlist: its
+// streams are grouped into buckets of the same video and audio codec family and
+// video range, once per audio language and once for all languages together. Each
+// bucket is ordered by bandwidth, over a tree that tells which ranges of it hold a
+// stream within a given resolution. A query checks every bucket's codecs and range
+// at once, then finds the best stream of each bucket it can play with a binary
+// search and O(log n) tree steps, skipping buckets that cannot beat the best so
+// far. Queries allocate nothing and may run concurrently. The selector refers into
+// the playlist and is valid until the playlist is parsed again or destroyed.
+// I-frame streams are not selected
+class HLSVariantSelector
+{
+public:
+    // Bit set of CodecFamily values
+    static constexpr uint32_t AnyCodec = UINT32_MAX;
+    static uint32_t CodecMask(initializer_list<CodecFamily> families);
+
+    // What a client can play and would like
+    struct Query
+    {
+        // Bits per second available. Compared against each stream's peak BANDWIDTH
+        long bandwidth = 0;
+
+        // Largest resolution the client can display. A width or height of 0 is no limit
+        HLSMasterPlaylist::Resolution maxResolution;
+
+        // Codec families the client can decode. Streams whose CODECS attribute is
+        // missing or not recognized are taken to be playable
+        uint32_t codecs = AnyCodec;
+
+        // Whether PQ and HLG streams, and Dolby Vision, may be picked
+        bool isHdrCapable = false;
+
+        // Preferred audio language, matched without regard to case. Empty for none
+        string_view language;
+    };
+
+    static constexpr size_t NoStream = SIZE_MAX;
+
+    struct Selection
+    {
+        // The stream's index in parse order, for HLSMasterPlaylist::GetStream. NoStream
+        // when the client can play none of the streams
+        size_t stream = NoStream;
+        const HLSMasterPlaylist::MediaTag* audio = nullptr;
+
+        // False when even the lowest playable stream needs more than the bandwidth,
+        // in which case that lowest stream is selected
+        bool isWithinBandwidth = false;
+    };
+
+    explicit HLSVariantSelector(const HLSMasterPlaylist& playlist);
+
+    // Returns the highest bandwidth stream the client can play within its bandwidth.
+    // Streams in the preferred language win over all others, whatever their bandwidth;
+    // equal bandwidths go to the stream listed first
+    Selection Select(const Query& query) const;
+
+    // Answers many clients at once, writing results[i] for queries[i]. The pool
+    // overload splits the queries across its workers and returns once all are done
+    void Select(const Query* queries, size_t count, Selection* results) const;
+    void Select(HLSThreadPool& pool, const Query* queries, size_t count, Selection* results) const;
+
+    size_t StreamCount() const { return m_streams->size(); }
+    size_t BucketCount() const { return m_buckets.size(); }
+
+private:
+    static constexpr uint16_t NoLanguage = UINT16_MAX;
+    static constexpr uint32_t NoEntry = UINT32_MAX;
+
+    // Set in the requirements of HDR streams, above every codec family
+    static constexpr uint32_t HdrBit = 1u << 31;
+
+    // Streams that share everything a query filters on except resolution, and the
+    // audio language unless that is NoLanguage. Their entries lie in [begin, end)
+    // of the entry arrays, ordered by bandwidth and then parse order. The bucket's
+    // tree has 2 * leafCount nodes from firstNode on
+    struct Bucket
+    {
+        // Codec family bits, and HdrBit for HDR streams
+        uint32_t requirements;
+        uint16_t language;
+        long minBandwidth;
+        long maxBandwidth;
+        uint32_t begin;
+        uint32_t end;
+        uint32_t firstNode;
+        uint32_t leafCount;
+    };
+
+    // A tree node covers a power-of-two range of a bucket's entries, and holds the
+    // smallest resolutions among them: those no other entry in the range is within
+    // in both width and height. They lie in [begin, end) of m_steps, by width
+    // ascending and so by height descending. An entry in the range fits a limit
+    // exactly when one of these does
+    struct Node
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct Step
+    {
+        int width;
+        int height;
+    };
+
+    // The best stream found so far by a query
+    struct Candidate
+    {
+        bool isWithinBandwidth = false;
+        long bandwidth = 0;
+        uint32_t stream = NoEntry;
+
+        bool IsBetterThan(const Candidate& other) const;
+    };
+
+    void BuildTree(Bucket& bucket);
+    bool NodeFits(const Node& node, int maxWidth, int maxHeight) const;
+
+    // Returns the last (or first) entry of a bucket in [first, last) whose resolution
+    // is within the limit, relative to the bucket's start, or NoEntry
+    uint32_t FindFit(const Bucket& bucket, uint32_t first, uint32_t last, int maxWidth, int maxHeight, bool isLast) const;
+    uint32_t FindFit(const Bucket& bucket, uint32_t node, uint32_t nodeFirst, uint32_t nodeLast,
+        uint32_t first, uint32_t last, int maxWidth, int maxHeight, bool isLast) const;
+
+    // Updates best with the best stream of the buckets in [first, last) whose
+    // requirements are all allowed
+    void Search(size_t first, size_t last, uint32_t allowed, long bandwidth, int maxWidth, int maxHeight, Candidate& best) const;
+
+    uint16_t FindLanguage(string_view language) const;
+
+    // The playlist's media streams, read straight from its columns
+    const HLSMasterPlaylist* m_playlist;
+    const HLSMasterPlaylist::StreamColumns* m_streams;
+
+    // Ordered by language, with the buckets shared by all languages last, and then
+    // by highest bandwidth first. Language i's buckets start at m_languageBuckets[i],
+    // and the shared ones at m_languageBuckets.back()
+    vector<Bucket> m_buckets;
+    vector<uint32_t> m_languageBuckets;
+
+    // The buckets' requirements again, packed together for checking them all at once
+    vector<uint32_t> m_requirements;
+
+    // Every bucket's entries, bucket by bucket
+    vector<long> m_bandwidths;
+    vector<int> m_widths;
+    vector<int> m_heights;
+    vector<uint32_t> m_streamIndexes;
+
+    vector<Node> m_nodes;
+    vector<Step> m_steps;
+
+    // Distinct audio languages of the streams, which buckets refer to by index
+    vector<HLSSymbol> m_languages;
+};
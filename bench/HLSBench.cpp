@@ -0,0 +1,709 @@
+#include "HLSPlaylistGenerator.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSMediaPlaylist.h"
+#include "HLSPlaylistCache.h"
+#include "HLSPlaylistFilter.h"
+#include "HLSSerializer.h"
+#include "HLSSnapshot.h"
+#include "HLSStructuralIndex.h"
+#include "HLSBatchProcessor.h"
+#include "HLSThreadPool.h"
+#include "HLSVariantSelector.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Every allocation made by the process goes through these, so a benchmark can
+// count the allocations made by the code it times
+static atomic<size_t> s_allocationCount(0);
+
+static void* CountedAlloc(size_t size)
+{
+    s_allocationCount.fetch_add(1, memory_order_relaxed);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (!memory)
+    {
+        throw bad_alloc();
+    }
+
+    return memory;
+}
+
+static void* CountedAlignedAlloc(size_t size, align_val_t alignment)
+{
+    s_allocationCount.fetch_add(1, memory_order_relaxed);
+    size_t align = max(static_cast<size_t>(alignment), sizeof(void*));
+
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, align, size == 0 ? 1 : size) != 0)
+    {
+        memory = nullptr;
+    }
+#endif
+
+    if (!memory)
+    {
+        throw bad_alloc();
+    }
+
+    return memory;
+}
+
+static void CountedAlignedFree(void* memory)
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept { try { return CountedAlloc(size); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, const nothrow_t&) noexcept { try { return CountedAlloc(size); } catch (...) { return nullptr; } }
+void* operator new(size_t size, align_val_t alignment) { return CountedAlignedAlloc(size, alignment); }
+void* operator new[](size_t size, align_val_t alignment) { return CountedAlignedAlloc(size, alignment); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, align_val_t) noexcept { CountedAlignedFree(memory); }
+void operator delete[](void* memory, align_val_t) noexcept { CountedAlignedFree(memory); }
+void operator delete(void* memory, size_t, align_val_t) noexcept { CountedAlignedFree(memory); }
+void operator delete[](void* memory, size_t, align_val_t) noexcept { CountedAlignedFree(memory); }
+
+// Peak resident set size of the process so far, in kilobytes
+static size_t PeakRssKb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+}
+
+struct BenchOptions
+{
+    GeneratorOptions playlist;
+    MediaGeneratorOptions mediaPlaylist;
+    size_t iterations = 200;
+    size_t batchSize = 256;
+    size_t maxThreads = 0;
+};
+
+// Timings of a single operation, repeated. The best time is the most stable on a
+// busy machine, the median shows what a typical call costs
+struct Measurement
+{
+    double bestNs = 0;
+    double medianNs = 0;
+    double allocationsPerOp = 0;
+};
+
+// Times op iterations times. Setup runs before every timed call, outside the
+// timing, and one untimed round first warms up caches and reusable buffers
+template <typename Setup, typename Op>
+static Measurement Measure(size_t iterations, Setup setup, Op op)
+{
+    setup();
+    op();
+
+    vector<double> times;
+    times.reserve(iterations);
+    size_t allocations = 0;
+
+    for (size_t i = 0; i < iterations; i++)
+    {
+        setup();
+
+        size_t allocationsBefore = s_allocationCount.load(memory_order_relaxed);
+        auto start = chrono::steady_clock::now();
+        op();
+        auto end = chrono::steady_clock::now();
+        allocations += s_allocationCount.load(memory_order_relaxed) - allocationsBefore;
+
+        times.push_back(chrono::duration<double, nano>(end - start).count());
+    }
+
+    sort(times.begin(), times.end());
+
+    Measurement result;
+    result.bestNs = times.front();
+    result.medianNs = times[times.size() / 2];
+    result.allocationsPerOp = double(allocations) / iterations;
+    return result;
+}
+
+static void PrintHeader(const char* title)
+{
+    cout << "\n" << title << "\n" <<
+        left << setw(28) << "benchmark" << right <<
+        setw(12) << "best ns/B" << setw(12) << "median ns/B" << setw(12) << "median us" <<
+        setw(12) << "allocs/op" << setw(14) << "peak RSS KB" << "\n";
+}
+
+static void PrintRow(const string& name, const Measurement& m, size_t bytes)
+{
+    cout << left << setw(28) << name << right << fixed <<
+        setw(12) << setprecision(3) << m.bestNs / bytes <<
+        setw(12) << setprecision(3) << m.medianNs / bytes <<
+        setw(12) << setprecision(1) << m.medianNs / 1000 <<
+        setw(12) << setprecision(1) << m.allocationsPerOp <<
+        setw(14) << PeakRssKb() << "\n";
+}
+
+static void BenchParse(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Parse (ns per input byte)");
+
+    HLSMasterPlaylist playlist;
+    Measurement m = Measure(options.iterations, [](){}, [&]() { playlist.ParseMasterPlaylist(text); });
+    PrintRow("ParseMasterPlaylist", m, text.size());
+
+    // The same text arriving in network-sized pieces
+    const size_t chunkSize = 4096;
+    m = Measure(options.iterations, [](){}, [&]()
+        {
+            for (size_t pos = 0; pos < text.size(); pos += chunkSize)
+            {
+                playlist.Feed(text.data() + pos, min(chunkSize, text.size() - pos));
+            }
+
+            playlist.Finish();
+        });
+    PrintRow("Feed 4KB chunks + Finish", m, text.size());
+
+    // A cold playlist pays for its arena and symbol lookups on the first parse
+    m = Measure(max<size_t>(options.iterations / 10, 1), [](){}, [&]()
+        {
+            HLSMasterPlaylist fresh;
+            fresh.ParseMasterPlaylist(text);
+        });
+    PrintRow("Construct + parse", m, text.size());
+
+    // Counting tags and reading the clock, against the first row
+    HLSParseMetrics metrics;
+    playlist.SetMetrics(&metrics);
+    m = Measure(options.iterations, [](){}, [&]() { playlist.ParseMasterPlaylist(text); });
+    PrintRow("ParseMasterPlaylist metrics", m, text.size());
+    playlist.SetMetrics(nullptr);
+}
+
+static void BenchScan(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Structural scan (ns per input byte)");
+
+    HLSStructuralIndex index;
+    for (int level = 0; level <= static_cast<int>(HLSStructuralIndex::BestLevel()); level++)
+    {
+        ScanLevel scanLevel = static_cast<ScanLevel>(level);
+        Measurement m = Measure(options.iterations, [](){}, [&]() { index.Build(text, scanLevel); });
+        PrintRow(string("Build ") + ScanLevelToString(scanLevel), m, text.size());
+    }
+}
+
+static void BenchSort(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Sort (ns per input byte, index build only)");
+
+    // Orders are cached per playlist, so each timed Sort runs on a fresh parse that
+    // has built no index yet
+    HLSMasterPlaylist playlist;
+    for (int param = 0; param < static_cast<int>(SortParameter::DEFAULT); param++)
+    {
+        SortParameter sortParam = static_cast<SortParameter>(param);
+        Measurement m = Measure(options.iterations,
+            [&]()
+            {
+                playlist.Sort(SortParameter::DEFAULT, true);
+                playlist.ParseMasterPlaylist(text);
+            },
+            [&]() { playlist.Sort(sortParam, true); });
+        PrintRow(string("Sort ") + SortTypeToString(sortParam), m, text.size());
+    }
+}
+
+static void BenchTopK(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Top-K (ns per input byte, no index built)");
+
+    // Queries never build or cache an index, so one parse serves every iteration
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(text);
+
+    const SortParameter sortParams[] = { SortParameter::BANDWIDTH, SortParameter::RESOLUTION, SortParameter::VIDEORANGE };
+    for (SortParameter sortParam : sortParams)
+    {
+        Measurement m = Measure(options.iterations, [](){},
+            [&]() { playlist.GetTopStreams(StreamType::MEDIA, sortParam, false, 3); });
+        PrintRow(string("Top 3 ") + SortTypeToString(sortParam), m, text.size());
+    }
+
+    Measurement m = Measure(options.iterations, [](){},
+        [&]() { playlist.GetTopStreamsByGroup(StreamType::MEDIA, GroupParameter::CODEC_FAMILY, SortParameter::RESOLUTION, false, 1); });
+    PrintRow("Top 1 RESOLUTION per codec", m, text.size());
+
+    m = Measure(options.iterations, [](){},
+        [&]() { playlist.GetTopStreamsByGroup(StreamType::MEDIA, GroupParameter::VIDEORANGE, SortParameter::BANDWIDTH, false, 1); });
+    PrintRow("Top 1 BANDWIDTH per range", m, text.size());
+}
+
+static void BenchSerialize(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Serialize (ns per output byte)");
+
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(text);
+    playlist.Sort(SortParameter::BANDWIDTH, true);
+
+    for (SerializeFormat format : { SerializeFormat::M3U8, SerializeFormat::JSON })
+    {
+        string buffer;
+        Measurement m = Measure(options.iterations, [&]() { buffer.clear(); },
+            [&]() { HLSSerializer(buffer, format).Write(playlist); });
+        PrintRow(format == SerializeFormat::M3U8 ? "Write M3U8" : "Write JSON", m, buffer.size());
+    }
+}
+
+static void BenchFilter(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Edge filter (ns per input byte)");
+
+    // A device profile for an older SDR television on a capped connection
+    HLSPlaylistFilter filter;
+    filter.DropStreams({ { HLSAttributeName::CODECS, HLSPlaylistFilter::Comparison::HAS_CODEC, "HEVC" } });
+    filter.DropStreams({ { HLSAttributeName::BANDWIDTH, HLSPlaylistFilter::Comparison::GREATER, "8000000" } });
+    filter.DropStreams({ { HLSAttributeName::VIDEO_RANGE, HLSPlaylistFilter::Comparison::EQUAL, "PQ" } });
+    filter.DropMediaTags({ { HLSAttributeName::TYPE, HLSPlaylistFilter::Comparison::EQUAL, "AUDIO" },
+        { HLSAttributeName::LANGUAGE, HLSPlaylistFilter::Comparison::NOT_IN, "en,es,fr" } });
+
+    string buffer;
+    Measurement m = Measure(options.iterations, [&]() { buffer.clear(); }, [&]() { filter.Apply(text, buffer); });
+    PrintRow("Filter", m, text.size());
+
+    // The same edit made by parsing and writing the playlist back, before any
+    // variants are even removed
+    HLSMasterPlaylist playlist;
+    m = Measure(options.iterations, [&]() { buffer.clear(); }, [&]()
+    {
+        playlist.ParseMasterPlaylist(text);
+        HLSSerializer(buffer).Write(playlist, SortParameter::BANDWIDTH, true);
+    });
+    PrintRow("Parse + sort + write", m, text.size());
+}
+
+static void BenchCache(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Playlist cache (ns per input byte)");
+
+    HLSPlaylistCache cache;
+    Measurement m = Measure(options.iterations, [&]() { cache.Clear(); }, [&]() { cache.Parse(text); });
+    PrintRow("Parse miss", m, text.size());
+
+    // A hit only hashes the text
+    m = Measure(options.iterations, [](){}, [&]() { cache.Parse(text); });
+    PrintRow("Parse hit", m, text.size());
+
+    // The cached playlist's sort indexes are built on the first hit that asks for
+    // an order, and reused after that
+    string buffer;
+    m = Measure(options.iterations, [&]() { buffer.clear(); },
+        [&]() { HLSSerializer(buffer).Write(*cache.Parse(text), SortParameter::BANDWIDTH, true); });
+    PrintRow("Parse hit + write sorted", m, text.size());
+}
+
+static void BenchSnapshot(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Snapshot (ns per input byte)");
+
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(text);
+
+    string buffer;
+    Measurement m = Measure(options.iterations, [&]() { buffer.clear(); }, [&]() { HLSSnapshot::Write(playlist, buffer); });
+    PrintRow("Write", m, text.size());
+
+    // Opening checks the header only, so the streams are read too to compare with a
+    // parse. The sink keeps the reads from being optimized away
+    volatile size_t sink = 0;
+    m = Measure(options.iterations, [](){}, [&]()
+    {
+        HLSSnapshot snapshot(buffer);
+        size_t total = 0;
+        for (size_t i = 0; i < snapshot.StreamCount(); i++)
+        {
+            HLSSnapshot::Stream stream = snapshot.GetStream(i);
+            total += stream.Bandwidth() + stream.Codecs().length() + stream.Uri().length();
+            if (HLSSnapshot::MediaTag audio = stream.Audio())
+            {
+                total += audio.Id().length();
+            }
+        }
+
+        sink = total;
+    });
+    PrintRow("Open + read streams", m, text.size());
+}
+
+static void BenchMediaParse(const BenchOptions& options, const string& text)
+{
+    PrintHeader("Media playlist parse (ns per input byte)");
+
+    HLSMediaPlaylist playlist;
+    Measurement m = Measure(max<size_t>(options.iterations / 10, 3), [](){},
+        [&]() { playlist.ParseMediaPlaylist(text); });
+    PrintRow("ParseMediaPlaylist", m, text.size());
+
+    HLSParseMetrics metrics;
+    playlist.SetMetrics(&metrics);
+    m = Measure(max<size_t>(options.iterations / 10, 3), [](){},
+        [&]() { playlist.ParseMediaPlaylist(text); });
+    PrintRow("ParseMediaPlaylist metrics", m, text.size());
+    playlist.SetMetrics(nullptr);
+
+    // Segments handed to a callback and never stored
+    HLSMediaPlaylist streaming;
+    double totalDuration = 0;
+    streaming.SetSegmentHandler([&totalDuration](const HLSMediaPlaylist::Segment& segment)
+        {
+            totalDuration += segment.duration;
+        });
+
+    m = Measure(max<size_t>(options.iterations / 10, 3), [](){}, [&]() { streaming.ParseMediaPlaylist(text); });
+    PrintRow("ParseMediaPlaylist streaming", m, text.size());
+}
+
+static void BenchRefresh(const BenchOptions& options)
+{
+    PrintHeader("Live refresh, one segment later (ns per input byte)");
+
+    // The same window a segment later, as a full playlist and as a delta update
+    // that lists only the last few segments
+    MediaGeneratorOptions window = options.mediaPlaylist;
+    string previous = GenerateMediaPlaylist(window);
+
+    window.segments++;
+    window.firstSegment = 1;
+    string next = GenerateMediaPlaylist(window);
+
+    window.skippedSegments = options.mediaPlaylist.segments > 6 ? options.mediaPlaylist.segments - 6 : 0;
+    string delta = GenerateMediaPlaylist(window);
+
+    HLSMediaPlaylist playlist;
+    size_t iterations = max<size_t>(options.iterations / 10, 3);
+
+    Measurement m = Measure(iterations, [](){}, [&]() { playlist.ParseMediaPlaylist(next); });
+    PrintRow("ParseMediaPlaylist", m, next.size());
+
+    m = Measure(iterations, [&]() { playlist.ParseMediaPlaylist(previous); }, [&]() { playlist.Refresh(next); });
+    PrintRow("Refresh", m, next.size());
+
+    m = Measure(iterations, [&]() { playlist.ParseMediaPlaylist(previous); }, [&]() { playlist.Refresh(delta); });
+    PrintRow("Refresh delta update", m, delta.size());
+}
+
+// Client profiles spread over the generator's ladders, codecs and languages
+static vector<HLSVariantSelector::Query> GenerateQueries(size_t count, uint64_t seed)
+{
+    static const char* const s_preferredLanguages[] = { "", "en", "de", "ja", "ko" };
+    static const int s_screenHeights[] = { 0, 480, 720, 1080, 2160 };
+
+    HLSRandom random(seed);
+    vector<HLSVariantSelector::Query> queries(count);
+
+    for (HLSVariantSelector::Query& query : queries)
+    {
+        query.bandwidth = 200000 + long(random.Below(20000000));
+        query.maxResolution.height = s_screenHeights[random.Below(5)];
+        query.maxResolution.width = query.maxResolution.height * 16 / 9;
+        query.codecs = HLSVariantSelector::CodecMask({ CodecFamily::AVC, CodecFamily::AAC, CodecFamily::AC3 });
+
+        if (random.Below(2))
+        {
+            query.codecs |= HLSVariantSelector::CodecMask({ CodecFamily::HEVC, CodecFamily::EC3 });
+        }
+
+        if (random.Below(4) == 0)
+        {
+            query.codecs |= HLSVariantSelector::CodecMask({ CodecFamily::DOLBY_VISION, CodecFamily::AV1, CodecFamily::VP9 });
+        }
+
+        query.isHdrCapable = random.Below(2) != 0;
+        query.language = s_preferredLanguages[random.Below(5)];
+    }
+
+    return queries;
+}
+
+static void BenchSelect(const BenchOptions& options, const string& text)
+{
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(text);
+
+    PrintHeader("Variant selection (ns per input byte)");
+    Measurement m = Measure(options.iterations, [](){}, [&]() { HLSVariantSelector selector(playlist); });
+    PrintRow("Build selector", m, text.size());
+
+    HLSVariantSelector selector(playlist);
+    vector<HLSVariantSelector::Query> queries = GenerateQueries(100000, options.playlist.seed);
+    vector<HLSVariantSelector::Selection> results(queries.size());
+
+    size_t maxThreads = options.maxThreads;
+    if (maxThreads == 0)
+    {
+        maxThreads = max(thread::hardware_concurrency(), 1U);
+    }
+
+    cout << "\nVariant selection of " << queries.size() << " client profiles over " << selector.StreamCount() <<
+        " streams in " << selector.BucketCount() << " buckets\n" <<
+        left << setw(28) << "benchmark" << right <<
+        setw(12) << "best ms" << setw(12) << "Mqueries/s" << setw(12) << "ns/query" <<
+        setw(12) << "allocs/q" << setw(14) << "peak RSS KB" << "\n";
+
+    auto printRow = [&](const string& name, const Measurement& m)
+    {
+        cout << left << setw(28) << name << right << fixed <<
+            setw(12) << setprecision(2) << m.bestNs / 1e6 <<
+            setw(12) << setprecision(2) << queries.size() * 1e3 / m.bestNs <<
+            setw(12) << setprecision(1) << m.bestNs / queries.size() <<
+            setw(12) << setprecision(3) << m.allocationsPerOp / queries.size() <<
+            setw(14) << PeakRssKb() << "\n";
+    };
+
+    size_t iterations = max<size_t>(options.iterations / 20, 3);
+    m = Measure(iterations, [](){}, [&]() { selector.Select(queries.data(), queries.size(), results.data()); });
+    printRow("Select", m);
+
+    HLSThreadPool pool(maxThreads);
+    m = Measure(iterations, [](){}, [&]() { selector.Select(pool, queries.data(), queries.size(), results.data()); });
+    printRow("Select on " + to_string(maxThreads) + " threads", m);
+}
+
+static void BenchBatch(const BenchOptions& options, const string& text)
+{
+    cout << "\nBatch parse + sort + serialize of " << options.batchSize << " playlists\n" <<
+        left << setw(28) << "threads" << right <<
+        setw(12) << "best ms" << setw(12) << "MB/s" << setw(12) << "speedup" <<
+        setw(12) << "allocs/pl" << setw(14) << "peak RSS KB" << "\n";
+
+    stringstream list;
+    for (size_t i = 0; i < options.batchSize; i++)
+    {
+        list << i << "\n";
+    }
+
+    size_t maxThreads = options.maxThreads;
+    if (maxThreads == 0)
+    {
+        maxThreads = max(thread::hardware_concurrency(), 1U);
+    }
+
+    // Thread counts double up to the maximum, which is always included
+    vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+
+    threadCounts.push_back(maxThreads);
+
+    double singleThreadNs = 0;
+    for (size_t threads : threadCounts)
+    {
+        HLSThreadPool pool(threads);
+        HLSBatchProcessor batch(pool);
+        batch.SetLoader([&text](const string&, HLSMasterPlaylist& playlist) { playlist.ParseMasterPlaylist(text); });
+
+        Measurement m = Measure(max<size_t>(options.iterations / 20, 3),
+            [&]()
+            {
+                list.clear();
+                list.seekg(0);
+            },
+            [&]() { batch.Run(list, SortParameter::BANDWIDTH, true, [](size_t, const string&, bool, const string&) {}); });
+
+        if (threads == 1)
+        {
+            singleThreadNs = m.bestNs;
+        }
+
+        double bytes = double(text.size()) * options.batchSize;
+        cout << left << setw(28) << threads << right << fixed <<
+            setw(12) << setprecision(2) << m.bestNs / 1e6 <<
+            setw(12) << setprecision(1) << bytes * 1e3 / m.bestNs <<
+            setw(12) << setprecision(2) << singleThreadNs / m.bestNs <<
+            setw(12) << setprecision(1) << m.allocationsPerOp / options.batchSize <<
+            setw(14) << PeakRssKb() << "\n";
+    }
+}
+
+static void BenchParallelParse(const BenchOptions& options, const string& text)
+{
+    // A playlist the size of an aggregated master playlist, in the given shape
+    const size_t targetSize = 16 * 1024 * 1024;
+    GeneratorOptions largeOptions = options.playlist;
+    size_t scale = max<size_t>(targetSize / max<size_t>(text.size(), 1), 1);
+    largeOptions.variants *= scale;
+    largeOptions.iFrameStreams *= scale;
+    string largeText = GenerateMasterPlaylist(largeOptions);
+
+    cout << "\nParallel parse of a " << largeText.size() / (1024 * 1024) << " MB playlist with " << largeOptions.variants << " variants\n" <<
+        left << setw(28) << "threads" << right <<
+        setw(12) << "best ms" << setw(12) << "MB/s" << setw(12) << "speedup" <<
+        setw(12) << "allocs/op" << setw(14) << "peak RSS KB" << "\n";
+
+    size_t maxThreads = options.maxThreads;
+    if (maxThreads == 0)
+    {
+        maxThreads = max(thread::hardware_concurrency(), 1U);
+    }
+
+    // Thread counts double up to the maximum, which is always included. One thread
+    // is the serial parse
+    vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+
+    threadCounts.push_back(maxThreads);
+
+    HLSMasterPlaylist playlist;
+    double singleThreadNs = 0;
+
+    for (size_t threads : threadCounts)
+    {
+        HLSThreadPool pool(threads);
+        Measurement m = Measure(max<size_t>(options.iterations / 20, 3), [](){},
+            [&]() { playlist.ParseMasterPlaylist(largeText, pool); });
+
+        if (threads == 1)
+        {
+            singleThreadNs = m.bestNs;
+        }
+
+        cout << left << setw(28) << threads << right << fixed <<
+            setw(12) << setprecision(2) << m.bestNs / 1e6 <<
+            setw(12) << setprecision(1) << largeText.size() * 1e3 / m.bestNs <<
+            setw(12) << setprecision(2) << singleThreadNs / m.bestNs <<
+            setw(12) << setprecision(1) << m.allocationsPerOp <<
+            setw(14) << PeakRssKb() << "\n";
+    }
+}
+
+static void PrintUsage()
+{
+    cout << "Usage: hlsbench [-variants N] [-iframes N] [-audio N] [-subtitles N] [-attrlength N]\n" <<
+            "                [-segments N] [-seed N] [-iterations N] [-batch N] [-threads N] [-dump|-dumpmedia]\n" <<
+            "   Generates a master playlist of the given shape and times parsing, scanning,\n" <<
+            "   each sort order, top-K queries, serialization, edge filtering, snapshots, variant selection,\n" <<
+            "   batch processing and parallel parsing, then parses a media playlist of the given\n" <<
+            "   number of segments\n" <<
+            "   -dump and -dumpmedia print the generated playlists instead of running the benchmarks\n";
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    bool isDump = false;
+    bool isDumpMedia = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-dump")
+        {
+            isDump = true;
+            continue;
+        }
+
+        if (arg == "-dumpmedia")
+        {
+            isDumpMedia = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        size_t value = strtoull(argv[++i], nullptr, 10);
+        if (arg == "-variants") options.playlist.variants = value;
+        else if (arg == "-iframes") options.playlist.iFrameStreams = value;
+        else if (arg == "-audio") options.playlist.audioRenditions = value;
+        else if (arg == "-subtitles") options.playlist.subtitleRenditions = value;
+        else if (arg == "-attrlength") options.playlist.attributeLength = options.mediaPlaylist.attributeLength = value;
+        else if (arg == "-segments") options.mediaPlaylist.segments = value;
+        else if (arg == "-seed") options.playlist.seed = options.mediaPlaylist.seed = value;
+        else if (arg == "-iterations") options.iterations = max<size_t>(value, 1);
+        else if (arg == "-batch") options.batchSize = max<size_t>(value, 1);
+        else if (arg == "-threads") options.maxThreads = value;
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    string text = GenerateMasterPlaylist(options.playlist);
+    if (isDump)
+    {
+        cout.write(text.data(), text.size());
+        return 0;
+    }
+
+    string mediaText = GenerateMediaPlaylist(options.mediaPlaylist);
+    if (isDumpMedia)
+    {
+        cout.write(mediaText.data(), mediaText.size());
+        return 0;
+    }
+
+    cout << "Playlist: " << text.size() << " bytes, " << options.playlist.variants << " variants, " <<
+        options.playlist.iFrameStreams << " i-frame streams, " << options.playlist.audioRenditions << " audio, " <<
+        options.playlist.subtitleRenditions << " subtitle renditions, seed " << options.playlist.seed << "\n" <<
+        "Best scan level: " << ScanLevelToString(HLSStructuralIndex::BestLevel()) << "\n";
+
+    BenchParse(options, text);
+    BenchScan(options, text);
+    BenchSort(options, text);
+    BenchTopK(options, text);
+    BenchSerialize(options, text);
+    BenchFilter(options, text);
+    BenchCache(options, text);
+    BenchSnapshot(options, text);
+    BenchSelect(options, text);
+    BenchBatch(options, text);
+    BenchParallelParse(options, text);
+
+    cout << "\nMedia playlist: " << mediaText.size() << " bytes, " << options.mediaPlaylist.segments << " segments\n";
+    BenchMediaParse(options, mediaText);
+    BenchRefresh(options);
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include "HLSPlaylistGenerator.h"
+#include <cstdio>
+
+static const char* const s_languages[] = { "en", "de", "fr", "es", "it", "ja", "pt-BR", "zh-Hans" };
+static const char* const s_channels[] = { "2", "6", "16/JOC", "8" };
+static const char* const s_audioCodecs[] = { "mp4a.40.2", "mp4a.40.5", "ec-3", "ac-3" };
+static const char* const s_videoCodecs[] = { "avc1.640028", "avc1.64001f", "avc1.4d401e", "hvc1.2.4.L150.B0",
+    "hvc1.2.4.L123.B0", "dvh1.05.06", "av01.0.08M.10", "vp09.02.10.10" };
+static const char* const s_frameRates[] = { "23.976", "24", "25", "29.97", "30", "50", "59.94", "60" };
+static const char* const s_videoRanges[] = { "SDR", "PQ", "HLG" };
+
+struct Rung
+{
+    int width;
+    int height;
+    long bandwidth;
+};
+
+static const Rung s_ladder[] =
+{
+    { 416, 234, 145000 },
+    { 640, 360, 365000 },
+    { 768, 432, 730000 },
+    { 960, 540, 2000000 },
+    { 1280, 720, 3000000 },
+    { 1920, 1080, 6000000 },
+    { 2560, 1440, 9000000 },
+    { 3840, 2160, 16000000 },
+};
+
+template <typename T, size_t N>
+static const T& Pick(HLSRandom& random, const T (&items)[N])
+{
+    return items[random.Below(N)];
+}
+
+// Pads a name with a run of URL-safe characters drawn from the generator, followed
+// by separator. Nothing is added for a length of 0
+static void AppendPadding(string& out, HLSRandom& random, size_t length, char separator)
+{
+    static const char s_alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+    if (length == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        out += s_alphabet[random.Below(sizeof(s_alphabet) - 1)];
+    }
+
+    out += separator;
+}
+
+string GenerateMasterPlaylist(const GeneratorOptions& options)
+{
+    HLSRandom random(options.seed);
+    string out;
+    out.reserve((options.variants * 2 + options.iFrameStreams + options.audioRenditions +
+        options.subtitleRenditions) * (160 + options.attributeLength));
+
+    out += "#EXTM3U\n#EXT-X-VERSION:6\n#EXT-X-INDEPENDENT-SEGMENTS\n\n";
+
+    for (size_t i = 0; i < options.audioRenditions; i++)
+    {
+        out += "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"audio-" + to_string(i) + "\",NAME=\"Audio ";
+        AppendPadding(out, random, options.attributeLength, ' ');
+        out += to_string(i);
+        out += "\",LANGUAGE=\"";
+        out += Pick(random, s_languages);
+        out += "\",DEFAULT=";
+        out += i == 0 ? "YES" : "NO";
+        out += ",AUTOSELECT=YES,CHANNELS=\"";
+        out += Pick(random, s_channels);
+        out += "\",URI=\"audio/" + to_string(i) + "/";
+        AppendPadding(out, random, options.attributeLength, '/');
+        out += "prog.m3u8\"\n";
+    }
+
+    for (size_t i = 0; i < options.subtitleRenditions; i++)
+    {
+        out += "#EXT-X-MEDIA:TYPE=SUBTITLES,GROUP-ID=\"subs\",NAME=\"Subtitles ";
+        AppendPadding(out, random, options.attributeLength, ' ');
+        out += to_string(i);
+        out += "\",LANGUAGE=\"";
+        out += Pick(random, s_languages);
+        out += "\",DEFAULT=NO,AUTOSELECT=YES,FORCED=NO,URI=\"subs/" + to_string(i) + "/";
+        AppendPadding(out, random, options.attributeLength, '/');
+        out += "prog.m3u8\"\n";
+    }
+
+    out += '\n';
+
+    for (size_t i = 0; i < options.iFrameStreams; i++)
+    {
+        const Rung& rung = Pick(random, s_ladder);
+
+        out += "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=" + to_string(rung.bandwidth / 10 + long(random.Below(50000)));
+        out += ",CODECS=\"";
+        out += Pick(random, s_videoCodecs);
+        out += "\",RESOLUTION=" + to_string(rung.width) + "x" + to_string(rung.height);
+        out += ",VIDEO-RANGE=";
+        out += Pick(random, s_videoRanges);
+        out += ",URI=\"iframe/" + to_string(i) + "/";
+        AppendPadding(out, random, options.attributeLength, '/');
+        out += "prog.m3u8\"\n";
+    }
+
+    out += '\n';
+
+    for (size_t i = 0; i < options.variants; i++)
+    {
+        const Rung& rung = Pick(random, s_ladder);
+        long bandwidth = rung.bandwidth + long(random.Below(rung.bandwidth / 2));
+
+        out += "#EXT-X-STREAM-INF:BANDWIDTH=" + to_string(bandwidth);
+        out += ",AVERAGE-BANDWIDTH=" + to_string(bandwidth - long(random.Below(bandwidth / 10)));
+        out += ",CODECS=\"";
+        out += Pick(random, s_videoCodecs);
+        out += ',';
+        out += Pick(random, s_audioCodecs);
+        out += "\",RESOLUTION=" + to_string(rung.width) + "x" + to_string(rung.height);
+        out += ",FRAME-RATE=";
+        out += Pick(random, s_frameRates);
+        out += ",VIDEO-RANGE=";
+        out += Pick(random, s_videoRanges);
+
+        if (options.audioRenditions > 0)
+        {
+            out += ",AUDIO=\"audio-" + to_string(random.Below(options.audioRenditions)) + "\"";
+        }
+
+        if (options.subtitleRenditions > 0)
+        {
+            out += ",SUBTITLES=\"subs\"";
+        }
+
+        out += "\nvideo/" + to_string(i) + "/";
+        AppendPadding(out, random, options.attributeLength, '/');
+        out += "prog.m3u8\n";
+    }
+
+    return out;
+}
+
+string GenerateMediaPlaylist(const MediaGeneratorOptions& options)
+{
+    HLSRandom random(options.seed);
+    string out;
+    out.reserve(options.segments * (100 + options.attributeLength));
+
+    int64_t firstSequence = 1000000 + int64_t(random.Below(1000000));
+    // Delta updates need version 9
+    out += "#EXTM3U\n#EXT-X-VERSION:" + string(options.skippedSegments > 0 ? "9" : "7") +
+        "\n#EXT-X-TARGETDURATION:6\n#EXT-X-MEDIA-SEQUENCE:" + to_string(firstSequence + int64_t(options.firstSegment)) + "\n";
+    out += "#EXT-X-MAP:URI=\"init.mp4\"\n";
+
+    if (options.skippedSegments > 0)
+    {
+        out += "#EXT-X-SKIP:SKIPPED-SEGMENTS=" + to_string(options.skippedSegments) + "\n";
+    }
+
+    // 2024-01-01T00:00:00Z, advanced by each segment
+    int64_t milliseconds = 1704067200000;
+
+    // Segments that are not listed are still generated, so that the random sequence
+    // and therefore the listed ones stay the same
+    size_t firstListed = options.firstSegment + options.skippedSegments;
+    string keyLine;
+    string segment;
+
+    for (size_t i = 0; i < options.segments; i++)
+    {
+        segment.clear();
+
+        if (options.keyPeriod > 0 && i % options.keyPeriod == 0)
+        {
+            keyLine = "#EXT-X-KEY:METHOD=AES-128,URI=\"keys/" + to_string(i / options.keyPeriod) + ".key\",IV=0x";
+            for (int digit = 0; digit < 32; digit++)
+            {
+                keyLine += "0123456789ABCDEF"[random.Below(16)];
+            }
+
+            keyLine += '\n';
+            segment += keyLine;
+        }
+        else if (i == firstListed)
+        {
+            // The key in effect is repeated ahead of the first listed segment
+            segment += keyLine;
+        }
+
+        // Mostly 6 second segments, with the odd short one at an ad break
+        int duration = random.Below(20) == 0 ? 2000 + int(random.Below(4000)) : 6000;
+
+        if (options.hasProgramDateTimes)
+        {
+            int64_t seconds = milliseconds / 1000;
+            int64_t days = seconds / 86400;
+            int64_t secondOfDay = seconds % 86400;
+
+            // Civil date from days since the epoch
+            int64_t z = days + 719468;
+            int64_t era = z / 146097;
+            int64_t dayOfEra = z - era * 146097;
+            int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+            int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+            int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+            int64_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+            int64_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+            int64_t year = yearOfEra + era * 400 + (month <= 2);
+
+            char date[40];
+            snprintf(date, sizeof(date), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", int(year), int(month), int(day),
+                int(secondOfDay / 3600), int(secondOfDay / 60 % 60), int(secondOfDay % 60), int(milliseconds % 1000));
+            segment += "#EXT-X-PROGRAM-DATE-TIME:";
+            segment += date;
+            segment += '\n';
+        }
+
+        segment += "#EXTINF:" + to_string(duration / 1000) + "." + to_string(duration % 1000 + 1000).substr(1) + ",\n";
+        segment += "segments/" + to_string(firstSequence + int64_t(i)) + "/";
+        AppendPadding(segment, random, options.attributeLength, '/');
+        segment += "media.ts\n";
+
+        if (i >= firstListed)
+        {
+            out += segment;
+        }
+
+        milliseconds += duration;
+    }
+
+    return out;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Shape of a generated master playlist
+struct GeneratorOptions
+{
+    size_t variants = 200;
+    size_t iFrameStreams = 40;
+    size_t audioRenditions = 6;
+    size_t subtitleRenditions = 4;
+
+    // Extra characters added to every URI and rendition name, to model CDNs
+    // that sign or tokenize their URLs
+    size_t attributeLength = 0;
+
+    uint64_t seed = 1;
+};
+
+// Shape of a generated media playlist
+struct MediaGeneratorOptions
+{
+    size_t segments = 100000;
+
+    // Every segment carries a program date time
+    bool hasProgramDateTimes = true;
+
+    // A new key every this many segments, or unencrypted when 0
+    size_t keyPeriod = 1000;
+
+    size_t attributeLength = 0;
+    uint64_t seed = 1;
+
+    // Segments before this one have left the live window and are not listed. The
+    // rest are the same as with a first segment of 0, so successive windows can be
+    // generated for refreshing
+    size_t firstSegment = 0;
+
+    // Turns the playlist into a delta update, with this many of the listed segments
+    // replaced by EXT-X-SKIP
+    size_t skippedSegments = 0;
+};
+
+// Small deterministic generator (splitmix64). Unlike the standard distributions,
+// its output is the same on every platform and standard library, so a given seed
+// always produces byte-identical playlists
+class HLSRandom
+{
+public:
+    explicit HLSRandom(uint64_t seed) : m_state(seed) {}
+
+    uint64_t Next()
+    {
+        uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, bound)
+    size_t Below(size_t bound) { return bound == 0 ? 0 : static_cast<size_t>(Next() % bound); }
+
+private:
+    uint64_t m_state;
+};
+
+// Generates a valid master playlist with the given shape. Variants cycle through
+// realistic ladders of resolutions, codecs, frame rates and video ranges, and refer
+// to the generated audio and subtitle groups
+string GenerateMasterPlaylist(const GeneratorOptions& options);
+
+// Generates a live media playlist of 6 second segments, as seen in a long DVR window
+string GenerateMediaPlaylist(const MediaGeneratorOptions& options);
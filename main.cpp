@@ -1,14 +1,32 @@
-#include <urlmon.h>
 #include "HLSMasterPlaylist.h"
+#include "HLSPlaylistSource.h"
+#include "HLSBatchProcessor.h"
+#include "HLSSerializer.h"
+#include "HLSHttpClient.h"
+#include "HLSPlaylistCache.h"
+#include <algorithm>
 #include <memory>
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <urlmon.h>
 
 // For URLOpenBlockingStream
 #pragma comment(lib, "urlmon.lib")
+#endif
+
+// Local playlists at least this large are parsed on every core
+static constexpr uintmax_t ParallelParseSize = 1024 * 1024;
 
 void PrintUsage()
 {
-    cout << "Usage: hlsparser.exe <URL> [<sort_method> -reverseOrder]\n" <<
+    cout << "Usage: hlsparser.exe <URL|file|-> [<sort_method> -reverseOrder] [-json]\n" <<
+            "       hlsparser.exe -batch <list_file|-> [<sort_method> -reverseOrder] [-json]\n" <<
+            "   A local file is read directly and - reads the playlist from stdin\n" <<
+            "   Batch mode reads one URL or file per line and prints a result for each, in order\n" <<
+            "   -json prints the playlist as JSON instead of M3U8\n" <<
             "   Sorting Methods:\n" <<
             "   0 - Bandwidth\n" <<
             "   1 - Average Bandwidth\n" <<
@@ -20,18 +38,155 @@ void PrintUsage()
             "   7 - Video Range\n";
 }
 
+#ifndef _WIN32
+// One client for the whole run, so that batch inputs on the same host share
+// connections
+HLSHttpClient& GetHttpClient()
+{
+    static HLSHttpClient s_client;
+    return s_client;
+}
+#endif
+
+// Fetches and parses a playlist from a URL. Throws if the URL cannot be opened
+void FetchPlaylist(const string& url, HLSMasterPlaylist& playlist)
+{
+#ifdef _WIN32
+    // Custom deleter for IStream RAII
+    unique_ptr<IStream, function<void(IStream*)>> stream(nullptr, [](IStream* s){ if (s) { s->Release(); }});
+
+    // Use a standard windows API to easily grab the file
+    IStream* tempStream = nullptr;
+    HRESULT result = URLOpenBlockingStream(0, url.c_str(), &tempStream, 0, 0);
+    if (result != 0)
+    {
+        throw runtime_error("Unable to open " + url);
+    }
+
+    stream.reset(tempStream);
+
+    // Parse the file as it is read rather than buffering the whole body
+    char buffer[1000];
+    unsigned long bytesRead;
+    stream->Read(buffer, 1000, &bytesRead);
+    while (bytesRead > 0U)
+    {
+        playlist.Feed(buffer, bytesRead);
+        stream->Read(buffer, 1000, &bytesRead);
+    }
+
+    playlist.Finish();
+#else
+    GetHttpClient().FetchPlaylist(url, playlist);
+#endif
+}
+
+// Local playlists are parsed straight out of the mapped file, anything else is fetched
+void LoadPlaylist(const string& location, HLSMasterPlaylist& playlist)
+{
+    if (location == "-")
+    {
+        playlist.ParseMasterPlaylist(HLSPlaylistSource::ReadDescriptor(0).View());
+    }
+    else if (filesystem::is_regular_file(location))
+    {
+        HLSBatchProcessor::LoadLocalFile(location, playlist);
+    }
+    else
+    {
+        FetchPlaylist(location, playlist);
+    }
+}
+
+#ifndef _WIN32
+// As LoadPlaylist, going through the cache so that repeated inputs are parsed once
+HLSPlaylistCache::PlaylistPtr LoadCachedPlaylist(HLSPlaylistCache& cache, const string& location)
+{
+    if (location == "-")
+    {
+        return cache.Parse(HLSPlaylistSource::ReadDescriptor(0).View());
+    }
+
+    if (filesystem::is_regular_file(location))
+    {
+        return cache.Parse(HLSPlaylistSource::MapFile(location).View());
+    }
+
+    return cache.Fetch(GetHttpClient(), location);
+}
+#endif
+
+int RunBatch(const string& listLocation, SortParameter sortMethod, bool sortAscending, SerializeFormat format)
+{
+    ifstream listFile;
+    if (listLocation != "-")
+    {
+        listFile.open(listLocation);
+        if (!listFile)
+        {
+            cout << "Unable to open " << listLocation << "\n";
+            return 1;
+        }
+    }
+
+    HLSThreadPool pool;
+    HLSBatchProcessor batch(pool);
+    batch.SetOutputFormat(format);
+
+#ifdef _WIN32
+    batch.SetLoader(&LoadPlaylist);
+#else
+    // Lists often name the same playlist more than once
+    HLSPlaylistCache cache;
+    batch.SetSharedLoader([&cache](const string& location) { return LoadCachedPlaylist(cache, location); });
+#endif
+
+    size_t failures = batch.Run(listLocation == "-" ? cin : listFile, sortMethod, sortAscending,
+        [](size_t index, const string& input, bool isSuccess, const string& output)
+        {
+            cout << "### " << index << " " << input << "\n";
+            if (isSuccess)
+            {
+                cout << output << "\n";
+            }
+            else
+            {
+                cout << "ERROR: " << output << "\n\n";
+            }
+        });
+
+    return failures > 0 ? 2 : 0;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc < 2 || argc > 4)
+    vector<string> args(argv, argv + argc);
+
+    // -json can go anywhere on the command line, so take it out before reading the rest
+    SerializeFormat format = SerializeFormat::M3U8;
+    auto const jsonArg = find(args.begin(), args.end(), "-json");
+    if (jsonArg != args.end())
+    {
+        format = SerializeFormat::JSON;
+        args.erase(jsonArg);
+    }
+
+    size_t argCount = args.size();
+    bool isBatch = argCount > 1 && args[1] == "-batch";
+
+    // Batch mode takes the list as an extra argument ahead of the usual ones
+    size_t argOffset = isBatch ? 1 : 0;
+
+    if (argCount < 2 + argOffset || argCount > 4 + argOffset)
     {
         PrintUsage();
         return 1;
     }
 
     SortParameter sortMethod = SortParameter::DEFAULT;
-    if (argc > 2)
+    if (argCount > 2 + argOffset)
     {
-        sortMethod = (SortParameter) atoi(argv[2]);
+        sortMethod = (SortParameter) atoi(args[2 + argOffset].c_str());
     }
 
     if (sortMethod > SortParameter::DEFAULT || sortMethod < SortParameter::BANDWIDTH)
@@ -41,42 +196,52 @@ int main(int argc, char* argv[])
     }
 
     bool sortAscending = true;
-    if (argc > 3)
+    if (argCount > 3 + argOffset)
     {
         sortAscending = false;
     }
 
-    // Custom deleter for IStream RAII
-    unique_ptr<IStream, function<void(IStream*)>> stream(nullptr, [](IStream* s){ if (s) { s->Release(); }});
+    if (isBatch)
+    {
+        return RunBatch(args[2], sortMethod, sortAscending, format);
+    }
 
-    // Use a standard windows API to easily grab the file
-    IStream* tempStream = nullptr;
-    HRESULT result = URLOpenBlockingStream(0, argv[1], &tempStream, 0, 0);
-    if (result != 0)
+    unique_ptr<HLSMasterPlaylist> playlist = make_unique<HLSMasterPlaylist>();
+
+    try
+    {
+        // A single large local playlist is split across every core
+        if (filesystem::is_regular_file(args[1]) && filesystem::file_size(args[1]) >= ParallelParseSize)
+        {
+            HLSThreadPool pool;
+            HLSPlaylistSource source = HLSPlaylistSource::MapFile(args[1]);
+            playlist->ParseMasterPlaylist(source.View(), pool);
+        }
+        else
+        {
+            LoadPlaylist(args[1], *playlist);
+        }
+    }
+    catch (const exception& e)
     {
+        cout << e.what() << "\n";
         PrintUsage();
         return 1;
     }
 
-    stream.reset(tempStream);
-    
-    // Read the file into a string stream for parsing
-    char buffer[1000];
-    unsigned long bytesRead;
-    stringstream ss;
-    stream->Read(buffer, 1000, &bytesRead);
-    while (bytesRead > 0U)
+    // Anything the parser did not recognize goes to stderr, out of the way of the playlist
+    HLSDiagnostic diagnostic;
+    while (playlist->GetDiagnostics().Next(diagnostic))
     {
-        ss.write(buffer, (long long)bytesRead);
-        stream->Read(buffer, 1000, &bytesRead);
+        cerr << "WARNING: Line " << diagnostic.line << ": " << DiagnosticCodeToString(diagnostic.code) <<
+            ": " << diagnostic.Text() << "\n";
     }
 
-    unique_ptr<HLSMasterPlaylist> playlist = make_unique<HLSMasterPlaylist>();
-    playlist->ParseMasterPlaylist(ss);
-
     playlist->Sort(sortMethod, sortAscending);
-    
-    cout << *playlist.get();
+
+    string output;
+    HLSSerializer(output, format).Write(*playlist);
+    cout.write(output.data(), output.size());
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "HLSTest.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSPlaylistGenerator.h"
+#include "HLSSerializer.h"
+
+static string Serialize(const HLSMasterPlaylist& playlist)
+{
+    string buffer;
+    HLSSerializer(buffer, SerializeFormat::JSON).Write(playlist, SortParameter::BANDWIDTH, true);
+    HLSSerializer(buffer, SerializeFormat::M3U8).Write(playlist, SortParameter::DEFAULT, true);
+    return buffer;
+}
+
+static string OneShot(string_view text)
+{
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(text);
+    return Serialize(playlist);
+}
+
+static string ToCrlf(const string& text)
+{
+    string crlf;
+    for (char c : text)
+    {
+        if (c == '\n')
+        {
+            crlf += '\r';
+        }
+        crlf += c;
+    }
+    return crlf;
+}
+
+// CRLF line endings, quoted values holding commas and equals signs, and no final line break
+static const char* const s_smallPlaylist =
+    "#EXTM3U\r\n"
+    "#EXT-X-INDEPENDENT-SEGMENTS\r\n"
+    "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aac\",NAME=\"English, stereo\",LANGUAGE=\"en\",CHANNELS=\"2\",URI=\"a=1.m3u8\"\r\n"
+    "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"ac3\",NAME=\"Deutsch\",LANGUAGE=\"de\",CHANNELS=\"6\",URI=\"de.m3u8\"\r\n"
+    "# a comment\r\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=2560000,CODECS=\"avc1.4d401f,mp4a.40.2\",RESOLUTION=1280x720,FRAME-RATE=29.97,AUDIO=\"aac\"\r\n"
+    "mid.m3u8?token=a,b\r\n"
+    "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=86000,CODECS=\"avc1.4d401f\",URI=\"iframe.m3u8\"\r\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=1280000,CODECS=\"avc1.42e00a,mp4a.40.2\",RESOLUTION=640x360,AUDIO=\"ac3\"\r\n"
+    "low.m3u8";
+
+HLS_TEST(FeedSplitAtEveryOffsetMatchesOneShotParse)
+{
+    string text = s_smallPlaylist;
+    string expected = OneShot(text);
+    HLS_CHECK(expected.find("English, stereo") != string::npos);
+    HLS_CHECK(expected.find("mid.m3u8?token=a,b") != string::npos);
+
+    // One playlist object, reused for every split
+    HLSMasterPlaylist playlist;
+    for (size_t split = 0; split <= text.length(); split++)
+    {
+        playlist.Feed(text.data(), split);
+        playlist.Feed(text.data() + split, text.length() - split);
+        playlist.Finish();
+        HLS_CHECK(Serialize(playlist) == expected);
+    }
+
+    // A byte at a time
+    for (char c : text)
+    {
+        playlist.Feed(&c, 1);
+    }
+    playlist.Finish();
+    HLS_CHECK(Serialize(playlist) == expected);
+}
+
+HLS_TEST(FeedSplitAtRandomOffsetsMatchesOneShotParse)
+{
+    GeneratorOptions options;
+    options.variants = 300;
+    options.attributeLength = 7;
+    string lf = GenerateMasterPlaylist(options);
+
+    HLSRandom random(3);
+    for (const string& text : { lf, ToCrlf(lf) })
+    {
+        string expected = OneShot(text);
+
+        for (size_t test = 0; test < 40; test++)
+        {
+            HLSMasterPlaylist playlist;
+            size_t maxChunk = size_t(1) << random.Below(14);
+
+            for (size_t pos = 0; pos < text.length(); )
+            {
+                size_t length = min(text.length() - pos, 1 + random.Below(maxChunk));
+                playlist.Feed(text.data() + pos, length);
+                pos += length;
+            }
+
+            playlist.Finish();
+            HLS_CHECK(Serialize(playlist) == expected);
+        }
+    }
+}
@@ -0,0 +1,258 @@
+#include "HLSTest.h"
+#ifndef _WIN32
+#include "HLSHttpClient.h"
+#include "HLSLoopbackServer.h"
+#include "HLSPlaylistCache.h"
+#include "HLSPlaylistGenerator.h"
+#include <future>
+
+using namespace std::chrono_literals;
+
+static const string& TestPlaylist()
+{
+    static const string text = []()
+    {
+        GeneratorOptions options;
+        options.variants = 40;
+        return GenerateMasterPlaylist(options);
+    }();
+    return text;
+}
+
+// Sends the playlist in chunks of chunkSize, in chunked transfer encoding
+static string ChunkedResponse(string_view body, size_t chunkSize)
+{
+    string response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+    for (size_t pos = 0; pos < body.length(); pos += chunkSize)
+    {
+        string_view chunk = body.substr(pos, chunkSize);
+        char size[16];
+        snprintf(size, sizeof(size), "%zx\r\n", chunk.length());
+        response += size;
+        response += chunk;
+        response += "\r\n";
+    }
+
+    return response + "0\r\n\r\n";
+}
+
+// The playlist server the tests share. Each path stands for one way a server can respond
+static HLSLoopbackServer::Response Respond(const HLSLoopbackServer::Request& request, const HLSLoopbackServer* server)
+{
+    HLSLoopbackServer::Response response;
+    const string& target = request.target;
+
+    if (target == "/master.m3u8")
+    {
+        response.data = HLSLoopbackServer::Ok(TestPlaylist());
+    }
+    else if (target == "/chunked.m3u8")
+    {
+        response.data = ChunkedResponse(TestPlaylist(), 1000);
+    }
+    else if (target == "/redirect.m3u8")
+    {
+        response.data = "HTTP/1.1 302 Found\r\nLocation: /master.m3u8\r\nContent-Length: 0\r\n\r\n";
+    }
+    else if (target == "/other-host.m3u8")
+    {
+        // localhost is only looked up once the redirect arrives
+        response.data = "HTTP/1.1 301 Moved Permanently\r\nLocation: " + server->Url("/master.m3u8", "localhost") +
+            "\r\nContent-Length: 0\r\n\r\n";
+    }
+    else if (target == "/loop.m3u8")
+    {
+        response.data = "HTTP/1.1 302 Found\r\nLocation: /loop.m3u8\r\nContent-Length: 0\r\n\r\n";
+    }
+    else if (target == "/slow.m3u8")
+    {
+        response.delay = 1000ms;
+        response.data = HLSLoopbackServer::Ok(TestPlaylist());
+    }
+    else if (target == "/closing.m3u8")
+    {
+        // Claims to keep the connection alive, then drops it, as a server timing out an
+        // idle connection does
+        response.data = HLSLoopbackServer::Ok(TestPlaylist());
+        response.isClosing = true;
+    }
+    else if (target == "/malformed.m3u8")
+    {
+        response.data = "HTTP/1.1 two hundred\r\n\r\n";
+        response.isClosing = true;
+    }
+    else if (target == "/etag.m3u8")
+    {
+        response.data = request.Header("If-None-Match") == "\"v1\"" ?
+            "HTTP/1.1 304 Not Modified\r\nETag: \"v1\"\r\n\r\n" :
+            HLSLoopbackServer::Ok(TestPlaylist(), "ETag: \"v1\"\r\n");
+    }
+    else
+    {
+        response.data = "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\nNot found";
+    }
+
+    return response;
+}
+
+struct LoopbackFixture
+{
+    HLSLoopbackServer server;
+    HLSHttpClient client;
+
+    explicit LoopbackFixture(const HLSHttpClient::Options& options = HLSHttpClient::Options()) :
+        server([this](const HLSLoopbackServer::Request& request) { return Respond(request, &server); }),
+        client(options) {}
+
+    HttpResult Get(const string& path, string* body = nullptr)
+    {
+        promise<HttpResult> done;
+        client.Fetch(server.Url(path),
+            [body](const char* data, size_t length) { if (body) body->append(data, length); },
+            [&done](const HttpResult& result) { done.set_value(result); });
+        return done.get_future().get();
+    }
+};
+
+static size_t StreamCount(const HLSMasterPlaylist& playlist)
+{
+    return playlist.GetStreams(SortParameter::DEFAULT, true).size();
+}
+
+HLS_TEST(HttpFetchesContentLengthAndChunkedBodies)
+{
+    LoopbackFixture fixture;
+
+    string body;
+    HttpResult result = fixture.Get("/master.m3u8", &body);
+    HLS_CHECK(result.isSuccess && result.status == 200);
+    HLS_CHECK(body == TestPlaylist());
+
+    body.clear();
+    result = fixture.Get("/chunked.m3u8", &body);
+    HLS_CHECK(result.isSuccess);
+    HLS_CHECK(body == TestPlaylist());
+
+    HLSMasterPlaylist playlist;
+    fixture.client.FetchPlaylist(fixture.server.Url("/chunked.m3u8"), playlist);
+    HLS_CHECK(StreamCount(playlist) == 40);
+}
+
+HLS_TEST(HttpReusesKeepAliveConnections)
+{
+    LoopbackFixture fixture;
+
+    for (int i = 0; i < 5; i++)
+    {
+        HLS_CHECK(fixture.Get("/master.m3u8").isSuccess);
+    }
+
+    HttpClientStats stats = fixture.client.GetStats();
+    HLS_CHECK(stats.connectionsOpened == 1);
+    HLS_CHECK(stats.connectionsReused == 4);
+    HLS_CHECK(fixture.server.ConnectionCount() == 1);
+}
+
+HLS_TEST(HttpFollowsRedirects)
+{
+    LoopbackFixture fixture;
+
+    HttpResult result = fixture.Get("/redirect.m3u8");
+    HLS_CHECK(result.isSuccess);
+    HLS_CHECK(result.url == fixture.server.Url("/master.m3u8"));
+
+    // A host the client has not resolved yet is looked up off the event loop
+    string body;
+    result = fixture.Get("/other-host.m3u8", &body);
+    HLS_CHECK(result.isSuccess);
+    HLS_CHECK(result.url == fixture.server.Url("/master.m3u8", "localhost"));
+    HLS_CHECK(body == TestPlaylist());
+    HLS_CHECK(fixture.client.GetStats().redirects == 2);
+
+    result = fixture.Get("/loop.m3u8");
+    HLS_CHECK(!result.isSuccess);
+    HLS_CHECK(result.error == "Too many redirects");
+}
+
+HLS_TEST(HttpReportsErrorResponses)
+{
+    LoopbackFixture fixture;
+
+    HttpResult result = fixture.Get("/missing.m3u8");
+    HLS_CHECK(!result.isSuccess);
+    HLS_CHECK(result.status == 404);
+
+    result = fixture.Get("/malformed.m3u8");
+    HLS_CHECK(!result.isSuccess);
+    HLS_CHECK(!result.error.empty());
+
+    HLSMasterPlaylist playlist;
+    HLS_CHECK_THROWS(fixture.client.FetchPlaylist(fixture.server.Url("/missing.m3u8"), playlist), runtime_error);
+}
+
+HLS_TEST(HttpTimesOutSlowResponses)
+{
+    HLSHttpClient::Options options;
+    options.requestTimeout = 200ms;
+    LoopbackFixture fixture(options);
+
+    HttpResult result = fixture.Get("/slow.m3u8");
+    HLS_CHECK(!result.isSuccess);
+    HLS_CHECK(fixture.client.GetStats().timeouts == 1);
+}
+
+HLS_TEST(HttpRetriesConnectionsClosedWhileIdle)
+{
+    LoopbackFixture fixture;
+
+    HLS_CHECK(fixture.Get("/closing.m3u8").isSuccess);
+
+    // The pooled connection is dead by now. The request fails on it before any of
+    // the response arrives, and is retried on a new connection
+    HLS_CHECK(fixture.Get("/master.m3u8").isSuccess);
+    HLS_CHECK(fixture.server.ConnectionCount() == 2);
+}
+
+HLS_TEST(HttpRunsConcurrentRequests)
+{
+    HLSHttpClient::Options options;
+    options.maxInFlight = 4;
+    options.maxConnectionsPerHost = 2;
+    LoopbackFixture fixture(options);
+
+    const size_t count = 40;
+    vector<promise<HttpResult>> done(count);
+    vector<string> bodies(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        string& body = bodies[i];
+        promise<HttpResult>& finished = done[i];
+        fixture.client.Fetch(fixture.server.Url(i % 2 ? "/master.m3u8" : "/chunked.m3u8"),
+            [&body](const char* data, size_t length) { body.append(data, length); },
+            [&finished](const HttpResult& result) { finished.set_value(result); });
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        HLS_CHECK(done[i].get_future().get().isSuccess);
+        HLS_CHECK(bodies[i] == TestPlaylist());
+    }
+
+    HLS_CHECK(fixture.server.ConnectionCount() <= 2);
+}
+
+HLS_TEST(HttpConditionalFetchReusesCachedPlaylist)
+{
+    LoopbackFixture fixture;
+    HLSPlaylistCache cache;
+
+    string url = fixture.server.Url("/etag.m3u8");
+    HLSPlaylistCache::PlaylistPtr first = cache.Fetch(fixture.client, url);
+    HLSPlaylistCache::PlaylistPtr second = cache.Fetch(fixture.client, url);
+
+    HLS_CHECK(first == second);
+    HLS_CHECK(StreamCount(*first) == 40);
+    HLS_CHECK(cache.GetStats().notModified == 1);
+}
+#endif
@@ -0,0 +1,209 @@
+#include "HLSLoopbackServer.h"
+#ifndef _WIN32
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Writes to a connection the client has closed fail rather than raise SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+string_view HLSLoopbackServer::Request::Header(string_view name) const
+{
+    for (const auto& header : headers)
+    {
+        if (header.first.length() == name.length() && equal(name.begin(), name.end(), header.first.begin(),
+            [](char a, char b) { return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b)); }))
+        {
+            return header.second;
+        }
+    }
+
+    return string_view();
+}
+
+HLSLoopbackServer::HLSLoopbackServer(Handler handler) :
+    m_handler(move(handler))
+{
+    m_listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listener < 0)
+    {
+        throw system_error(errno, generic_category(), "Unable to create listening socket");
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+
+    socklen_t length = sizeof(address);
+    if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(m_listener, 64) != 0 ||
+        getsockname(m_listener, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    {
+        int error = errno;
+        close(m_listener);
+        throw system_error(error, generic_category(), "Unable to listen on the loopback address");
+    }
+
+    m_port = ntohs(address.sin_port);
+    m_acceptor = thread(&HLSLoopbackServer::AcceptLoop, this);
+}
+
+HLSLoopbackServer::~HLSLoopbackServer()
+{
+    m_isStopping = true;
+
+    // Shutting the sockets down wakes the threads blocked on them
+    shutdown(m_listener, SHUT_RDWR);
+    m_acceptor.join();
+    close(m_listener);
+
+    vector<thread> threads;
+    {
+        lock_guard<mutex> lock(m_lock);
+        for (int fd : m_connections)
+        {
+            shutdown(fd, SHUT_RDWR);
+        }
+
+        threads.swap(m_threads);
+    }
+
+    for (thread& connection : threads)
+    {
+        connection.join();
+    }
+}
+
+string HLSLoopbackServer::Url(string_view path, string_view host) const
+{
+    return "http://" + string(host) + ":" + to_string(m_port) + string(path);
+}
+
+string HLSLoopbackServer::Ok(string_view body, string_view extraHeaders)
+{
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + to_string(body.length()) + "\r\n" +
+        string(extraHeaders) + "\r\n" + string(body);
+}
+
+void HLSLoopbackServer::AcceptLoop()
+{
+    while (!m_isStopping)
+    {
+        int fd = accept(m_listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return;
+        }
+
+        lock_guard<mutex> lock(m_lock);
+        if (m_isStopping)
+        {
+            close(fd);
+            return;
+        }
+
+        m_connectionCount++;
+        m_connections.push_back(fd);
+        m_threads.emplace_back(&HLSLoopbackServer::Serve, this, fd);
+    }
+}
+
+void HLSLoopbackServer::Serve(int fd)
+{
+    string buffer;
+    char chunk[4096];
+    bool isOpen = true;
+
+    while (isOpen && !m_isStopping)
+    {
+        // Requests have no body, so each one ends at its blank line
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == string::npos)
+        {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                isOpen = false;
+                break;
+            }
+
+            buffer.append(chunk, received);
+        }
+
+        if (!isOpen)
+        {
+            break;
+        }
+
+        string head = buffer.substr(0, end);
+        buffer.erase(0, end + 4);
+
+        // "GET <target> HTTP/1.1", then one header per line
+        Request request;
+        size_t lineEnd = head.find("\r\n");
+        string requestLine = head.substr(0, lineEnd);
+        size_t targetStart = requestLine.find(' ') + 1;
+        request.target = requestLine.substr(targetStart, requestLine.rfind(' ') - targetStart);
+
+        while (lineEnd != string::npos)
+        {
+            size_t lineStart = lineEnd + 2;
+            lineEnd = head.find("\r\n", lineStart);
+            string line = head.substr(lineStart, lineEnd == string::npos ? string::npos : lineEnd - lineStart);
+
+            size_t colon = line.find(':');
+            if (colon != string::npos)
+            {
+                size_t valueStart = line.find_first_not_of(' ', colon + 1);
+                request.headers.emplace_back(line.substr(0, colon),
+                    valueStart == string::npos ? string() : line.substr(valueStart));
+            }
+        }
+
+        m_requestCount++;
+        Response response = m_handler(request);
+
+        if (response.delay.count() > 0)
+        {
+            this_thread::sleep_for(response.delay);
+        }
+
+        size_t sent = 0;
+        while (sent < response.data.length())
+        {
+            ssize_t written = send(fd, response.data.data() + sent, response.data.length() - sent, MSG_NOSIGNAL);
+            if (written <= 0)
+            {
+                isOpen = false;
+                break;
+            }
+
+            sent += written;
+        }
+
+        if (response.isClosing)
+        {
+            break;
+        }
+    }
+
+    lock_guard<mutex> lock(m_lock);
+    m_connections.erase(find(m_connections.begin(), m_connections.end(), fd));
+    close(fd);
+}
+#endif
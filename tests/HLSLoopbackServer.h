@@ -0,0 +1,81 @@
+#pragma once
+#ifndef _WIN32
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "HLSHttpClient.h"
+
+using namespace std;
+
+// A stand-in HTTP/1.1 server on 127.0.0.1, for testing HLSHttpClient without a
+// network. Each connection is served on a thread of its own, one request at a time.
+// The handler decides each response byte for byte, so tests can send malformed,
+// slow or truncated responses as easily as good ones
+class HLSLoopbackServer
+{
+public:
+    struct Request
+    {
+        string target;
+        HttpHeaders headers;
+
+        // Matched without regard to case. Empty if the header is not present
+        string_view Header(string_view name) const;
+    };
+
+    struct Response
+    {
+        // Sent as is, status line and headers included
+        string data;
+
+        // Waited out before anything is sent
+        chrono::milliseconds delay = chrono::milliseconds(0);
+
+        // Closes the connection once the response is sent, whatever it says
+        bool isClosing = false;
+    };
+
+    typedef function<Response(const Request& request)> Handler;
+
+    // Starts listening on a free port
+    explicit HLSLoopbackServer(Handler handler);
+
+    // Closes every connection and waits for the threads serving them
+    ~HLSLoopbackServer();
+
+    HLSLoopbackServer(const HLSLoopbackServer&) = delete;
+    HLSLoopbackServer& operator = (const HLSLoopbackServer&) = delete;
+
+    // http://<host>:<port><path>. The server answers for any name of the loopback address
+    string Url(string_view path, string_view host = "127.0.0.1") const;
+
+    size_t ConnectionCount() const { return m_connectionCount; }
+    size_t RequestCount() const { return m_requestCount; }
+
+    // A complete response with a Content-Length body
+    static string Ok(string_view body, string_view extraHeaders = "");
+
+private:
+    void AcceptLoop();
+    void Serve(int fd);
+
+    Handler m_handler;
+    int m_listener = -1;
+    uint16_t m_port = 0;
+
+    atomic<bool> m_isStopping{ false };
+    atomic<size_t> m_connectionCount{ 0 };
+    atomic<size_t> m_requestCount{ 0 };
+
+    mutex m_lock;
+    vector<int> m_connections;
+    vector<thread> m_threads;
+    thread m_acceptor;
+};
+#endif
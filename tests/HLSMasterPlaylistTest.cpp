@@ -0,0 +1,27 @@
+#include "HLSTest.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSSerializer.h"
+
+static string WithFrameRate(string_view frameRate)
+{
+    string text = "#EXTM3U\n#EXT-X-STREAM-INF:BANDWIDTH=1280000,FRAME-RATE=";
+    text += frameRate;
+    text += "\nlow.m3u8\n";
+    return text;
+}
+
+HLS_TEST(MasterPlaylistRejectsNonFiniteFrameRates)
+{
+    for (string_view frameRate : { "inf", "-inf", "infinity", "nan" })
+    {
+        HLSMasterPlaylist playlist;
+        HLS_CHECK_THROWS(playlist.ParseMasterPlaylist(WithFrameRate(frameRate)), invalid_argument);
+    }
+
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(WithFrameRate("29.97"));
+
+    string buffer;
+    HLSSerializer(buffer, SerializeFormat::M3U8).Write(playlist, SortParameter::FRAMERATE, true);
+    HLS_CHECK(buffer.find("FRAME-RATE=29.97") != string::npos);
+}
@@ -0,0 +1,229 @@
+#include "HLSTest.h"
+#include "HLSMediaPlaylist.h"
+#include "HLSPlaylistGenerator.h"
+
+static string Describe(const HLSMediaPlaylist::Segment& segment)
+{
+    char line[512];
+    snprintf(line, sizeof(line), "%lld %.3f %.*s %llu@%llu %d:%lld key=%s,%s,%s map=%s,%llu@%llu %d%d\n",
+        (long long)segment.sequence, segment.duration, int(segment.uri.length()), segment.uri.data(),
+        (unsigned long long)segment.byteRange.length, (unsigned long long)segment.byteRange.offset,
+        int(segment.hasProgramDateTime), (long long)segment.programDateTime,
+        segment.key ? segment.key->method.c_str() : "", segment.key ? segment.key->uri.c_str() : "",
+        segment.key ? segment.key->iv.c_str() : "", segment.map ? segment.map->uri.c_str() : "",
+        (unsigned long long)(segment.map ? segment.map->byteRange.length : 0),
+        (unsigned long long)(segment.map ? segment.map->byteRange.offset : 0),
+        int(segment.isDiscontinuity), int(segment.isGap));
+    return line;
+}
+
+// Everything a parse produces, one segment per line
+static string Describe(const HLSMediaPlaylist& playlist)
+{
+    char header[256];
+    snprintf(header, sizeof(header), "v%d t%lld s%lld d%lld p%d e%d i%d f%d n%zu %.3f\n", playlist.GetVersion(),
+        (long long)playlist.GetTargetDuration(), (long long)playlist.GetMediaSequence(),
+        (long long)playlist.GetDiscontinuitySequence(), int(playlist.GetPlaylistType()), int(playlist.HasEndList()),
+        int(playlist.HasIndependentSegments()), int(playlist.IsIFramesOnly()), playlist.SegmentCount(),
+        playlist.TotalDuration());
+
+    string description = header;
+    for (size_t i = 0; i < playlist.GetDurations().size(); i++)
+    {
+        description += Describe(playlist.GetSegment(i));
+    }
+    return description;
+}
+
+static string Parsed(string_view text)
+{
+    HLSMediaPlaylist playlist;
+    playlist.ParseMediaPlaylist(text);
+    return Describe(playlist);
+}
+
+// Segments [first, last) of a generated live stream. With skipped segments it is a
+// delta update of the same window
+static string Window(size_t first, size_t last, size_t skipped = 0)
+{
+    MediaGeneratorOptions options;
+    options.segments = last;
+    options.firstSegment = first;
+    options.skippedSegments = skipped;
+    options.keyPeriod = 7;
+    return GenerateMediaPlaylist(options);
+}
+
+static const char* const s_vodPlaylist =
+    "#EXTM3U\n"
+    "#EXT-X-VERSION:7\n"
+    "#EXT-X-TARGETDURATION:6\n"
+    "#EXT-X-MEDIA-SEQUENCE:100\n"
+    "#EXT-X-DISCONTINUITY-SEQUENCE:3\n"
+    "#EXT-X-PLAYLIST-TYPE:VOD\n"
+    "#EXT-X-INDEPENDENT-SEGMENTS\n"
+    "#EXT-X-MAP:URI=\"init.mp4\",BYTERANGE=\"720@0\"\n"
+    "#EXT-X-PROGRAM-DATE-TIME:2024-01-01T00:00:00.000Z\n"
+    "#EXTINF:6.000,\n"
+    "#EXT-X-BYTERANGE:1000@720\n"
+    "main.mp4\n"
+    "#EXTINF:6.000,\n"
+    "#EXT-X-BYTERANGE:2000\n"
+    "main.mp4\n"
+    "#EXT-X-KEY:METHOD=AES-128,URI=\"k1.key\",IV=0x0123\n"
+    "#EXTINF:5.5,\n"
+    "seg3.ts\n"
+    "#EXT-X-DISCONTINUITY\n"
+    "#EXT-X-GAP\n"
+    "#EXTINF:4,\n"
+    "seg4.ts\n"
+    "#EXT-X-KEY:METHOD=NONE\n"
+    "#EXT-X-MAP:URI=\"init2.mp4\"\n"
+    "#EXTINF:6,\n"
+    "seg5.ts\n"
+    "#EXT-X-ENDLIST\n";
+
+HLS_TEST(MediaPlaylistStoresSegmentColumns)
+{
+    HLSMediaPlaylist playlist;
+    playlist.ParseMediaPlaylist(s_vodPlaylist);
+
+    string expected =
+        "v7 t6 s100 d3 p2 e1 i1 f0 n5 27.500\n"
+        "100 6.000 main.mp4 1000@720 1:1704067200000 key=,, map=init.mp4,720@0 00\n"
+        "101 6.000 main.mp4 2000@1720 0:0 key=,, map=init.mp4,720@0 00\n"
+        "102 5.500 seg3.ts 0@0 0:0 key=AES-128,k1.key,0x0123 map=init.mp4,720@0 00\n"
+        "103 4.000 seg4.ts 0@0 0:0 key=AES-128,k1.key,0x0123 map=init.mp4,720@0 11\n"
+        "104 6.000 seg5.ts 0@0 0:0 key=,, map=init2.mp4,0@0 00\n";
+    HLS_CHECK(Describe(playlist) == expected);
+    HLS_CHECK(playlist.GetKeys().size() == 1 && playlist.GetMaps().size() == 2);
+    HLS_CHECK_THROWS(playlist.GetSegment(5), out_of_range);
+
+    // Split at every offset, fed in two chunks
+    string text = s_vodPlaylist;
+    for (size_t split = 0; split <= text.length(); split++)
+    {
+        playlist.Feed(text.data(), split);
+        playlist.Feed(text.data() + split, text.length() - split);
+        playlist.Finish();
+        HLS_CHECK(Describe(playlist) == expected);
+    }
+}
+
+HLS_TEST(MediaPlaylistStreamsSegments)
+{
+    string text = Window(0, 300);
+    HLSMediaPlaylist stored;
+    stored.ParseMediaPlaylist(text);
+
+    string streamed;
+    HLSMediaPlaylist playlist;
+    playlist.SetSegmentHandler([&streamed](const HLSMediaPlaylist::Segment& segment) { streamed += Describe(segment); });
+    playlist.ParseMediaPlaylist(text);
+
+    string expected;
+    for (size_t i = 0; i < stored.SegmentCount(); i++)
+    {
+        expected += Describe(stored.GetSegment(i));
+    }
+
+    HLS_CHECK(streamed == expected);
+    HLS_CHECK(playlist.SegmentCount() == stored.SegmentCount());
+    HLS_CHECK(playlist.TotalDuration() == stored.TotalDuration());
+    HLS_CHECK(playlist.GetDurations().empty());
+}
+
+HLS_TEST(MediaPlaylistRefreshMatchesFreshParse)
+{
+    HLSMediaPlaylist playlist;
+    playlist.ParseMediaPlaylist(Window(0, 100));
+
+    // The window slides on by varying amounts, including not at all and by its whole length
+    size_t first = 0;
+    size_t last = 100;
+    for (size_t step : { 1, 0, 3, 6, 7, 20, 99, 100 })
+    {
+        first += step;
+        last += step;
+        string text = Window(first, last);
+        HLS_CHECK(playlist.Refresh(text));
+        HLS_CHECK(Describe(playlist) == Parsed(text));
+    }
+
+    // A window that grows without sliding, as an EVENT playlist does
+    last += 15;
+    string grown = Window(first, last);
+    HLS_CHECK(playlist.Refresh(grown));
+    HLS_CHECK(Describe(playlist) == Parsed(grown));
+}
+
+HLS_TEST(MediaPlaylistRefreshFallsBackToFullParse)
+{
+    HLSMediaPlaylist playlist;
+    playlist.ParseMediaPlaylist(Window(0, 100));
+
+    // Past the end of the known segments, so nothing can be kept
+    string later = Window(150, 250);
+    HLS_CHECK(!playlist.Refresh(later));
+    HLS_CHECK(Describe(playlist) == Parsed(later));
+
+    // A different stream whose sequence numbers overlap
+    MediaGeneratorOptions options;
+    options.segments = 100;
+    options.seed = 2;
+    string other = GenerateMediaPlaylist(options);
+    HLS_CHECK(!playlist.Refresh(other));
+    HLS_CHECK(Describe(playlist) == Parsed(other));
+}
+
+HLS_TEST(MediaPlaylistRefreshAppliesDeltaUpdates)
+{
+    HLSMediaPlaylist playlist;
+    playlist.ParseMediaPlaylist(Window(0, 100));
+
+    // The same window as a delta update is the same as the full playlist, apart from
+    // the version it needs
+    size_t first = 0;
+    size_t last = 100;
+    for (size_t step : { 1, 4, 10 })
+    {
+        first += step;
+        last += step;
+        HLS_CHECK(playlist.Refresh(Window(first, last, 80)));
+
+        HLSMediaPlaylist full;
+        full.ParseMediaPlaylist(Window(first, last));
+        HLS_CHECK(playlist.GetVersion() == 9);
+        HLS_CHECK(Describe(playlist).substr(2) == Describe(full).substr(2));
+    }
+
+    // Segments the delta skips that the client never had cannot be filled in
+    HLS_CHECK_THROWS(playlist.Refresh(Window(first + 50, last + 50, 80)), logic_error);
+
+    playlist.ParseMediaPlaylist(Window(0, 100));
+    MediaGeneratorOptions options;
+    options.segments = 101;
+    options.firstSegment = 1;
+    options.skippedSegments = 80;
+    options.keyPeriod = 7;
+    options.seed = 2;
+    HLS_CHECK_THROWS(playlist.Refresh(GenerateMediaPlaylist(options)), logic_error);
+
+    // The playlist is left ready for a new parse
+    string text = Window(0, 100);
+    playlist.ParseMediaPlaylist(text);
+    HLS_CHECK(Describe(playlist) == Parsed(text));
+}
+
+HLS_TEST(MediaPlaylistRefreshStreamsOnlyNewSegments)
+{
+    size_t count = 0;
+    HLSMediaPlaylist playlist;
+    playlist.SetSegmentHandler([&count](const HLSMediaPlaylist::Segment&) { count++; });
+    playlist.ParseMediaPlaylist(Window(0, 100));
+    HLS_CHECK(count == 100);
+
+    HLS_CHECK(playlist.Refresh(Window(5, 112)));
+    HLS_CHECK(count == 112);
+    HLS_CHECK(playlist.SegmentCount() == 107);
+}
@@ -0,0 +1,66 @@
+#include "HLSTest.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSPlaylistGenerator.h"
+#include "HLSSerializer.h"
+#include "HLSThreadPool.h"
+#include <atomic>
+
+// A generated playlist large enough to be split into several chunks
+static string LargePlaylist()
+{
+    GeneratorOptions options;
+    options.variants = 6000;
+    options.attributeLength = 32;
+    return GenerateMasterPlaylist(options);
+}
+
+static string ToJson(const HLSMasterPlaylist& playlist)
+{
+    string buffer;
+    HLSSerializer(buffer, SerializeFormat::JSON).Write(playlist, SortParameter::BANDWIDTH, true);
+    return buffer;
+}
+
+HLS_TEST(ParallelParseMatchesSerialParse)
+{
+    string text = LargePlaylist();
+
+    HLSMasterPlaylist serial;
+    serial.ParseMasterPlaylist(text);
+
+    HLSThreadPool pool(3);
+    HLSMasterPlaylist parallel;
+    parallel.ParseMasterPlaylist(text, pool);
+
+    HLS_CHECK(ToJson(parallel) == ToJson(serial));
+}
+
+HLS_TEST(ParallelParseRunsInsideTasksOfTheSamePool)
+{
+    string text = LargePlaylist();
+
+    HLSMasterPlaylist serial;
+    serial.ParseMasterPlaylist(text);
+    string expected = ToJson(serial);
+
+    // Every worker waits on chunks of its own parse, which only the waiting
+    // workers themselves are left to run
+    atomic<size_t> matches(0);
+    {
+        HLSThreadPool pool(2);
+        for (int i = 0; i < 2; i++)
+        {
+            pool.Submit([&]()
+            {
+                HLSMasterPlaylist playlist;
+                playlist.ParseMasterPlaylist(text, pool);
+                if (ToJson(playlist) == expected)
+                {
+                    matches++;
+                }
+            });
+        }
+    }
+
+    HLS_CHECK(matches == 2);
+}
@@ -0,0 +1,118 @@
+#include "HLSTest.h"
+#include "HLSPlaylistCache.h"
+#include "HLSPlaylistGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Heap bytes currently allocated through operator new by the whole test program. Each
+// block carries its size in front of it, so that unsized deletes can subtract it too
+static atomic<long long> s_heapBytes{ 0 };
+static constexpr size_t HeapHeader = alignof(max_align_t);
+
+void* operator new(size_t size)
+{
+    char* block = static_cast<char*>(malloc(size + HeapHeader));
+    if (!block)
+    {
+        throw bad_alloc();
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+    s_heapBytes.fetch_add(size, memory_order_relaxed);
+    return block + HeapHeader;
+}
+
+void operator delete(void* memory) noexcept
+{
+    if (memory)
+    {
+        char* block = static_cast<char*>(memory) - HeapHeader;
+        s_heapBytes.fetch_sub(*reinterpret_cast<size_t*>(block), memory_order_relaxed);
+        free(block);
+    }
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+// Memory resources allocate through the aligned forms
+void* operator new(size_t size, align_val_t alignment)
+{
+    size_t offset = max(size_t(alignment), HeapHeader);
+    size_t length = (size + offset + size_t(alignment) - 1) / size_t(alignment) * size_t(alignment);
+    char* block = static_cast<char*>(aligned_alloc(size_t(alignment), length));
+    if (!block)
+    {
+        throw bad_alloc();
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+    s_heapBytes.fetch_add(size, memory_order_relaxed);
+    return block + offset;
+}
+
+void operator delete(void* memory, align_val_t alignment) noexcept
+{
+    if (memory)
+    {
+        char* block = static_cast<char*>(memory) - max(size_t(alignment), HeapHeader);
+        s_heapBytes.fetch_sub(*reinterpret_cast<size_t*>(block), memory_order_relaxed);
+        free(block);
+    }
+}
+
+void operator delete(void* memory, size_t, align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+HLS_TEST(CachedPlaylistsInternIntoTheirOwnSymbols)
+{
+    GeneratorOptions options;
+    options.attributeLength = 24;
+    string text = GenerateMasterPlaylist(options);
+
+    size_t globalSymbols = HLSSymbolTable::Global()->Size();
+
+    HLSPlaylistCache cache;
+    HLSPlaylistCache::PlaylistPtr playlist = cache.Parse(text);
+    HLS_CHECK(playlist->GetStreams(SortParameter::DEFAULT, true).size() == options.variants);
+    HLS_CHECK(HLSSymbolTable::Global()->Size() == globalSymbols);
+
+    // The entry's bytes cover its symbols as well as its arena, so they exceed a parse
+    // into a counted arena alone
+    HLSCountingResource upstream;
+    {
+        pmr::monotonic_buffer_resource arena(&upstream);
+        HLSMasterPlaylist uncached(&arena, make_shared<HLSSymbolTable>());
+        uncached.ParseMasterPlaylist(text);
+    }
+    HLS_CHECK(cache.GetStats().bytes > upstream.AllocatedBytes());
+
+    // The same text is a hit on the same playlist
+    HLS_CHECK(cache.Parse(text) == playlist);
+    HLS_CHECK(cache.GetStats().hits == 1);
+}
+
+HLS_TEST(CachedPlaylistBytesCoverWhatTheEntryHolds)
+{
+    GeneratorOptions options;
+    options.variants = 4000;
+    string text = GenerateMasterPlaylist(options);
+
+    HLSPlaylistCache cache;
+    long long before = s_heapBytes.load();
+    HLSPlaylistCache::PlaylistPtr playlist = cache.Parse(text);
+    long long held = s_heapBytes.load() - before;
+
+    // Everything still allocated once the parse is over belongs to the entry. Only the
+    // cache's bookkeeping and a few fixed-size members of the playlist go uncounted,
+    // while a structural index left behind would be a third of the entry
+    size_t bytes = cache.GetStats().bytes;
+    HLS_CHECK(held > 0);
+    HLS_CHECK(size_t(held) <= bytes + bytes / 100);
+}
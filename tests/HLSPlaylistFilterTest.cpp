@@ -0,0 +1,135 @@
+#include "HLSTest.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSPlaylistFilter.h"
+#include "HLSPlaylistGenerator.h"
+
+static string Filter(const HLSPlaylistFilter& filter, string_view playlist, HLSFilterStats* stats = nullptr)
+{
+    string output;
+    HLSFilterStats result = filter.Apply(playlist, output);
+    if (stats)
+    {
+        *stats = result;
+    }
+    return output;
+}
+
+HLS_TEST(FilterWithoutRulesCopiesThePlaylist)
+{
+    HLSPlaylistFilter filter;
+
+    // CRLF line endings, a blank line, a comment and no final newline all survive
+    string text =
+        "#EXTM3U\r\n"
+        "#EXT-X-INDEPENDENT-SEGMENTS\r\n"
+        "\r\n"
+        "# A comment\r\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aac\",NAME=\"English\",LANGUAGE=\"en\",URI=\"en.m3u8\"\r\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1280000,CODECS=\"avc1.4d401f,mp4a.40.2\",AUDIO=\"aac\"\r\n"
+        "low.m3u8";
+    HLSFilterStats stats;
+    HLS_CHECK(Filter(filter, text, &stats) == text);
+    HLS_CHECK(stats.streamsDropped == 0 && stats.mediaTagsDropped == 0 && stats.tagsRewritten == 0);
+
+    GeneratorOptions options;
+    options.variants = 200;
+    string generated = GenerateMasterPlaylist(options);
+    HLS_CHECK(Filter(filter, generated) == generated);
+
+    HLS_CHECK_THROWS(Filter(filter, "#EXT-X-STREAM-INF:BANDWIDTH=1\nlow.m3u8\n"), logic_error);
+}
+
+HLS_TEST(FilterRemovesAttributes)
+{
+    HLSPlaylistFilter filter;
+    filter.RemoveStreamAttribute(HLSAttributeName::AVERAGE_BANDWIDTH);
+    filter.RemoveMediaAttribute(HLSAttributeName::CHANNELS);
+
+    string text =
+        "#EXTM3U\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aac\",NAME=\"English\",CHANNELS=\"2\",URI=\"en.m3u8\"\r\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1280000,AVERAGE-BANDWIDTH=1000000,CODECS=\"avc1.4d401f,mp4a.40.2\",AUDIO=\"aac\"\n"
+        "low.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=2560000,AUDIO=\"aac\"\n"
+        "mid.m3u8\n";
+    string expected =
+        "#EXTM3U\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aac\",NAME=\"English\",URI=\"en.m3u8\"\r\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1280000,CODECS=\"avc1.4d401f,mp4a.40.2\",AUDIO=\"aac\"\n"
+        "low.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=2560000,AUDIO=\"aac\"\n"
+        "mid.m3u8\n";
+
+    HLSFilterStats stats;
+    HLS_CHECK(Filter(filter, text, &stats) == expected);
+    HLS_CHECK(stats.tagsRewritten == 2);
+}
+
+HLS_TEST(FilterDropsStreamsOfEmptiedGroups)
+{
+    // Every French rendition goes, which empties the "fr" audio group and the "pq"
+    // video group, while the "subs" group keeps nothing
+    HLSPlaylistFilter filter;
+    filter.DropMediaTags({ { HLSAttributeName::LANGUAGE, HLSPlaylistFilter::Comparison::EQUAL, "fr" } });
+    filter.DropMediaTags({ { HLSAttributeName::TYPE, HLSPlaylistFilter::Comparison::IN, "VIDEO,SUBTITLES" },
+        { HLSAttributeName::GROUP_ID, HLSPlaylistFilter::Comparison::NOT_EQUAL, "sdr" } });
+
+    string text =
+        "#EXTM3U\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"en\",NAME=\"English\",LANGUAGE=\"en\",URI=\"en.m3u8\"\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"fr\",NAME=\"French\",LANGUAGE=\"fr\",URI=\"fr.m3u8\"\n"
+        "#EXT-X-MEDIA:TYPE=VIDEO,GROUP-ID=\"sdr\",NAME=\"SDR\",URI=\"sdr.m3u8\"\n"
+        "#EXT-X-MEDIA:TYPE=VIDEO,GROUP-ID=\"pq\",NAME=\"PQ\",URI=\"pq.m3u8\"\n"
+        "#EXT-X-MEDIA:TYPE=SUBTITLES,GROUP-ID=\"subs\",NAME=\"English\",LANGUAGE=\"en\",URI=\"subs.m3u8\"\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1000000,AUDIO=\"en\",VIDEO=\"sdr\",SUBTITLES=\"subs\"\n"
+        "en-sdr.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1000000,AUDIO=\"fr\",VIDEO=\"sdr\"\n"
+        "fr-sdr.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1000000,AUDIO=\"en\",VIDEO=\"pq\"\n"
+        "en-pq.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1000000,AUDIO=\"en\"\n"
+        "en.m3u8\n";
+    string expected =
+        "#EXTM3U\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"en\",NAME=\"English\",LANGUAGE=\"en\",URI=\"en.m3u8\"\n"
+        "#EXT-X-MEDIA:TYPE=VIDEO,GROUP-ID=\"sdr\",NAME=\"SDR\",URI=\"sdr.m3u8\"\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1000000,AUDIO=\"en\",VIDEO=\"sdr\"\n"
+        "en-sdr.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1000000,AUDIO=\"en\"\n"
+        "en.m3u8\n";
+
+    HLSFilterStats stats;
+    HLS_CHECK(Filter(filter, text, &stats) == expected);
+    HLS_CHECK(stats.mediaTagsDropped == 3);
+    HLS_CHECK(stats.streamsDropped == 2);
+    HLS_CHECK(stats.tagsRewritten == 1);
+}
+
+HLS_TEST(FilterDropsUrisAfterCommentsAndBlankLines)
+{
+    HLSPlaylistFilter filter;
+    filter.DropStreams({ { HLSAttributeName::CODECS, HLSPlaylistFilter::Comparison::HAS_CODEC, "HEVC" } });
+
+    string text =
+        "#EXTM3U\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=9000000,CODECS=\"hvc1.2.4.L123.B0\"\n"
+        "# comment\n"
+        "\r\n"
+        "hevc.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1280000,CODECS=\"avc1.4d401f\"\n"
+        "avc.m3u8\n";
+    string expected =
+        "#EXTM3U\n"
+        "# comment\n"
+        "\r\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1280000,CODECS=\"avc1.4d401f\"\n"
+        "avc.m3u8\n";
+
+    string output = Filter(filter, text);
+    HLS_CHECK(output == expected);
+
+    HLSMasterPlaylist filtered;
+    filtered.ParseMasterPlaylist(output);
+    HLS_CHECK(filtered.GetStreams(SortParameter::DEFAULT, true).size() == 1);
+    HLS_CHECK(filtered.GetStreams(SortParameter::DEFAULT, true)[0].uri == "avc.m3u8");
+}
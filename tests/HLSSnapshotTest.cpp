@@ -0,0 +1,166 @@
+#include "HLSTest.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSPlaylistGenerator.h"
+#include "HLSSnapshot.h"
+#include <cstring>
+
+// Covers what generated playlists do not: every group type, groups named before
+// they are defined or never defined, streams with no groups, and empty attributes
+static const char* EdgeCasePlaylist =
+    "#EXTM3U\n"
+    "#EXT-X-INDEPENDENT-SEGMENTS\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=900000,AVERAGE-BANDWIDTH=800000,CODECS=\"avc1.64001f,mp4a.40.2\","
+        "RESOLUTION=1280x720,FRAME-RATE=29.970,AUDIO=\"aac\",VIDEO=\"cam\",SUBTITLES=\"subs\","
+        "CLOSED-CAPTIONS=\"cc\",VIDEO-RANGE=SDR\n"
+    "video/720.m3u8\n"
+    "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aac\",NAME=\"English\",LANGUAGE=\"en\",CHANNELS=\"2\","
+        "DEFAULT=YES,AUTOSELECT=YES,URI=\"audio/en.m3u8\"\n"
+    "#EXT-X-MEDIA:TYPE=VIDEO,GROUP-ID=\"cam\",NAME=\"Angle 1\",URI=\"video/angle1.m3u8\"\n"
+    "#EXT-X-MEDIA:TYPE=SUBTITLES,GROUP-ID=\"subs\",NAME=\"Deutsch\",LANGUAGE=\"de\",URI=\"subs/de.m3u8\"\n"
+    "#EXT-X-MEDIA:TYPE=CLOSED-CAPTIONS,GROUP-ID=\"cc\",NAME=\"CC1\",LANGUAGE=\"en\"\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=150000\n"
+    "video/audio-less.m3u8\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=5000000,CODECS=\"hvc1.2.4.L153.B0\",RESOLUTION=3840x2160,"
+        "AUDIO=\"missing\",VIDEO-RANGE=PQ\n"
+    "video/2160.m3u8\n"
+    "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=86000,CODECS=\"avc1.64001f\",RESOLUTION=1280x720,"
+        "VIDEO=\"cam\",URI=\"iframe/720.m3u8\"\n";
+
+static void CheckMediaTag(const HLSMasterPlaylist::MediaTag& tag, const HLSSnapshot::MediaTag& saved)
+{
+    HLS_CHECK(saved);
+    HLS_CHECK(saved.Id() == tag.id.View());
+    HLS_CHECK(saved.Type() == tag.type);
+    HLS_CHECK(saved.Uri() == tag.uri);
+    HLS_CHECK(saved.Name() == tag.name);
+    HLS_CHECK(saved.Language() == tag.language.View());
+    HLS_CHECK(saved.Channels() == tag.channels.View());
+    HLS_CHECK(saved.IsDefault() == tag.isDefault);
+    HLS_CHECK(saved.AutoSelect() == tag.autoSelect);
+}
+
+static void CheckGroup(const HLSMasterPlaylist::MediaTag* tag, const HLSSnapshot::MediaTag& saved)
+{
+    HLS_CHECK((tag != nullptr) == bool(saved));
+    if (tag)
+    {
+        CheckMediaTag(*tag, saved);
+    }
+}
+
+static void CheckStream(const HLSMasterPlaylist::StreamInfo& stream, const HLSSnapshot::Stream& saved)
+{
+    HLS_CHECK(saved.Type() == stream.type);
+    HLS_CHECK(saved.Bandwidth() == stream.bandwidth);
+    HLS_CHECK(saved.AvgBandwidth() == stream.avgBandwidth);
+    HLS_CHECK(saved.Codecs() == stream.codecs.View());
+    HLS_CHECK(saved.Uri() == stream.uri);
+    HLS_CHECK(saved.VideoRange() == stream.videoRange.View());
+    HLS_CHECK(saved.GetResolution().width == stream.resolution.width);
+    HLS_CHECK(saved.GetResolution().height == stream.resolution.height);
+    HLS_CHECK(saved.FrameRate() == stream.frameRate);
+    CheckGroup(stream.audio, saved.Audio());
+    CheckGroup(stream.video, saved.Video());
+    CheckGroup(stream.subtitles, saved.Subtitles());
+    CheckGroup(stream.closedCaptions, saved.ClosedCaptions());
+}
+
+// Parses text, snapshots the playlist, reopens the snapshot and compares every field
+static void CheckRoundTrip(const string& text)
+{
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(text);
+
+    string buffer;
+    HLSSnapshot::Write(playlist, buffer);
+    HLS_CHECK(buffer.length() % 8 == 0);
+
+    HLSSnapshot snapshot(buffer);
+    HLS_CHECK(snapshot.HasIndependentSegments() == playlist.HasIndependentSegments());
+
+    HLSMasterPlaylist::MediaTagView mediaTags = playlist.GetMediaTags(SortParameter::DEFAULT, true);
+    HLSMasterPlaylist::StreamView streams = playlist.GetStreams(SortParameter::DEFAULT, true);
+    HLSMasterPlaylist::StreamView iStreams = playlist.GetIStreams(SortParameter::DEFAULT, true);
+    HLS_CHECK(snapshot.MediaTagCount() == mediaTags.size());
+    HLS_CHECK(snapshot.StreamCount() == streams.size());
+    HLS_CHECK(snapshot.IStreamCount() == iStreams.size());
+
+    for (size_t i = 0; i < mediaTags.size(); i++)
+    {
+        CheckMediaTag(mediaTags[i], snapshot.GetMediaTag(i));
+    }
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        CheckStream(streams[i], snapshot.GetStream(i));
+    }
+
+    for (size_t i = 0; i < iStreams.size(); i++)
+    {
+        CheckStream(iStreams[i], snapshot.GetIStream(i));
+    }
+
+    HLS_CHECK_THROWS(snapshot.GetMediaTag(mediaTags.size()), out_of_range);
+    HLS_CHECK_THROWS(snapshot.GetStream(streams.size()), out_of_range);
+    HLS_CHECK_THROWS(snapshot.GetIStream(iStreams.size()), out_of_range);
+}
+
+HLS_TEST(SnapshotRoundTripsEdgeCases)
+{
+    CheckRoundTrip(EdgeCasePlaylist);
+
+    // Every kind of group reference survives, and so does a reference to a missing group
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(EdgeCasePlaylist);
+    string buffer;
+    HLSSnapshot::Write(playlist, buffer);
+    HLSSnapshot snapshot(buffer);
+
+    HLSSnapshot::Stream first = snapshot.GetStream(0);
+    HLS_CHECK(first.Audio().Id() == "aac");
+    HLS_CHECK(first.Video().Id() == "cam");
+    HLS_CHECK(first.Subtitles().Id() == "subs");
+    HLS_CHECK(first.ClosedCaptions().Id() == "cc");
+    HLS_CHECK(!snapshot.GetStream(1).Audio());
+    HLS_CHECK(!snapshot.GetStream(2).Audio());
+    HLS_CHECK(snapshot.GetIStream(0).Uri() == "iframe/720.m3u8");
+}
+
+HLS_TEST(SnapshotRoundTripsGeneratedPlaylists)
+{
+    for (uint64_t seed = 1; seed <= 8; seed++)
+    {
+        GeneratorOptions options;
+        options.seed = seed;
+        options.variants = 50 * seed;
+        options.iFrameStreams = 10 * seed;
+        options.attributeLength = seed % 3 * 16;
+        CheckRoundTrip(GenerateMasterPlaylist(options));
+    }
+}
+
+HLS_TEST(SnapshotRoundTripsEmptyPlaylist)
+{
+    CheckRoundTrip("#EXTM3U\n");
+}
+
+HLS_TEST(SnapshotRejectsOtherVersionsAndCorruptData)
+{
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(EdgeCasePlaylist);
+    string buffer;
+    HLSSnapshot::Write(playlist, buffer);
+
+    // The version follows the 8 magic bytes
+    string oldVersion = buffer;
+    uint32_t version = 1;
+    memcpy(&oldVersion[8], &version, sizeof(version));
+    HLS_CHECK_THROWS(HLSSnapshot snapshot(oldVersion), runtime_error);
+
+    string notSnapshot = buffer;
+    notSnapshot[0] = 'X';
+    HLS_CHECK_THROWS(HLSSnapshot snapshot(notSnapshot), runtime_error);
+
+    string truncated = buffer.substr(0, buffer.length() / 2);
+    HLS_CHECK_THROWS(HLSSnapshot snapshot(truncated), runtime_error);
+}
@@ -0,0 +1,137 @@
+#include "HLSTest.h"
+#include "HLSMasterPlaylist.h"
+#include "HLSPlaylistGenerator.h"
+
+static const SortParameter s_sortParameters[] =
+{
+    SortParameter::BANDWIDTH, SortParameter::AVG_BANDWIDTH, SortParameter::RESOLUTION, SortParameter::FRAMERATE,
+    SortParameter::CODECS, SortParameter::CHANNELS, SortParameter::AUDIO_LANGUAGE, SortParameter::VIDEORANGE,
+};
+
+static string RangePlaylist()
+{
+    // Few distinct values per column, so that most positions fall among ties
+    GeneratorOptions options;
+    options.variants = 700;
+    options.iFrameStreams = 90;
+    return GenerateMasterPlaylist(options);
+}
+
+static HLSMasterPlaylist::StreamView View(const HLSMasterPlaylist& playlist, StreamType type, SortParameter param, bool isAscending)
+{
+    return type == StreamType::IFRAME ? playlist.GetIStreams(param, isAscending) : playlist.GetStreams(param, isAscending);
+}
+
+// Positions [first, last) of the view, as parse order indexes
+static vector<uint32_t> Positions(const HLSMasterPlaylist::StreamView& view, size_t first, size_t last)
+{
+    vector<uint32_t> indexes;
+    for (size_t pos = first; pos < min(last, view.size()); pos++)
+    {
+        indexes.push_back(static_cast<uint32_t>(view.Index(pos)));
+    }
+    return indexes;
+}
+
+HLS_TEST(StreamRangesMatchSortedPositions)
+{
+    string text = RangePlaylist();
+
+    for (StreamType type : { StreamType::MEDIA, StreamType::IFRAME })
+    {
+        // An order's index covers both kinds of stream, so each kind starts from a new parse
+        HLSMasterPlaylist playlist;
+        playlist.ParseMasterPlaylist(text);
+
+        size_t count = playlist.GetStreamColumns(type).size();
+        const pair<size_t, size_t> ranges[] =
+        {
+            { 0, 0 }, { 0, 1 }, { 0, 10 }, { 3, 4 }, { 17, 250 }, { count / 2, count / 2 + 33 },
+            { count - 1, count }, { count - 5, count + 5 }, { count, count + 10 }, { 0, count },
+        };
+
+        for (SortParameter param : s_sortParameters)
+        {
+            for (bool isAscending : { true, false })
+            {
+                // Selected from the key column, as no index has been built for this order yet
+                vector<vector<uint32_t>> selected;
+                for (const auto& range : ranges)
+                {
+                    selected.push_back(playlist.GetStreamRange(type, param, isAscending, range.first, range.second));
+                }
+
+                vector<uint32_t> top = playlist.GetTopStreams(type, param, isAscending, 25);
+
+                // Building the index must not change the answers
+                HLSMasterPlaylist::StreamView view = View(playlist, type, param, isAscending);
+                HLS_CHECK(top == Positions(view, 0, 25));
+
+                for (size_t i = 0; i < size(ranges); i++)
+                {
+                    vector<uint32_t> expected = Positions(view, ranges[i].first, ranges[i].second);
+                    HLS_CHECK(selected[i] == expected);
+                    HLS_CHECK(playlist.GetStreamRange(type, param, isAscending, ranges[i].first, ranges[i].second) == expected);
+                }
+            }
+        }
+    }
+}
+
+HLS_TEST(GroupedTopStreamsMatchSortedPositions)
+{
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(RangePlaylist());
+    const HLSMasterPlaylist::StreamColumns& streams = playlist.GetStreamColumns(StreamType::MEDIA);
+
+    for (GroupParameter group : { GroupParameter::CODEC_FAMILY, GroupParameter::VIDEORANGE })
+    {
+        auto isSameGroup = [&](const HLSMasterPlaylist::StreamGroup& streamGroup, uint32_t i)
+        {
+            return group == GroupParameter::CODEC_FAMILY ? streams.codecInfos[i].video.family == streamGroup.family :
+                streams.videoRanges[i] == streamGroup.videoRange;
+        };
+
+        const size_t countPerGroup = 4;
+        HLSMasterPlaylist::StreamGroups groups =
+            playlist.GetTopStreamsByGroup(StreamType::MEDIA, group, SortParameter::BANDWIDTH, false, countPerGroup);
+        HLS_CHECK(groups.groups.size() > 1);
+
+        // Groups come in the order their first stream was parsed, and together cover every stream
+        vector<bool> isGrouped(groups.groups.size());
+        size_t nextGroup = 0;
+        for (uint32_t i = 0; i < streams.size(); i++)
+        {
+            size_t g = 0;
+            while (g < groups.groups.size() && !isSameGroup(groups.groups[g], i))
+            {
+                g++;
+            }
+
+            HLS_CHECK(g < groups.groups.size());
+            if (!isGrouped[g])
+            {
+                HLS_CHECK(g == nextGroup);
+                isGrouped[g] = true;
+                nextGroup++;
+            }
+        }
+
+        HLSMasterPlaylist::StreamView view = playlist.GetStreams(SortParameter::BANDWIDTH, false);
+        for (const HLSMasterPlaylist::StreamGroup& streamGroup : groups.groups)
+        {
+            vector<uint32_t> expected;
+            for (size_t pos = 0; pos < view.size() && expected.size() < countPerGroup; pos++)
+            {
+                uint32_t i = static_cast<uint32_t>(view.Index(pos));
+                if (isSameGroup(streamGroup, i))
+                {
+                    expected.push_back(i);
+                }
+            }
+
+            vector<uint32_t> actual(groups.streams.begin() + streamGroup.begin, groups.streams.begin() + streamGroup.end);
+            HLS_CHECK(actual == expected);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#include "HLSTest.h"
+#include "HLSPlaylistGenerator.h"
+#include "HLSStructuralIndex.h"
+
+// Random bytes with the structural characters, and the characters around them, common
+static string RandomBuffer(HLSRandom& random, size_t length)
+{
+    static const char s_common[] = "\n\r=,\"#:xA09 ";
+
+    string buffer(length, '\0');
+    for (char& c : buffer)
+    {
+        c = random.Below(2) ? s_common[random.Below(sizeof(s_common) - 1)] : static_cast<char>(random.Below(256));
+    }
+    return buffer;
+}
+
+static vector<uint32_t> Positions(const HLSStructuralIndex& index)
+{
+    return vector<uint32_t>(index.begin(), index.end());
+}
+
+HLS_TEST(StructuralIndexLevelsAgree)
+{
+    vector<ScanLevel> levels = { ScanLevel::SCALAR };
+    if (HLSStructuralIndex::BestLevel() >= ScanLevel::SSE2)
+    {
+        levels.push_back(ScanLevel::SSE2);
+    }
+    if (HLSStructuralIndex::BestLevel() >= ScanLevel::AVX2)
+    {
+        levels.push_back(ScanLevel::AVX2);
+    }
+
+    // One index per level, each rebuilt over every buffer in turn, so that storage
+    // left from a longer build is reused as well
+    vector<HLSStructuralIndex> indexes(levels.size());
+    HLSRandom random(12);
+
+    for (size_t test = 0; test < 2000; test++)
+    {
+        size_t length = test < 200 ? test : random.Below(test % 10 == 0 ? 20000 : 500);
+        if (length % 32 == 0)
+        {
+            length++;
+        }
+
+        // Start at an unaligned offset into the buffer
+        size_t offset = random.Below(32);
+        string buffer = RandomBuffer(random, offset + length);
+        string_view text = string_view(buffer).substr(offset);
+
+        vector<uint32_t> expected;
+        for (size_t i = 0; i < text.length(); i++)
+        {
+            if (text[i] == '\n' || text[i] == '=' || text[i] == ',' || text[i] == '"')
+            {
+                expected.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            indexes[i].Build(text, levels[i]);
+            HLS_CHECK(indexes[i].Text() == text);
+            HLS_CHECK(Positions(indexes[i]) == expected);
+        }
+    }
+}
+
+HLS_TEST(StructuralIndexOfAPlaylist)
+{
+    GeneratorOptions options;
+    options.attributeLength = 13;
+    string text = GenerateMasterPlaylist(options) + "#EXT-X-STREAM-INF:BANDWIDTH=1";
+
+    HLSStructuralIndex scalar;
+    scalar.Build(text, ScanLevel::SCALAR);
+
+    HLSStructuralIndex best;
+    best.Build(text);
+    HLS_CHECK(Positions(best) == Positions(scalar));
+
+    best.Release();
+    HLS_CHECK(best.size() == 0 && best.Text().empty());
+}
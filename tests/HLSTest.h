@@ -0,0 +1,46 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A minimal harness for the tests in this directory. Each test file defines its
+// cases with HLS_TEST, and HLSTests.cpp runs every registered case in turn
+struct HLSTestCase
+{
+    const char* name;
+    void (*run)();
+};
+
+vector<HLSTestCase>& TestCases();
+
+struct HLSTestRegistration
+{
+    HLSTestRegistration(const char* name, void (*run)()) { TestCases().push_back({ name, run }); }
+};
+
+// Thrown by a failed check, naming the expression and where it is
+class HLSTestFailure : public runtime_error
+{
+public:
+    HLSTestFailure(const char* expression, const char* file, int line) :
+        runtime_error(string(file) + ":" + to_string(line) + ": " + expression) {}
+};
+
+#define HLS_TEST(name) \
+    static void name(); \
+    static HLSTestRegistration name##Registration(#name, name); \
+    static void name()
+
+#define HLS_CHECK(expression) \
+    do { if (!(expression)) throw HLSTestFailure(#expression, __FILE__, __LINE__); } while (0)
+
+// Checks that statement throws an exception of the given type
+#define HLS_CHECK_THROWS(statement, exceptionType) \
+    do \
+    { \
+        bool isThrown = false; \
+        try { statement; } catch (const exceptionType&) { isThrown = true; } \
+        if (!isThrown) throw HLSTestFailure(#statement " throws " #exceptionType, __FILE__, __LINE__); \
+    } while (0)
@@ -0,0 +1,39 @@
+#include "HLSTest.h"
+#include <iostream>
+
+vector<HLSTestCase>& TestCases()
+{
+    static vector<HLSTestCase> cases;
+    return cases;
+}
+
+// Runs every test, or only those whose names contain the first argument
+int main(int argc, char* argv[])
+{
+    string filter = argc > 1 ? argv[1] : "";
+    size_t failed = 0;
+    size_t run = 0;
+
+    for (const HLSTestCase& testCase : TestCases())
+    {
+        if (string(testCase.name).find(filter) == string::npos)
+        {
+            continue;
+        }
+
+        run++;
+        try
+        {
+            testCase.run();
+            cout << "ok   " << testCase.name << "\n";
+        }
+        catch (const exception& e)
+        {
+            failed++;
+            cout << "FAIL " << testCase.name << ": " << e.what() << "\n";
+        }
+    }
+
+    cout << run - failed << " of " << run << " tests passed\n";
+    return failed == 0 ? 0 : 1;
+}
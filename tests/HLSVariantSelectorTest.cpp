@@ -0,0 +1,164 @@
+#include "HLSTest.h"
+#include "HLSPlaylistGenerator.h"
+#include "HLSVariantSelector.h"
+#include <cctype>
+
+// What Select promises, worked out by looking at every stream in turn
+static HLSVariantSelector::Selection SelectByScan(const HLSMasterPlaylist& playlist, const HLSVariantSelector::Query& query)
+{
+    const HLSMasterPlaylist::StreamColumns& streams = playlist.GetStreamColumns(StreamType::MEDIA);
+
+    auto isPlayable = [&](size_t i)
+    {
+        const CodecList& codecs = streams.codecInfos[i];
+        for (CodecFamily family : { codecs.video.family, codecs.audio.family })
+        {
+            if (family != CodecFamily::UNKNOWN && (query.codecs & HLSVariantSelector::CodecMask({ family })) == 0)
+            {
+                return false;
+            }
+        }
+
+        string_view range = streams.videoRanges[i].View();
+        bool isHdr = range == "PQ" || range == "HLG" || codecs.video.family == CodecFamily::DOLBY_VISION;
+        int maxWidth = query.maxResolution.width;
+        int maxHeight = query.maxResolution.height;
+
+        return (query.isHdrCapable || !isHdr) && (maxWidth <= 0 || streams.widths[i] <= maxWidth) &&
+            (maxHeight <= 0 || streams.heights[i] <= maxHeight);
+    };
+
+    auto isPreferred = [&](size_t i)
+    {
+        const HLSMasterPlaylist::MediaTag* audio = playlist.GetGroup(streams.audioGroups[i]);
+        string_view language = audio ? audio->language.View() : string_view();
+        return !query.language.empty() && language.length() == query.language.length() &&
+            equal(language.begin(), language.end(), query.language.begin(),
+                [](char a, char b) { return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b)); });
+    };
+
+    // Within the bandwidth the highest stream wins, otherwise the lowest, and ties go
+    // to the stream listed first
+    auto best = [&](bool isPreferredOnly)
+    {
+        size_t best = HLSVariantSelector::NoStream;
+        bool isBestWithin = false;
+
+        for (size_t i = 0; i < streams.size(); i++)
+        {
+            if (!isPlayable(i) || (isPreferredOnly && !isPreferred(i)))
+            {
+                continue;
+            }
+
+            bool isWithin = streams.bandwidths[i] <= query.bandwidth;
+            bool isBetter = best == HLSVariantSelector::NoStream || (isWithin != isBestWithin ? isWithin :
+                isWithin ? streams.bandwidths[i] > streams.bandwidths[best] : streams.bandwidths[i] < streams.bandwidths[best]);
+
+            if (isBetter)
+            {
+                best = i;
+                isBestWithin = isWithin;
+            }
+        }
+
+        HLSVariantSelector::Selection selection;
+        if (best != HLSVariantSelector::NoStream)
+        {
+            selection.stream = best;
+            selection.audio = playlist.GetGroup(streams.audioGroups[best]);
+            selection.isWithinBandwidth = isBestWithin;
+        }
+
+        return selection;
+    };
+
+    HLSVariantSelector::Selection selection = best(true);
+    return selection.stream != HLSVariantSelector::NoStream ? selection : best(false);
+}
+
+static HLSVariantSelector::Query RandomQuery(HLSRandom& random)
+{
+    static const char* const s_languages[] = { "", "en", "EN", "de", "ja", "ko", "fr", "zz" };
+    static const int s_sizes[] = { 0, 240, 480, 720, 1080, 1440, 2160, 4320 };
+
+    HLSVariantSelector::Query query;
+    query.bandwidth = long(random.Below(25000000));
+    query.maxResolution.width = s_sizes[random.Below(8)] * 16 / 9 + int(random.Below(3)) - 1;
+    query.maxResolution.height = s_sizes[random.Below(8)] + int(random.Below(3)) - 1;
+    query.codecs = random.Below(4) == 0 ? HLSVariantSelector::AnyCodec : uint32_t(random.Next());
+    query.isHdrCapable = random.Below(2) != 0;
+    query.language = s_languages[random.Below(8)];
+    return query;
+}
+
+static bool operator == (const HLSVariantSelector::Selection& a, const HLSVariantSelector::Selection& b)
+{
+    return a.stream == b.stream && a.audio == b.audio && a.isWithinBandwidth == b.isWithinBandwidth;
+}
+
+HLS_TEST(VariantSelectionMatchesLinearScan)
+{
+    // Ladders of several sizes, so that buckets hold from one stream to hundreds
+    for (size_t variants : { 1, 2, 7, 40, 300, 2000 })
+    {
+        GeneratorOptions options;
+        options.variants = variants;
+        options.seed = variants;
+
+        HLSMasterPlaylist playlist;
+        playlist.ParseMasterPlaylist(GenerateMasterPlaylist(options));
+        HLSVariantSelector selector(playlist);
+        HLS_CHECK(selector.StreamCount() == variants);
+
+        HLSRandom random(variants);
+        for (size_t i = 0; i < 3000; i++)
+        {
+            HLSVariantSelector::Query query = RandomQuery(random);
+            HLS_CHECK(selector.Select(query) == SelectByScan(playlist, query));
+        }
+    }
+}
+
+HLS_TEST(VariantSelectionBatchesMatchSingleQueries)
+{
+    GeneratorOptions options;
+    options.variants = 500;
+
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(GenerateMasterPlaylist(options));
+    HLSVariantSelector selector(playlist);
+
+    HLSRandom random(7);
+    vector<HLSVariantSelector::Query> queries(5000);
+    for (HLSVariantSelector::Query& query : queries)
+    {
+        query = RandomQuery(random);
+    }
+
+    vector<HLSVariantSelector::Selection> batch(queries.size());
+    selector.Select(queries.data(), queries.size(), batch.data());
+
+    HLSThreadPool pool(3);
+    vector<HLSVariantSelector::Selection> pooled(queries.size());
+    selector.Select(pool, queries.data(), queries.size(), pooled.data());
+
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        HLSVariantSelector::Selection single = selector.Select(queries[i]);
+        HLS_CHECK(batch[i] == single);
+        HLS_CHECK(pooled[i] == single);
+    }
+}
+
+HLS_TEST(VariantSelectionOfAnEmptyPlaylist)
+{
+    HLSMasterPlaylist playlist;
+    playlist.ParseMasterPlaylist(string_view("#EXTM3U\n"));
+    HLSVariantSelector selector(playlist);
+
+    HLSVariantSelector::Query query;
+    query.bandwidth = 1000000;
+    HLS_CHECK(selector.Select(query).stream == HLSVariantSelector::NoStream);
+    HLS_CHECK(selector.Select(query).audio == nullptr);
+}